@@ -0,0 +1,14 @@
+@echo off
+
+REM Change this to your visual studio's 'vcvars64.bat' script path
+set MSVC_PATH="C:\Program Files (x86)\Microsoft Visual Studio\2019\Community\VC\Auxiliary\Build"
+set CXXFLAGS=/std:c++17 /EHsc /W4 /WX /Zl /FC /wd4996 /wd4201 /wd4505 /nologo /O2 /DNDEBUG %*
+set INCLUDES=/I"deps\GLEW\include" /I"deps\GLFW\include"
+set LIBS="deps\GLEW\lib\glew32s.lib" opengl32.lib User32.lib Psapi.lib
+
+call %MSVC_PATH%\vcvars64.bat
+
+pushd %~dp0
+if not exist .\build mkdir build 
+cl %CXXFLAGS% %INCLUDES% code\bench.cpp /Fo:build\ /Fe:build\simpimg_bench.exe %LIBS% /link /NODEFAULTLIB:libcmt.lib
+popd
\ No newline at end of file
@@ -0,0 +1,9 @@
+#!/bin/sh
+
+# The benchmarks don't need a window or GL, so they build on Linux too (headless boxes, CI).
+CXXFLAGS="-std=c++17 -O2 -DNDEBUG -Wall -Wextra -Wno-missing-field-initializers -Wno-unused-function $*"
+INCLUDES="-Ideps/GLEW/include"
+
+cd "$(dirname "$0")"
+mkdir -p build
+${CXX:-g++} $CXXFLAGS $INCLUDES code/bench.cpp -o build/simpimg_bench -pthread
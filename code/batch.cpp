@@ -0,0 +1,261 @@
+// Batched rendering of many small images (the thumbnail grid) with one instanced draw per page.
+//
+// Every image is shrunk to fit a BATCH_LAYER_SIZE^2 layer of a GL_TEXTURE_2D_ARRAY (a page), placed at the
+// layer's top left corner with its mip chain (halving only, so an image ends up between half and all of a
+// layer). Each drawn image is one instance: its world rect, the part of the layer it covers and the layer
+// index live in a single instance buffer, so drawing the whole batch is one glDrawElementsInstanced per
+// page, usually just the one since drivers allow hundreds of layers or more.
+
+#define BATCH_LAYER_SIZE 256
+#define BATCH_MAX_PAGES 16
+
+struct Batch_Instance
+{
+    float quad_rect[4]; // World space x, y, width, height.
+    float uv_rect[4];
+    float layer;
+};
+
+struct Image_Batch
+{
+    int layer_size;
+    int levels;
+    int layers_per_page;
+
+    unsigned int pages[BATCH_MAX_PAGES];
+    int page_count;
+
+    // Layer i is layer (i % layers_per_page) of page (i / layers_per_page). Which layers get drawn is up to
+    // the instances, see batch_push_instance().
+    float (*layer_extents)[2]; // Part of each layer its image covers, in uv.
+    int capacity;
+
+    Batch_Instance *instances;
+    int *instance_pages;
+    int count;
+
+    unsigned int VAO;
+    unsigned int instance_buffer;
+    bool instances_dirty;
+};
+
+// Sets up a VAO sharing the quad's VBO/EBO plus the per-instance attributes (locations 2 to 4).
+internal Image_Batch *batch_create(int capacity, unsigned int quad_vbo, unsigned int quad_ebo)
+{
+    int max_layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+
+    Image_Batch *batch = static_cast<Image_Batch *> (calloc(1, sizeof(Image_Batch)));
+    if (batch == NULL) {
+        return(NULL);
+    }
+
+    batch->layer_size = BATCH_LAYER_SIZE;
+    batch->levels = mip_level_count(BATCH_LAYER_SIZE, BATCH_LAYER_SIZE);
+    batch->layers_per_page = MIN(max_layers, capacity);
+    batch->capacity = MIN(capacity, batch->layers_per_page * BATCH_MAX_PAGES);
+    batch->layer_extents = static_cast<float (*)[2]> (calloc(batch->capacity, sizeof(*batch->layer_extents)));
+    batch->instances = static_cast<Batch_Instance *> (calloc(batch->capacity, sizeof(Batch_Instance)));
+    batch->instance_pages = static_cast<int *> (calloc(batch->capacity, sizeof(int)));
+
+    if (batch->layer_extents == NULL || batch->instances == NULL || batch->instance_pages == NULL) {
+        free(batch->layer_extents);
+        free(batch->instances);
+        free(batch->instance_pages);
+        free(batch);
+        return(NULL);
+    }
+
+    glGenVertexArrays(1, &batch->VAO);
+    glGenBuffers(1, &batch->instance_buffer);
+
+    glBindVertexArray(batch->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_ebo);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, vertex_pos));
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, texture_pos));
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, batch->instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Batch_Instance) * batch->capacity, NULL, GL_DYNAMIC_DRAW);
+
+    for (int i = 2; i <= 4; ++i) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return(batch);
+}
+
+internal void batch_destroy(Image_Batch *batch)
+{
+    glDeleteTextures(batch->page_count, batch->pages);
+    glDeleteBuffers(1, &batch->instance_buffer);
+    glDeleteVertexArrays(1, &batch->VAO);
+
+    free(batch->layer_extents);
+    free(batch->instances);
+    free(batch->instance_pages);
+    free(batch);
+}
+
+internal bool batch_add_page(Image_Batch *batch)
+{
+    int layers = MIN(batch->layers_per_page, batch->capacity - batch->page_count * batch->layers_per_page);
+    unsigned int *texture = &batch->pages[batch->page_count];
+
+    glGenTextures(1, texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, *texture);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, batch->levels - 1);
+
+    for (int level = 0; level < batch->levels; ++level) {
+        int size = mip_level_dimension(batch->layer_size, level);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, size, size, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    batch->page_count += 1;
+
+    return(glGetError() == GL_NO_ERROR);
+}
+
+// Uploads level 'first' onwards of an RGBA8 image's chain into 'layer', level 'first' has to fit a layer.
+// Replaces whatever the layer held before.
+internal bool batch_upload_layer(Image_Batch *batch, int layer, const unsigned char *pixels, const Mip_Chain *chain, int first)
+{
+    PROFILE_ZONE(PROFILE_UPLOAD);
+
+    int page = layer / batch->layers_per_page;
+    while (page >= batch->page_count) {
+        if (!batch_add_page(batch)) {
+            return(false);
+        }
+    }
+
+    int width = chain->width;
+    int height = chain->height;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, batch->pages[page]);
+    layer %= batch->layers_per_page;
+
+    // NOTE(Aiden): Filtering near the image's right and bottom edges reads one texel past them, which would
+    // be whatever the rest of the layer holds. So every level gets its last column and row repeated once
+    // past the edge (when there's room), same as GL_CLAMP_TO_EDGE would give a texture of its own.
+    for (int level = 0; level < batch->levels && first + level < chain->levels; ++level) {
+        int w = mip_level_dimension(width, first + level);
+        int h = mip_level_dimension(height, first + level);
+        int size = mip_level_dimension(batch->layer_size, level);
+        const unsigned char *level_pixels = mip_level_pixels(chain, pixels, first + level);
+        const unsigned char *last_row = level_pixels + static_cast<size_t> (h - 1) * w * 4;
+
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, level_pixels);
+
+        if (h < size) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, h, layer, w, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, last_row);
+        }
+
+        if (w < size) {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, w - 1);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, w, 0, layer, 1, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, level_pixels);
+
+            if (h < size) {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, w, h, layer, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, last_row);
+            }
+
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    float size = static_cast<float> (batch->layer_size);
+    float *extent = batch->layer_extents[page * batch->layers_per_page + layer];
+    extent[0] = static_cast<float> (mip_level_dimension(width, first)) / size;
+    extent[1] = static_cast<float> (mip_level_dimension(height, first)) / size;
+
+    return(true);
+}
+
+// Draws the image in 'layer' at a world space rect. Returns the instance's index, or -1 when the batch is full.
+internal int batch_push_instance(Image_Batch *batch, int layer, float x, float y, float width, float height)
+{
+    if (batch->count == batch->capacity) {
+        return(-1);
+    }
+
+    int index = batch->count;
+    const float *extent = batch->layer_extents[layer];
+
+    Batch_Instance *instance = &batch->instances[index];
+    instance->quad_rect[0] = x;
+    instance->quad_rect[1] = y;
+    instance->quad_rect[2] = width;
+    instance->quad_rect[3] = height;
+    instance->uv_rect[0] = 0.0f;
+    instance->uv_rect[1] = 0.0f;
+    instance->uv_rect[2] = extent[0];
+    instance->uv_rect[3] = extent[1];
+    instance->layer = static_cast<float> (layer % batch->layers_per_page);
+    batch->instance_pages[index] = layer / batch->layers_per_page;
+
+    batch->count += 1;
+    batch->instances_dirty = true;
+
+    return(index);
+}
+
+internal void batch_clear_instances(Image_Batch *batch)
+{
+    batch->count = 0;
+    batch->instances_dirty = true;
+}
+
+// Expects the shader to be bound with 'instanced' set and 'layer_data' on texture unit 3.
+internal void batch_render(Image_Batch *batch)
+{
+    glBindVertexArray(batch->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->instance_buffer);
+
+    if (batch->instances_dirty) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Batch_Instance) * batch->count, batch->instances);
+        batch->instances_dirty = false;
+    }
+
+    glActiveTexture(GL_TEXTURE3);
+
+    // Runs of instances on the same page go out as one draw.
+    for (int first = 0; first < batch->count;) {
+        int page = batch->instance_pages[first];
+        int count = 1;
+        while (first + count < batch->count && batch->instance_pages[first + count] == page) {
+            count += 1;
+        }
+
+        // NOTE(Aiden): No base instance in GL 3.3, so every run points the attributes at its own instances.
+        size_t offset = sizeof(Batch_Instance) * first;
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Batch_Instance), (void *) (offset + offsetof(Batch_Instance, quad_rect)));
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Batch_Instance), (void *) (offset + offsetof(Batch_Instance, uv_rect)));
+        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(Batch_Instance), (void *) (offset + offsetof(Batch_Instance, layer)));
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, batch->pages[page]);
+        glDrawElementsInstanced(GL_TRIANGLES, QUAD_TRIANGLES * QUAD_ELEMENTS, GL_UNSIGNED_INT, NULL, count);
+        first += count;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,953 @@
+// Benchmarks, built into their own executable by build_bench.bat or build_bench.sh (no window, no GL context,
+// so they also run on headless Linux boxes).
+//
+// Usage: simpimg_bench entropy <file.jpg> [runs]
+//   Times the JPEG index pass on the serial path and on the speculative parallel path with 2 to 32 threads,
+//   and checks that every parallel result matches the serial one. Region decodes through the index (edge MCUs
+//   included) have to match a full stb_image decode bit for bit.
+//
+// Usage: simpimg_bench corpus <directory> [runs] [--json <file>]
+//   Decodes every image in the directory the way load_create_texture() does, minus GL: probe, paletted PNGs
+//   as indices, everything else to RGB(A) plus the mip chain, DDS/KTX2 parsed in place. The caches are left
+//   out so every run does the work. Prints megapixels and megabytes (of file) per second for each format,
+//   best of 'runs' per image, how often stb_image allocates and the peak resident set of the process.
+//
+// Usage: simpimg_bench kernels [runs] [--json <file>] [--baseline <file>]
+//   Times stb_image's hot loops one at a time on synthetic input, in cycles per pixel (see bench_kernels.cpp).
+//   With a baseline (the JSON of an earlier run) every kernel is compared to it and the run fails if any of
+//   them got more than 10% slower.
+//
+// Usage: simpimg_bench thumbnails <directory> [size]
+//   Runs the batch thumbnailer over the directory tree (encoding but not writing the PNGs) with 1, 2, 4, ...
+//   workers up to one per core, and prints images per second and the speedup over one worker.
+//
+// Usage: simpimg_bench resample
+//   Times resample.cpp with every filter and pixel format against a naive per-pixel filter and checks they
+//   agree, then measures each filter's aliasing and sharpness on a zone plate (see bench_resample.cpp). Fails
+//   if premultiplied colour filtered in linear light ends up above its alpha.
+//
+// Usage: simpimg_bench jobs [workers]
+//   Stress tests the job system: lots of tiny jobs, dependency chains and diamonds, cancellation, priorities,
+//   jobs waiting for jobs they split off, mip chains. Checks every result, prints how long each took and
+//   each worker's jobs, steals and utilisation, and fails if anything came out wrong.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define GLEW_STATIC
+#include <glew.h>
+
+#define global static
+#define internal static
+
+#include "profile.cpp"
+
+// NOTE(Aiden): Every allocation stb_image makes goes through these, that's where a decode's churn is.
+// Our own code allocates a handful of whole buffers per image at most.
+global std::atomic<long long> bench_allocations;
+global std::atomic<long long> bench_allocated_bytes;
+
+internal void *bench_malloc(size_t size)
+{
+    ++bench_allocations;
+    bench_allocated_bytes += static_cast<long long> (size);
+    return(malloc(size));
+}
+
+internal void *bench_realloc(void *pointer, size_t size)
+{
+    ++bench_allocations;
+    bench_allocated_bytes += static_cast<long long> (size);
+    return(realloc(pointer, size));
+}
+
+#define STBI_MALLOC(size) bench_malloc(size)
+#define STBI_REALLOC(pointer, size) bench_realloc(pointer, size)
+#define STBI_FREE(pointer) free(pointer)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define ARR_LEN(arr) ((sizeof(arr))/sizeof(*arr))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+#define BENCH_DEFAULT_RUNS 5
+#define BENCH_REGIONS 32 // Random regions compared with stb_image on top of the fixed ones, see bench_region_mismatches().
+
+#include "platform.cpp"
+#include "jobs.cpp"
+#include "block_compression.cpp"
+#include "resample.cpp"
+#include "mipmaps.cpp"
+#include "cache.cpp"
+#include "texture_container.cpp"
+#include "jpeg_index.cpp"
+#include "png_write.cpp"
+#include "thumbnailer.cpp"
+
+global const int BENCH_THREAD_COUNTS[] = { 2, 4, 8, 16, 32 }; // 1 is the serial path.
+
+global const char *BENCH_CORPUS_EXTENSIONS[] = { ".png", ".jpg", ".jpeg", ".dds", ".ktx2" };
+global const Mip_Options BENCH_MIP_OPTIONS = { MIP_FILTER_BOX, true, true }; // The viewer's defaults.
+
+enum Bench_Format
+{
+    BENCH_FORMAT_PNG,
+    BENCH_FORMAT_PNG_PALETTED,
+    BENCH_FORMAT_JPEG,
+    BENCH_FORMAT_DDS,
+    BENCH_FORMAT_KTX2,
+    BENCH_FORMAT_OTHER, // stb_image doesn't go by the extension, a misnamed file still decodes.
+
+    BENCH_FORMAT_COUNT
+};
+
+global const char *BENCH_FORMAT_NAMES[BENCH_FORMAT_COUNT] = { "png", "png_paletted", "jpeg", "dds", "ktx2", "other" };
+
+struct Bench_Image
+{
+    Bench_Format format;
+    bool ok;
+    double megapixels;
+    double megabytes;
+    double best;
+    long long allocations;
+    long long allocated_bytes;
+};
+
+struct Bench_Totals
+{
+    int images;
+    int failures;
+    double megapixels;
+    double megabytes;
+    double seconds;
+    long long allocations;
+    long long allocated_bytes;
+};
+
+internal double bench_seconds()
+{
+    return(std::chrono::duration<double> (std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Builds the index 'runs' times and keeps the best time, the last result is left in 'source'.
+internal double bench_build_index(Jpeg_Source *source, int thread_count, int runs, bool *ok)
+{
+    double best = 0.0;
+
+    for (int run = 0; run < runs; ++run) {
+        free(source->checkpoints);
+        free(source->preview);
+        source->checkpoints = NULL;
+        source->preview = NULL;
+
+        double start = bench_seconds();
+        *ok = jpeg_build_index(source, thread_count);
+        double elapsed = bench_seconds() - start;
+
+        if (!*ok) {
+            break;
+        }
+
+        best = (run == 0 || elapsed < best ? elapsed : best);
+    }
+
+    return(best);
+}
+
+internal bool bench_same_index(Jpeg_Source *a, Jpeg_Source *b)
+{
+    // NOTE(Aiden): Checkpoints can legitimately differ in how many bits were prefetched, so compare
+    // what they decode to instead: the preview and a band of full resolution rows through the middle.
+    if (memcmp(a->preview, b->preview, static_cast<size_t> (a->preview_width) * a->preview_height * 4) != 0) {
+        return(false);
+    }
+
+    int rows = MIN(a->height, 64);
+    size_t size = static_cast<size_t> (a->width) * rows * 4;
+    unsigned char *pixels_a = static_cast<unsigned char *> (malloc(size));
+    unsigned char *pixels_b = static_cast<unsigned char *> (malloc(size));
+
+    bool same = (pixels_a && pixels_b &&
+                 jpeg_decode_region(a, 0, (a->height - rows) / 2, a->width, rows, pixels_a) &&
+                 jpeg_decode_region(b, 0, (b->height - rows) / 2, b->width, rows, pixels_b) &&
+                 memcmp(pixels_a, pixels_b, size) == 0);
+
+    free(pixels_a);
+    free(pixels_b);
+    return(same);
+}
+
+// Decodes regions through the index and compares them with the same pixels of a full stb_image decode, which
+// they have to match bit for bit: the corners and the last row and column (partial MCUs), an odd offset in
+// the middle and 'random' more. Returns how many didn't match, -1 if stb_image can't decode the file.
+internal int bench_region_mismatches(Jpeg_Source *source, const char *filename, int random, int *checked)
+{
+    int width, height, channels;
+    unsigned char *full = stbi_load(filename, &width, &height, &channels, 4);
+    if (full == NULL || width != source->width || height != source->height) {
+        stbi_image_free(full);
+        return(-1);
+    }
+
+    int middle_x = width / 2 - MIN(width / 2, 31);
+    int regions[5][4] = {
+        { 0, 0, MIN(width, 67), MIN(height, 45) },
+        { width - MIN(width, 53), height - MIN(height, 29), MIN(width, 53), MIN(height, 29) },
+        { middle_x, height / 3, MIN(width - middle_x, 91), MIN(height - height / 3, 77) },
+        { 0, height - 1, width, 1 },
+        { width - 1, 0, 1, height },
+    };
+
+    unsigned char *out = static_cast<unsigned char *> (malloc(static_cast<size_t> (MIN(width, 512)) * MIN(height, 512) * 4 + static_cast<size_t> (width + height) * 4));
+    unsigned int state = 1;
+    int mismatches = 0;
+    *checked = 0;
+
+    for (int i = 0; out && i < static_cast<int> (ARR_LEN(regions)) + random; ++i) {
+        int x, y, w, h;
+        if (i < static_cast<int> (ARR_LEN(regions))) {
+            x = regions[i][0];
+            y = regions[i][1];
+            w = regions[i][2];
+            h = regions[i][3];
+        } else {
+            state = state * 1664525u + 1013904223u;
+            w = 1 + static_cast<int> ((state >> 8) % static_cast<unsigned int> (MIN(width, 512)));
+            state = state * 1664525u + 1013904223u;
+            h = 1 + static_cast<int> ((state >> 8) % static_cast<unsigned int> (MIN(height, 512)));
+            state = state * 1664525u + 1013904223u;
+            x = static_cast<int> ((state >> 8) % static_cast<unsigned int> (width - w + 1));
+            state = state * 1664525u + 1013904223u;
+            y = static_cast<int> ((state >> 8) % static_cast<unsigned int> (height - h + 1));
+        }
+
+        bool same = jpeg_decode_region(source, x, y, w, h, out);
+        for (int row = 0; same && row < h; ++row) {
+            same = (memcmp(out + static_cast<size_t> (row) * w * 4, full + (static_cast<size_t> (y + row) * width + x) * 4, static_cast<size_t> (w) * 4) == 0);
+        }
+
+        mismatches += (same ? 0 : 1);
+        *checked += 1;
+    }
+
+    free(out);
+    stbi_image_free(full);
+    return(out ? mismatches : -1);
+}
+
+internal Jpeg_Source *bench_open_jpeg(const char *filename)
+{
+    Jpeg_Source *source = jpeg_source_open(filename);
+    if (source) {
+        source->preview_width = (source->width > 8 ? source->width / 8 : 1);
+        source->preview_height = (source->height > 8 ? source->height / 8 : 1);
+    }
+
+    return(source);
+}
+
+internal int bench_entropy(const char *filename, int runs)
+{
+    Jpeg_Source *serial = bench_open_jpeg(filename);
+    if (serial == NULL) {
+        fprintf(stderr, "%s: not a single scan baseline JPEG\n", filename);
+        return(1);
+    }
+
+    if (serial->decoder->restart_interval != 0) {
+        printf("%s has restart markers, the parallel path is never used for it.\n", filename);
+    }
+
+    bool ok;
+    double serial_time = bench_build_index(serial, 1, runs, &ok);
+    if (!ok) {
+        fprintf(stderr, "%s: could not decode the scan\n", filename);
+        jpeg_source_destroy(serial);
+        return(1);
+    }
+
+    double megabytes = static_cast<double> (serial->file.size - serial->scan_offset) / (1024.0 * 1024.0);
+    double megapixels = static_cast<double> (serial->width) * serial->height / 1e6;
+
+    printf("%s: %dx%d, %.1f MB of entropy coded data, best of %d runs, %u hardware threads\n\n",
+           filename, serial->width, serial->height, megabytes, runs, std::thread::hardware_concurrency());
+    printf("%-10s %10s %10s %10s %9s %s\n", "path", "ms", "MB/s", "MP/s", "speedup", "");
+    printf("%-10s %10.2f %10.1f %10.1f %8.2fx\n", "serial", serial_time * 1000.0, megabytes / serial_time, megapixels / serial_time, 1.0);
+
+    int checked;
+    int mismatches = bench_region_mismatches(serial, filename, BENCH_REGIONS, &checked);
+    if (mismatches < 0) {
+        printf("%-10s could not decode the whole image with stb_image\n", "regions");
+    } else {
+        printf("%-10s %d of %d match a full stb_image decode%s\n", "regions", checked - mismatches, checked, mismatches ? "  MISMATCH" : "");
+    }
+
+    int failures = (mismatches != 0 ? 1 : 0);
+    for (int i = 0; i < static_cast<int> (ARR_LEN(BENCH_THREAD_COUNTS)); ++i) {
+        int thread_count = BENCH_THREAD_COUNTS[i];
+        Jpeg_Source *parallel = bench_open_jpeg(filename);
+
+        double best = bench_build_index(parallel, thread_count, runs, &ok);
+        bool speculated = ok && parallel->index_threads == thread_count;
+        bool same = ok && bench_same_index(serial, parallel);
+        failures += (same ? 0 : 1);
+
+        char label[32];
+        snprintf(label, sizeof(label), "%d threads", thread_count);
+
+        if (ok) {
+            printf("%-10s %10.2f %10.1f %10.1f %8.2fx %s%s\n", label, best * 1000.0, megabytes / best, megapixels / best,
+                   serial_time / best, speculated ? "" : "(fell back to serial) ", same ? "" : "MISMATCH");
+        } else {
+            printf("%-10s %10s %10s %10s %9s %s\n", label, "-", "-", "-", "-", "failed");
+        }
+
+        jpeg_source_destroy(parallel);
+    }
+
+    jpeg_source_destroy(serial);
+    return(failures ? 1 : 0);
+}
+
+internal bool bench_has_extension(const char *filename, const char *extension)
+{
+    const char *dot = strrchr(filename, '.');
+    return(dot && _stricmp(dot, extension) == 0);
+}
+
+// Peak resident set of the whole process so far, in bytes.
+internal unsigned long long bench_peak_rss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return(counters.PeakWorkingSetSize);
+    }
+
+    return(0);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return(static_cast<unsigned long long> (usage.ru_maxrss) * 1024); // Kilobytes on Linux.
+    }
+
+    return(0);
+#endif
+}
+
+internal bool bench_decode_container(const char *filename, Bench_Image *image)
+{
+    Mapped_File file;
+    if (!platform_map_file(filename, &file)) {
+        return(false);
+    }
+
+    Compressed_Image compressed = {};
+    // Whether the driver takes the block format is a question for GL, not part of the work here.
+    bool ok = (image->format == BENCH_FORMAT_DDS ? parse_dds(file.data, file.size, &compressed) : parse_ktx2(file.data, file.size, &compressed));
+
+    if (ok) {
+        image->megapixels = static_cast<double> (compressed.width) * compressed.height / 1e6;
+    }
+
+    platform_unmap_file(&file);
+    return(ok);
+}
+
+// The CPU side of load_create_texture(), everything it would hand to GL is thrown away.
+internal bool bench_decode(const char *filename, Bench_Image *image)
+{
+    if (image->format == BENCH_FORMAT_DDS || image->format == BENCH_FORMAT_KTX2) {
+        return(bench_decode_container(filename, image));
+    }
+
+    int info_width, info_height, info_channels = 0;
+    {
+        PROFILE_ZONE(PROFILE_PROBE);
+        stbi_info(filename, &info_width, &info_height, &info_channels);
+    }
+
+    int width, height, channels;
+    if (image->format == BENCH_FORMAT_PNG || image->format == BENCH_FORMAT_PNG_PALETTED) {
+        int palette_len;
+        unsigned char palette[256 * 4];
+        unsigned char *indices;
+        {
+            PROFILE_ZONE(PROFILE_DECODE);
+            indices = stbi_load_png_indexed(filename, &width, &height, palette, &palette_len);
+        }
+
+        if (indices) {
+            image->format = BENCH_FORMAT_PNG_PALETTED;
+            image->megapixels = static_cast<double> (width) * height / 1e6;
+            stbi_image_free(indices);
+            return(true);
+        }
+    }
+
+    int wanted_channels = ((info_channels == 2 || info_channels == 4) ? 4 : 3);
+    unsigned char *data = stbi_load(filename, &width, &height, &channels, wanted_channels);
+    if (data == NULL) {
+        return(false);
+    }
+
+    Mip_Chain chain = {};
+    bool ok = mip_generate(data, width, height, wanted_channels, &BENCH_MIP_OPTIONS, 0, &chain);
+    image->megapixels = static_cast<double> (width) * height / 1e6;
+
+    free(chain.data);
+    stbi_image_free(data);
+    return(ok);
+}
+
+internal Bench_Format bench_guess_format(const char *filename)
+{
+    if (bench_has_extension(filename, ".png")) {
+        return(BENCH_FORMAT_PNG);
+    } else if (bench_has_extension(filename, ".jpg") || bench_has_extension(filename, ".jpeg")) {
+        return(BENCH_FORMAT_JPEG);
+    } else if (bench_has_extension(filename, ".dds")) {
+        return(BENCH_FORMAT_DDS);
+    } else if (bench_has_extension(filename, ".ktx2")) {
+        return(BENCH_FORMAT_KTX2);
+    }
+
+    return(BENCH_FORMAT_OTHER);
+}
+
+// JSON strings can't hold raw backslashes (Windows paths) or quotes. profile.cpp has its own, which is
+// only compiled in along with the profiler.
+internal void bench_write_json_string(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if (static_cast<unsigned char> (*c) >= 0x20) {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+internal void bench_write_corpus_json(FILE *file, const char *directory, int runs, const Bench_Totals *totals, unsigned long long peak_rss)
+{
+    fprintf(file, "{\n  \"directory\": ");
+    bench_write_json_string(file, directory);
+    fprintf(file, ",\n  \"runs\": %d,\n  \"hardware_threads\": %u,\n  \"peak_rss_bytes\": %llu,\n  \"formats\": {",
+            runs, std::thread::hardware_concurrency(), peak_rss);
+
+    bool first = true;
+    for (int format = 0; format <= BENCH_FORMAT_COUNT; ++format) {
+        const Bench_Totals *total = &totals[format];
+        if (total->images == 0) {
+            continue;
+        }
+
+        fprintf(file, "%s\n    \"%s\": {\"images\": %d, \"failures\": %d, \"megapixels\": %.3f, \"megabytes\": %.3f, "
+                "\"seconds\": %.6f, \"megapixels_per_second\": %.3f, \"megabytes_per_second\": %.3f, "
+                "\"allocations\": %lld, \"allocated_bytes\": %lld}",
+                (first ? "" : ","), (format == BENCH_FORMAT_COUNT ? "all" : BENCH_FORMAT_NAMES[format]),
+                total->images, total->failures, total->megapixels, total->megabytes, total->seconds,
+                (total->seconds > 0.0 ? total->megapixels / total->seconds : 0.0),
+                (total->seconds > 0.0 ? total->megabytes / total->seconds : 0.0),
+                total->allocations, total->allocated_bytes);
+        first = false;
+    }
+
+    fprintf(file, "\n  }\n}\n");
+}
+
+internal int bench_corpus(const char *directory, int runs, const char *json_filename)
+{
+    Directory_Listing listing;
+    if (!platform_list_directory(directory, BENCH_CORPUS_EXTENSIONS, static_cast<int> (ARR_LEN(BENCH_CORPUS_EXTENSIONS)), &listing)) {
+        fprintf(stderr, "%s: could not list the directory\n", directory);
+        return(1);
+    }
+
+    if (listing.count == 0) {
+        fprintf(stderr, "%s: no images\n", directory);
+        platform_free_listing(&listing);
+        return(1);
+    }
+
+    Bench_Image *images = static_cast<Bench_Image *> (calloc(listing.count, sizeof(Bench_Image)));
+    if (images == NULL) {
+        platform_free_listing(&listing);
+        return(1);
+    }
+
+    // Decoded the way the viewer decodes them.
+    stbi_set_premultiply_on_load(1);
+
+    // NOTE(Aiden): Run after run over the whole directory rather than each image 'runs' times in a row,
+    // so one image's buffers aren't still warm in the cache when it's timed again.
+    char path[4096];
+    for (int run = 0; run < runs; ++run) {
+        for (int i = 0; i < listing.count; ++i) {
+            Bench_Image *image = &images[i];
+            const char *name = platform_listing_name(&listing, i);
+            snprintf(path, sizeof(path), "%s" PATH_SEPARATOR "%s", directory, name);
+
+            File_Stamp stamp = {};
+            platform_get_file_stamp(path, &stamp);
+            image->megabytes = static_cast<double> (stamp.size) / (1024.0 * 1024.0);
+            image->format = bench_guess_format(name);
+
+            long long allocations = bench_allocations;
+            long long allocated_bytes = bench_allocated_bytes;
+
+            double start = bench_seconds();
+            bool ok = bench_decode(path, image);
+            double elapsed = bench_seconds() - start;
+
+            image->ok = (run == 0 ? ok : image->ok && ok);
+            image->best = (run == 0 || elapsed < image->best ? elapsed : image->best);
+            image->allocations = bench_allocations - allocations;
+            image->allocated_bytes = bench_allocated_bytes - allocated_bytes;
+        }
+    }
+
+    // The last slot is every format together.
+    Bench_Totals totals[BENCH_FORMAT_COUNT + 1] = {};
+    for (int i = 0; i < listing.count; ++i) {
+        const Bench_Image *image = &images[i];
+        Bench_Totals *format_totals[2] = { &totals[image->format], &totals[BENCH_FORMAT_COUNT] };
+
+        for (int j = 0; j < 2; ++j) {
+            Bench_Totals *total = format_totals[j];
+            total->images += 1;
+
+            if (!image->ok) {
+                total->failures += 1;
+                fprintf(stderr, "%s: failed to decode\n", platform_listing_name(&listing, i));
+                continue;
+            }
+
+            total->megapixels += image->megapixels;
+            total->megabytes += image->megabytes;
+            total->seconds += image->best;
+            total->allocations += image->allocations;
+            total->allocated_bytes += image->allocated_bytes;
+        }
+    }
+
+    unsigned long long peak_rss = bench_peak_rss();
+
+    printf("%s: %d images, best of %d runs per image, %u hardware threads\n\n",
+           directory, listing.count, runs, std::thread::hardware_concurrency());
+    printf("%-13s %7s %6s %10s %10s %10s %10s %12s %12s\n",
+           "format", "images", "failed", "MP", "ms", "MP/s", "MB/s", "allocs/img", "alloc MB/img");
+
+    for (int format = 0; format <= BENCH_FORMAT_COUNT; ++format) {
+        const Bench_Totals *total = &totals[format];
+        if (total->images == 0) {
+            continue;
+        }
+
+        int decoded = total->images - total->failures;
+        double seconds = (total->seconds > 0.0 ? total->seconds : 1e-9);
+        printf("%-13s %7d %6d %10.2f %10.2f %10.1f %10.1f %12.1f %12.2f\n",
+               (format == BENCH_FORMAT_COUNT ? "all" : BENCH_FORMAT_NAMES[format]), total->images, total->failures,
+               total->megapixels, total->seconds * 1000.0, total->megapixels / seconds, total->megabytes / seconds,
+               (decoded ? static_cast<double> (total->allocations) / decoded : 0.0),
+               (decoded ? static_cast<double> (total->allocated_bytes) / (1024.0 * 1024.0) / decoded : 0.0));
+    }
+
+    printf("\npeak RSS: %.1f MB\n", static_cast<double> (peak_rss) / (1024.0 * 1024.0));
+
+    int result = (totals[BENCH_FORMAT_COUNT].failures ? 1 : 0);
+    if (json_filename) {
+        FILE *file = fopen(json_filename, "w");
+        if (file) {
+            bench_write_corpus_json(file, directory, runs, totals, peak_rss);
+            fclose(file);
+        } else {
+            fprintf(stderr, "%s: could not write the results\n", json_filename);
+            result = 1;
+        }
+    }
+
+    free(images);
+    platform_free_listing(&listing);
+    return(result);
+}
+
+internal int bench_thumbnails(const char *directory, int size)
+{
+    int cores = static_cast<int> (std::thread::hardware_concurrency());
+    cores = (cores > 0 ? cores : 1);
+
+    // An untimed run first, so every timed one finds the files in the OS cache.
+    Thumbnailer_Stats stats;
+    if (!thumbnailer_run(directory, NULL, size, cores, &stats)) {
+        return(1);
+    }
+
+    printf("%d images (%d failed), %.1f megapixels, %dx%d box\n\n", stats.images, stats.failures, stats.megapixels, size, size);
+    printf("%8s %10s %10s %8s %8s\n", "threads", "seconds", "images/s", "speedup", "steals");
+
+    double single = 0.0;
+    for (int threads = 1;; threads *= 2) {
+        threads = MIN(threads, cores);
+        thumbnailer_run(directory, NULL, size, threads, &stats);
+
+        double rate = (stats.seconds > 0.0 ? stats.images / stats.seconds : 0.0);
+        single = (threads == 1 ? rate : single);
+        printf("%8d %10.3f %10.1f %7.2fx %8d\n", threads, stats.seconds, rate, (single > 0.0 ? rate / single : 0.0), stats.steals);
+
+        if (threads == cores) {
+            break;
+        }
+    }
+
+    return(stats.failures == 0 ? 0 : 1);
+}
+
+#define BENCH_JOBS_TINY 200000
+#define BENCH_JOBS_CHAINS 64
+#define BENCH_JOBS_CHAIN_LENGTH 64
+#define BENCH_JOBS_CANCELLED 20000
+#define BENCH_JOBS_NESTED 256
+
+internal bool bench_jobs_check(bool ok, const char *test, double seconds)
+{
+    printf("%-12s %-4s %10.3f ms\n", test, (ok ? "ok" : "FAIL"), seconds * 1000.0);
+    return(ok);
+}
+
+// Stress tests for the job system, each one times itself and checks its results. Runs with 'worker_count'
+// workers (one less than there are cores with -1).
+internal int bench_jobs(int worker_count)
+{
+    job_system = job_system_create(worker_count);
+    Job_System *system = job_system;
+    printf("%d workers\n\n", system->worker_count);
+
+    int failures = 0;
+
+    // Lots of jobs doing next to nothing, every one of them has to run exactly once.
+    {
+        double start = bench_seconds();
+        std::atomic<long long> sum(0);
+        Job_Token token = {};
+
+        for (int i = 0; i < BENCH_JOBS_TINY; ++i) {
+            job_run(system, [&sum, i]() { sum += i; }, JOB_PRIORITY_NORMAL, &token);
+        }
+        job_token_wait(system, &token);
+
+        long long expected = static_cast<long long> (BENCH_JOBS_TINY) * (BENCH_JOBS_TINY - 1) / 2;
+        double seconds = bench_seconds() - start;
+        failures += !bench_jobs_check(sum == expected, "tiny", seconds);
+        printf("%31.1f jobs/s\n", (seconds > 0.0 ? BENCH_JOBS_TINY / seconds : 0.0));
+    }
+
+    // Chains of dependent jobs, each link has to see the one before it done.
+    {
+        double start = bench_seconds();
+        std::atomic<int> out_of_order(0);
+        int *steps = static_cast<int *> (calloc(BENCH_JOBS_CHAINS, sizeof(int)));
+        Job *last[BENCH_JOBS_CHAINS];
+
+        for (int chain = 0; chain < BENCH_JOBS_CHAINS; ++chain) {
+            Job *previous = NULL;
+            for (int link = 0; link < BENCH_JOBS_CHAIN_LENGTH; ++link) {
+                Job *job = job_create([&out_of_order, steps, chain, link]() {
+                    if (steps[chain] != link) {
+                        out_of_order += 1;
+                    }
+                    steps[chain] = link + 1;
+                }, JOB_PRIORITY_NORMAL, NULL);
+
+                if (previous) {
+                    job_depends_on(job, previous);
+                    job_release(previous);
+                }
+                job_submit(system, job);
+                previous = job;
+            }
+            last[chain] = previous;
+        }
+
+        bool ok = true;
+        for (int chain = 0; chain < BENCH_JOBS_CHAINS; ++chain) {
+            job_wait(system, last[chain]);
+            job_release(last[chain]);
+            ok = ok && (steps[chain] == BENCH_JOBS_CHAIN_LENGTH);
+        }
+
+        free(steps);
+        failures += !bench_jobs_check(ok && out_of_order == 0, "chains", bench_seconds() - start);
+    }
+
+    // Diamonds: one job fans out to many, one more joins them and must see all of them done.
+    {
+        double start = bench_seconds();
+        bool ok = true;
+
+        for (int diamond = 0; diamond < BENCH_JOBS_CHAINS && ok; ++diamond) {
+            std::atomic<int> top(0), middle(0), early(0);
+            int seen = -1;
+
+            Job *first = job_create([&top]() { top += 1; }, JOB_PRIORITY_NORMAL, NULL);
+            Job *join = job_create([&middle, &seen]() { seen = middle; }, JOB_PRIORITY_NORMAL, NULL);
+
+            for (int i = 0; i < BENCH_JOBS_CHAIN_LENGTH; ++i) {
+                Job *job = job_create([&top, &middle, &early]() {
+                    early += (top == 0 ? 1 : 0);
+                    middle += 1;
+                }, JOB_PRIORITY_NORMAL, NULL);
+
+                job_depends_on(job, first);
+                job_depends_on(join, job);
+                job_submit(system, job);
+                job_release(job);
+            }
+
+            job_submit(system, join);
+            job_submit(system, first);
+            job_release(first);
+
+            job_wait(system, join);
+            job_release(join);
+            ok = (seen == BENCH_JOBS_CHAIN_LENGTH && early == 0);
+        }
+
+        failures += !bench_jobs_check(ok, "diamonds", bench_seconds() - start);
+    }
+
+    // Cancelling a token: nothing that hadn't started may start afterwards, and waiting for it still returns.
+    // Every worker is held up first, so most of the jobs are still queued when it gets cancelled.
+    {
+        double start = bench_seconds();
+        std::atomic<bool> release(false);
+        std::atomic<int> ran(0), after(0);
+        std::atomic<bool> cancelled(false);
+        Job_Token blockers = {}, token = {};
+
+        for (int i = 0; i < system->worker_count; ++i) {
+            job_run(system, [&release]() {
+                while (!release) {
+                    std::this_thread::yield();
+                }
+            }, JOB_PRIORITY_HIGH, &blockers);
+        }
+
+        for (int i = 0; i < BENCH_JOBS_CANCELLED; ++i) {
+            job_run(system, [&ran, &after, &cancelled]() {
+                ran += 1;
+                after += (cancelled ? 1 : 0);
+            }, JOB_PRIORITY_LOW, &token);
+        }
+
+        job_token_cancel(&token);
+        cancelled = true;
+        release = true;
+
+        job_token_wait(system, &token);
+        job_token_wait(system, &blockers);
+
+        failures += !bench_jobs_check(after == 0 && token.outstanding == 0, "cancel", bench_seconds() - start);
+        printf("%31d of %d ran\n", ran.load(), BENCH_JOBS_CANCELLED);
+    }
+
+    // Priorities: with every worker held up, queue low, normal and high jobs and see in which order they run.
+    {
+        double start = bench_seconds();
+        std::atomic<bool> release(false);
+        std::atomic<int> order(0);
+        int sums[JOB_PRIORITY_COUNT] = {};
+        int counts[JOB_PRIORITY_COUNT] = {};
+        std::mutex sums_mutex;
+        Job_Token blockers = {}, token = {};
+
+        for (int i = 0; i < system->worker_count; ++i) {
+            job_run(system, [&release]() {
+                while (!release) {
+                    std::this_thread::yield();
+                }
+            }, JOB_PRIORITY_HIGH, &blockers);
+        }
+
+        for (int priority = JOB_PRIORITY_COUNT - 1; priority >= 0; --priority) {
+            for (int i = 0; i < BENCH_JOBS_NESTED; ++i) {
+                job_run(system, [&order, &sums, &counts, &sums_mutex, priority]() {
+                    int position = order++;
+                    std::lock_guard<std::mutex> lock(sums_mutex);
+                    sums[priority] += position;
+                    counts[priority] += 1;
+                }, static_cast<Job_Priority> (priority), &token);
+            }
+        }
+
+        release = true;
+        job_token_wait(system, &token);
+        job_token_wait(system, &blockers);
+
+        // Stealing makes it only roughly ordered, but on average high has to come before normal before low.
+        double average[JOB_PRIORITY_COUNT];
+        for (int priority = 0; priority < JOB_PRIORITY_COUNT; ++priority) {
+            average[priority] = static_cast<double> (sums[priority]) / (counts[priority] ? counts[priority] : 1);
+        }
+
+        bool ok = (average[JOB_PRIORITY_HIGH] <= average[JOB_PRIORITY_NORMAL] && average[JOB_PRIORITY_NORMAL] <= average[JOB_PRIORITY_LOW]);
+        failures += !bench_jobs_check(ok, "priorities", bench_seconds() - start);
+        printf("%31s high %.0f, normal %.0f, low %.0f (average position)\n", "", average[JOB_PRIORITY_HIGH], average[JOB_PRIORITY_NORMAL], average[JOB_PRIORITY_LOW]);
+    }
+
+    // Jobs that split themselves up with job_run_parallel() and wait for the parts, the way mip generation
+    // does inside a loading job. Deadlocks here if waiting doesn't run other jobs. The parts have to run at
+    // the priority of the job that split them up.
+    {
+        double start = bench_seconds();
+        std::atomic<long long> sum(0);
+        std::atomic<int> wrong_priority(0);
+        Job_Token token = {};
+
+        for (int i = 0; i < BENCH_JOBS_NESTED; ++i) {
+            job_run(system, [&sum, &wrong_priority]() {
+                std::atomic<int> next(0);
+                job_run_parallel(0, [&sum, &wrong_priority, &next]() {
+                    wrong_priority += (job_priority != JOB_PRIORITY_LOW);
+                    for (int part = next++; part < BENCH_JOBS_NESTED; part = next++) {
+                        sum += part;
+                    }
+                });
+            }, JOB_PRIORITY_LOW, &token);
+        }
+        job_token_wait(system, &token);
+
+        long long expected = static_cast<long long> (BENCH_JOBS_NESTED) * BENCH_JOBS_NESTED * (BENCH_JOBS_NESTED - 1) / 2;
+        failures += !bench_jobs_check(sum == expected && wrong_priority == 0, "nested", bench_seconds() - start);
+    }
+
+    // Real work: mip chains of a noise image, a few at once.
+    {
+        double start = bench_seconds();
+        int size = 2048;
+        unsigned char *pixels = static_cast<unsigned char *> (malloc(static_cast<size_t> (size) * size * 4));
+        unsigned int state = 1;
+        for (size_t i = 0; i < static_cast<size_t> (size) * size * 4; ++i) {
+            state = state * 1664525u + 1013904223u;
+            pixels[i] = static_cast<unsigned char> (state >> 24);
+        }
+
+        std::atomic<int> generated(0);
+        Job_Token token = {};
+        for (int i = 0; i < 8; ++i) {
+            job_run(system, [pixels, size, &generated]() {
+                Mip_Chain chain = {};
+                if (mip_generate(pixels, size, size, 4, &BENCH_MIP_OPTIONS, 0, &chain)) {
+                    generated += 1;
+                    free(chain.data);
+                }
+            }, JOB_PRIORITY_NORMAL, &token);
+        }
+        job_token_wait(system, &token);
+
+        free(pixels);
+        failures += !bench_jobs_check(generated == 8, "mips", bench_seconds() - start);
+    }
+
+    printf("\n");
+    job_system_report(system, stdout);
+
+    job_system_destroy(system);
+    job_system = NULL;
+
+    printf("\n%d failed\n", failures);
+    return(failures == 0 ? 0 : 1);
+}
+
+#include "bench_kernels.cpp"
+#include "bench_resample.cpp"
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "entropy") == 0) {
+        int runs = (argc >= 4 ? atoi(argv[3]) : BENCH_DEFAULT_RUNS);
+        return(bench_entropy(argv[2], runs > 0 ? runs : 1));
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "corpus") == 0) {
+        int runs = BENCH_DEFAULT_RUNS;
+        const char *json_filename = NULL;
+
+        for (int i = 3; i < argc; ++i) {
+            if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+                json_filename = argv[++i];
+            } else {
+                runs = atoi(argv[i]);
+            }
+        }
+
+        // Mip generation splits itself up over the job system, like it does in the viewer.
+        job_system = job_system_create(-1);
+        int result = bench_corpus(argv[2], runs > 0 ? runs : 1, json_filename);
+        job_system_destroy(job_system);
+        return(result);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "kernels") == 0) {
+        int runs = KERNEL_DEFAULT_RUNS;
+        const char *json_filename = NULL;
+        const char *baseline_filename = NULL;
+
+        for (int i = 2; i < argc; ++i) {
+            if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+                json_filename = argv[++i];
+            } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+                baseline_filename = argv[++i];
+            } else {
+                runs = atoi(argv[i]);
+            }
+        }
+
+        return(bench_kernels(runs > 0 ? runs : 1, json_filename, baseline_filename));
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "thumbnails") == 0) {
+        int size = (argc >= 4 ? atoi(argv[3]) : THUMBNAILER_DEFAULT_SIZE);
+        return(bench_thumbnails(argv[2], size > 0 ? size : THUMBNAILER_DEFAULT_SIZE));
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "resample") == 0) {
+        return(bench_resample());
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "jobs") == 0) {
+        return(bench_jobs(argc >= 3 ? atoi(argv[2]) : -1));
+    }
+
+    fprintf(stderr, "usage: %s entropy <file.jpg> [runs]\n", argv[0]);
+    fprintf(stderr, "       %s corpus <directory> [runs] [--json <file>]\n", argv[0]);
+    fprintf(stderr, "       %s kernels [runs] [--json <file>] [--baseline <file>]\n", argv[0]);
+    fprintf(stderr, "       %s thumbnails <directory> [size]\n", argv[0]);
+    fprintf(stderr, "       %s resample\n", argv[0]);
+    fprintf(stderr, "       %s jobs [workers]\n", argv[0]);
+    return(1);
+}
@@ -0,0 +1,736 @@
+// Microbenchmarks for stb_image's inner loops, each one run in isolation on synthetic input so the numbers
+// only move when the kernel does. Part of simpimg_bench, see bench.cpp for the usage.
+//
+// Inputs come from a fixed seed and are the same on every machine: random coefficient blocks shaped like a
+// real photo's (mostly zero past the first few in zigzag order), entropy coded with the JPEG spec's example
+// tables for jpeg_decode_block, random planes for the colour conversion and upsampling, a Paeth filtered
+// RGBA image and the same image deflated with the fixed Huffman codes for do_zlib.
+//
+// Cycles are the time stamp counter, which ticks at a constant rate whatever the core clock is doing, so
+// compare numbers from the same machine only. Without one (not x86) the cycles are nanoseconds.
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define KERNEL_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define KERNEL_TSC
+#endif
+
+#define KERNEL_DEFAULT_RUNS 25
+#define KERNEL_WIDTH 1024
+#define KERNEL_HEIGHT 256
+#define KERNEL_PIXELS (KERNEL_WIDTH * KERNEL_HEIGHT)
+#define KERNEL_BLOCKS (KERNEL_PIXELS / 64)
+#define KERNEL_REGRESSION 0.10 // Slower than the baseline by more than this fails the run.
+
+struct Kernel_Input
+{
+    short *zigzag;           // KERNEL_BLOCKS coefficient blocks in zigzag order, what the encoder reads.
+    short *blocks;           // The same in natural order, what the decoder should give back.
+    unsigned char *entropy;
+    int entropy_size;
+    stbi__jpeg *jpeg;
+    stbi__context context;
+
+    unsigned char *planes;   // Y, Cb and Cr, KERNEL_PIXELS each.
+
+    unsigned char *pixels;   // RGBA, the image the PNG kernels reconstruct.
+    unsigned char *filtered; // 'pixels' with a Paeth filter byte in front of every row.
+    unsigned char *deflated;
+    int deflated_size;
+
+    unsigned char *rgb;      // Input of convert_format, which frees it, so a fresh copy for every run.
+    unsigned char *rgb_copy;
+    unsigned char *rgbe;
+
+    unsigned char *out;      // Big enough for any kernel's output.
+    short *out_blocks;
+};
+
+struct Kernel
+{
+    const char *name;
+    void (*prepare)(Kernel_Input *input); // Not timed, can be NULL.
+    void (*run)(Kernel_Input *input);
+};
+
+struct Kernel_Bits
+{
+    unsigned char *out;
+    int size;
+    unsigned int buffer;
+    int count;
+};
+
+internal inline unsigned long long kernel_cycles()
+{
+#ifdef KERNEL_TSC
+    return(__rdtsc());
+#else
+    return(static_cast<unsigned long long> (std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now().time_since_epoch()).count()));
+#endif
+}
+
+internal unsigned int kernel_random(unsigned int *state)
+{
+    // xorshift32, rand() differs between C runtimes.
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return(*state);
+}
+
+// From the example tables in Annex K of the JPEG spec, which is what most encoders use.
+global int KERNEL_DC_COUNTS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+global const unsigned char KERNEL_DC_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+global int KERNEL_AC_COUNTS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+global const unsigned char KERNEL_AC_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+// JPEG writes bits MSB first and escapes every 0xFF byte with a 0x00.
+internal void kernel_put_jpeg_bits(Kernel_Bits *bits, unsigned int value, int count)
+{
+    for (int i = count - 1; i >= 0; --i) {
+        bits->buffer = (bits->buffer << 1) | ((value >> i) & 1);
+        if (++bits->count == 8) {
+            bits->out[bits->size++] = static_cast<unsigned char> (bits->buffer);
+            if (bits->buffer == 0xff) {
+                bits->out[bits->size++] = 0;
+            }
+
+            bits->buffer = 0;
+            bits->count = 0;
+        }
+    }
+}
+
+internal void kernel_put_jpeg_symbol(Kernel_Bits *bits, const stbi__huffman *huffman, int symbol)
+{
+    for (int i = 0; huffman->size[i]; ++i) {
+        if (huffman->values[i] == symbol) {
+            kernel_put_jpeg_bits(bits, huffman->code[i], huffman->size[i]);
+            return;
+        }
+    }
+}
+
+internal int kernel_magnitude_bits(int value)
+{
+    int magnitude = (value < 0 ? -value : value);
+    int bits = 0;
+    while (magnitude) {
+        ++bits;
+        magnitude >>= 1;
+    }
+
+    return(bits);
+}
+
+internal void kernel_put_jpeg_value(Kernel_Bits *bits, int value, int size)
+{
+    // Negative values are stored as value - 1 in 'size' bits, which is what stbi__extend_receive undoes.
+    kernel_put_jpeg_bits(bits, static_cast<unsigned int> (value < 0 ? value - 1 : value) & ((1u << size) - 1), size);
+}
+
+internal void kernel_encode_blocks(Kernel_Input *input)
+{
+    Kernel_Bits bits = { input->entropy, 0, 0, 0 };
+    const stbi__huffman *dc_table = &input->jpeg->huff_dc[0];
+    const stbi__huffman *ac_table = &input->jpeg->huff_ac[0];
+    int previous_dc = 0;
+
+    for (int block = 0; block < KERNEL_BLOCKS; ++block) {
+        const short *zigzag = &input->zigzag[block * 64];
+
+        int diff = zigzag[0] - previous_dc;
+        int size = kernel_magnitude_bits(diff);
+        previous_dc = zigzag[0];
+        kernel_put_jpeg_symbol(&bits, dc_table, size);
+        kernel_put_jpeg_value(&bits, diff, size);
+
+        int run = 0;
+        for (int k = 1; k < 64; ++k) {
+            if (zigzag[k] == 0) {
+                ++run;
+                continue;
+            }
+
+            for (; run >= 16; run -= 16) {
+                kernel_put_jpeg_symbol(&bits, ac_table, 0xf0);
+            }
+
+            size = kernel_magnitude_bits(zigzag[k]);
+            kernel_put_jpeg_symbol(&bits, ac_table, (run << 4) | size);
+            kernel_put_jpeg_value(&bits, zigzag[k], size);
+            run = 0;
+        }
+
+        if (run) {
+            kernel_put_jpeg_symbol(&bits, ac_table, 0x00);
+        }
+    }
+
+    // Pad the last byte with ones and end on EOI, like an encoder would.
+    kernel_put_jpeg_bits(&bits, 0x7f, (8 - bits.count) & 7);
+    input->entropy[bits.size++] = 0xff;
+    input->entropy[bits.size++] = 0xd9;
+    input->entropy_size = bits.size;
+}
+
+// Deflate is the other way around, LSB first, but Huffman codes still go in MSB first.
+internal void kernel_put_zlib_bits(Kernel_Bits *bits, unsigned int value, int count)
+{
+    bits->buffer |= value << bits->count;
+    bits->count += count;
+
+    while (bits->count >= 8) {
+        bits->out[bits->size++] = static_cast<unsigned char> (bits->buffer);
+        bits->buffer >>= 8;
+        bits->count -= 8;
+    }
+}
+
+internal void kernel_put_zlib_code(Kernel_Bits *bits, unsigned int code, int length)
+{
+    unsigned int reversed = 0;
+    for (int i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+
+    kernel_put_zlib_bits(bits, reversed, length);
+}
+
+// The fixed literal/length code from RFC 1951 3.2.6.
+internal void kernel_put_zlib_symbol(Kernel_Bits *bits, int symbol)
+{
+    if (symbol < 144) {
+        kernel_put_zlib_code(bits, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        kernel_put_zlib_code(bits, 0x190 + (symbol - 144), 9);
+    } else if (symbol < 280) {
+        kernel_put_zlib_code(bits, symbol - 256, 7);
+    } else {
+        kernel_put_zlib_code(bits, 0xc0 + (symbol - 280), 8);
+    }
+}
+
+// One fixed Huffman block. Matches are only looked for one pixel and one row back, that's where PNG's
+// filtered data repeats, and is enough to give the decoder a realistic mix of literals and copies.
+internal void kernel_deflate(Kernel_Input *input, const unsigned char *data, int size)
+{
+    Kernel_Bits bits = { input->deflated, 0, 0, 0 };
+    const int distances[2] = { 4, KERNEL_WIDTH * 4 + 1 };
+
+    bits.out[bits.size++] = 0x78; // 32K window, deflate.
+    bits.out[bits.size++] = 0x01;
+    kernel_put_zlib_bits(&bits, 1, 1); // Last block.
+    kernel_put_zlib_bits(&bits, 1, 2); // Fixed codes.
+
+    for (int i = 0; i < size;) {
+        int best_length = 0, best_distance = 0;
+        for (int d = 0; d < 2; ++d) {
+            int distance = distances[d];
+            int length = 0;
+            while (i >= distance && i + length < size && length < 258 && data[i + length] == data[i + length - distance]) {
+                ++length;
+            }
+
+            if (length > best_length) {
+                best_length = length;
+                best_distance = distance;
+            }
+        }
+
+        if (best_length < 3) {
+            kernel_put_zlib_symbol(&bits, data[i++]);
+            continue;
+        }
+
+        int code = 28;
+        while (stbi__zlength_base[code] > best_length) {
+            --code;
+        }
+        kernel_put_zlib_symbol(&bits, 257 + code);
+        kernel_put_zlib_bits(&bits, best_length - stbi__zlength_base[code], stbi__zlength_extra[code]);
+
+        code = 29;
+        while (stbi__zdist_base[code] > best_distance) {
+            --code;
+        }
+        kernel_put_zlib_code(&bits, code, 5);
+        kernel_put_zlib_bits(&bits, best_distance - stbi__zdist_base[code], stbi__zdist_extra[code]);
+
+        i += best_length;
+    }
+
+    kernel_put_zlib_symbol(&bits, 256);
+    kernel_put_zlib_bits(&bits, 0, 7); // Flush the last byte.
+
+    unsigned int a = 1, b = 0;
+    for (int i = 0; i < size; ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    unsigned int adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        bits.out[bits.size++] = static_cast<unsigned char> (adler >> shift);
+    }
+
+    input->deflated_size = bits.size;
+}
+
+internal bool kernel_create_input(Kernel_Input *input)
+{
+    *input = {};
+    size_t blocks_size = sizeof(short) * KERNEL_BLOCKS * 64;
+    size_t filtered_size = static_cast<size_t> (KERNEL_WIDTH * 4 + 1) * KERNEL_HEIGHT;
+
+    input->zigzag = static_cast<short *> (malloc(blocks_size));
+    input->blocks = static_cast<short *> (malloc(blocks_size));
+    input->out_blocks = static_cast<short *> (malloc(blocks_size));
+    input->entropy = static_cast<unsigned char *> (malloc(blocks_size * 4)); // Room for the worst case of 0xFF escapes.
+    input->jpeg = static_cast<stbi__jpeg *> (calloc(1, sizeof(stbi__jpeg)));
+    input->planes = static_cast<unsigned char *> (malloc(KERNEL_PIXELS * 3));
+    input->pixels = static_cast<unsigned char *> (malloc(KERNEL_PIXELS * 4));
+    input->filtered = static_cast<unsigned char *> (malloc(filtered_size));
+    input->deflated = static_cast<unsigned char *> (malloc(filtered_size * 2));
+    input->rgb = static_cast<unsigned char *> (malloc(KERNEL_PIXELS * 3));
+    input->rgbe = static_cast<unsigned char *> (malloc(KERNEL_PIXELS * 4));
+    input->out = static_cast<unsigned char *> (malloc(KERNEL_PIXELS * 4 * sizeof(float)));
+
+    if (!input->zigzag || !input->blocks || !input->out_blocks || !input->entropy || !input->jpeg || !input->planes ||
+        !input->pixels || !input->filtered || !input->deflated || !input->rgb || !input->rgbe || !input->out) {
+        return(false);
+    }
+
+    unsigned int seed = 0x9e3779b9;
+
+    // NOTE(Aiden): Roughly what a quality 85 photo looks like after quantisation: a wandering DC, a few
+    // larger coefficients up front and the odd small one further along.
+    int dc = 0;
+    for (int block = 0; block < KERNEL_BLOCKS; ++block) {
+        short *zigzag = &input->zigzag[block * 64];
+        dc += static_cast<int> (kernel_random(&seed) % 65) - 32;
+        dc = (dc < -1000 ? -1000 : (dc > 1000 ? 1000 : dc));
+        zigzag[0] = static_cast<short> (dc);
+
+        for (int k = 1; k < 64; ++k) {
+            int odds = 64 - k * 3;
+            int value = 0;
+            if (odds > 0 && static_cast<int> (kernel_random(&seed) % 100) < odds) {
+                value = 1 + static_cast<int> (kernel_random(&seed) % (2 + 48 / k));
+                value = (kernel_random(&seed) & 1 ? -value : value);
+            }
+            zigzag[k] = static_cast<short> (value);
+        }
+
+        for (int k = 0; k < 64; ++k) {
+            input->blocks[block * 64 + stbi__jpeg_dezigzag[k]] = zigzag[k];
+        }
+    }
+
+    stbi__jpeg *jpeg = input->jpeg;
+    memcpy(jpeg->huff_dc[0].values, KERNEL_DC_VALUES, sizeof(KERNEL_DC_VALUES));
+    memcpy(jpeg->huff_ac[0].values, KERNEL_AC_VALUES, sizeof(KERNEL_AC_VALUES));
+    if (!stbi__build_huffman(&jpeg->huff_dc[0], KERNEL_DC_COUNTS) || !stbi__build_huffman(&jpeg->huff_ac[0], KERNEL_AC_COUNTS)) {
+        return(false);
+    }
+    stbi__build_fast_ac(jpeg->fast_ac[0], &jpeg->huff_ac[0]);
+
+    for (int i = 0; i < 64; ++i) {
+        jpeg->dequant[0][i] = 1;
+    }
+
+    kernel_encode_blocks(input);
+
+    for (int i = 0; i < KERNEL_PIXELS * 3; ++i) {
+        input->planes[i] = static_cast<unsigned char> (kernel_random(&seed));
+        input->rgb[i] = static_cast<unsigned char> (kernel_random(&seed));
+    }
+
+    for (int i = 0; i < KERNEL_PIXELS * 4; ++i) {
+        input->rgbe[i] = static_cast<unsigned char> (kernel_random(&seed));
+    }
+
+    // A smooth gradient with a little noise, so the filtered bytes are small but not all the same.
+    for (int y = 0; y < KERNEL_HEIGHT; ++y) {
+        for (int x = 0; x < KERNEL_WIDTH; ++x) {
+            unsigned char *pixel = &input->pixels[(y * KERNEL_WIDTH + x) * 4];
+            pixel[0] = static_cast<unsigned char> (x / 4 + (kernel_random(&seed) & 3));
+            pixel[1] = static_cast<unsigned char> (y + (kernel_random(&seed) & 3));
+            pixel[2] = static_cast<unsigned char> ((x + y) / 5);
+            pixel[3] = 255;
+        }
+    }
+
+    // Paeth everywhere. stb_image treats the first row as if the one above it was all zero.
+    for (int y = 0; y < KERNEL_HEIGHT; ++y) {
+        unsigned char *row = &input->filtered[y * (KERNEL_WIDTH * 4 + 1)];
+        const unsigned char *current = &input->pixels[y * KERNEL_WIDTH * 4];
+        const unsigned char *above = (y ? current - KERNEL_WIDTH * 4 : NULL);
+        row[0] = STBI__F_paeth;
+
+        for (int i = 0; i < KERNEL_WIDTH * 4; ++i) {
+            int a = (i >= 4 ? current[i - 4] : 0);
+            int b = (above ? above[i] : 0);
+            int c = (above && i >= 4 ? above[i - 4] : 0);
+            row[1 + i] = static_cast<unsigned char> (current[i] - stbi__paeth(a, b, c));
+        }
+    }
+
+    kernel_deflate(input, input->filtered, static_cast<int> (filtered_size));
+    return(true);
+}
+
+internal void kernel_destroy_input(Kernel_Input *input)
+{
+    free(input->zigzag);
+    free(input->blocks);
+    free(input->out_blocks);
+    free(input->entropy);
+    free(input->jpeg);
+    free(input->planes);
+    free(input->pixels);
+    free(input->filtered);
+    free(input->deflated);
+    free(input->rgb);
+    free(input->rgb_copy);
+    free(input->rgbe);
+    free(input->out);
+    *input = {};
+}
+
+internal void kernel_idct(Kernel_Input *input, void (*idct)(stbi_uc *out, int out_stride, short data[64]))
+{
+    // Each block goes to its place in a KERNEL_WIDTH wide image, like the decoder's output.
+    for (int block = 0; block < KERNEL_BLOCKS; ++block) {
+        int bx = block % (KERNEL_WIDTH / 8), by = block / (KERNEL_WIDTH / 8);
+        idct(input->out + (by * 8) * KERNEL_WIDTH + bx * 8, KERNEL_WIDTH, &input->blocks[block * 64]);
+    }
+}
+
+internal void kernel_idct_block(Kernel_Input *input) { kernel_idct(input, stbi__idct_block); }
+
+internal void kernel_ycbcr(Kernel_Input *input, void (*convert)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step))
+{
+    const unsigned char *y = input->planes;
+    const unsigned char *cb = y + KERNEL_PIXELS;
+    const unsigned char *cr = cb + KERNEL_PIXELS;
+
+    for (int row = 0; row < KERNEL_HEIGHT; ++row) {
+        int offset = row * KERNEL_WIDTH;
+        convert(input->out + offset * 4, y + offset, cb + offset, cr + offset, KERNEL_WIDTH, 4);
+    }
+}
+
+internal void kernel_ycbcr_row(Kernel_Input *input) { kernel_ycbcr(input, stbi__YCbCr_to_RGB_row); }
+
+// 2x2 upsampling, KERNEL_WIDTH output pixels per row from half as many input samples.
+internal void kernel_resample(Kernel_Input *input, stbi_uc *(*resample)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs))
+{
+    // The far row is the input row on the other side of the output row, clamped at the edges.
+    for (int row = 0; row < KERNEL_HEIGHT; ++row) {
+        int near_y = row / 2;
+        int far_y = ((row & 1) ? MIN(near_y + 1, KERNEL_HEIGHT / 2 - 1) : (near_y > 0 ? near_y - 1 : 0));
+        resample(input->out + row * KERNEL_WIDTH, input->planes + near_y * (KERNEL_WIDTH / 2),
+                 input->planes + far_y * (KERNEL_WIDTH / 2), KERNEL_WIDTH / 2, 2);
+    }
+}
+
+internal void kernel_resample_hv_2(Kernel_Input *input) { kernel_resample(input, stbi__resample_row_hv_2); }
+
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+internal void kernel_idct_simd(Kernel_Input *input) { kernel_idct(input, stbi__idct_simd); }
+internal void kernel_ycbcr_simd(Kernel_Input *input) { kernel_ycbcr(input, stbi__YCbCr_to_RGB_simd); }
+internal void kernel_resample_hv_2_simd(Kernel_Input *input) { kernel_resample(input, stbi__resample_row_hv_2_simd); }
+#endif
+
+internal void kernel_decode_block_prepare(Kernel_Input *input)
+{
+    stbi__start_mem(&input->context, input->entropy, input->entropy_size);
+    input->jpeg->s = &input->context;
+    stbi__jpeg_reset(input->jpeg);
+}
+
+internal void kernel_decode_block(Kernel_Input *input)
+{
+    stbi__jpeg *jpeg = input->jpeg;
+    for (int block = 0; block < KERNEL_BLOCKS; ++block) {
+        stbi__jpeg_decode_block(jpeg, &input->out_blocks[block * 64], &jpeg->huff_dc[0], &jpeg->huff_ac[0], jpeg->fast_ac[0], 0, jpeg->dequant[0]);
+    }
+}
+
+// The whole row reconstruction of stb_image's PNG loader, every row Paeth filtered.
+internal void kernel_paeth_unfilter_with(Kernel_Input *input, int premultiply)
+{
+    stbi__context context = {};
+    context.img_n = 4;
+
+    stbi__png png = {};
+    png.s = &context;
+    png.premultiply = premultiply;
+
+    stbi__uint32 size = static_cast<stbi__uint32> ((KERNEL_WIDTH * 4 + 1) * KERNEL_HEIGHT);
+    if (stbi__create_png_image_raw(&png, input->filtered, size, 4, KERNEL_WIDTH, KERNEL_HEIGHT, 8, 6)) {
+        memcpy(input->out, png.out, KERNEL_PIXELS * 4);
+    }
+
+    STBI_FREE(png.out);
+}
+
+internal void kernel_paeth_unfilter(Kernel_Input *input)
+{
+    kernel_paeth_unfilter_with(input, 0);
+}
+
+// The same with every row premultiplied right after the next one is unfiltered, what RGBA PNGs decoded for
+// the viewer go through.
+internal void kernel_paeth_unfilter_premultiply(Kernel_Input *input)
+{
+    kernel_paeth_unfilter_with(input, 1);
+}
+
+internal void kernel_premultiply_prepare(Kernel_Input *input)
+{
+    memcpy(input->out, input->pixels, KERNEL_PIXELS * 4);
+}
+
+// The pass anything that wasn't premultiplied while decoding gets at the end.
+internal void kernel_premultiply(Kernel_Input *input)
+{
+    stbi__premultiply(input->out, KERNEL_PIXELS, 4);
+}
+
+internal void kernel_zlib(Kernel_Input *input)
+{
+    stbi_zlib_decode_buffer(reinterpret_cast<char *> (input->out), (KERNEL_WIDTH * 4 + 1) * KERNEL_HEIGHT,
+                            reinterpret_cast<const char *> (input->deflated), input->deflated_size);
+}
+
+internal void kernel_convert_format_prepare(Kernel_Input *input)
+{
+    free(input->rgb_copy);
+    input->rgb_copy = static_cast<unsigned char *> (malloc(KERNEL_PIXELS * 3));
+    if (input->rgb_copy) {
+        memcpy(input->rgb_copy, input->rgb, KERNEL_PIXELS * 3);
+    }
+}
+
+// RGB to RGBA, what every JPEG without an alpha channel goes through when RGBA is asked for.
+internal void kernel_convert_format(Kernel_Input *input)
+{
+    if (input->rgb_copy == NULL) {
+        return;
+    }
+
+    unsigned char *rgba = stbi__convert_format(input->rgb_copy, 3, 4, KERNEL_WIDTH, KERNEL_HEIGHT);
+    input->rgb_copy = NULL; // Freed by stb_image.
+    STBI_FREE(rgba);
+}
+
+internal void kernel_hdr_convert(Kernel_Input *input)
+{
+    float *out = reinterpret_cast<float *> (input->out);
+    for (int i = 0; i < KERNEL_PIXELS; ++i) {
+        stbi__hdr_convert(out + i * 3, input->rgbe + i * 4, 3);
+    }
+}
+
+global const Kernel KERNELS[] = {
+    { "idct_block", NULL, kernel_idct_block },
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+    { "idct_simd", NULL, kernel_idct_simd },
+#endif
+    { "ycbcr_to_rgb_row", NULL, kernel_ycbcr_row },
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+    { "ycbcr_to_rgb_simd", NULL, kernel_ycbcr_simd },
+#endif
+    { "resample_row_hv_2", NULL, kernel_resample_hv_2 },
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+    { "resample_row_hv_2_simd", NULL, kernel_resample_hv_2_simd },
+#endif
+    { "jpeg_decode_block", kernel_decode_block_prepare, kernel_decode_block },
+    { "png_paeth_unfilter", NULL, kernel_paeth_unfilter },
+    { "png_paeth_premultiply", NULL, kernel_paeth_unfilter_premultiply },
+    { "premultiply_rgba", kernel_premultiply_prepare, kernel_premultiply },
+    { "zlib_inflate", NULL, kernel_zlib },
+    { "convert_format_rgb_rgba", kernel_convert_format_prepare, kernel_convert_format },
+    { "hdr_convert", NULL, kernel_hdr_convert },
+};
+
+// The synthetic data is only worth timing if the kernels decode it to what it was made from.
+internal bool kernel_check_input(Kernel_Input *input)
+{
+    kernel_decode_block_prepare(input);
+    kernel_decode_block(input);
+    if (memcmp(input->out_blocks, input->blocks, sizeof(short) * KERNEL_BLOCKS * 64) != 0) {
+        fprintf(stderr, "jpeg_decode_block: the synthetic scan doesn't decode to its coefficients\n");
+        return(false);
+    }
+
+    kernel_zlib(input);
+    if (memcmp(input->out, input->filtered, (KERNEL_WIDTH * 4 + 1) * KERNEL_HEIGHT) != 0) {
+        fprintf(stderr, "zlib_inflate: the synthetic stream doesn't inflate to its data\n");
+        return(false);
+    }
+
+    kernel_paeth_unfilter(input);
+    if (memcmp(input->out, input->pixels, KERNEL_PIXELS * 4) != 0) {
+        fprintf(stderr, "png_paeth_unfilter: the synthetic rows don't unfilter to the image\n");
+        return(false);
+    }
+
+    return(true);
+}
+
+// Finds "name": {"cycles_per_pixel": x in a file written by kernel_write_json(), 0.0 if it isn't there.
+internal double kernel_baseline(const char *json, const char *name)
+{
+    char key[128];
+    snprintf(key, sizeof(key), "\"%s\"", name);
+
+    const char *entry = (json ? strstr(json, key) : NULL);
+    const char *value = (entry ? strstr(entry, "\"cycles_per_pixel\":") : NULL);
+
+    return(value ? strtod(value + strlen("\"cycles_per_pixel\":"), NULL) : 0.0);
+}
+
+internal char *kernel_read_file(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return(NULL);
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *text = static_cast<char *> (malloc(static_cast<size_t> (size) + 1));
+    if (text) {
+        size_t read = fread(text, 1, static_cast<size_t> (size), file);
+        text[read] = '\0';
+    }
+
+    fclose(file);
+    return(text);
+}
+
+internal void kernel_write_json(FILE *file, int runs, const double *cycles, const double *nanoseconds)
+{
+    fprintf(file, "{\n  \"runs\": %d,\n  \"pixels_per_run\": %d,\n  \"cycle_counter\": \"%s\",\n  \"kernels\": {",
+            runs, KERNEL_PIXELS,
+#ifdef KERNEL_TSC
+            "tsc"
+#else
+            "nanoseconds"
+#endif
+            );
+
+    for (int i = 0; i < static_cast<int> (ARR_LEN(KERNELS)); ++i) {
+        fprintf(file, "%s\n    \"%s\": {\"cycles_per_pixel\": %.4f, \"ns_per_pixel\": %.4f}",
+                (i ? "," : ""), KERNELS[i].name, cycles[i], nanoseconds[i]);
+    }
+
+    fprintf(file, "\n  }\n}\n");
+}
+
+internal int bench_kernels(int runs, const char *json_filename, const char *baseline_filename)
+{
+    char *baseline = NULL;
+    if (baseline_filename) {
+        baseline = kernel_read_file(baseline_filename);
+        if (baseline == NULL) {
+            fprintf(stderr, "%s: could not read the baseline\n", baseline_filename);
+            return(1);
+        }
+    }
+
+    Kernel_Input input;
+    if (!kernel_create_input(&input) || !kernel_check_input(&input)) {
+        kernel_destroy_input(&input);
+        free(baseline);
+        return(1);
+    }
+
+    double cycles[ARR_LEN(KERNELS)];
+    double nanoseconds[ARR_LEN(KERNELS)];
+    int regressions = 0;
+
+    printf("%d pixels per run, best of %d runs\n\n", KERNEL_PIXELS, runs);
+    printf("%-24s %12s %10s", "kernel", "cycles/px", "ns/px");
+    if (baseline) {
+        printf(" %12s %8s", "baseline", "change");
+    }
+    printf("\n");
+
+    for (int i = 0; i < static_cast<int> (ARR_LEN(KERNELS)); ++i) {
+        const Kernel *kernel = &KERNELS[i];
+        unsigned long long best_cycles = 0;
+        double best_seconds = 0.0;
+
+        // One untimed run first so the buffers are paged in and warm.
+        for (int run = -1; run < runs; ++run) {
+            if (kernel->prepare) {
+                kernel->prepare(&input);
+            }
+
+            double start_seconds = bench_seconds();
+            unsigned long long start = kernel_cycles();
+            kernel->run(&input);
+            unsigned long long elapsed = kernel_cycles() - start;
+            double seconds = bench_seconds() - start_seconds;
+
+            if (run == 0 || (run > 0 && elapsed < best_cycles)) {
+                best_cycles = elapsed;
+            }
+            if (run == 0 || (run > 0 && seconds < best_seconds)) {
+                best_seconds = seconds;
+            }
+        }
+
+        cycles[i] = static_cast<double> (best_cycles) / KERNEL_PIXELS;
+        nanoseconds[i] = best_seconds * 1e9 / KERNEL_PIXELS;
+        printf("%-24s %12.3f %10.3f", kernel->name, cycles[i], nanoseconds[i]);
+
+        double reference = kernel_baseline(baseline, kernel->name);
+        if (baseline && reference > 0.0) {
+            double change = cycles[i] / reference - 1.0;
+            bool regressed = (change > KERNEL_REGRESSION);
+            regressions += (regressed ? 1 : 0);
+            printf(" %12.3f %+7.1f%% %s", reference, change * 100.0, regressed ? "SLOWER" : "");
+        } else if (baseline) {
+            printf(" %12s %8s", "-", "-");
+        }
+        printf("\n");
+    }
+
+    int result = (regressions ? 1 : 0);
+    if (json_filename) {
+        FILE *file = fopen(json_filename, "w");
+        if (file) {
+            kernel_write_json(file, runs, cycles, nanoseconds);
+            fclose(file);
+        } else {
+            fprintf(stderr, "%s: could not write the results\n", json_filename);
+            result = 1;
+        }
+    }
+
+    kernel_destroy_input(&input);
+    free(baseline);
+    return(result);
+}
@@ -0,0 +1,422 @@
+// Speed and quality of resample.cpp. Part of simpimg_bench, see bench.cpp for the usage.
+//
+// Speed: a noise image shrunk by 2 and by 8 with every filter, for each pixel format the resampler takes,
+// on one thread and on the job system. The naive per-pixel filter it's compared to evaluates the 2D kernel for
+// every source pixel under every output pixel (what a straightforward implementation does), in doubles. It's
+// far too slow to run on the whole image, so it only does the first rows and its time is scaled up. Those
+// rows also give the accuracy: the largest difference between the two, in 8 or 16-bit steps.
+//
+// Quality: a zone plate (rings getting finer towards the edges, up to the source's Nyquist frequency) shrunk
+// by 8. Where the rings are finer than the output can show, an ideal filter gives flat grey and whatever is
+// left there is aliasing. Where they're coarse, an ideal filter keeps them as they are, what's left of their
+// contrast is the sharpness. Point sampling (no filter at all) is there for comparison.
+//
+// Premultiplied alpha: noise with every kind of alpha (0 and opaque included) through the mip filters and the
+// resampler in linear light, where no colour may come out above its alpha. And translucent white next to
+// transparent pixels, which has to stay white, anything else is a dark or bright fringe.
+
+#define RESAMPLE_BENCH_WIDTH 4096
+#define RESAMPLE_BENCH_HEIGHT 2048
+#define RESAMPLE_BENCH_NAIVE_ROWS 4
+#define RESAMPLE_BENCH_RUNS 3
+#define RESAMPLE_BENCH_PLATE 2048
+#define RESAMPLE_BENCH_PLATE_SCALE 8
+#define RESAMPLE_BENCH_PREMULTIPLIED_SIZE 256
+
+struct Resample_Bench_Format
+{
+    const char *name;
+    int channels;
+    Resample_Depth depth;
+    bool linear_light;
+};
+
+global const Resample_Bench_Format RESAMPLE_BENCH_FORMATS[] = {
+    { "rgba8",        4, RESAMPLE_8_BIT,  false },
+    { "rgba8 linear", 4, RESAMPLE_8_BIT,  true },
+    { "rgb8",         3, RESAMPLE_8_BIT,  false },
+    { "grey8",        1, RESAMPLE_8_BIT,  false },
+    { "rgba16",       4, RESAMPLE_16_BIT, false },
+};
+
+// Either a mip level (mip_downsample()) or the resampler shrinking by 3.
+struct Resample_Bench_Premultiplied
+{
+    const char *name;
+    int channels;
+    Resample_Depth depth;
+    bool mip;
+    Mip_Filter mip_filter;
+    Resample_Filter filter;
+};
+
+global const Resample_Bench_Premultiplied RESAMPLE_BENCH_PREMULTIPLIED[] = {
+    { "mip box",       4, RESAMPLE_8_BIT,  true,  MIP_FILTER_BOX,      RESAMPLE_BOX },
+    { "mip box",       2, RESAMPLE_8_BIT,  true,  MIP_FILTER_BOX,      RESAMPLE_BOX },
+    { "mip lanczos3",  4, RESAMPLE_8_BIT,  true,  MIP_FILTER_LANCZOS,  RESAMPLE_LANCZOS3 },
+    { "mip mitchell",  4, RESAMPLE_8_BIT,  true,  MIP_FILTER_MITCHELL, RESAMPLE_MITCHELL },
+    { "box /3",        4, RESAMPLE_8_BIT,  false, MIP_FILTER_BOX,      RESAMPLE_BOX },
+    { "kaiser /3",     4, RESAMPLE_8_BIT,  false, MIP_FILTER_BOX,      RESAMPLE_KAISER },
+    { "lanczos3 /3",   2, RESAMPLE_8_BIT,  false, MIP_FILTER_BOX,      RESAMPLE_LANCZOS3 },
+    { "lanczos3 /3",   4, RESAMPLE_16_BIT, false, MIP_FILTER_BOX,      RESAMPLE_LANCZOS3 },
+};
+
+global const Resample_Filter RESAMPLE_BENCH_FILTERS[] = { RESAMPLE_BOX, RESAMPLE_MITCHELL, RESAMPLE_LANCZOS3, RESAMPLE_KAISER };
+global const char *RESAMPLE_BENCH_FILTER_NAMES[] = { "box", "mitchell", "lanczos3", "kaiser" };
+
+internal inline double resample_bench_sample(const void *pixels, int depth_max, int index)
+{
+    return(depth_max == 255 ? static_cast<const unsigned char *> (pixels)[index] : static_cast<const unsigned short *> (pixels)[index]);
+}
+
+// The straightforward way: for each output pixel and each source pixel under its footprint, evaluate the kernel
+// in both directions. Returns the largest difference to 'expected' over the rows it did.
+internal double resample_bench_naive(const void *src, int width, int height, int channels, Resample_Depth depth, bool linear_light,
+                                     Resample_Filter filter, int dst_width, int dst_height, int rows, const void *expected)
+{
+    int depth_max = (depth == RESAMPLE_8_BIT ? 255 : 65535);
+    bool has_alpha = (channels == 2 || channels == 4);
+
+    double scale_x = static_cast<double> (width) / dst_width;
+    double scale_y = static_cast<double> (height) / dst_height;
+    double filter_x = (scale_x > 1.0 ? scale_x : 1.0);
+    double filter_y = (scale_y > 1.0 ? scale_y : 1.0);
+    double support_x = resample_support(filter) * filter_x + 1.0;
+    double support_y = resample_support(filter) * filter_y + 1.0;
+
+    double largest = 0.0;
+
+    for (int y = 0; y < rows; ++y) {
+        double center_y = (y + 0.5) * scale_y;
+
+        for (int x = 0; x < dst_width; ++x) {
+            double center_x = (x + 0.5) * scale_x;
+            double sum[4] = {0}, total = 0.0;
+
+            for (int sy = static_cast<int> (floor(center_y - support_y)); sy <= static_cast<int> (ceil(center_y + support_y)); ++sy) {
+                for (int sx = static_cast<int> (floor(center_x - support_x)); sx <= static_cast<int> (ceil(center_x + support_x)); ++sx) {
+                    double weight;
+                    if (filter == RESAMPLE_BOX) {
+                        double wx = MIN(sx + 1.0, center_x + 0.5 * filter_x) - (sx > center_x - 0.5 * filter_x ? sx : center_x - 0.5 * filter_x);
+                        double wy = MIN(sy + 1.0, center_y + 0.5 * filter_y) - (sy > center_y - 0.5 * filter_y ? sy : center_y - 0.5 * filter_y);
+                        weight = (wx > 0.0 && wy > 0.0 ? wx * wy : 0.0);
+                    } else {
+                        weight = resample_kernel(filter, (sx + 0.5 - center_x) / filter_x) * resample_kernel(filter, (sy + 0.5 - center_y) / filter_y);
+                    }
+
+                    if (weight == 0.0) {
+                        continue;
+                    }
+
+                    int cx = (sx < 0 ? 0 : (sx >= width ? width - 1 : sx));
+                    int cy = (sy < 0 ? 0 : (sy >= height ? height - 1 : sy));
+                    int index = (cy * width + cx) * channels;
+
+                    for (int c = 0; c < channels; ++c) {
+                        double value = resample_bench_sample(src, depth_max, index + c) / depth_max;
+                        bool alpha = (has_alpha && c == channels - 1);
+                        sum[c] += weight * (linear_light && !alpha ? srgb_to_linear(value) : value);
+                    }
+                    total += weight;
+                }
+            }
+
+            for (int c = 0; c < channels; ++c) {
+                bool alpha = (has_alpha && c == channels - 1);
+                double value = sum[c] / total;
+                value = (value < 0.0 ? 0.0 : (value > 1.0 ? 1.0 : value));
+                value = (linear_light && !alpha ? linear_to_srgb(value) : value) * depth_max;
+
+                double difference = fabs(value - resample_bench_sample(expected, depth_max, (y * dst_width + x) * channels + c));
+                largest = (difference > largest ? difference : largest);
+            }
+        }
+    }
+
+    return(largest);
+}
+
+internal double resample_bench_time(const Resample_Image *src, Resample_Image *dst, const Resample_Bench_Format *format,
+                                    const Resample_Options *options, int thread_count)
+{
+    double best = 0.0;
+    for (int run = 0; run < RESAMPLE_BENCH_RUNS; ++run) {
+        double start = bench_seconds();
+        resample(src, dst, format->channels, format->depth, options, thread_count);
+        double seconds = bench_seconds() - start;
+        best = (run == 0 || seconds < best ? seconds : best);
+    }
+
+    return(best);
+}
+
+internal int bench_resample_speed()
+{
+    size_t size = static_cast<size_t> (RESAMPLE_BENCH_WIDTH) * RESAMPLE_BENCH_HEIGHT * 4 * 2;
+    unsigned char *src = static_cast<unsigned char *> (malloc(size));
+    unsigned char *dst = static_cast<unsigned char *> (malloc(size / 4));
+    if (src == NULL || dst == NULL) {
+        free(src);
+        free(dst);
+        return(1);
+    }
+
+    // Smooth gradients with noise on top, so the filters have something to do in every channel.
+    unsigned int state = 1;
+    for (size_t i = 0; i < size; ++i) {
+        state = state * 1664525u + 1013904223u;
+        src[i] = static_cast<unsigned char> (((i / 4) % 248) + (state >> 29));
+    }
+
+    int failures = 0;
+    double source_megapixels = RESAMPLE_BENCH_WIDTH * static_cast<double> (RESAMPLE_BENCH_HEIGHT) / 1e6;
+
+    printf("%-9s %-13s %5s %10s %10s %10s %9s %8s\n", "filter", "format", "scale", "1 thread", "all", "MP/s", "vs naive", "error");
+
+    for (int f = 0; f < static_cast<int> (ARR_LEN(RESAMPLE_BENCH_FILTERS)); ++f) {
+        for (int i = 0; i < static_cast<int> (ARR_LEN(RESAMPLE_BENCH_FORMATS)); ++i) {
+            const Resample_Bench_Format *format = &RESAMPLE_BENCH_FORMATS[i];
+            Resample_Options options = { RESAMPLE_BENCH_FILTERS[f], format->linear_light };
+
+            for (int scale = 2; scale <= 8; scale *= 4) {
+                Resample_Image source = { src, RESAMPLE_BENCH_WIDTH, RESAMPLE_BENCH_HEIGHT, 0 };
+                Resample_Image destination = { dst, RESAMPLE_BENCH_WIDTH / scale, RESAMPLE_BENCH_HEIGHT / scale, 0 };
+
+                double single = resample_bench_time(&source, &destination, format, &options, 1);
+                double all = resample_bench_time(&source, &destination, format, &options, 0);
+
+                double start = bench_seconds();
+                double error = resample_bench_naive(src, source.width, source.height, format->channels, format->depth, format->linear_light,
+                                                    options.filter, destination.width, destination.height, RESAMPLE_BENCH_NAIVE_ROWS, dst);
+                double naive = (bench_seconds() - start) * destination.height / RESAMPLE_BENCH_NAIVE_ROWS;
+
+                // Floats against doubles, and the tables round linear light to 16 bits on the way out.
+                bool ok = (error <= (format->depth == RESAMPLE_8_BIT ? 1.0 : 2.0));
+                failures += (ok ? 0 : 1);
+
+                printf("%-9s %-13s %4dx %8.2f ms %7.2f ms %10.1f %8.1fx %8.2f%s\n", RESAMPLE_BENCH_FILTER_NAMES[f], format->name, scale,
+                       single * 1000.0, all * 1000.0, source_megapixels / all, naive / single, error, (ok ? "" : "  FAIL"));
+            }
+        }
+    }
+
+    free(src);
+    free(dst);
+    return(failures);
+}
+
+internal void resample_bench_plate_quality(const unsigned char *plate, const unsigned char *out, double *aliasing, double *sharpness)
+{
+    // The rings at radius r have r / PLATE cycles per source pixel (see bench_resample_quality()), so the
+    // output's Nyquist frequency of 0.5 / SCALE cycles per source pixel is at this radius.
+    int size = RESAMPLE_BENCH_PLATE / RESAMPLE_BENCH_PLATE_SCALE;
+    double nyquist_radius = 0.5 / RESAMPLE_BENCH_PLATE_SCALE * RESAMPLE_BENCH_PLATE;
+
+    double alias_sum = 0.0, pass_sum = 0.0, reference_sum = 0.0;
+    int alias_count = 0;
+
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            double dx = (x + 0.5) * RESAMPLE_BENCH_PLATE_SCALE - RESAMPLE_BENCH_PLATE / 2.0;
+            double dy = (y + 0.5) * RESAMPLE_BENCH_PLATE_SCALE - RESAMPLE_BENCH_PLATE / 2.0;
+            double r = sqrt(dx*dx + dy*dy);
+            double value = out[y * size + x] / 255.0 - 0.5;
+
+            if (r > 1.5 * nyquist_radius && r < RESAMPLE_BENCH_PLATE / 2.0) {
+                alias_sum += value * value;
+                alias_count += 1;
+            } else if (r < 0.5 * nyquist_radius) {
+                // The rings the output should keep, measured against the source at the same spot.
+                int sx = static_cast<int> ((x + 0.5) * RESAMPLE_BENCH_PLATE_SCALE);
+                int sy = static_cast<int> ((y + 0.5) * RESAMPLE_BENCH_PLATE_SCALE);
+                double reference = plate[sy * RESAMPLE_BENCH_PLATE + sx] / 255.0 - 0.5;
+                pass_sum += value * reference;
+                reference_sum += reference * reference;
+            }
+        }
+    }
+
+    // RMS of what should be flat grey, relative to the rings' own RMS (0.5 / sqrt(2)).
+    *aliasing = sqrt(alias_sum / (alias_count ? alias_count : 1)) / (0.5 / sqrt(2.0));
+    *sharpness = (reference_sum > 0.0 ? pass_sum / reference_sum : 0.0);
+}
+
+internal int bench_resample_quality()
+{
+    int size = RESAMPLE_BENCH_PLATE / RESAMPLE_BENCH_PLATE_SCALE;
+    unsigned char *plate = static_cast<unsigned char *> (malloc(static_cast<size_t> (RESAMPLE_BENCH_PLATE) * RESAMPLE_BENCH_PLATE));
+    unsigned char *out = static_cast<unsigned char *> (malloc(static_cast<size_t> (size) * size));
+    if (plate == NULL || out == NULL) {
+        free(plate);
+        free(out);
+        return(1);
+    }
+
+    // cos(pi r^2 / PLATE) has a local frequency of r / PLATE cycles per pixel, the source's Nyquist frequency
+    // at the middle of the edges.
+    const double pi = 3.14159265358979323846;
+    for (int y = 0; y < RESAMPLE_BENCH_PLATE; ++y) {
+        for (int x = 0; x < RESAMPLE_BENCH_PLATE; ++x) {
+            double dx = x + 0.5 - RESAMPLE_BENCH_PLATE / 2.0;
+            double dy = y + 0.5 - RESAMPLE_BENCH_PLATE / 2.0;
+            double value = 0.5 + 0.5 * cos(pi * (dx*dx + dy*dy) / RESAMPLE_BENCH_PLATE);
+            plate[y * RESAMPLE_BENCH_PLATE + x] = static_cast<unsigned char> (value * 255.0 + 0.5);
+        }
+    }
+
+    printf("\n%-9s %10s %10s   (zone plate shrunk %dx, aliasing: lower is better, sharpness: 1 is ideal)\n",
+           "filter", "aliasing", "sharpness", RESAMPLE_BENCH_PLATE_SCALE);
+
+    double aliasing, sharpness;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            int sx = x * RESAMPLE_BENCH_PLATE_SCALE + RESAMPLE_BENCH_PLATE_SCALE / 2;
+            int sy = y * RESAMPLE_BENCH_PLATE_SCALE + RESAMPLE_BENCH_PLATE_SCALE / 2;
+            out[y * size + x] = plate[sy * RESAMPLE_BENCH_PLATE + sx];
+        }
+    }
+
+    resample_bench_plate_quality(plate, out, &aliasing, &sharpness);
+    printf("%-9s %10.4f %10.4f\n", "point", aliasing, sharpness);
+
+    for (int f = 0; f < static_cast<int> (ARR_LEN(RESAMPLE_BENCH_FILTERS)); ++f) {
+        Resample_Options options = { RESAMPLE_BENCH_FILTERS[f], false };
+        if (!resample_8(plate, RESAMPLE_BENCH_PLATE, RESAMPLE_BENCH_PLATE, out, size, size, 1, &options, 0)) {
+            free(plate);
+            free(out);
+            return(1);
+        }
+
+        resample_bench_plate_quality(plate, out, &aliasing, &sharpness);
+        printf("%-9s %10.4f %10.4f\n", RESAMPLE_BENCH_FILTER_NAMES[f], aliasing, sharpness);
+    }
+
+    free(plate);
+    free(out);
+    return(0);
+}
+
+internal void resample_bench_store(void *pixels, int depth_max, int index, unsigned int value)
+{
+    if (depth_max == 255) {
+        static_cast<unsigned char *> (pixels)[index] = static_cast<unsigned char> (value);
+    } else {
+        static_cast<unsigned short *> (pixels)[index] = static_cast<unsigned short> (value);
+    }
+}
+
+// Premultiplied noise, or with 'white' every other column translucent white and the rest transparent.
+internal void resample_bench_premultiplied_source(void *pixels, int size, int channels, int depth_max, bool white)
+{
+    unsigned int state = 1;
+
+    for (int i = 0; i < size * size; ++i) {
+        state = state * 1664525u + 1013904223u;
+        unsigned int random = state >> 8;
+
+        unsigned int alpha, colour[3];
+        if (white) {
+            alpha = ((i % size) % 2 == 0 ? static_cast<unsigned int> (depth_max) / 2 + 1 : 0);
+            colour[0] = colour[1] = colour[2] = alpha;
+        } else {
+            switch (random & 3) {
+                case 0:  alpha = 0; break;
+                case 1:  alpha = static_cast<unsigned int> (depth_max); break;
+                default: alpha = (random >> 2) % static_cast<unsigned int> (depth_max + 1); break;
+            }
+
+            for (int c = 0; c < 3; ++c) {
+                state = state * 1664525u + 1013904223u;
+                colour[c] = resample_premultiply((state >> 8) % static_cast<unsigned int> (depth_max + 1), alpha, static_cast<unsigned int> (depth_max));
+            }
+        }
+
+        for (int c = 0; c < channels - 1; ++c) {
+            resample_bench_store(pixels, depth_max, i * channels + c, colour[c]);
+        }
+        resample_bench_store(pixels, depth_max, i * channels + channels - 1, alpha);
+    }
+}
+
+internal bool resample_bench_premultiplied_run(const Resample_Bench_Premultiplied *test, const void *src, int size, void *dst, int *dst_size)
+{
+    if (test->mip) {
+        Mip_Options options = { test->mip_filter, true, true };
+        *dst_size = size / 2;
+        return(mip_downsample(static_cast<const unsigned char *> (src), size, size, test->channels, &options, 0, static_cast<unsigned char *> (dst)));
+    }
+
+    Resample_Options options = { test->filter, true, true };
+    *dst_size = size / 3;
+    Resample_Image source = { const_cast<void *> (src), size, size, 0 };
+    Resample_Image destination = { dst, *dst_size, *dst_size, 0 };
+    return(resample(&source, &destination, test->channels, test->depth, &options, 0));
+}
+
+internal int bench_resample_premultiplied()
+{
+    int size = RESAMPLE_BENCH_PREMULTIPLIED_SIZE;
+    size_t bytes = static_cast<size_t> (size) * size * 4 * 2;
+    void *src = malloc(bytes);
+    void *dst = malloc(bytes);
+    if (src == NULL || dst == NULL) {
+        free(src);
+        free(dst);
+        return(1);
+    }
+
+    printf("\n%-14s %-6s %12s %12s   (premultiplied in linear light, colour above alpha: in steps, white fringe: in steps)\n",
+           "filter", "format", "above alpha", "fringe");
+
+    int failures = 0;
+    for (int i = 0; i < static_cast<int> (ARR_LEN(RESAMPLE_BENCH_PREMULTIPLIED)); ++i) {
+        const Resample_Bench_Premultiplied *test = &RESAMPLE_BENCH_PREMULTIPLIED[i];
+        int depth_max = (test->depth == RESAMPLE_8_BIT ? 255 : 65535);
+        int channels = test->channels;
+
+        // Worst colour above its alpha in the noise, worst distance between colour and alpha in the white.
+        double largest[2] = {};
+        bool ran = true;
+
+        for (int white = 0; white < 2; ++white) {
+            resample_bench_premultiplied_source(src, size, channels, depth_max, white != 0);
+
+            int dst_size;
+            ran = ran && resample_bench_premultiplied_run(test, src, size, dst, &dst_size);
+
+            for (int p = 0; ran && p < dst_size * dst_size; ++p) {
+                double alpha = resample_bench_sample(dst, depth_max, p * channels + channels - 1);
+                for (int c = 0; c < channels - 1; ++c) {
+                    double colour = resample_bench_sample(dst, depth_max, p * channels + c);
+                    double error = (white ? fabs(colour - alpha) : colour - alpha);
+                    largest[white] = (error > largest[white] ? error : largest[white]);
+                }
+            }
+        }
+
+        bool ok = (ran && largest[0] <= 0.0 && largest[1] <= 1.0);
+        failures += (ok ? 0 : 1);
+
+        printf("%-14s %-6s %12.0f %12.0f%s\n", test->name, (channels == 2 ? (depth_max == 255 ? "ga8" : "ga16") : (depth_max == 255 ? "rgba8" : "rgba16")),
+               largest[0], largest[1], (ok ? "" : "  FAIL"));
+    }
+
+    free(src);
+    free(dst);
+    return(failures);
+}
+
+internal int bench_resample()
+{
+    job_system = job_system_create(-1);
+    printf("%d job workers plus the calling thread\n\n", job_system->worker_count);
+
+    int failures = bench_resample_speed();
+    failures += bench_resample_quality();
+    failures += bench_resample_premultiplied();
+
+    job_system_destroy(job_system);
+    job_system = NULL;
+
+    return(failures == 0 ? 0 : 1);
+}
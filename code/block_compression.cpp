@@ -0,0 +1,516 @@
+// BC1 / BC7 block compression, used to keep large images in VRAM at a fraction of their size.
+//
+// Both encoders work on a 4x4 block of RGBA8 pixels: the endpoints are picked along the
+// principal axis of the block's colours and every pixel then gets the closest palette entry.
+// BC7 only uses mode 6 (single subset, RGBA 7.7.7.7 + p-bit, 4-bit indices), which is plenty
+// for browsing-quality display and keeps the encoder small.
+
+#define BC1_BLOCK_BYTES 8
+#define BC7_BLOCK_BYTES 16
+#define BLOCK_PIXELS 16
+#define MAX_TEXTURE_LEVELS 32
+
+// NOTE(Aiden): Values are stored in cache entries, only ever append to this.
+// We only encode BC1 and BC7 ourselves, the rest can come from DDS/KTX2 files.
+enum Block_Format
+{
+    BLOCK_FORMAT_BC1 = 1,
+    BLOCK_FORMAT_BC7 = 2,
+    BLOCK_FORMAT_BC1_ALPHA = 3,
+    BLOCK_FORMAT_BC2 = 4,
+    BLOCK_FORMAT_BC3 = 5,
+    BLOCK_FORMAT_BC4 = 6,
+    BLOCK_FORMAT_BC5 = 7,
+    BLOCK_FORMAT_BC6H_UNSIGNED = 8,
+    BLOCK_FORMAT_BC6H_SIGNED = 9,
+};
+
+struct Compressed_Image
+{
+    Block_Format format;
+    int width;
+    int height;
+    int levels;
+
+    unsigned char *data;
+    size_t data_size;
+    
+    // Relative to 'data', level 0 is the full resolution image.
+    size_t level_offsets[MAX_TEXTURE_LEVELS];
+
+    // Colours already multiplied by alpha, containers say so in their headers.
+    bool premultiplied;
+};
+
+global const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+internal inline int block_format_bytes(Block_Format format)
+{
+    switch (format) {
+        case BLOCK_FORMAT_BC1:
+        case BLOCK_FORMAT_BC1_ALPHA:
+        case BLOCK_FORMAT_BC4:
+            return(BC1_BLOCK_BYTES);
+        default:
+            return(BC7_BLOCK_BYTES);
+    }
+}
+
+internal unsigned int block_format_gl(Block_Format format)
+{
+    switch (format) {
+        case BLOCK_FORMAT_BC1:           return(GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+        case BLOCK_FORMAT_BC1_ALPHA:     return(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT);
+        case BLOCK_FORMAT_BC2:           return(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT);
+        case BLOCK_FORMAT_BC3:           return(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+        case BLOCK_FORMAT_BC4:           return(GL_COMPRESSED_RED_RGTC1);
+        case BLOCK_FORMAT_BC5:           return(GL_COMPRESSED_RG_RGTC2);
+        case BLOCK_FORMAT_BC6H_UNSIGNED: return(GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT);
+        case BLOCK_FORMAT_BC6H_SIGNED:   return(GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT);
+        case BLOCK_FORMAT_BC7:           return(GL_COMPRESSED_RGBA_BPTC_UNORM);
+    }
+
+    return(0);
+}
+
+// RGTC (BC4/BC5) is core since 3.3, the rest depend on the driver.
+internal bool block_format_supported(Block_Format format)
+{
+    switch (format) {
+        case BLOCK_FORMAT_BC1:
+        case BLOCK_FORMAT_BC1_ALPHA:
+        case BLOCK_FORMAT_BC2:
+        case BLOCK_FORMAT_BC3:
+            return(GLEW_EXT_texture_compression_s3tc);
+        case BLOCK_FORMAT_BC6H_UNSIGNED:
+        case BLOCK_FORMAT_BC6H_SIGNED:
+        case BLOCK_FORMAT_BC7:
+            return(GLEW_ARB_texture_compression_bptc);
+        default:
+            return(true);
+    }
+}
+
+internal inline size_t block_level_size(Block_Format format, int width, int height)
+{
+    size_t blocks_x = (width + 3) / 4;
+    size_t blocks_y = (height + 3) / 4;
+
+    return(blocks_x * blocks_y * block_format_bytes(format));
+}
+
+internal inline int mip_level_count(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = (width > 1 ? width / 2 : 1);
+        height = (height > 1 ? height / 2 : 1);
+        levels += 1;
+    }
+
+    return(levels);
+}
+
+// For images whose levels are stored back to back, returns the total size.
+internal size_t compute_level_offsets(Compressed_Image *image)
+{
+    size_t offset = 0;
+
+    for (int level = 0, w = image->width, h = image->height; level < image->levels; ++level) {
+        image->level_offsets[level] = offset;
+        offset += block_level_size(image->format, w, h);
+        w = (w > 1 ? w / 2 : 1);
+        h = (h > 1 ? h / 2 : 1);
+    }
+
+    return(offset);
+}
+
+internal inline int clamp_byte(float value)
+{
+    int v = static_cast<int> (value + 0.5f);
+    return(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+internal void block_principal_axis(const unsigned char *block, int channels, float *mean, float *axis)
+{
+    float cov[4][4] = {0};
+
+    for (int c = 0; c < 4; ++c) {
+        mean[c] = 0.0f;
+        axis[c] = (c < channels ? 1.0f : 0.0f);
+    }
+
+    for (int i = 0; i < BLOCK_PIXELS; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            mean[c] += block[i*4 + c];
+        }
+    }
+
+    for (int c = 0; c < channels; ++c) {
+        mean[c] /= BLOCK_PIXELS;
+    }
+
+    for (int i = 0; i < BLOCK_PIXELS; ++i) {
+        float d[4];
+        for (int c = 0; c < channels; ++c) {
+            d[c] = block[i*4 + c] - mean[c];
+        }
+
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                cov[a][b] += d[a] * d[b];
+            }
+        }
+    }
+
+    // NOTE(Aiden): Power iteration converges fast enough for a 4x4 matrix,
+    // a handful of steps gives an axis that's indistinguishable from the real one.
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {0};
+        float length = 0.0f;
+
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                next[a] += cov[a][b] * axis[b];
+            }
+            length += next[a] * next[a];
+        }
+
+        if (length < 1e-8f) {
+            break;
+        }
+
+        length = 1.0f / sqrtf(length);
+        for (int c = 0; c < channels; ++c) {
+            axis[c] = next[c] * length;
+        }
+    }
+}
+
+internal void block_axis_extents(const unsigned char *block, int channels, float *low, float *high)
+{
+    float mean[4], axis[4];
+    block_principal_axis(block, channels, mean, axis);
+
+    float t_min = 0.0f;
+    float t_max = 0.0f;
+
+    for (int i = 0; i < BLOCK_PIXELS; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            t += (block[i*4 + c] - mean[c]) * axis[c];
+        }
+
+        if (t < t_min) t_min = t;
+        if (t > t_max) t_max = t;
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        low[c] = (c < channels ? mean[c] + axis[c] * t_min : 255.0f);
+        high[c] = (c < channels ? mean[c] + axis[c] * t_max : 255.0f);
+    }
+}
+
+internal inline unsigned short pack_565(const float *color)
+{
+    int r = (clamp_byte(color[0]) * 31 + 127) / 255;
+    int g = (clamp_byte(color[1]) * 63 + 127) / 255;
+    int b = (clamp_byte(color[2]) * 31 + 127) / 255;
+
+    return(static_cast<unsigned short> ((r << 11) | (g << 5) | b));
+}
+
+internal inline void unpack_565(unsigned short packed, int *color)
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+internal void encode_bc1_block(const unsigned char *block, unsigned char *out)
+{
+    float low[4], high[4];
+    block_axis_extents(block, 3, low, high);
+
+    unsigned short color0 = pack_565(high);
+    unsigned short color1 = pack_565(low);
+
+    // color0 > color1 selects the 4-colour (opaque) mode.
+    if (color0 < color1) {
+        unsigned short temp = color0;
+        color0 = color1;
+        color1 = temp;
+    }
+
+    unsigned int indices = 0;
+
+    if (color0 != color1) {
+        int palette[4][3];
+        unpack_565(color0, palette[0]);
+        unpack_565(color1, palette[1]);
+
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < BLOCK_PIXELS; ++i) {
+            int best = 0;
+            int best_error = INT_MAX;
+
+            for (int p = 0; p < 4; ++p) {
+                int error = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int d = block[i*4 + c] - palette[p][c];
+                    error += d * d;
+                }
+
+                if (error < best_error) {
+                    best_error = error;
+                    best = p;
+                }
+            }
+
+            indices |= static_cast<unsigned int> (best) << (i * 2);
+        }
+    }
+
+    out[0] = static_cast<unsigned char> (color0 & 0xFF);
+    out[1] = static_cast<unsigned char> (color0 >> 8);
+    out[2] = static_cast<unsigned char> (color1 & 0xFF);
+    out[3] = static_cast<unsigned char> (color1 >> 8);
+    out[4] = static_cast<unsigned char> (indices & 0xFF);
+    out[5] = static_cast<unsigned char> ((indices >> 8) & 0xFF);
+    out[6] = static_cast<unsigned char> ((indices >> 16) & 0xFF);
+    out[7] = static_cast<unsigned char> (indices >> 24);
+}
+
+internal inline void write_bits(unsigned char *out, int *position, unsigned int value, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        int bit = *position + i;
+        if ((value >> i) & 1) {
+            out[bit / 8] |= static_cast<unsigned char> (1 << (bit % 8));
+        }
+    }
+
+    *position += count;
+}
+
+// Quantize an endpoint to 7 bits per channel plus a shared p-bit, picking the p-bit that rounds best.
+internal void quantize_bc7_endpoint(const float *color, int *quantized, int *pbit)
+{
+    int best_error = INT_MAX;
+
+    for (int p = 0; p < 2; ++p) {
+        int q[4];
+        int error = 0;
+
+        for (int c = 0; c < 4; ++c) {
+            int v = clamp_byte(color[c]);
+            q[c] = (v - p + 1) / 2;
+            if (q[c] > 127) q[c] = 127;
+            if (q[c] < 0) q[c] = 0;
+
+            int d = ((q[c] << 1) | p) - v;
+            error += d * d;
+        }
+
+        if (error < best_error) {
+            best_error = error;
+            *pbit = p;
+            for (int c = 0; c < 4; ++c) {
+                quantized[c] = q[c];
+            }
+        }
+    }
+}
+
+internal void encode_bc7_block(const unsigned char *block, unsigned char *out)
+{
+    float low[4], high[4];
+    block_axis_extents(block, 4, low, high);
+
+    int q[2][4];
+    int pbits[2];
+    quantize_bc7_endpoint(low, q[0], &pbits[0]);
+    quantize_bc7_endpoint(high, q[1], &pbits[1]);
+
+    int endpoints[2][4];
+    for (int e = 0; e < 2; ++e) {
+        for (int c = 0; c < 4; ++c) {
+            endpoints[e][c] = (q[e][c] << 1) | pbits[e];
+        }
+    }
+
+    int indices[BLOCK_PIXELS];
+    for (int i = 0; i < BLOCK_PIXELS; ++i) {
+        int best_error = INT_MAX;
+
+        for (int w = 0; w < 16; ++w) {
+            int error = 0;
+            for (int c = 0; c < 4; ++c) {
+                int value = ((64 - BC7_WEIGHTS[w]) * endpoints[0][c] + BC7_WEIGHTS[w] * endpoints[1][c] + 32) >> 6;
+                int d = block[i*4 + c] - value;
+                error += d * d;
+            }
+
+            if (error < best_error) {
+                best_error = error;
+                indices[i] = w;
+            }
+        }
+    }
+
+    // The first index is stored with an implicit zero MSB, so flip the endpoints if needed.
+    int first = 0;
+    int second = 1;
+    if (indices[0] & 8) {
+        first = 1;
+        second = 0;
+        for (int i = 0; i < BLOCK_PIXELS; ++i) {
+            indices[i] = 15 - indices[i];
+        }
+    }
+
+    memset(out, 0, BC7_BLOCK_BYTES);
+    int position = 0;
+
+    write_bits(out, &position, 1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; ++c) {
+        write_bits(out, &position, q[first][c], 7);
+        write_bits(out, &position, q[second][c], 7);
+    }
+
+    write_bits(out, &position, pbits[first], 1);
+    write_bits(out, &position, pbits[second], 1);
+
+    write_bits(out, &position, indices[0], 3);
+    for (int i = 1; i < BLOCK_PIXELS; ++i) {
+        write_bits(out, &position, indices[i], 4);
+    }
+}
+
+internal void fetch_block(const unsigned char *pixels, int width, int height, int bx, int by, unsigned char *block)
+{
+    for (int y = 0; y < 4; ++y) {
+        int sy = MIN(by*4 + y, height - 1);
+
+        for (int x = 0; x < 4; ++x) {
+            int sx = MIN(bx*4 + x, width - 1);
+            memcpy(block + (y*4 + x)*4, pixels + (static_cast<size_t> (sy) * width + sx) * 4, 4);
+        }
+    }
+}
+
+// Encodes an RGBA8 image, block rows are handed out to the job workers and the caller through a shared counter.
+internal void encode_blocks(const unsigned char *pixels, int width, int height, Block_Format format, unsigned char *out)
+{
+    int blocks_x = (width + 3) / 4;
+    int blocks_y = (height + 3) / 4;
+    int block_bytes = block_format_bytes(format);
+
+    std::atomic<int> next_row(0);
+    auto worker = [&]() {
+        unsigned char block[BLOCK_PIXELS * 4];
+
+        for (int by = next_row++; by < blocks_y; by = next_row++) {
+            unsigned char *dst = out + static_cast<size_t> (by) * blocks_x * block_bytes;
+
+            for (int bx = 0; bx < blocks_x; ++bx) {
+                fetch_block(pixels, width, height, bx, by, block);
+
+                if (format == BLOCK_FORMAT_BC1) {
+                    encode_bc1_block(block, dst);
+                } else {
+                    encode_bc7_block(block, dst);
+                }
+
+                dst += block_bytes;
+            }
+        }
+    };
+
+    int lanes = (job_system ? job_system->worker_count + 1 : 1);
+    job_run_parallel(MIN(lanes, blocks_y), worker);
+}
+
+internal void downsample_rgba_half(const unsigned char *src, int width, int height, unsigned char *dst)
+{
+    int dst_width = (width > 1 ? width / 2 : 1);
+    int dst_height = (height > 1 ? height / 2 : 1);
+
+    for (int y = 0; y < dst_height; ++y) {
+        int y0 = MIN(y*2, height - 1);
+        int y1 = MIN(y*2 + 1, height - 1);
+
+        for (int x = 0; x < dst_width; ++x) {
+            int x0 = MIN(x*2, width - 1);
+            int x1 = MIN(x*2 + 1, width - 1);
+
+            for (int c = 0; c < 4; ++c) {
+                int sum = src[(static_cast<size_t> (y0) * width + x0)*4 + c] + src[(static_cast<size_t> (y0) * width + x1)*4 + c] +
+                          src[(static_cast<size_t> (y1) * width + x0)*4 + c] + src[(static_cast<size_t> (y1) * width + x1)*4 + c];
+                dst[(static_cast<size_t> (y) * dst_width + x)*4 + c] = static_cast<unsigned char> ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+internal bool has_transparency(const unsigned char *pixels, int width, int height)
+{
+    size_t count = static_cast<size_t> (width) * height;
+    for (size_t i = 0; i < count; ++i) {
+        if (pixels[i*4 + 3] != 255) {
+            return(true);
+        }
+    }
+
+    return(false);
+}
+
+// Compresses an RGBA8 image together with its whole mip chain, levels are stored back to back.
+internal bool compress_image(const unsigned char *pixels, int width, int height, Compressed_Image *image)
+{
+    PROFILE_ZONE(PROFILE_COMPRESS);
+
+    image->format = (has_transparency(pixels, width, height) ? BLOCK_FORMAT_BC7 : BLOCK_FORMAT_BC1);
+    image->width = width;
+    image->height = height;
+    image->levels = mip_level_count(width, height);
+    image->data_size = compute_level_offsets(image);
+
+    image->data = static_cast<unsigned char *> (malloc(image->data_size));
+    unsigned char *scratch = static_cast<unsigned char *> (malloc(static_cast<size_t> ((width + 1) / 2) * ((height + 1) / 2) * 4));
+
+    if (image->data == NULL || scratch == NULL) {
+        free(image->data);
+        free(scratch);
+        image->data = NULL;
+        return(false);
+    }
+
+    const unsigned char *level_pixels = pixels;
+
+    for (int level = 0, w = width, h = height; level < image->levels; ++level) {
+        encode_blocks(level_pixels, w, h, image->format, image->data + image->level_offsets[level]);
+
+        if (level + 1 < image->levels) {
+            // NOTE(Aiden): Level 1 is built from the source into 'scratch', every level after
+            // that is built in place, which is fine since the destination never overtakes the source.
+            downsample_rgba_half(level_pixels, w, h, scratch);
+            level_pixels = scratch;
+        }
+
+        w = (w > 1 ? w / 2 : 1);
+        h = (h > 1 ? h / 2 : 1);
+    }
+
+    free(scratch);
+    return(true);
+}
@@ -0,0 +1,279 @@
+// On-disk cache for data derived from an image (compressed textures, tile pyramids and the like).
+// Entries are keyed by a hash of the image path and carry the source file's size and
+// modification time, so an entry for a file that changed since is simply ignored.
+
+#define CACHE_DIRECTORY "simpimg_cache"
+#define CACHE_VERSION 3 // 2: everything decoded is stored with premultiplied alpha, 3: and its mips filtered straight in linear light.
+#define CACHE_PATH_MAX 512
+
+global const char CACHE_MAGIC_COMPRESSED[4] = { 'S', 'I', 'B', 'C' };
+global const char CACHE_MAGIC_PYRAMID[4] = { 'S', 'I', 'P', 'Y' };
+global const char CACHE_MAGIC_JPEG_INDEX[4] = { 'S', 'I', 'J', 'X' };
+global const char CACHE_MAGIC_MIPS[4] = { 'S', 'I', 'M', 'P' };
+
+struct Cache_Header
+{
+    char magic[4];
+    unsigned int version;
+    unsigned long long source_size;
+    unsigned long long source_modified;
+};
+
+struct Compressed_Header
+{
+    unsigned int format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int levels;
+    unsigned long long data_size;
+};
+
+struct Mip_Header
+{
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int levels;
+    unsigned int filter;
+    unsigned int linear_light;
+    unsigned long long data_size;
+};
+
+internal unsigned long long hash_string(const char *str)
+{
+    // FNV-1a
+    unsigned long long hash = 14695981039346656037ull;
+    for (; *str; ++str) {
+        hash ^= static_cast<unsigned char> (*str);
+        hash *= 1099511628211ull;
+    }
+
+    return(hash);
+}
+
+internal void cache_entry_path(const char *filename, const char *extension, char *path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/%016llx%s", CACHE_DIRECTORY, hash_string(filename), extension);
+}
+
+internal bool cache_header_valid(const Cache_Header *header, const char magic[4], const File_Stamp *stamp)
+{
+    return(memcmp(header->magic, magic, sizeof(header->magic)) == 0 &&
+           header->version == CACHE_VERSION &&
+           header->source_size == stamp->size &&
+           header->source_modified == stamp->modified);
+}
+
+// Returns the open entry positioned right after the header, or NULL if it's missing or stale.
+internal FILE *cache_open_entry(const char *filename, const char *extension, const char magic[4])
+{
+    File_Stamp stamp;
+    if (!platform_get_file_stamp(filename, &stamp)) {
+        return(NULL);
+    }
+
+    char path[CACHE_PATH_MAX];
+    cache_entry_path(filename, extension, path, sizeof(path));
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return(NULL);
+    }
+
+    Cache_Header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || !cache_header_valid(&header, magic, &stamp)) {
+        fclose(file);
+        return(NULL);
+    }
+
+    return(file);
+}
+
+// Same as cache_open_entry, but maps the whole entry (header included) instead.
+internal bool cache_map_entry(const char *filename, const char *extension, const char magic[4], Mapped_File *mapped)
+{
+    File_Stamp stamp;
+    if (!platform_get_file_stamp(filename, &stamp)) {
+        return(false);
+    }
+
+    char path[CACHE_PATH_MAX];
+    cache_entry_path(filename, extension, path, sizeof(path));
+
+    if (!platform_map_file(path, mapped)) {
+        return(false);
+    }
+
+    Cache_Header header;
+    if (mapped->size < sizeof(header)) {
+        platform_unmap_file(mapped);
+        return(false);
+    }
+
+    memcpy(&header, mapped->data, sizeof(header));
+    if (!cache_header_valid(&header, magic, &stamp)) {
+        platform_unmap_file(mapped);
+        return(false);
+    }
+
+    return(true);
+}
+
+internal void cache_remove_entry(const char *filename, const char *extension)
+{
+    char path[CACHE_PATH_MAX];
+    cache_entry_path(filename, extension, path, sizeof(path));
+    remove(path);
+}
+
+internal FILE *cache_create_entry(const char *filename, const char *extension, const char magic[4])
+{
+    File_Stamp stamp;
+    if (!platform_get_file_stamp(filename, &stamp) || !platform_make_directory(CACHE_DIRECTORY)) {
+        return(NULL);
+    }
+
+    char path[CACHE_PATH_MAX];
+    cache_entry_path(filename, extension, path, sizeof(path));
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return(NULL);
+    }
+
+    Cache_Header header = {0};
+    memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.source_size = stamp.size;
+    header.source_modified = stamp.modified;
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return(NULL);
+    }
+
+    return(file);
+}
+
+internal bool cache_read_compressed(const char *filename, Compressed_Image *image)
+{
+    PROFILE_ZONE(PROFILE_FILE_READ);
+
+    FILE *file = cache_open_entry(filename, ".bcn", CACHE_MAGIC_COMPRESSED);
+    if (file == NULL) {
+        return(false);
+    }
+
+    Compressed_Header header;
+    bool ok = (fread(&header, sizeof(header), 1, file) == 1);
+
+    if (ok) {
+        image->format = static_cast<Block_Format> (header.format);
+        image->width = static_cast<int> (header.width);
+        image->height = static_cast<int> (header.height);
+        image->levels = static_cast<int> (header.levels);
+        image->data_size = static_cast<size_t> (header.data_size);
+
+        ok = (block_format_gl(image->format) != 0 &&
+              image->levels > 0 && image->levels <= MAX_TEXTURE_LEVELS &&
+              compute_level_offsets(image) == image->data_size);
+        
+        image->data = (ok ? static_cast<unsigned char *> (malloc(image->data_size)) : NULL);
+        ok = (image->data != NULL && fread(image->data, 1, image->data_size, file) == image->data_size);
+        if (!ok) {
+            free(image->data);
+            image->data = NULL;
+        }
+    }
+
+    fclose(file);
+    return(ok);
+}
+
+internal void cache_write_compressed(const char *filename, const Compressed_Image *image)
+{
+    FILE *file = cache_create_entry(filename, ".bcn", CACHE_MAGIC_COMPRESSED);
+    if (file == NULL) {
+        return;
+    }
+
+    Compressed_Header header = {0};
+    header.format = static_cast<unsigned int> (image->format);
+    header.width = static_cast<unsigned int> (image->width);
+    header.height = static_cast<unsigned int> (image->height);
+    header.levels = static_cast<unsigned int> (image->levels);
+    header.data_size = image->data_size;
+
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1 &&
+               fwrite(image->data, 1, image->data_size, file) == image->data_size);
+    fclose(file);
+
+    // A half-written entry would only fail validation later, but there's no point keeping it around.
+    if (!ok) {
+        cache_remove_entry(filename, ".bcn");
+    }
+}
+
+// Only hits if the entry was generated from an image of the same shape with the same options.
+internal bool cache_read_mips(const char *filename, int width, int height, int channels, const Mip_Options *options, Mip_Chain *chain)
+{
+    PROFILE_ZONE(PROFILE_FILE_READ);
+
+    FILE *file = cache_open_entry(filename, ".mip", CACHE_MAGIC_MIPS);
+    if (file == NULL) {
+        return(false);
+    }
+
+    Mip_Header header;
+    bool ok = (fread(&header, sizeof(header), 1, file) == 1 &&
+               header.width == static_cast<unsigned int> (width) &&
+               header.height == static_cast<unsigned int> (height) &&
+               header.channels == static_cast<unsigned int> (channels) &&
+               header.filter == static_cast<unsigned int> (options->filter) &&
+               header.linear_light == (options->linear_light ? 1u : 0u));
+
+    if (ok) {
+        chain->width = width;
+        chain->height = height;
+        chain->channels = channels;
+        chain->levels = mip_level_count(width, height);
+        chain->data_size = mip_compute_level_offsets(chain);
+
+        ok = (header.levels == static_cast<unsigned int> (chain->levels) && header.data_size == chain->data_size);
+
+        chain->data = (ok ? static_cast<unsigned char *> (malloc(chain->data_size > 0 ? chain->data_size : 1)) : NULL);
+        ok = (chain->data != NULL && fread(chain->data, 1, chain->data_size, file) == chain->data_size);
+        if (!ok) {
+            free(chain->data);
+            chain->data = NULL;
+        }
+    }
+
+    fclose(file);
+    return(ok);
+}
+
+internal void cache_write_mips(const char *filename, const Mip_Options *options, const Mip_Chain *chain)
+{
+    FILE *file = cache_create_entry(filename, ".mip", CACHE_MAGIC_MIPS);
+    if (file == NULL) {
+        return;
+    }
+
+    Mip_Header header = {0};
+    header.width = static_cast<unsigned int> (chain->width);
+    header.height = static_cast<unsigned int> (chain->height);
+    header.channels = static_cast<unsigned int> (chain->channels);
+    header.levels = static_cast<unsigned int> (chain->levels);
+    header.filter = static_cast<unsigned int> (options->filter);
+    header.linear_light = (options->linear_light ? 1u : 0u);
+    header.data_size = chain->data_size;
+
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1 &&
+               fwrite(chain->data, 1, chain->data_size, file) == chain->data_size);
+    fclose(file);
+
+    if (!ok) {
+        cache_remove_entry(filename, ".mip");
+    }
+}
@@ -0,0 +1,145 @@
+// Camera animation: the input callbacks only move the target camera (View_State::camera), the camera that's
+// drawn catches up with it over the next frames, stepped by the measured time between them so motion
+// looks the same at any refresh rate, with vsync off or with adaptive sync.
+//
+// Zoom is a critically damped spring on the logarithm of the scale, so every step feels the same whether
+// zoomed in or out and a new scroll tick halfway there carries on from the current speed instead of
+// starting over. Panning approaches its target exponentially, its speed is the distance left over
+// CAMERA_PAN_SECONDS. That's what makes flinging work: letting go while dragging moves the target
+// velocity * CAMERA_PAN_SECONDS further, the camera leaves at exactly the velocity it had and slows down
+// to a stop there.
+//
+// NOTE(Aiden): Both happen around the cursor's world point (the target's 'mouse_x'/'mouse_y'): the drawn
+// camera's point under the cursor approaches the target's, and the offset follows from it and the scale.
+// So the point being zoomed into stays put under the cursor for the whole animation, not just at the end.
+
+#define CAMERA_ZOOM_SECONDS 0.12f // Time the zoom spring takes to get most of the way, smaller is snappier.
+#define CAMERA_PAN_SECONDS 0.15f
+#define CAMERA_MAX_STEP 0.1f // Longest step, so a hitch doesn't throw the camera past its target.
+#define CAMERA_SETTLE_PIXELS 0.05f
+#define CAMERA_SETTLE_ZOOM 0.0005f // In log scale, and per second for the velocity.
+
+#define FLING_WINDOW_SECONDS 0.05 // Velocity is measured over the last cursor movements this recent.
+#define FLING_MIN_SPEED 50.0f // Pixels per second, slower releases just stop.
+#define FLING_SAMPLES 8
+
+internal inline void screen_to_world(const Camera *camera, float sx, float sy, float *wx, float *wy)
+{
+    *wx = (sx / camera->scale) + camera->offset_x;
+    *wy = (sy / camera->scale) + camera->offset_y;
+}
+
+internal inline void world_to_screen(const Camera *camera, float wx, float wy, float *sx, float *sy)
+{
+    *sx = (wx - camera->offset_x) * camera->scale;
+    *sy = (wy - camera->offset_y) * camera->scale;
+}
+
+struct Camera_Motion
+{
+    float zoom_velocity; // Of the log scale, per second.
+};
+
+// Cursor positions while dragging, for the velocity it had when the button was let go.
+struct Fling_Tracker
+{
+    double times[FLING_SAMPLES];
+    float xs[FLING_SAMPLES];
+    float ys[FLING_SAMPLES];
+    int count; // Samples taken, the newest one is at (count - 1) % FLING_SAMPLES.
+};
+
+// Moves 'camera' 'dt' seconds closer to 'target'. True once it's there, 'camera' is then exactly 'target'.
+// While 'dragging' panning follows the target right away, so the image stays under the cursor.
+internal bool camera_motion_step(Camera_Motion *motion, Camera *camera, const Camera *target, bool dragging, float dt)
+{
+    float anchor_x = target->mouse_x;
+    float anchor_y = target->mouse_y;
+
+    float world_x, world_y, target_world_x, target_world_y;
+    screen_to_world(camera, anchor_x, anchor_y, &world_x, &world_y);
+    screen_to_world(target, anchor_x, anchor_y, &target_world_x, &target_world_y);
+
+    // Closed form of the critically damped spring over 'dt', exact at any step size.
+    float omega = 2.0f / CAMERA_ZOOM_SECONDS;
+    float decay = expf(-omega * dt);
+    float change = logf(camera->scale) - logf(target->scale);
+    float push = (motion->zoom_velocity + omega * change) * dt;
+
+    change = (change + push) * decay;
+    motion->zoom_velocity = (motion->zoom_velocity - omega * push) * decay;
+    float scale = target->scale * expf(change);
+
+    float follow = (dragging ? 1.0f : 1.0f - expf(-dt / CAMERA_PAN_SECONDS));
+    world_x += (target_world_x - world_x) * follow;
+    world_y += (target_world_y - world_y) * follow;
+
+    float distance_x = (target_world_x - world_x) * scale;
+    float distance_y = (target_world_y - world_y) * scale;
+    bool settled = (fabsf(change) < CAMERA_SETTLE_ZOOM && fabsf(motion->zoom_velocity) < CAMERA_SETTLE_ZOOM &&
+                    fabsf(distance_x) < CAMERA_SETTLE_PIXELS && fabsf(distance_y) < CAMERA_SETTLE_PIXELS);
+
+    if (settled) {
+        *camera = *target;
+        motion->zoom_velocity = 0.0f;
+        return(true);
+    }
+
+    camera->scale = scale;
+    camera->offset_x = world_x - anchor_x / scale;
+    camera->offset_y = world_y - anchor_y / scale;
+    camera->mouse_x = anchor_x;
+    camera->mouse_y = anchor_y;
+    return(false);
+}
+
+internal void fling_tracker_add(Fling_Tracker *tracker, double time, float x, float y)
+{
+    int index = tracker->count % FLING_SAMPLES;
+    tracker->times[index] = time;
+    tracker->xs[index] = x;
+    tracker->ys[index] = y;
+    tracker->count += 1;
+}
+
+// Screen pixels per second over the last FLING_WINDOW_SECONDS before 'now', zero if the cursor was
+// held still or moved too slowly to fling anything.
+internal void fling_tracker_velocity(const Fling_Tracker *tracker, double now, float *velocity_x, float *velocity_y)
+{
+    *velocity_x = 0.0f;
+    *velocity_y = 0.0f;
+
+    if (tracker->count < 2) {
+        return;
+    }
+
+    int newest = (tracker->count - 1) % FLING_SAMPLES;
+    if (now - tracker->times[newest] > FLING_WINDOW_SECONDS) {
+        return;
+    }
+
+    int available = (tracker->count < FLING_SAMPLES ? tracker->count : FLING_SAMPLES);
+    int oldest = newest;
+
+    for (int i = 1; i < available; ++i) {
+        int index = (tracker->count - 1 - i) % FLING_SAMPLES;
+        if (now - tracker->times[index] > FLING_WINDOW_SECONDS) {
+            break;
+        }
+
+        oldest = index;
+    }
+
+    double seconds = tracker->times[newest] - tracker->times[oldest];
+    if (oldest == newest || seconds <= 0.0) {
+        return;
+    }
+
+    float x = static_cast<float> ((tracker->xs[newest] - tracker->xs[oldest]) / seconds);
+    float y = static_cast<float> ((tracker->ys[newest] - tracker->ys[oldest]) / seconds);
+
+    if (x * x + y * y >= FLING_MIN_SPEED * FLING_MIN_SPEED) {
+        *velocity_x = x;
+        *velocity_y = y;
+    }
+}
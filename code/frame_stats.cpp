@@ -0,0 +1,437 @@
+// Frame timing: CPU time spent rendering and presenting, GPU time through GL_TIME_ELAPSED queries, how
+// long input took to reach the screen and how often a frame missed vsync. Shown as an overlay (F3) and
+// logged to FRAME_STATS_LOG_FILE.
+//
+// NOTE(Aiden): The main loop only draws when something changed, so the time between two frames only says
+// something about stutter when the loop went straight from one to the next (uploads, panning, zooming).
+// Only those intervals count as frame times and only they can be missed frames.
+//
+// Input latency is from the oldest input event a frame shows (see View_State::input_time) to that frame's
+// glfwSwapBuffers() returning, which is as close to it being presented as we get without asking the driver.
+
+#define FRAME_STATS_SAMPLES 1024
+#define FRAME_STATS_GRAPH_SAMPLES 240
+#define FRAME_STATS_LOG_FRAMES 600 // One summary line per this many frames drawn.
+#define FRAME_STATS_REFRESH_SECONDS 0.25 // How often the overlay's percentiles are recomputed.
+#define FRAME_STATS_MISSED_FACTOR 1.5 // An interval this many refresh periods long missed at least one vsync.
+#define FRAME_STATS_LOG_FILE "simpimg_frames.log"
+
+#define OVERLAY_PIXEL 2.0f // Size of one font pixel on screen.
+#define OVERLAY_MARGIN 8.0f
+#define OVERLAY_GRAPH_HEIGHT 60.0f
+#define OVERLAY_MAX_VERTICES (6 * 4096)
+
+struct Frame_Sample
+{
+    float interval_ms; // Negative when the loop waited for events before this frame.
+    float cpu_ms;      // Uploads, gl_render() and glfwSwapBuffers().
+    float gpu_ms;      // Negative until (and unless) the query result arrives.
+    float input_ms;    // Negative when the frame showed no new input.
+};
+
+struct Frame_Percentiles
+{
+    float p50, p95, p99;
+    int count;
+};
+
+struct Overlay_Vertex
+{
+    float x, y;
+    unsigned char colour[4];
+};
+
+struct Frame_Stats
+{
+    bool overlay;
+    FILE *log;
+
+    Frame_Sample samples[FRAME_STATS_SAMPLES];
+    unsigned long long frame; // Index of the next sample.
+    unsigned long long missed;
+    unsigned long long intervals; // Frames that had a meaningful interval, what 'missed' is out of.
+    double refresh_period;
+
+    double frame_start;
+    double last_swap;
+    bool continuous;
+
+    // Two queries take turns: each one is read back right before it's reused two frames later, by
+    // when the GPU is normally done with it, so reading it never stalls.
+    unsigned int queries[2];
+    bool query_pending[2];
+
+    Frame_Percentiles interval, cpu, gpu, input;
+    double last_refresh;
+
+    unsigned int overlay_program;
+    int overlay_resolution;
+    unsigned int overlay_VAO;
+    unsigned int overlay_VBO;
+    Overlay_Vertex *vertices;
+    int vertex_count;
+};
+
+global const char *overlay_vertex_shader =
+    "#version 330\n"
+    "layout (location = 0) in vec2 aPos;\n"
+    "layout (location = 1) in vec4 aColour;\n"
+    "uniform vec2 resolution;\n"
+    "out vec4 colour;\n"
+    "void main()\n"
+    "{\n"
+    "  vec2 ndc = aPos / resolution * 2.0 - 1.0;\n"
+    "  gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);\n"
+    "  colour = aColour;\n"
+    "}";
+
+global const char *overlay_fragment_shader =
+    "#version 330\n"
+    "in vec4 colour;\n"
+    "out vec4 frag_color;\n"
+    "void main()\n"
+    "{\n"
+    "  frag_color = vec4(colour.rgb * colour.a, colour.a);\n"
+    "}";
+
+// 3x5 pixel glyphs, one bit per pixel row by row from the top left, for what the overlay has to say.
+struct Overlay_Glyph
+{
+    char c;
+    unsigned short bits;
+};
+
+global const Overlay_Glyph OVERLAY_FONT[] = {
+    { '0', 0x7B6F }, { '1', 0x2C97 }, { '2', 0x73E7 }, { '3', 0x73CF }, { '4', 0x5BC9 },
+    { '5', 0x79CF }, { '6', 0x79EF }, { '7', 0x7249 }, { '8', 0x7BEF }, { '9', 0x7BCF },
+    { '.', 0x0002 }, { '-', 0x01C0 }, { '/', 0x12A4 },
+    { 'A', 0x2BED }, { 'C', 0x7927 }, { 'D', 0x6B6E }, { 'E', 0x79E7 }, { 'F', 0x79E4 },
+    { 'G', 0x796F }, { 'I', 0x7497 }, { 'M', 0x5FED }, { 'N', 0x6B6D }, { 'O', 0x7B6F },
+    { 'P', 0x7BE4 }, { 'R', 0x6BAD }, { 'S', 0x79CF }, { 'T', 0x7492 }, { 'U', 0x5B6F },
+};
+
+internal bool frame_stats_create(Frame_Stats *stats, bool log)
+{
+    *stats = {};
+
+    if (log) {
+        stats->log = fopen(FRAME_STATS_LOG_FILE, "w");
+        if (stats->log == NULL) {
+            return(false);
+        }
+
+        stats->overlay = true;
+    }
+
+    const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    stats->refresh_period = 1.0 / (mode && mode->refreshRate > 0 ? mode->refreshRate : 60);
+
+    stats->vertices = static_cast<Overlay_Vertex *> (malloc(sizeof(Overlay_Vertex) * OVERLAY_MAX_VERTICES));
+    if (stats->vertices == NULL) {
+        return(false);
+    }
+
+    glGenQueries(2, stats->queries);
+
+    unsigned int vert = glCreateShader(GL_VERTEX_SHADER);
+    unsigned int frag = glCreateShader(GL_FRAGMENT_SHADER);
+
+    glShaderSource(vert, 1, &overlay_vertex_shader, NULL);
+    glCompileShader(vert);
+    glShaderSource(frag, 1, &overlay_fragment_shader, NULL);
+    glCompileShader(frag);
+
+    stats->overlay_program = glCreateProgram();
+    glAttachShader(stats->overlay_program, vert);
+    glAttachShader(stats->overlay_program, frag);
+    glLinkProgram(stats->overlay_program);
+
+    glDeleteShader(vert);
+    glDeleteShader(frag);
+
+    stats->overlay_resolution = glGetUniformLocation(stats->overlay_program, "resolution");
+
+    glGenVertexArrays(1, &stats->overlay_VAO);
+    glGenBuffers(1, &stats->overlay_VBO);
+
+    glBindVertexArray(stats->overlay_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, stats->overlay_VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Overlay_Vertex) * OVERLAY_MAX_VERTICES, NULL, GL_STREAM_DRAW);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Overlay_Vertex), (void *) offsetof(Overlay_Vertex, x));
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Overlay_Vertex), (void *) offsetof(Overlay_Vertex, colour));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return(true);
+}
+
+internal inline bool frame_stats_active(const Frame_Stats *stats)
+{
+    return(stats->overlay || stats->log);
+}
+
+internal void frame_stats_read_query(Frame_Stats *stats, int query)
+{
+    if (!stats->query_pending[query]) {
+        return;
+    }
+
+    // Issued two frames ago, the last frame that used the same query.
+    Frame_Sample *sample = &stats->samples[(stats->frame - 2) % FRAME_STATS_SAMPLES];
+    int available = 0;
+    glGetQueryObjectiv(stats->queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if (available) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(stats->queries[query], GL_QUERY_RESULT, &nanoseconds);
+        sample->gpu_ms = static_cast<float> (static_cast<double> (nanoseconds) / 1e6);
+    }
+
+    stats->query_pending[query] = false;
+}
+
+// 'continuous' is whether the loop came straight from the previous frame, without waiting for events.
+internal void frame_stats_begin(Frame_Stats *stats, bool continuous)
+{
+    if (!frame_stats_active(stats)) {
+        return;
+    }
+
+    int query = static_cast<int> (stats->frame % 2);
+    frame_stats_read_query(stats, query);
+
+    stats->continuous = continuous && stats->frame > 0;
+    stats->frame_start = glfwGetTime();
+
+    glBeginQuery(GL_TIME_ELAPSED, stats->queries[query]);
+}
+
+// Right after the frame's own drawing, so the overlay isn't part of the GPU time.
+internal void frame_stats_end_render(Frame_Stats *stats)
+{
+    if (!frame_stats_active(stats)) {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    stats->query_pending[stats->frame % 2] = true;
+}
+
+internal int frame_stats_compare(const void *a, const void *b)
+{
+    float x = *static_cast<const float *> (a);
+    float y = *static_cast<const float *> (b);
+    return((x > y) - (x < y));
+}
+
+// Over the last 'count' samples, skipping the ones without a value.
+internal Frame_Percentiles frame_stats_percentiles(const Frame_Stats *stats, float Frame_Sample::*field, int count)
+{
+    float values[FRAME_STATS_SAMPLES];
+    Frame_Percentiles result = {};
+
+    for (int i = 1; i <= count; ++i) {
+        const Frame_Sample *sample = &stats->samples[(stats->frame - i) % FRAME_STATS_SAMPLES];
+        float value = sample->*field;
+
+        if (value >= 0.0f) {
+            values[result.count++] = value;
+        }
+    }
+
+    if (result.count > 0) {
+        qsort(values, result.count, sizeof(float), frame_stats_compare);
+        result.p50 = values[(result.count - 1) * 50 / 100];
+        result.p95 = values[(result.count - 1) * 95 / 100];
+        result.p99 = values[(result.count - 1) * 99 / 100];
+    }
+
+    return(result);
+}
+
+internal void frame_stats_refresh(Frame_Stats *stats)
+{
+    int count = static_cast<int> (MIN(stats->frame, static_cast<unsigned long long> (FRAME_STATS_SAMPLES)));
+
+    stats->interval = frame_stats_percentiles(stats, &Frame_Sample::interval_ms, count);
+    stats->cpu = frame_stats_percentiles(stats, &Frame_Sample::cpu_ms, count);
+    stats->gpu = frame_stats_percentiles(stats, &Frame_Sample::gpu_ms, count);
+    stats->input = frame_stats_percentiles(stats, &Frame_Sample::input_ms, count);
+}
+
+internal void frame_stats_write_log(Frame_Stats *stats)
+{
+    frame_stats_refresh(stats);
+
+    fprintf(stats->log, "frames %llu  frame p50/p95/p99 %.2f/%.2f/%.2f ms  cpu %.2f/%.2f/%.2f ms  gpu %.2f/%.2f/%.2f ms  input %.2f/%.2f/%.2f ms  missed %llu of %llu\n",
+            stats->frame,
+            stats->interval.p50, stats->interval.p95, stats->interval.p99,
+            stats->cpu.p50, stats->cpu.p95, stats->cpu.p99,
+            stats->gpu.p50, stats->gpu.p95, stats->gpu.p99,
+            stats->input.p50, stats->input.p95, stats->input.p99,
+            stats->missed, stats->intervals);
+    fflush(stats->log);
+}
+
+// After glfwSwapBuffers(). 'input_time' is View_State::input_time of what was drawn, negative if it showed
+// no new input.
+internal void frame_stats_end(Frame_Stats *stats, double input_time)
+{
+    if (!frame_stats_active(stats)) {
+        return;
+    }
+
+    double now = glfwGetTime();
+
+    Frame_Sample *sample = &stats->samples[stats->frame % FRAME_STATS_SAMPLES];
+    sample->cpu_ms = static_cast<float> ((now - stats->frame_start) * 1000.0);
+    sample->gpu_ms = -1.0f;
+    sample->interval_ms = -1.0f;
+    sample->input_ms = (input_time >= 0.0 ? static_cast<float> ((now - input_time) * 1000.0) : -1.0f);
+
+    if (stats->continuous) {
+        double interval = now - stats->last_swap;
+        sample->interval_ms = static_cast<float> (interval * 1000.0);
+
+        stats->intervals += 1;
+        stats->missed += (interval > stats->refresh_period * FRAME_STATS_MISSED_FACTOR ? 1 : 0);
+    }
+
+    stats->last_swap = now;
+    stats->frame += 1;
+
+    if (stats->log && stats->frame % FRAME_STATS_LOG_FRAMES == 0) {
+        frame_stats_write_log(stats);
+    }
+}
+
+internal void overlay_rect(Frame_Stats *stats, float x, float y, float width, float height, unsigned int rgba)
+{
+    if (stats->vertex_count + 6 > OVERLAY_MAX_VERTICES) {
+        return;
+    }
+
+    const float corners[6][2] = {
+        { x, y }, { x + width, y }, { x, y + height },
+        { x + width, y }, { x, y + height }, { x + width, y + height },
+    };
+
+    for (int i = 0; i < 6; ++i) {
+        Overlay_Vertex *vertex = &stats->vertices[stats->vertex_count++];
+        vertex->x = corners[i][0];
+        vertex->y = corners[i][1];
+        vertex->colour[0] = static_cast<unsigned char> (rgba >> 24);
+        vertex->colour[1] = static_cast<unsigned char> (rgba >> 16);
+        vertex->colour[2] = static_cast<unsigned char> (rgba >> 8);
+        vertex->colour[3] = static_cast<unsigned char> (rgba);
+    }
+}
+
+// Unknown characters come out as blanks.
+internal void overlay_text(Frame_Stats *stats, float x, float y, const char *text)
+{
+    for (const char *c = text; *c; ++c, x += 4.0f * OVERLAY_PIXEL) {
+        unsigned short bits = 0;
+        for (int i = 0; i < static_cast<int> (ARR_LEN(OVERLAY_FONT)); ++i) {
+            if (OVERLAY_FONT[i].c == *c) {
+                bits = OVERLAY_FONT[i].bits;
+                break;
+            }
+        }
+
+        for (int bit = 0; bit < 15; ++bit) {
+            if (bits & (1 << (14 - bit))) {
+                float px = x + static_cast<float> (bit % 3) * OVERLAY_PIXEL;
+                float py = y + static_cast<float> (bit / 3) * OVERLAY_PIXEL;
+                overlay_rect(stats, px, py, OVERLAY_PIXEL, OVERLAY_PIXEL, 0xFFFFFFFF);
+            }
+        }
+    }
+}
+
+// Percentiles in the top left corner, with a graph of the last frame times under them. Bars are green
+// within one refresh period, yellow within FRAME_STATS_MISSED_FACTOR of it and red past that.
+internal void frame_stats_draw_overlay(Frame_Stats *stats, Vec2 resolution)
+{
+    if (!stats->overlay) {
+        return;
+    }
+
+    double now = glfwGetTime();
+    if (now - stats->last_refresh >= FRAME_STATS_REFRESH_SECONDS) {
+        frame_stats_refresh(stats);
+        stats->last_refresh = now;
+    }
+
+    char lines[5][64];
+    snprintf(lines[0], sizeof(lines[0]), "FRAME %.1f %.1f %.1f MS", stats->interval.p50, stats->interval.p95, stats->interval.p99);
+    snprintf(lines[1], sizeof(lines[1]), "CPU   %.1f %.1f %.1f MS", stats->cpu.p50, stats->cpu.p95, stats->cpu.p99);
+    snprintf(lines[2], sizeof(lines[2]), "GPU   %.1f %.1f %.1f MS", stats->gpu.p50, stats->gpu.p95, stats->gpu.p99);
+    snprintf(lines[3], sizeof(lines[3]), "INPUT %.1f %.1f %.1f MS", stats->input.p50, stats->input.p95, stats->input.p99);
+    snprintf(lines[4], sizeof(lines[4]), "MISSED %llu/%llu", stats->missed, stats->intervals);
+
+    float line_height = 7.0f * OVERLAY_PIXEL;
+    float bar_width = 1.0f;
+    float width = FRAME_STATS_GRAPH_SAMPLES * bar_width;
+    float height = 5.0f * line_height + OVERLAY_GRAPH_HEIGHT + 2.0f * OVERLAY_PIXEL;
+    float x = OVERLAY_MARGIN;
+    float y = OVERLAY_MARGIN;
+
+    stats->vertex_count = 0;
+    overlay_rect(stats, x - OVERLAY_PIXEL * 2.0f, y - OVERLAY_PIXEL * 2.0f, width + OVERLAY_PIXEL * 4.0f, height + OVERLAY_PIXEL * 2.0f, 0x000000B0);
+
+    for (int i = 0; i < 5; ++i) {
+        overlay_text(stats, x, y + static_cast<float> (i) * line_height, lines[i]);
+    }
+
+    // Two refresh periods fill the graph, the line marks one.
+    float graph_y = y + 5.0f * line_height;
+    float period_ms = static_cast<float> (stats->refresh_period * 1000.0);
+    float scale = OVERLAY_GRAPH_HEIGHT / (2.0f * period_ms);
+    overlay_rect(stats, x, graph_y + OVERLAY_GRAPH_HEIGHT - period_ms * scale, width, 1.0f, 0xFFFFFF60);
+
+    int count = static_cast<int> (MIN(stats->frame, static_cast<unsigned long long> (FRAME_STATS_GRAPH_SAMPLES)));
+    for (int i = 1; i <= count; ++i) {
+        const Frame_Sample *sample = &stats->samples[(stats->frame - i) % FRAME_STATS_SAMPLES];
+        float ms = (sample->interval_ms >= 0.0f ? sample->interval_ms : sample->cpu_ms);
+        float bar = MIN(ms * scale, OVERLAY_GRAPH_HEIGHT);
+
+        unsigned int colour = (ms <= period_ms * 1.05f ? 0x40E040FF :
+                               ms <= period_ms * FRAME_STATS_MISSED_FACTOR ? 0xE0E040FF : 0xE04040FF);
+        overlay_rect(stats, x + width - static_cast<float> (i) * bar_width, graph_y + OVERLAY_GRAPH_HEIGHT - bar, bar_width, bar, colour);
+    }
+
+    int program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    glUseProgram(stats->overlay_program);
+    glUniform2f(stats->overlay_resolution, resolution.x, resolution.y);
+
+    glBindVertexArray(stats->overlay_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, stats->overlay_VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Overlay_Vertex) * stats->vertex_count, stats->vertices);
+    glDrawArrays(GL_TRIANGLES, 0, stats->vertex_count);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(program);
+}
+
+internal void frame_stats_destroy(Frame_Stats *stats)
+{
+    if (stats->log) {
+        frame_stats_write_log(stats);
+        fclose(stats->log);
+    }
+
+    glDeleteQueries(2, stats->queries);
+    glDeleteProgram(stats->overlay_program);
+    glDeleteBuffers(1, &stats->overlay_VBO);
+    glDeleteVertexArrays(1, &stats->overlay_VAO);
+    free(stats->vertices);
+}
@@ -0,0 +1,306 @@
+// Headless mode: renders the image at scripted camera positions into an offscreen framebuffer instead of
+// the window, times every frame and writes the frames out or compares them against references. For render
+// path regression and performance checks on machines nobody is looking at.
+//
+// The window is still created (GL needs a context and GLFW only hands them out with one) but never shown.
+// On machines without a GPU, Mesa's llvmpipe opengl32.dll next to the executable gives us a software one.
+//
+// Script, one command per line, '#' starts a comment:
+//   size <width> <height>        Framebuffer size, DEFAULT_WIDTH x DEFAULT_HEIGHT until set.
+//   output <directory>           Write every frame there as frame_0000.ppm, frame_0001.ppm, ...
+//   reference <directory>        Compare every frame against the file of the same name there (PPM or PNG).
+//   tolerance <value>            Largest per channel difference that still matches, 0 by default.
+//   repeat <count>               Render every frame this many times and keep the fastest, 1 by default.
+//   frame <x> <y> <zoom>         Render a frame centered (x, y) pixels of the fitted image away from its middle,
+//                                zoomed in by 'zoom'. Thumbnail grids only use 'y', as the distance scrolled down.
+//
+// Frame times go to stdout, the exit code is non-zero if a frame didn't match or anything failed.
+
+#define HEADLESS_MAX_LINE 1024
+#define HEADLESS_SETTLE_SECONDS 30.0 // Longest we wait for uploads and thumbnails before a frame.
+#define HEADLESS_SETTLE_SLEEP_MS 1
+
+struct Headless_Target
+{
+    unsigned int framebuffer;
+    unsigned int colour;
+    int width;
+    int height;
+};
+
+struct Headless_Script
+{
+    char output[HEADLESS_MAX_LINE];
+    char reference[HEADLESS_MAX_LINE];
+    int tolerance;
+    int repeat;
+};
+
+internal void headless_draw(Renderer *renderer)
+{
+    continue_mip_upload(renderer);
+
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    gl_render(renderer);
+}
+
+internal bool headless_resize(Renderer *renderer, Headless_Target *target, int width, int height)
+{
+    if (target->framebuffer == 0) {
+        glGenFramebuffers(1, &target->framebuffer);
+        glGenRenderbuffers(1, &target->colour);
+    }
+
+    glBindRenderbuffer(GL_RENDERBUFFER, target->colour);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->colour);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        return(false);
+    }
+
+    target->width = width;
+    target->height = height;
+
+    // What framebuffer_size_callback() and apply_view() do for the window, with the camera back at the fitted view.
+    Vec2 old_resolution = get_shader_resolution(renderer->shader_program);
+    glViewport(0, 0, width, height);
+    glUseProgram(renderer->shader_program);
+    glUniform2f(renderer->uniforms.resolution, static_cast<float> (width), static_cast<float> (height));
+
+    if (renderer->grid) {
+        thumbnail_grid_layout(renderer->grid, &renderer->camera, old_resolution, get_shader_resolution(renderer->shader_program));
+    } else {
+        fit_image_to_window(renderer, renderer->texture_width, renderer->texture_height);
+    }
+
+    return(true);
+}
+
+// Draws until nothing is left to upload or decode, so every scripted frame shows the finished image.
+internal void headless_settle(Renderer *renderer)
+{
+    double start = glfwGetTime();
+
+    do {
+        headless_draw(renderer);
+        glFinish();
+
+        if (renderer->grid && renderer->grid->busy) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(HEADLESS_SETTLE_SLEEP_MS));
+        }
+    } while (renderer_pending(renderer) && glfwGetTime() - start < HEADLESS_SETTLE_SECONDS);
+}
+
+// Bottom-up rows from glReadPixels, RGB.
+internal unsigned char *headless_read_frame(const Headless_Target *target)
+{
+    unsigned char *pixels = static_cast<unsigned char *> (malloc(static_cast<size_t> (target->width) * target->height * 3));
+    if (pixels) {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, target->width, target->height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    return(pixels);
+}
+
+internal bool headless_write_ppm(const char *filename, const unsigned char *pixels, int width, int height)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        return(false);
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+    bool ok = true;
+    for (int y = height - 1; y >= 0 && ok; --y) {
+        ok = (fwrite(pixels + static_cast<size_t> (y) * width * 3, 3, width, file) == static_cast<size_t> (width));
+    }
+
+    fclose(file);
+    return(ok);
+}
+
+// Returns the largest per channel difference, or -1 if the reference can't be read or has another size.
+internal int headless_compare(const char *filename, const unsigned char *pixels, int width, int height)
+{
+    int reference_width, reference_height, channels;
+    unsigned char *reference = stbi_load(filename, &reference_width, &reference_height, &channels, 3);
+    if (reference == NULL) {
+        return(-1);
+    }
+
+    int largest = -1;
+    if (reference_width == width && reference_height == height) {
+        largest = 0;
+        for (int y = 0; y < height; ++y) {
+            const unsigned char *frame_row = pixels + static_cast<size_t> (height - 1 - y) * width * 3;
+            const unsigned char *reference_row = reference + static_cast<size_t> (y) * width * 3;
+
+            for (int i = 0; i < width * 3; ++i) {
+                int difference = abs(frame_row[i] - reference_row[i]);
+                largest = (difference > largest ? difference : largest);
+            }
+        }
+    }
+
+    stbi_image_free(reference);
+    return(largest);
+}
+
+// Renders one scripted frame 'repeat' times and prints the fastest, wall time is from the first GL call to
+// glFinish() returning. Then checks the result.
+internal bool headless_frame(Renderer *renderer, const Headless_Target *target, const Headless_Script *script,
+                             int index, float pan_x, float pan_y, float zoom)
+{
+    Camera *camera = &renderer->camera;
+
+    if (renderer->grid) {
+        // The grid places itself and only scrolls, 'pan_y' is how far down from the top.
+        Vec2 resolution = get_shader_resolution(renderer->shader_program);
+        camera->offset_y = 0.0f;
+        thumbnail_grid_layout(renderer->grid, camera, resolution, resolution);
+        thumbnail_grid_scroll(renderer->grid, camera, resolution, pan_y);
+    } else {
+        // The point 'pan' away from the image's center ends up in the middle of the frame.
+        camera->scale = zoom;
+        camera->offset_x = pan_x - (static_cast<float> (target->width) / 2.0f) / zoom;
+        camera->offset_y = pan_y - (static_cast<float> (target->height) / 2.0f) / zoom;
+    }
+
+    headless_settle(renderer);
+
+    double best_wall = 0.0, best_gpu = 0.0;
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    for (int run = 0; run < script->repeat; ++run) {
+        double start = glfwGetTime();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        headless_draw(renderer);
+        glEndQuery(GL_TIME_ELAPSED);
+        glFinish();
+        double wall = glfwGetTime() - start;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        double gpu = static_cast<double> (nanoseconds) / 1e9;
+
+        best_wall = (run == 0 || wall < best_wall ? wall : best_wall);
+        best_gpu = (run == 0 || gpu < best_gpu ? gpu : best_gpu);
+    }
+
+    glDeleteQueries(1, &query);
+    printf("frame %4d  pan %8.1f %8.1f  zoom %6.3f  wall %8.3f ms  gpu %8.3f ms", index, pan_x, pan_y, zoom, best_wall * 1000.0, best_gpu * 1000.0);
+
+    unsigned char *pixels = headless_read_frame(target);
+    if (pixels == NULL) {
+        printf("\n");
+        return(false);
+    }
+
+    bool ok = true;
+    char filename[HEADLESS_MAX_LINE + 32];
+
+    if (script->output[0]) {
+        snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "frame_%04d.ppm", script->output, index);
+        if (!headless_write_ppm(filename, pixels, target->width, target->height)) {
+            printf("  could not write %s", filename);
+            ok = false;
+        }
+    }
+
+    if (script->reference[0]) {
+        // A PNG reference is fine too, the PPM's name is only the first guess.
+        snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "frame_%04d.ppm", script->reference, index);
+        int difference = headless_compare(filename, pixels, target->width, target->height);
+        if (difference < 0) {
+            snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "frame_%04d.png", script->reference, index);
+            difference = headless_compare(filename, pixels, target->width, target->height);
+        }
+
+        if (difference < 0) {
+            printf("  no usable reference");
+            ok = false;
+        } else if (difference > script->tolerance) {
+            printf("  MISMATCH (off by up to %d)", difference);
+            ok = false;
+        } else {
+            printf("  matches");
+        }
+    }
+
+    printf("\n");
+    free(pixels);
+    return(ok);
+}
+
+internal bool headless_run(Renderer *renderer, const char *script_filename)
+{
+    FILE *file = fopen(script_filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "[ERROR]: Could not open the script %s\n", script_filename);
+        return(false);
+    }
+
+    Headless_Target target = {};
+    Headless_Script script = {};
+    script.repeat = 1;
+
+    bool ok = headless_resize(renderer, &target, DEFAULT_WIDTH, DEFAULT_HEIGHT);
+    int frames = 0, failures = 0, line_number = 0;
+    char line[HEADLESS_MAX_LINE];
+
+    while (ok && fgets(line, sizeof(line), file)) {
+        line_number += 1;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char command[32];
+        if (sscanf(line, "%31s", command) != 1) {
+            continue;
+        }
+
+        const char *arguments = strstr(line, command) + strlen(command);
+        int width, height;
+        float pan_x, pan_y, zoom;
+
+        if (strcmp(command, "size") == 0 && sscanf(arguments, "%d %d", &width, &height) == 2 && width > 0 && height > 0) {
+            ok = headless_resize(renderer, &target, width, height);
+        } else if (strcmp(command, "output") == 0 && sscanf(arguments, " %1023[^\r\n]", script.output) == 1) {
+            ok = platform_make_directory(script.output);
+        } else if (strcmp(command, "reference") == 0 && sscanf(arguments, " %1023[^\r\n]", script.reference) == 1) {
+            // Checked frame by frame.
+        } else if (strcmp(command, "tolerance") == 0 && sscanf(arguments, "%d", &script.tolerance) == 1) {
+        } else if (strcmp(command, "repeat") == 0 && sscanf(arguments, "%d", &script.repeat) == 1 && script.repeat > 0) {
+        } else if (strcmp(command, "frame") == 0 && sscanf(arguments, "%f %f %f", &pan_x, &pan_y, &zoom) == 3 && zoom > 0.0f) {
+            failures += (headless_frame(renderer, &target, &script, frames, pan_x, pan_y, zoom) ? 0 : 1);
+            frames += 1;
+        } else {
+            fprintf(stderr, "[ERROR]: %s:%d: can't make sense of '%s'\n", script_filename, line_number, command);
+            ok = false;
+        }
+    }
+
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "[ERROR]: Headless run stopped at %s:%d\n", script_filename, line_number);
+    }
+
+    printf("%d frames, %d failed\n", frames, failures);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &target.framebuffer);
+    glDeleteRenderbuffers(1, &target.colour);
+
+    return(ok && failures == 0);
+}
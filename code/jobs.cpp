@@ -0,0 +1,469 @@
+// Job system everything that runs off the main thread goes through: loading images, decoding thumbnails and
+// tiles, generating mips, compressing blocks, the batch thumbnailer.
+//
+// Every worker has a deque per priority. A worker runs its own newest job first and, when it has none left,
+// steals the oldest job of another worker, so work spreads out without everybody fighting over one queue.
+// High priority jobs anywhere go before normal ones, normal ones before low ones. Jobs submitted from threads
+// that aren't workers (the main thread) are dealt out to the workers in turn.
+//
+// A job can depend on others (job_depends_on()), it's only queued once all of them are done. It can also
+// belong to a Job_Token: cancelling the token drops its jobs that haven't started yet (they count as done,
+// so whatever depends on them still runs), running ones can check job_cancelled() to stop early, and
+// job_token_wait() waits for all of them. Waiting runs other jobs meanwhile, which is what makes it fine
+// for jobs to wait for jobs they submitted themselves.
+//
+// NOTE(Aiden): The main thread never has to wait for anything, it polls job_done() once a frame. There's one
+// worker less than there are cores, the main thread keeps its own for GL and input.
+
+#define JOB_MAX_WORKERS 64
+#define JOB_HELP_SLEEP_US 50 // How long job_wait() backs off when there's nothing it could run meanwhile.
+
+enum Job_Priority
+{
+    JOB_PRIORITY_HIGH,   // Whatever the user is waiting for right now, the image being opened.
+    JOB_PRIORITY_NORMAL, // What's on screen but still missing.
+    JOB_PRIORITY_LOW,    // Prefetching.
+
+    JOB_PRIORITY_COUNT
+};
+
+struct Job_Token
+{
+    std::atomic<bool> cancelled;
+    std::atomic<int> outstanding; // Jobs submitted with the token that haven't finished yet.
+};
+
+struct Job
+{
+    std::function<void()> work;
+    Job_Priority priority;
+    Job_Token *token;
+
+    std::atomic<int> references;
+    std::atomic<int> blockers; // Unfinished dependencies, plus one until it's submitted.
+    std::atomic<bool> finished;
+
+    // Jobs waiting for this one, only touched with 'mutex' held.
+    std::mutex mutex;
+    Job **continuations;
+    int continuation_count;
+    int continuation_capacity;
+};
+
+// NOTE(Aiden): Jobs live in [first, count). The owner pushes and pops at 'count', thieves take from 'first'.
+struct Job_Deque
+{
+    std::mutex mutex;
+    Job **jobs;
+    int first;
+    int count;
+    int capacity;
+};
+
+struct Job_Worker
+{
+    Job_Deque deques[JOB_PRIORITY_COUNT];
+    std::thread thread;
+
+    std::atomic<unsigned long long> jobs_run; // Cancelled ones too.
+    std::atomic<unsigned long long> steals;
+    std::atomic<unsigned long long> busy_nanoseconds;
+};
+
+struct Job_System
+{
+    Job_Worker workers[JOB_MAX_WORKERS];
+    int worker_count;
+    int deque_count; // At least one, so a system without workers still has somewhere to put jobs.
+
+    std::atomic<int> queued;
+    std::atomic<unsigned int> next_deque;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool quit;
+
+    std::chrono::steady_clock::time_point started;
+};
+
+global Job_System *job_system = NULL; // The one the viewer uses, created at startup.
+global thread_local Job_System *job_worker_system = NULL; // Whose worker the current thread is, if anybody's.
+global thread_local int job_worker_index = -1;
+global thread_local int job_depth = 0; // How many jobs the current thread is in the middle of.
+global thread_local Job_Priority job_priority = JOB_PRIORITY_HIGH; // Of the innermost of those, high outside of jobs.
+
+// Which of 'system's workers the current thread is, -1 for any other thread.
+internal inline int job_current_worker(Job_System *system)
+{
+    return(job_worker_system == system ? job_worker_index : -1);
+}
+
+internal bool job_deque_push(Job_Deque *deque, Job *job)
+{
+    std::lock_guard<std::mutex> lock(deque->mutex);
+
+    if (deque->first > 0) {
+        memmove(deque->jobs, deque->jobs + deque->first, sizeof(Job *) * (deque->count - deque->first));
+        deque->count -= deque->first;
+        deque->first = 0;
+    }
+
+    if (deque->count == deque->capacity) {
+        int capacity = (deque->capacity ? deque->capacity * 2 : 256);
+        Job **jobs = static_cast<Job **> (realloc(deque->jobs, sizeof(Job *) * capacity));
+        if (jobs == NULL) {
+            return(false);
+        }
+
+        deque->jobs = jobs;
+        deque->capacity = capacity;
+    }
+
+    deque->jobs[deque->count++] = job;
+    return(true);
+}
+
+internal Job *job_deque_pop(Job_Deque *deque, bool oldest)
+{
+    std::lock_guard<std::mutex> lock(deque->mutex);
+
+    if (deque->count == deque->first) {
+        return(NULL);
+    }
+
+    return(oldest ? deque->jobs[deque->first++] : deque->jobs[--deque->count]);
+}
+
+internal void job_release(Job *job)
+{
+    if (--job->references == 0) {
+        free(job->continuations);
+        delete job;
+    }
+}
+
+internal void job_execute(Job_System *system, Job *job);
+
+internal void job_enqueue(Job_System *system, Job *job)
+{
+    int index = job_current_worker(system);
+    index = (index >= 0 ? index : static_cast<int> (system->next_deque++ % system->deque_count));
+
+    if (!job_deque_push(&system->workers[index].deques[job->priority], job)) {
+        job_execute(system, job); // Out of memory, it'll just have to run right here.
+        return;
+    }
+
+    system->queued += 1;
+
+    // NOTE(Aiden): Taking the lock makes sure a worker that just found nothing is either asleep already or
+    // is going to see 'queued' when it checks before sleeping, so the wake up can't get lost in between.
+    {
+        std::lock_guard<std::mutex> lock(system->sleep_mutex);
+    }
+    system->wake.notify_one();
+}
+
+// Marks the job done and queues whatever was only waiting for it.
+internal void job_finish(Job_System *system, Job *job)
+{
+    Job **continuations;
+    int continuation_count;
+
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished = true;
+        continuations = job->continuations;
+        continuation_count = job->continuation_count;
+        job->continuations = NULL;
+        job->continuation_count = 0;
+    }
+
+    for (int i = 0; i < continuation_count; ++i) {
+        if (--continuations[i]->blockers == 0) {
+            job_enqueue(system, continuations[i]);
+        }
+
+        job_release(continuations[i]);
+    }
+
+    free(continuations);
+
+    if (job->token) {
+        job->token->outstanding -= 1;
+    }
+
+    job_release(job);
+}
+
+internal void job_execute(Job_System *system, Job *job)
+{
+    int index = job_current_worker(system);
+    if (index >= 0) {
+        system->workers[index].jobs_run += 1;
+    }
+
+    if (job->token == NULL || !job->token->cancelled) {
+        // Jobs run while waiting inside another job are already part of that one's time.
+        Job_Priority outer_priority = job_priority;
+        job_priority = job->priority;
+        job_depth += 1;
+        auto start = std::chrono::steady_clock::now();
+        job->work();
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        job_depth -= 1;
+        job_priority = outer_priority;
+
+        if (index >= 0 && job_depth == 0) {
+            system->workers[index].busy_nanoseconds += static_cast<unsigned long long> (nanoseconds);
+        }
+    }
+
+    // The closure can hold on to things (buffers, other jobs' results), they go as soon as it's run.
+    job->work = nullptr;
+    job_finish(system, job);
+}
+
+// The most urgent job there is: for each priority the worker's own newest one, then the oldest one of
+// anybody else. 'worker' is -1 for threads that aren't workers, they only ever steal.
+internal Job *job_take(Job_System *system, int worker)
+{
+    for (int priority = 0; priority < JOB_PRIORITY_COUNT; ++priority) {
+        if (worker >= 0) {
+            Job *job = job_deque_pop(&system->workers[worker].deques[priority], false);
+            if (job) {
+                system->queued -= 1;
+                return(job);
+            }
+        }
+
+        for (int i = 1; i <= system->deque_count; ++i) {
+            int victim = (worker + i) % system->deque_count;
+            if (victim == worker) {
+                continue;
+            }
+
+            Job *job = job_deque_pop(&system->workers[victim].deques[priority], true);
+            if (job) {
+                system->queued -= 1;
+                if (worker >= 0) {
+                    system->workers[worker].steals += 1;
+                }
+                return(job);
+            }
+        }
+    }
+
+    return(NULL);
+}
+
+internal void job_worker(Job_System *system, int worker)
+{
+    job_worker_system = system;
+    job_worker_index = worker;
+
+    for (;;) {
+        Job *job = job_take(system, worker);
+        if (job) {
+            job_execute(system, job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(system->sleep_mutex);
+        system->wake.wait(lock, [system] { return(system->quit || system->queued > 0); });
+
+        if (system->quit) {
+            return;
+        }
+    }
+}
+
+// 'worker_count' -1 means one less than there are cores. A system without any runs everything in
+// job_wait() and job_token_wait().
+internal Job_System *job_system_create(int worker_count)
+{
+    if (worker_count < 0) {
+        worker_count = static_cast<int> (std::thread::hardware_concurrency()) - 1;
+        worker_count = (worker_count > 1 ? worker_count : 1);
+    }
+
+    Job_System *system = new Job_System();
+    system->worker_count = MIN(worker_count, JOB_MAX_WORKERS);
+    system->deque_count = (system->worker_count > 0 ? system->worker_count : 1);
+    system->started = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < system->worker_count; ++i) {
+        system->workers[i].thread = std::thread(job_worker, system, i);
+    }
+
+    return(system);
+}
+
+// Everything submitted should be done (or waited for) by now, jobs still queued are dropped.
+internal void job_system_destroy(Job_System *system)
+{
+    {
+        std::lock_guard<std::mutex> lock(system->sleep_mutex);
+        system->quit = true;
+    }
+
+    system->wake.notify_all();
+
+    for (int i = 0; i < system->worker_count; ++i) {
+        system->workers[i].thread.join();
+    }
+
+    for (int i = 0; i < system->deque_count; ++i) {
+        for (int priority = 0; priority < JOB_PRIORITY_COUNT; ++priority) {
+            free(system->workers[i].deques[priority].jobs);
+        }
+    }
+
+    delete system;
+}
+
+// The caller holds a reference until job_release(), the job doesn't run before job_submit().
+internal Job *job_create(std::function<void()> work, Job_Priority priority, Job_Token *token)
+{
+    Job *job = new Job();
+    job->work = std::move(work);
+    job->priority = priority;
+    job->token = token;
+    job->references = 1;
+    job->blockers = 1;
+    return(job);
+}
+
+// 'job' won't start before 'dependency' is done. Only before 'job' is submitted.
+internal void job_depends_on(Job *job, Job *dependency)
+{
+    std::lock_guard<std::mutex> lock(dependency->mutex);
+    if (dependency->finished) {
+        return;
+    }
+
+    if (dependency->continuation_count == dependency->continuation_capacity) {
+        int capacity = (dependency->continuation_capacity ? dependency->continuation_capacity * 2 : 4);
+        Job **continuations = static_cast<Job **> (realloc(dependency->continuations, sizeof(Job *) * capacity));
+        if (continuations == NULL) {
+            return; // NOTE(Aiden): Can't wait for it then, which is still better than never running.
+        }
+
+        dependency->continuations = continuations;
+        dependency->continuation_capacity = capacity;
+    }
+
+    dependency->continuations[dependency->continuation_count++] = job;
+    job->references += 1;
+    job->blockers += 1;
+}
+
+internal void job_submit(Job_System *system, Job *job)
+{
+    job->references += 1; // Dropped by job_finish().
+    if (job->token) {
+        job->token->outstanding += 1;
+    }
+
+    if (--job->blockers == 0) {
+        job_enqueue(system, job);
+    }
+}
+
+// Fire and forget.
+internal void job_run(Job_System *system, std::function<void()> work, Job_Priority priority, Job_Token *token)
+{
+    Job *job = job_create(std::move(work), priority, token);
+    job_submit(system, job);
+    job_release(job);
+}
+
+internal inline bool job_done(Job *job)
+{
+    return(job->finished);
+}
+
+internal inline bool job_cancelled(Job_Token *token)
+{
+    return(token && token->cancelled);
+}
+
+// Runs one queued job on the calling thread, or backs off for a moment if there's none.
+internal void job_help(Job_System *system)
+{
+    Job *job = job_take(system, job_current_worker(system));
+    if (job) {
+        job_execute(system, job);
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(JOB_HELP_SLEEP_US));
+    }
+}
+
+internal void job_wait(Job_System *system, Job *job)
+{
+    while (!job->finished) {
+        job_help(system);
+    }
+}
+
+internal void job_token_cancel(Job_Token *token)
+{
+    token->cancelled = true;
+}
+
+internal void job_token_wait(Job_System *system, Job_Token *token)
+{
+    while (token->outstanding > 0) {
+        job_help(system);
+    }
+}
+
+// Runs 'work' on the calling thread plus 'lanes - 1' jobs and returns once all of them are done. Every 'work'
+// takes its share of what there is to do by itself (from an atomic counter), so it doesn't matter how many
+// of them really end up running at the same time. 'lanes' 0 means one per worker and the caller. Without a
+// job system it's just the calling thread. The lanes get the priority of the job calling this, so splitting up
+// a prefetch doesn't jump ahead of the image being opened.
+internal void job_run_parallel(int lanes, const std::function<void()> &work)
+{
+    Job_System *system = job_system;
+    if (lanes <= 0) {
+        lanes = (system ? system->worker_count + 1 : 1);
+    }
+
+    if (system == NULL || lanes == 1) {
+        work();
+        return;
+    }
+
+    Job_Token token = {};
+    for (int i = 1; i < lanes; ++i) {
+        job_run(system, work, job_priority, &token);
+    }
+
+    work();
+    job_token_wait(system, &token);
+}
+
+internal unsigned long long job_system_steals(Job_System *system)
+{
+    unsigned long long steals = 0;
+    for (int i = 0; i < system->worker_count; ++i) {
+        steals += system->workers[i].steals;
+    }
+
+    return(steals);
+}
+
+// Per worker: jobs run, jobs stolen from others and the share of the time since creation spent running jobs.
+internal void job_system_report(Job_System *system, FILE *file)
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - system->started).count();
+
+    fprintf(file, "%8s %10s %10s %8s\n", "worker", "jobs", "steals", "busy");
+    for (int i = 0; i < system->worker_count; ++i) {
+        Job_Worker *worker = &system->workers[i];
+        double busy = static_cast<double> (worker->busy_nanoseconds) / 1e9;
+        fprintf(file, "%8d %10llu %10llu %7.1f%%\n", i, worker->jobs_run.load(), worker->steals.load(),
+                (seconds > 0.0 ? 100.0 * busy / seconds : 0.0));
+    }
+}
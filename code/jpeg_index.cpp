@@ -0,0 +1,995 @@
+// Region-of-interest decoding for huge baseline JPEGs.
+//
+// Huffman data can only be decoded front to back, so to start anywhere but the beginning we need the exact
+// state of the entropy decoder at that point. One full pass over the scan records a checkpoint (byte position,
+// bit buffer, DC predictors and restart countdown) every JPEG_INDEX_COLUMNS MCUs on every MCU row. Decoding a
+// rectangle then restores the nearest checkpoint left of it on each row it covers and only runs the IDCT for
+// the MCUs inside, so the cost follows the size of the rectangle instead of the size of the image.
+//
+// The same pass keeps the DC coefficient of every block, which is the image at 1/8 scale for free, that's
+// what we show until the full resolution tiles are decoded. Both are kept in the cache (see jpeg_write_index).
+//
+// NOTE(Aiden): Only single scan baseline files are handled (greyscale or 3 interleaved components), which is
+// what cameras and stitchers write. Progressive files need every scan for any pixel, they go the slow way.
+
+#define JPEG_INDEX_COLUMNS 32
+#define JPEG_PREVIEW_LEVEL 3 // The DC-only image is 1/8 scale, which is level 3 of the tile pyramid.
+#define JPEG_MARGIN_MCUS 1   // Chroma upsampling looks at neighbouring samples, decode one MCU more on each side.
+#define JPEG_MAX_MCU_BLOCKS 48 // 3 components of up to 4x4 blocks.
+#define JPEG_MAX_THREADS 32
+#define JPEG_MIN_RANGE_BYTES (1 << 20)
+
+struct Jpeg_Checkpoint
+{
+    unsigned long long offset; // Position in the file, right after the last byte in 'code_buffer'.
+    unsigned int code_buffer;
+    int code_bits;
+    int dc_pred[4];
+    int todo;
+    unsigned char marker;
+    unsigned char nomore;
+    unsigned char padding[2];
+};
+
+struct Jpeg_Index_Header
+{
+    unsigned int width;
+    unsigned int height;
+    unsigned int mcu_x;
+    unsigned int mcu_y;
+    unsigned int column_step;
+    unsigned int preview_width;
+    unsigned int preview_height;
+    unsigned int padding;
+    unsigned long long scan_offset;
+};
+
+struct Jpeg_Planes
+{
+    unsigned char *planes[4];
+    short *dc[4]; // One value per block instead, for the index pass.
+    int strides[4];
+    int origin_x; // In MCUs.
+    int origin_y;
+};
+
+struct Jpeg_Source
+{
+    Mapped_File file;
+    stbi__context context;
+    stbi__jpeg *decoder;
+    size_t scan_offset;
+
+    int width;
+    int height;
+    int components;
+    bool is_rgb;
+
+    // MCU grid of the scan, for a single component scan every block is an MCU of its own.
+    int mcu_x;
+    int mcu_y;
+    int mcu_w;
+    int mcu_h;
+    int h_max;
+    int v_max;
+    int comp_h[4];
+    int comp_v[4];
+    int mcu_blocks; // Blocks per MCU, the DC values jpeg_decode_mcu_dc() writes.
+
+    Jpeg_Checkpoint *checkpoints; // 'row_checkpoints' per MCU row.
+    int row_checkpoints;
+    int index_threads; // What the index pass ended up running on, 1 when it was the serial one.
+
+    unsigned char *preview; // RGBA, 'preview_width' x 'preview_height'.
+    int preview_width;
+    int preview_height;
+};
+
+internal void jpeg_source_destroy(Jpeg_Source *source)
+{
+    if (source->file.data) {
+        platform_unmap_file(&source->file);
+    }
+
+    free(source->decoder);
+    free(source->checkpoints);
+    free(source->preview);
+    free(source);
+}
+
+// Reads everything up to the start of the entropy coded data, without allocating any component planes.
+internal bool jpeg_source_parse(Jpeg_Source *source)
+{
+    stbi__jpeg *z = source->decoder;
+    stbi__context *s = &source->context;
+
+    z->s = s;
+    z->restart_interval = 0;
+    stbi__setup_jpeg(z);
+
+    if (!stbi__decode_jpeg_header(z, STBI__SCAN_header) || z->progressive) {
+        return(false);
+    }
+
+    int m = stbi__get_marker(z);
+    while (!stbi__SOS(m)) {
+        if (stbi__EOI(m) || !stbi__process_marker(z, m)) {
+            return(false);
+        }
+        m = stbi__get_marker(z);
+    }
+
+    if (!stbi__process_scan_header(z)) {
+        return(false);
+    }
+
+    source->width = static_cast<int> (s->img_x);
+    source->height = static_cast<int> (s->img_y);
+    source->components = s->img_n;
+    source->is_rgb = (s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif)));
+    source->scan_offset = static_cast<size_t> (s->img_buffer - s->img_buffer_original);
+
+    // Everything has to be in this one scan.
+    if ((s->img_n != 1 && s->img_n != 3) || z->scan_n != s->img_n) {
+        return(false);
+    }
+
+    if (z->scan_n == 1) {
+        source->h_max = source->v_max = 1;
+        source->comp_h[0] = source->comp_v[0] = 1;
+    } else {
+        source->h_max = source->v_max = 1;
+        for (int i = 0; i < s->img_n; ++i) {
+            source->comp_h[i] = z->img_comp[i].h;
+            source->comp_v[i] = z->img_comp[i].v;
+            source->h_max = (z->img_comp[i].h > source->h_max ? z->img_comp[i].h : source->h_max);
+            source->v_max = (z->img_comp[i].v > source->v_max ? z->img_comp[i].v : source->v_max);
+        }
+
+        for (int i = 0; i < s->img_n; ++i) {
+            if (source->h_max % source->comp_h[i] != 0 || source->v_max % source->comp_v[i] != 0) {
+                return(false);
+            }
+        }
+    }
+
+    source->mcu_blocks = 0;
+    for (int i = 0; i < z->scan_n; ++i) {
+        source->mcu_blocks += source->comp_h[i] * source->comp_v[i];
+    }
+
+    source->mcu_w = source->h_max * 8;
+    source->mcu_h = source->v_max * 8;
+    source->mcu_x = (source->width + source->mcu_w - 1) / source->mcu_w;
+    source->mcu_y = (source->height + source->mcu_h - 1) / source->mcu_h;
+    source->row_checkpoints = (source->mcu_x + JPEG_INDEX_COLUMNS - 1) / JPEG_INDEX_COLUMNS;
+
+    return(true);
+}
+
+internal void jpeg_save_checkpoint(stbi__jpeg *z, Jpeg_Checkpoint *checkpoint)
+{
+    checkpoint->offset = static_cast<unsigned long long> (z->s->img_buffer - z->s->img_buffer_original);
+    checkpoint->code_buffer = z->code_buffer;
+    checkpoint->code_bits = z->code_bits;
+    checkpoint->todo = z->todo;
+    checkpoint->marker = z->marker;
+    checkpoint->nomore = static_cast<unsigned char> (z->nomore);
+
+    for (int i = 0; i < 4; ++i) {
+        checkpoint->dc_pred[i] = z->img_comp[i].dc_pred;
+    }
+}
+
+internal bool jpeg_restore_checkpoint(Jpeg_Source *source, const Jpeg_Checkpoint *checkpoint)
+{
+    stbi__jpeg *z = source->decoder;
+    if (checkpoint->offset < source->scan_offset || checkpoint->offset > source->file.size) {
+        return(false);
+    }
+
+    source->context.img_buffer = source->context.img_buffer_original + checkpoint->offset;
+    z->code_buffer = checkpoint->code_buffer;
+    z->code_bits = checkpoint->code_bits;
+    z->todo = checkpoint->todo;
+    z->marker = checkpoint->marker;
+    z->nomore = checkpoint->nomore;
+
+    for (int i = 0; i < 4; ++i) {
+        z->img_comp[i].dc_pred = checkpoint->dc_pred[i];
+    }
+
+    return(true);
+}
+
+// Same restart handling as stbi__parse_entropy_coded_data, called after every MCU.
+internal bool jpeg_finish_mcu(Jpeg_Source *source, stbi__jpeg *z, int mcu_x, int mcu_y)
+{
+    if (--z->todo <= 0) {
+        if (z->code_bits < 24) {
+            stbi__grow_buffer_unsafe(z);
+        }
+
+        if (!STBI__RESTART(z->marker)) {
+            return(mcu_x == source->mcu_x - 1 && mcu_y == source->mcu_y - 1);
+        }
+
+        stbi__jpeg_reset(z);
+    }
+
+    return(true);
+}
+
+// Decodes one MCU at the current position, 'out' can be NULL to only advance the entropy decoder.
+internal bool jpeg_decode_mcu(Jpeg_Source *source, int mcu_x, int mcu_y, const Jpeg_Planes *out)
+{
+    stbi__jpeg *z = source->decoder;
+    STBI_SIMD_ALIGN(short, data[64]);
+
+    for (int k = 0; k < z->scan_n; ++k) {
+        int n = z->order[k];
+        int h = source->comp_h[n];
+        int v = source->comp_v[n];
+        int ha = z->img_comp[n].ha;
+
+        for (int y = 0; y < v; ++y) {
+            for (int x = 0; x < h; ++x) {
+                if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) {
+                    return(false);
+                }
+
+                if (out) {
+                    int bx = (mcu_x - out->origin_x) * h + x;
+                    int by = (mcu_y - out->origin_y) * v + y;
+                    z->idct_block_kernel(out->planes[n] + by * 8 * out->strides[n] + bx * 8, out->strides[n], data);
+                }
+            }
+        }
+    }
+
+    return(jpeg_finish_mcu(source, z, mcu_x, mcu_y));
+}
+
+// Entropy decodes one MCU and keeps only the DC value of each block, in scan order.
+internal bool jpeg_decode_mcu_dc(Jpeg_Source *source, stbi__jpeg *z, short *dc)
+{
+    STBI_SIMD_ALIGN(short, data[64]);
+
+    for (int k = 0; k < z->scan_n; ++k) {
+        int n = z->order[k];
+        int ha = z->img_comp[n].ha;
+
+        for (int b = 0; b < source->comp_h[n] * source->comp_v[n]; ++b) {
+            if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) {
+                return(false);
+            }
+
+            *dc++ = static_cast<short> (z->img_comp[n].dc_pred);
+        }
+    }
+
+    return(true);
+}
+
+// Puts the DC values of one MCU (as written by jpeg_decode_mcu_dc) into per-component planes,
+// 'offset' is what has to be added to every value of a component to get the real one.
+internal void jpeg_store_mcu_dc(Jpeg_Source *source, const Jpeg_Planes *out, int mcu_x, int mcu_y, const short *dc, const int *offset)
+{
+    stbi__jpeg *z = source->decoder;
+
+    for (int k = 0; k < z->scan_n; ++k) {
+        int n = z->order[k];
+        int h = source->comp_h[n];
+        int v = source->comp_v[n];
+
+        for (int y = 0; y < v; ++y) {
+            short *row = out->dc[n] + static_cast<size_t> (mcu_y * v + y) * out->strides[n] + mcu_x * h;
+
+            for (int x = 0; x < h; ++x) {
+                row[x] = static_cast<short> (*dc++ + offset[n]);
+            }
+        }
+    }
+}
+
+internal void jpeg_start_scan(Jpeg_Source *source)
+{
+    source->context.img_buffer = source->context.img_buffer_original + source->scan_offset;
+    stbi__jpeg_reset(source->decoder);
+}
+
+// Turns the per-block DC values into the RGBA preview, one preview pixel per 8x8 pixels of the image.
+// A block with only its DC coefficient set decodes to a flat dc/8 + 128.
+internal void jpeg_build_preview(Jpeg_Source *source, const Jpeg_Planes *dc, unsigned char *rows)
+{
+    stbi__jpeg *z = source->decoder;
+
+    for (int y = 0; y < source->preview_height; ++y) {
+        for (int n = 0; n < source->components; ++n) {
+            int hs = source->h_max / source->comp_h[n];
+            int vs = source->v_max / source->comp_v[n];
+            float scale = static_cast<float> (z->dequant[z->img_comp[n].tq][0]) / 8.0f;
+            const short *line = dc->dc[n] + static_cast<size_t> (y / vs) * dc->strides[n];
+
+            for (int x = 0; x < source->preview_width; ++x) {
+                rows[n * source->preview_width + x] = static_cast<unsigned char> (clamp_byte(line[x / hs] * scale + 128.0f));
+            }
+        }
+
+        unsigned char *out = source->preview + static_cast<size_t> (y) * source->preview_width * 4;
+        const unsigned char *c0 = rows;
+        const unsigned char *c1 = rows + source->preview_width;
+        const unsigned char *c2 = rows + source->preview_width * 2;
+
+        if (source->components == 1 || source->is_rgb) {
+            for (int x = 0; x < source->preview_width; ++x) {
+                out[x*4 + 0] = c0[x];
+                out[x*4 + 1] = (source->components == 1 ? c0[x] : c1[x]);
+                out[x*4 + 2] = (source->components == 1 ? c0[x] : c2[x]);
+                out[x*4 + 3] = 255;
+            }
+        } else {
+            z->YCbCr_to_RGB_kernel(out, c0, c1, c2, source->preview_width, 4);
+        }
+    }
+}
+
+internal bool jpeg_build_index_serial(Jpeg_Source *source, const Jpeg_Planes *dc)
+{
+    stbi__jpeg *z = source->decoder;
+    short values[JPEG_MAX_MCU_BLOCKS];
+    int no_offset[4] = {0};
+
+    jpeg_start_scan(source);
+
+    for (int j = 0; j < source->mcu_y; ++j) {
+        Jpeg_Checkpoint *row = source->checkpoints + static_cast<size_t> (j) * source->row_checkpoints;
+
+        for (int i = 0; i < source->mcu_x; ++i) {
+            if (i % JPEG_INDEX_COLUMNS == 0) {
+                jpeg_save_checkpoint(z, &row[i / JPEG_INDEX_COLUMNS]);
+            }
+
+            if (!jpeg_decode_mcu_dc(source, z, values) || !jpeg_finish_mcu(source, z, i, j)) {
+                return(false);
+            }
+
+            jpeg_store_mcu_dc(source, dc, i, j, values, no_offset);
+        }
+    }
+
+    return(true);
+}
+
+// Parallel index pass
+//
+// Without restart markers there's no place in the scan we know an MCU starts at, except the very first one.
+// So the scan is cut into equal byte ranges and every thread just starts decoding at the beginning of its range,
+// as if an MCU started there, recording the state before every MCU it decodes. The first MCUs are garbage, but
+// Huffman codes resynchronise quickly: after a few MCUs the speculative decoder ends up at exactly the same bit
+// position as the real one, at an MCU boundary, and from there on both decode the same MCUs.
+//
+// Once all ranges are done, every thread continues past the end of its range until it hits an MCU start the next
+// thread recorded, that's where the next thread's results become valid. DC values are coded as differences,
+// so the next thread's are off by a constant per component, which we know at the sync point too. Stitching is
+// then just copying every thread's valid MCUs in order, with the right offsets.
+
+struct Jpeg_Mcu_State
+{
+    long long position; // Bit position in the scan, with stuffed zero bytes not counted. Relative to the range start.
+    unsigned int offset;
+    unsigned int code_buffer;
+    int code_bits;
+    short dc_pred[4];
+    unsigned char marker;
+    unsigned char nomore;
+};
+
+struct Jpeg_Mcu_List
+{
+    Jpeg_Mcu_State *states;
+    short *dc; // 'stride' per MCU.
+    int stride; // Jpeg_Source::mcu_blocks.
+    int count;
+    int capacity;
+};
+
+struct Jpeg_Speculation
+{
+    stbi__jpeg decoder;
+    stbi__context context;
+
+    size_t start; // Byte range in the file.
+    size_t end;
+
+    size_t stuffing_at; // How far we've looked for stuffed bytes, and how many we found after 'start'.
+    long long stuffing_count;
+
+    Jpeg_Mcu_List mcus;    // Decoded within the range.
+    Jpeg_Mcu_List overlap; // Decoded past the range, until we caught up with the next range.
+
+    int sync;   // First MCU in 'mcus' that's a real one, set by the previous range.
+    int dc_offset[4];
+    bool synced;
+    bool failed;
+};
+
+internal bool jpeg_grow_mcus(Jpeg_Mcu_List *list, int capacity)
+{
+    Jpeg_Mcu_State *states = static_cast<Jpeg_Mcu_State *> (realloc(list->states, sizeof(Jpeg_Mcu_State) * capacity));
+    if (states) {
+        list->states = states;
+    }
+
+    short *values = static_cast<short *> (realloc(list->dc, sizeof(short) * list->stride * capacity));
+    if (values) {
+        list->dc = values;
+    }
+
+    if (states == NULL || values == NULL) {
+        return(false);
+    }
+
+    list->capacity = capacity;
+    return(true);
+}
+
+// NOTE(Aiden): Ranges are sized for their share of the MCUs up front (see jpeg_build_index_parallel()), so
+// this only grows the ones that turned out denser than average, and by half rather than double.
+internal Jpeg_Mcu_State *jpeg_push_mcu(Jpeg_Mcu_List *list, short **dc)
+{
+    if (list->count == list->capacity && !jpeg_grow_mcus(list, list->capacity + list->capacity / 2 + 256)) {
+        return(NULL);
+    }
+
+    *dc = list->dc + static_cast<size_t> (list->count) * list->stride;
+    return(&list->states[list->count++]);
+}
+
+// Bit position of the decoder relative to 'base', stuffed bytes since 'base' are counted as we go.
+internal long long jpeg_bit_position(Jpeg_Speculation *range, stbi__jpeg *z, size_t base)
+{
+    const unsigned char *data = z->s->img_buffer_original;
+    size_t at = static_cast<size_t> (z->s->img_buffer - data);
+
+    while (range->stuffing_at < at) {
+        if (data[range->stuffing_at] == 0xFF && range->stuffing_at + 1 < at && data[range->stuffing_at + 1] == 0x00) {
+            range->stuffing_count += 1;
+            range->stuffing_at += 2;
+        } else {
+            range->stuffing_at += 1;
+        }
+    }
+
+    return((static_cast<long long> (at) - static_cast<long long> (base)) * 8 - z->code_bits - range->stuffing_count * 8);
+}
+
+internal void jpeg_record_state(Jpeg_Mcu_State *state, stbi__jpeg *z, long long position)
+{
+    state->position = position;
+    state->offset = static_cast<unsigned int> (z->s->img_buffer - z->s->img_buffer_original);
+    state->code_buffer = z->code_buffer;
+    state->code_bits = z->code_bits;
+    state->marker = z->marker;
+    state->nomore = static_cast<unsigned char> (z->nomore);
+
+    for (int i = 0; i < 4; ++i) {
+        state->dc_pred[i] = static_cast<short> (z->img_comp[i].dc_pred);
+    }
+}
+
+// Decodes the range as if an MCU started right at its first byte. The first range is the only one that's right from the start.
+internal void jpeg_speculate(Jpeg_Source *source, Jpeg_Speculation *range, bool first)
+{
+    stbi__jpeg *z = &range->decoder;
+    z->s = &range->context;
+    range->context.img_buffer = range->context.img_buffer_original + range->start;
+    range->stuffing_at = range->start;
+    stbi__jpeg_reset(z);
+
+    unsigned char *restart_at = range->context.img_buffer;
+
+    while (!z->nomore && range->context.img_buffer < range->context.img_buffer_original + range->end) {
+        short *dc;
+        Jpeg_Mcu_State *state = jpeg_push_mcu(&range->mcus, &dc);
+        if (state == NULL) {
+            range->failed = true;
+            return;
+        }
+
+        jpeg_record_state(state, z, jpeg_bit_position(range, z, range->start));
+
+        if (!jpeg_decode_mcu_dc(source, z, dc)) {
+            if (first) {
+                range->failed = true;
+                return;
+            }
+
+            // NOTE(Aiden): Garbage we haven't synced out of yet, start over a bit further on. Recorded states
+            // stay usable, the positions don't depend on where we started.
+            range->mcus.count -= 1;
+            if (range->context.img_buffer == restart_at) {
+                range->context.img_buffer += 1;
+            }
+            restart_at = range->context.img_buffer;
+            stbi__jpeg_reset(z);
+        }
+    }
+}
+
+// Continues from where the range stopped until we're at an MCU start the next range recorded too.
+internal void jpeg_synchronise(Jpeg_Source *source, Jpeg_Speculation *range, Jpeg_Speculation *next)
+{
+    stbi__jpeg *z = &range->decoder;
+
+    // Positions from here on are relative to the next range's start, like the ones it recorded.
+    range->stuffing_at = next->start;
+    range->stuffing_count = 0;
+
+    for (int k = 0; !range->failed; ) {
+        if (range->context.img_buffer >= range->context.img_buffer_original + next->start) {
+            long long position = jpeg_bit_position(range, z, next->start);
+
+            while (k < next->mcus.count && next->mcus.states[k].position < position) {
+                k += 1;
+            }
+
+            if (k == next->mcus.count) {
+                range->failed = true;
+                break;
+            }
+
+            if (next->mcus.states[k].position == position) {
+                next->sync = k;
+                for (int i = 0; i < 4; ++i) {
+                    next->dc_offset[i] = z->img_comp[i].dc_pred - next->mcus.states[k].dc_pred[i];
+                }
+                next->synced = true;
+                break;
+            }
+        }
+
+        short *dc;
+        Jpeg_Mcu_State *state = jpeg_push_mcu(&range->overlap, &dc);
+        if (state == NULL || z->nomore) {
+            range->failed = true;
+            break;
+        }
+
+        jpeg_record_state(state, z, 0);
+        range->failed = !jpeg_decode_mcu_dc(source, z, dc);
+    }
+}
+
+internal void jpeg_store_state(Jpeg_Source *source, const Jpeg_Mcu_State *state, const int *offset, int index, Jpeg_Checkpoint *checkpoint)
+{
+    checkpoint->offset = state->offset;
+    checkpoint->code_buffer = state->code_buffer;
+    checkpoint->code_bits = state->code_bits;
+    checkpoint->marker = state->marker;
+    checkpoint->nomore = state->nomore;
+
+    // No restart interval, so the countdown just started at its maximum.
+    checkpoint->todo = 0x7fffffff - index;
+
+    for (int i = 0; i < 4; ++i) {
+        checkpoint->dc_pred[i] = (i < source->components ? static_cast<short> (state->dc_pred[i] + offset[i]) : 0);
+    }
+}
+
+// Copies the valid MCUs of a list into the index, returns the index of the next MCU.
+internal int jpeg_stitch(Jpeg_Source *source, const Jpeg_Planes *dc, const Jpeg_Mcu_List *list, int first, const int *offset, int index)
+{
+    int total = source->mcu_x * source->mcu_y;
+
+    for (int k = first; k < list->count && index < total; ++k, ++index) {
+        int i = index % source->mcu_x;
+        int j = index / source->mcu_x;
+
+        if (i % JPEG_INDEX_COLUMNS == 0) {
+            jpeg_store_state(source, &list->states[k], offset, index,
+                             &source->checkpoints[static_cast<size_t> (j) * source->row_checkpoints + i / JPEG_INDEX_COLUMNS]);
+        }
+
+        jpeg_store_mcu_dc(source, dc, i, j, list->dc + static_cast<size_t> (k) * list->stride, offset);
+    }
+
+    return(index);
+}
+
+internal bool jpeg_build_index_parallel(Jpeg_Source *source, const Jpeg_Planes *dc, int thread_count)
+{
+    Jpeg_Speculation *ranges = static_cast<Jpeg_Speculation *> (calloc(thread_count, sizeof(Jpeg_Speculation)));
+    if (ranges == NULL) {
+        return(false);
+    }
+
+    // Every range gets about its share of the MCUs, plus some for ranges that are denser than average.
+    int share = source->mcu_x * source->mcu_y / thread_count;
+    share += share / 8 + 256;
+
+    size_t scan_size = source->file.size - source->scan_offset;
+    for (int t = 0; t < thread_count; ++t) {
+        Jpeg_Speculation *range = &ranges[t];
+        range->mcus.stride = range->overlap.stride = source->mcu_blocks;
+        jpeg_grow_mcus(&range->mcus, share); // Just a head start, jpeg_push_mcu() grows it when it can't.
+
+        range->decoder = *source->decoder;
+        range->context = source->context;
+        range->start = source->scan_offset + scan_size * t / thread_count;
+        range->end = source->scan_offset + scan_size * (t + 1) / thread_count;
+
+        // Never start on the zero byte that belongs to a stuffed 0xFF.
+        if (t > 0 && source->file.data[range->start - 1] == 0xFF) {
+            range->start += 1;
+        }
+    }
+
+    std::thread threads[JPEG_MAX_THREADS];
+    for (int t = 1; t < thread_count; ++t) {
+        threads[t] = std::thread(jpeg_speculate, source, &ranges[t], false);
+    }
+    jpeg_speculate(source, &ranges[0], true);
+    for (int t = 1; t < thread_count; ++t) {
+        threads[t].join();
+    }
+
+    for (int t = 1; t < thread_count; ++t) {
+        threads[t] = std::thread(jpeg_synchronise, source, &ranges[t - 1], &ranges[t]);
+    }
+    for (int t = 1; t < thread_count; ++t) {
+        threads[t].join();
+    }
+
+    bool ok = !ranges[0].failed;
+    for (int t = 1; ok && t < thread_count; ++t) {
+        ok = ranges[t].synced && !ranges[t].failed;
+    }
+
+    // DC offsets add up along the chain of ranges, the first one is exact.
+    int offset[4] = {0};
+    int index = 0;
+
+    for (int t = 0; ok && t < thread_count; ++t) {
+        Jpeg_Speculation *range = &ranges[t];
+        for (int i = 0; i < 4 && t > 0; ++i) {
+            offset[i] += range->dc_offset[i];
+        }
+
+        index = jpeg_stitch(source, dc, &range->mcus, range->sync, offset, index);
+        index = jpeg_stitch(source, dc, &range->overlap, 0, offset, index);
+    }
+
+    // The last range stops as soon as it sees the end of the scan, the few MCUs still in its bit buffer are left.
+    if (ok && index < source->mcu_x * source->mcu_y) {
+        Jpeg_Speculation *last = &ranges[thread_count - 1];
+        stbi__jpeg *z = &last->decoder;
+        short values[JPEG_MAX_MCU_BLOCKS];
+
+        for (; ok && index < source->mcu_x * source->mcu_y; ++index) {
+            int i = index % source->mcu_x;
+            int j = index / source->mcu_x;
+
+            if (i % JPEG_INDEX_COLUMNS == 0) {
+                Jpeg_Mcu_State state;
+                jpeg_record_state(&state, z, 0);
+                jpeg_store_state(source, &state, offset, index,
+                                 &source->checkpoints[static_cast<size_t> (j) * source->row_checkpoints + i / JPEG_INDEX_COLUMNS]);
+            }
+
+            ok = jpeg_decode_mcu_dc(source, z, values);
+            jpeg_store_mcu_dc(source, dc, i, j, values, offset);
+        }
+    }
+
+    for (int t = 0; t < thread_count; ++t) {
+        free(ranges[t].mcus.states);
+        free(ranges[t].mcus.dc);
+        free(ranges[t].overlap.states);
+        free(ranges[t].overlap.dc);
+    }
+    free(ranges);
+
+    return(ok);
+}
+
+// Speculation only pays off for big scans without restart markers, everything else is indexed on one thread.
+internal int jpeg_index_thread_count(Jpeg_Source *source)
+{
+    if (source->decoder->restart_interval != 0) {
+        return(1);
+    }
+
+    size_t ranges = (source->file.size - source->scan_offset) / JPEG_MIN_RANGE_BYTES;
+    int thread_count = static_cast<int> (std::thread::hardware_concurrency());
+    thread_count = MIN(thread_count, static_cast<int> (MIN(ranges, static_cast<size_t> (JPEG_MAX_THREADS))));
+
+    return(thread_count > 1 ? thread_count : 1);
+}
+
+// The one full pass: records the checkpoints and the DC-only preview. 'thread_count' of 0 picks one.
+internal bool jpeg_build_index(Jpeg_Source *source, int thread_count)
+{
+    PROFILE_ZONE(PROFILE_JPEG_INDEX);
+
+    size_t checkpoint_count = static_cast<size_t> (source->row_checkpoints) * source->mcu_y;
+    source->checkpoints = static_cast<Jpeg_Checkpoint *> (calloc(checkpoint_count, sizeof(Jpeg_Checkpoint)));
+    source->preview = static_cast<unsigned char *> (malloc(static_cast<size_t> (source->preview_width) * source->preview_height * 4));
+
+    Jpeg_Planes dc = {0};
+    bool ok = (source->checkpoints != NULL && source->preview != NULL);
+
+    for (int n = 0; ok && n < source->components; ++n) {
+        dc.strides[n] = source->mcu_x * source->comp_h[n];
+        dc.dc[n] = static_cast<short *> (malloc(sizeof(short) * dc.strides[n] * source->mcu_y * source->comp_v[n]));
+        ok = (dc.dc[n] != NULL);
+    }
+
+    unsigned char *rows = (ok ? static_cast<unsigned char *> (malloc(static_cast<size_t> (source->preview_width) * source->components)) : NULL);
+    ok = ok && (rows != NULL);
+
+    if (thread_count == 0) {
+        thread_count = jpeg_index_thread_count(source);
+    }
+    thread_count = MIN(thread_count, JPEG_MAX_THREADS);
+
+    if (ok) {
+        // NOTE(Aiden): The speculative pass gives up on broken files, on ranges too short to resynchronise in
+        // and when out of memory, the serial one deals with all of those.
+        source->index_threads = thread_count;
+        if (thread_count <= 1 || source->decoder->restart_interval != 0 || !jpeg_build_index_parallel(source, &dc, thread_count)) {
+            source->index_threads = 1;
+            ok = jpeg_build_index_serial(source, &dc);
+        }
+    }
+
+    if (ok) {
+        jpeg_build_preview(source, &dc, rows);
+    }
+
+    for (int n = 0; n < source->components; ++n) {
+        free(dc.dc[n]);
+    }
+    free(rows);
+
+    return(ok);
+}
+
+internal bool jpeg_read_index(Jpeg_Source *source, const char *filename)
+{
+    PROFILE_ZONE(PROFILE_FILE_READ);
+
+    FILE *file = cache_open_entry(filename, ".jix", CACHE_MAGIC_JPEG_INDEX);
+    if (file == NULL) {
+        return(false);
+    }
+
+    Jpeg_Index_Header header;
+    bool ok = (fread(&header, sizeof(header), 1, file) == 1 &&
+               header.width == static_cast<unsigned int> (source->width) &&
+               header.height == static_cast<unsigned int> (source->height) &&
+               header.mcu_x == static_cast<unsigned int> (source->mcu_x) &&
+               header.mcu_y == static_cast<unsigned int> (source->mcu_y) &&
+               header.column_step == JPEG_INDEX_COLUMNS &&
+               header.preview_width == static_cast<unsigned int> (source->preview_width) &&
+               header.preview_height == static_cast<unsigned int> (source->preview_height) &&
+               header.scan_offset == source->scan_offset);
+
+    size_t checkpoint_count = static_cast<size_t> (source->row_checkpoints) * source->mcu_y;
+    size_t preview_size = static_cast<size_t> (source->preview_width) * source->preview_height * 4;
+
+    if (ok) {
+        source->checkpoints = static_cast<Jpeg_Checkpoint *> (malloc(checkpoint_count * sizeof(Jpeg_Checkpoint)));
+        source->preview = static_cast<unsigned char *> (malloc(preview_size));
+
+        ok = (source->checkpoints != NULL && source->preview != NULL &&
+              fread(source->checkpoints, sizeof(Jpeg_Checkpoint), checkpoint_count, file) == checkpoint_count &&
+              fread(source->preview, 1, preview_size, file) == preview_size);
+    }
+
+    if (!ok) {
+        free(source->checkpoints);
+        free(source->preview);
+        source->checkpoints = NULL;
+        source->preview = NULL;
+    }
+
+    fclose(file);
+    return(ok);
+}
+
+// Layout of a cache entry: Cache_Header + Jpeg_Index_Header, every checkpoint in row order, the RGBA preview.
+internal void jpeg_write_index(Jpeg_Source *source, const char *filename)
+{
+    FILE *file = cache_create_entry(filename, ".jix", CACHE_MAGIC_JPEG_INDEX);
+    if (file == NULL) {
+        return;
+    }
+
+    Jpeg_Index_Header header = {0};
+    header.width = static_cast<unsigned int> (source->width);
+    header.height = static_cast<unsigned int> (source->height);
+    header.mcu_x = static_cast<unsigned int> (source->mcu_x);
+    header.mcu_y = static_cast<unsigned int> (source->mcu_y);
+    header.column_step = JPEG_INDEX_COLUMNS;
+    header.preview_width = static_cast<unsigned int> (source->preview_width);
+    header.preview_height = static_cast<unsigned int> (source->preview_height);
+    header.scan_offset = source->scan_offset;
+
+    size_t checkpoint_count = static_cast<size_t> (source->row_checkpoints) * source->mcu_y;
+    size_t preview_size = static_cast<size_t> (source->preview_width) * source->preview_height * 4;
+
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1 &&
+               fwrite(source->checkpoints, sizeof(Jpeg_Checkpoint), checkpoint_count, file) == checkpoint_count &&
+               fwrite(source->preview, 1, preview_size, file) == preview_size);
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok) {
+        cache_remove_entry(filename, ".jix");
+    }
+}
+
+// Returns NULL for anything that isn't a JPEG we can decode by region.
+internal Jpeg_Source *jpeg_source_open(const char *filename)
+{
+    Jpeg_Source *source = static_cast<Jpeg_Source *> (calloc(1, sizeof(Jpeg_Source)));
+    if (source == NULL) {
+        return(NULL);
+    }
+
+    source->decoder = static_cast<stbi__jpeg *> (calloc(1, sizeof(stbi__jpeg)));
+
+    // NOTE(Aiden): stb_image's memory context takes an int length, anything bigger has to go the slow way.
+    if (source->decoder == NULL || !platform_map_file(filename, &source->file) || source->file.size > INT_MAX) {
+        jpeg_source_destroy(source);
+        return(NULL);
+    }
+
+    stbi__start_mem(&source->context, source->file.data, static_cast<int> (source->file.size));
+
+    if (!jpeg_source_parse(source)) {
+        jpeg_source_destroy(source);
+        return(NULL);
+    }
+
+    return(source);
+}
+
+// Gets the index and preview from the cache, or builds (and caches) them with a pass over the whole scan.
+internal bool jpeg_source_load_index(Jpeg_Source *source, const char *filename, int preview_width, int preview_height)
+{
+    source->preview_width = preview_width;
+    source->preview_height = preview_height;
+
+    if (jpeg_read_index(source, filename)) {
+        return(true);
+    }
+
+    if (!jpeg_build_index(source, 0)) {
+        return(false);
+    }
+
+    jpeg_write_index(source, filename);
+    return(true);
+}
+
+// Decodes the pixels in [x, x + width) x [y, y + height) into 'out' (RGBA, 'width' pixels per row).
+// NOTE(Aiden): The result is bit-exact with decoding the whole image through stb_image.
+internal bool jpeg_decode_region(Jpeg_Source *source, int x, int y, int width, int height, unsigned char *out)
+{
+    PROFILE_ZONE(PROFILE_JPEG_REGION);
+
+    stbi__jpeg *z = source->decoder;
+
+    int i0 = x / source->mcu_w - JPEG_MARGIN_MCUS;
+    int j0 = y / source->mcu_h - JPEG_MARGIN_MCUS;
+    int i1 = (x + width + source->mcu_w - 1) / source->mcu_w + JPEG_MARGIN_MCUS;
+    int j1 = (y + height + source->mcu_h - 1) / source->mcu_h + JPEG_MARGIN_MCUS;
+
+    i0 = (i0 < 0 ? 0 : i0);
+    j0 = (j0 < 0 ? 0 : j0);
+    i1 = MIN(i1, source->mcu_x);
+    j1 = MIN(j1, source->mcu_y);
+
+    // Pixel rectangle covered by the decoded MCUs.
+    int region_x = i0 * source->mcu_w;
+    int region_y = j0 * source->mcu_h;
+    int region_w = MIN((i1 - i0) * source->mcu_w, source->width - region_x);
+    int region_h = MIN((j1 - j0) * source->mcu_h, source->height - region_y);
+
+    Jpeg_Planes planes = {0};
+    planes.origin_x = i0;
+    planes.origin_y = j0;
+
+    unsigned char *linebuf[4] = {0};
+    bool ok = true;
+
+    for (int n = 0; ok && n < source->components; ++n) {
+        planes.strides[n] = (i1 - i0) * source->comp_h[n] * 8;
+        planes.planes[n] = static_cast<unsigned char *> (malloc(static_cast<size_t> (planes.strides[n]) * (j1 - j0) * source->comp_v[n] * 8));
+        linebuf[n] = static_cast<unsigned char *> (malloc(static_cast<size_t> (region_w) + 3));
+        ok = (planes.planes[n] != NULL && linebuf[n] != NULL);
+    }
+
+    // Resume every row from the closest checkpoint and only run the IDCT for the MCUs we keep.
+    for (int j = j0; ok && j < j1; ++j) {
+        int first = i0 / JPEG_INDEX_COLUMNS;
+        ok = jpeg_restore_checkpoint(source, &source->checkpoints[static_cast<size_t> (j) * source->row_checkpoints + first]);
+
+        for (int i = first * JPEG_INDEX_COLUMNS; ok && i < i1; ++i) {
+            ok = jpeg_decode_mcu(source, i, j, (i >= i0 ? &planes : NULL));
+        }
+    }
+
+    // Upsample and colour convert like load_jpeg_image does, but only hand the requested columns to the converter.
+    if (ok) {
+        stbi__resample resample[4];
+        unsigned char *coutput[4] = {0};
+        int component_rows[4];
+
+        for (int n = 0; n < source->components; ++n) {
+            stbi__resample *r = &resample[n];
+            r->hs = source->h_max / source->comp_h[n];
+            r->vs = source->v_max / source->comp_v[n];
+            r->ystep = r->vs >> 1;
+            r->w_lores = (region_w + r->hs - 1) / r->hs;
+            r->ypos = 0;
+            r->line0 = r->line1 = planes.planes[n];
+
+            // Rows of this component we can step through, stb_image stops at the bottom of the image too.
+            component_rows[n] = (source->height * source->comp_v[n] + source->v_max - 1) / source->v_max - j0 * source->comp_v[n] * 8;
+            component_rows[n] = MIN(component_rows[n], (j1 - j0) * source->comp_v[n] * 8);
+
+            if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+            else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+            else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+            else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+            else                               r->resample = stbi__resample_row_generic;
+        }
+
+        int dx = x - region_x;
+        for (int row = 0; row < MIN(region_h, y + height - region_y); ++row) {
+            for (int n = 0; n < source->components; ++n) {
+                stbi__resample *r = &resample[n];
+                int y_bot = r->ystep >= (r->vs >> 1);
+
+                coutput[n] = r->resample(linebuf[n], y_bot ? r->line1 : r->line0, y_bot ? r->line0 : r->line1, r->w_lores, r->hs);
+                if (++r->ystep >= r->vs) {
+                    r->ystep = 0;
+                    r->line0 = r->line1;
+                    if (++r->ypos < component_rows[n]) {
+                        r->line1 += planes.strides[n];
+                    }
+                }
+            }
+
+            if (row + region_y < y) {
+                continue;
+            }
+
+            unsigned char *dst = out + static_cast<size_t> (row + region_y - y) * width * 4;
+            if (source->components == 1) {
+                for (int i = 0; i < width; ++i, dst += 4) {
+                    dst[0] = dst[1] = dst[2] = coutput[0][dx + i];
+                    dst[3] = 255;
+                }
+            } else if (source->is_rgb) {
+                for (int i = 0; i < width; ++i, dst += 4) {
+                    dst[0] = coutput[0][dx + i];
+                    dst[1] = coutput[1][dx + i];
+                    dst[2] = coutput[2][dx + i];
+                    dst[3] = 255;
+                }
+            } else {
+                z->YCbCr_to_RGB_kernel(dst, coutput[0] + dx, coutput[1] + dx, coutput[2] + dx, width, 4);
+            }
+        }
+    }
+
+    for (int n = 0; n < source->components; ++n) {
+        free(planes.planes[n]);
+        free(linebuf[n]);
+    }
+
+    return(ok);
+}
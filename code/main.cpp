@@ -1,5 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
@@ -9,6 +19,11 @@
 #include <glew.h>
 #include <glfw3.h>
 
+#define global static
+#define internal static
+
+#include "profile.cpp"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -20,9 +35,6 @@
 #define SCALE_MAX 10.0f
 #define SCALE_MIN 0.1f
 
-#define global static
-#define internal static
-
 #define QUAD_VERTICES 4
 #define QUAD_TRIANGLES 2
 #define QUAD_ELEMENTS 3
@@ -30,6 +42,26 @@
 #define ARR_LEN(arr) ((sizeof(arr))/sizeof(*arr))
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 
+#define PALETTE_ENTRIES 256
+
+#define MIP_UPLOAD_BYTES_PER_FRAME (8 << 20)
+#define BACKGROUND_FRAME_SECONDS 0.1 // Pending uploads continue at this pace while the window isn't focused.
+#define MIPLESS_VRAM_RESERVE (256ull << 20) // Left for the framebuffer, other textures and everything else.
+#define MIP_CACHE_MIN_PIXELS (4 << 20) // Smaller images are quicker to filter again than to read back.
+#define VSYNC_ADAPTIVE -1 // Swap interval that waits for vsync unless the frame is late, then tears instead.
+
+#define PROFILE_CSV_FILE "simpimg_profile.csv"
+#define PROFILE_TRACE_FILE "simpimg_trace.json"
+
+#include "platform.cpp"
+#include "jobs.cpp"
+#include "block_compression.cpp"
+#include "resample.cpp"
+#include "mipmaps.cpp"
+#include "cache.cpp"
+#include "texture_container.cpp"
+#include "jpeg_index.cpp"
+
 /* 
  * @ToDo: Some of the functionality could be in separate file(s) and just #include them for "unity build" (https://en.wikipedia.org/wiki/Unity_build)
  * @ToDo: Double click to reset camera to its default position?
@@ -69,63 +101,287 @@ struct Camera
     float scale;
 };
 
-struct Renderer
+struct Tiled_Image;
+struct Image_Batch;
+struct Thumbnail_Grid;
+struct Frame_Stats;
+
+#include "render_thread.cpp"
+#include "camera_motion.cpp"
+
+// A texture whose levels are still being uploaded, coarsest first, a few rows per frame.
+struct Mip_Upload
+{
+    unsigned char *pixels; // Level 0 straight from stb_image, NULL when there's nothing left to upload.
+    Mip_Chain chain;
+    int format;
+    int level;
+    int row;
+    int profile_record; // The uploads still count towards the image's record, see profile.cpp.
+};
+
+// An image decoded (and given its mip chain, or turned into a tile pyramid) by a job, the texture is set up
+// by finish_pending_load() once it's done. Everything but 'job' belongs to the job until then.
+struct Pending_Load
+{
+    Job *job; // NULL when nothing is loading.
+    char filename[MAX_PATH];
+    int wanted_channels;
+    bool mipless;
+    bool tiled; // Too large for a single texture, the job fills in 'tiled_image' instead of 'data'.
+    bool try_palette; // Keep a paletted PNG as indices + palette, anything else is decoded as usual.
+    bool try_compress; // Fill in 'compressed' instead of 'data', unless encoding fails.
+    int profile_record;
+
+    unsigned char *data; // The 8-bit indices when 'paletted' is set.
+    int width;
+    int height;
+    Mip_Chain chain;
+    bool paletted;
+    unsigned char palette[PALETTE_ENTRIES * 4];
+    Compressed_Image compressed; // Only its 'data' is set when the image was compressed.
+    Tiled_Image *tiled_image;
+    const char *error; // For win32_error(), set when 'data' (or 'compressed.data', or 'tiled_image') is NULL.
+};
+
+// Looked up once after linking, see the shaders below for what each of them means.
+struct Shader_Uniforms
 {
-    Vertex vertices[QUAD_VERTICES];
-    Triangle indices[QUAD_TRIANGLES];
+    int resolution;
+    int camera;
+    int quad_rect;
+    int uv_rect;
+    int paletted;
+    int mipless;
+    int instanced;
+    int premultiplied;
+};
 
+struct Renderer
+{
     unsigned int shader_program;
+    Shader_Uniforms uniforms;
+    
+    // NOTE(Aiden): A single unit quad that never changes, where it ends up on screen is
+    // entirely up to the 'quad_rect'/'uv_rect' and 'camera' uniforms.
     unsigned int VAO;
     unsigned int VBO;
+    unsigned int EBO;
     
     unsigned int texture;
     float texture_width;
     float texture_height;
+
+    // NOTE(Aiden): For paletted images 'texture' holds the 8-bit indices (GL_R8UI)
+    // and colours are resolved in the fragment shader from 'palette_texture'.
+    unsigned int palette_texture;
+    bool paletted;
+
+    // Set when 'texture' only has level 0, minification is then filtered in the fragment shader.
+    bool mipless;
+
+    // Whether 'texture' holds premultiplied alpha, everything stb_image decodes does. Only DDS/KTX2 files
+    // can have straight alpha, the fragment shader premultiplies those.
+    bool premultiplied;
+
+    // Only set for images too large for a single texture, 'texture' is unused then.
+    Tiled_Image *tiled_image;
+
+    // Set when browsing a directory, draws through its own batch.
+    Thumbnail_Grid *grid;
+
+    Pending_Load load;
+    Mip_Upload upload;
     
+    // What's drawn, on its way to the newest view from 'views' (headless mode sets it directly).
     Camera camera;
+    View_State target;
+    Camera_Motion motion;
+    bool animating;
+    double last_step_time; // Of the camera, negative when it was at rest.
+    double input_time; // View_State::input_time of the view being drawn, negative once it was presented.
+
+    // NOTE(Aiden): Input callbacks run on the main thread and only ever change 'view', they publish it
+    // through 'views' for the render thread. Everything above belongs to whoever draws, see render_thread.cpp.
+    // 'drawn_views' goes the other way, with 'camera' as drawn, so grabbing an image that's still moving
+    // stops it where it is instead of where it was headed.
+    View_State view;
+    View_Buffer views;
+    View_Buffer drawn_views;
+    View_State drawn; // The last one taken from 'drawn_views'.
+    Fling_Tracker fling;
+
+    // Set by anything that changes what's on screen, only drawn when it's set.
+    bool dirty;
+
+    Frame_Stats *frame_stats;
 };
 
+enum Mip_Policy
+{
+    MIP_POLICY_AUTO, // Mipless only when the full chain doesn't fit into the budget.
+    MIP_POLICY_FULL_CHAIN,
+    MIP_POLICY_MIPLESS,
+};
+
+struct Settings
+{
+    // Keep paletted PNGs as an index plane + palette instead of expanding them to RGB(A).
+    bool keep_png_palette;
+    
+    // Encode textures to BC1/BC7 before upload (and cache the result) to save VRAM. Also applies to the tile
+    // pyramid cache, which otherwise stores raw RGBA tiles.
+    bool compress_textures;
+
+    // Persist the tile pyramid of huge images, so reopening them doesn't decode anything.
+    bool cache_pyramids;
+
+    // Decode huge baseline JPEGs tile by tile through an index of the entropy coded data, instead of all at once.
+    bool jpeg_region_decode;
+
+    // How mip levels (and the level 1 of every tile) are filtered, see mipmaps.cpp.
+    Mip_Options mips;
+
+    // Persist the mip chain of large images next to the other cache entries.
+    bool cache_mips;
+
+    // Whether textures get a mip chain or are filtered by the shader from level 0 alone, which saves a quarter
+    // of their VRAM. MIP_POLICY_AUTO decides per image from what the driver reports as free and 'texture_budget_mb'.
+    Mip_Policy mip_policy;
+    unsigned int texture_budget_mb; // 0 is no limit of our own.
+};
+
+global Settings settings = {
+    true,  // keep_png_palette
+    false, // compress_textures
+    true,  // cache_pyramids
+    true,  // jpeg_region_decode
+    { MIP_FILTER_BOX, true, true }, // mips
+    true,  // cache_mips
+    MIP_POLICY_AUTO, // mip_policy
+    0,     // texture_budget_mb
+};
+
+// Off in headless mode, where nobody would be there to click them away. Errors only go to stderr then.
+global bool message_boxes = true;
+
 global const char* SUPPORTED_EXTENSIONS[] = {
     ".png",
     ".jpg",
     ".jpeg",
+    ".dds",
+    ".ktx2",
 };
 
+global const Vertex QUAD[QUAD_VERTICES] = {
+    {{ 0.0f, 0.0f }, { 0.0f, 0.0f }},
+    {{ 1.0f, 0.0f }, { 1.0f, 0.0f }},
+    {{ 0.0f, 1.0f }, { 0.0f, 1.0f }},
+    {{ 1.0f, 1.0f }, { 1.0f, 1.0f }},
+};
+
+global const Triangle QUAD_INDICES[QUAD_TRIANGLES] = {
+    {0, 1, 2},
+    {1, 2, 3},
+};
+
+// 'camera' is (offset_x, offset_y, scale) straight from Camera, 'quad_rect' is where the quad goes
+// in world space and 'uv_rect' the part of the texture it shows, both as (x, y, width, height).
+// Instanced draws (see batch.cpp) take both rects and a texture array layer from per-instance attributes instead.
 global const char *vertex_shader =
     "#version 330\n"
     "layout (location = 0) in vec2 aVertex_pos;\n"
     "layout (location = 1) in vec2 aTexture_pos;\n"
+    "layout (location = 2) in vec4 aQuad_rect;\n"
+    "layout (location = 3) in vec4 aUv_rect;\n"
+    "layout (location = 4) in float aLayer;\n"
     "uniform vec2 resolution;\n"
+    "uniform vec3 camera;\n"
+    "uniform vec4 quad_rect;\n"
+    "uniform vec4 uv_rect;\n"
+    "uniform bool instanced;\n"
     "out vec2 texture_pos;\n"
+    "flat out float layer;\n"
     "void main() {\n"
-    "  vec2 pos = (aVertex_pos / resolution) * 2.0 - 1.0;\n"
+    "  vec4 rect = (instanced ? aQuad_rect : quad_rect);\n"
+    "  vec4 uv = (instanced ? aUv_rect : uv_rect);\n"
+    "  vec2 screen = (rect.xy + aVertex_pos * rect.zw - camera.xy) * camera.z;\n"
+    "  vec2 pos = (screen / resolution) * 2.0 - 1.0;\n"
     "  gl_Position = vec4(pos.x, -pos.y, 0.0, 1.0);\n"
-    "  texture_pos = aTexture_pos;\n"
+    "  texture_pos = uv.xy + aTexture_pos * uv.zw;\n"
+    "  layer = aLayer;\n"
     "}";
 
+// NOTE(Aiden): Integer textures can't be filtered by the hardware, so for paletted images
+// we fetch the four surrounding indices, resolve them to colours and blend those ourselves.
+// Mipless textures are minified by averaging bilinear taps spread over the screen pixel's footprint,
+// every tap already covers 2x2 texels, so up to 8x8 taps keep things alias-free down to 1/16 scale.
+// Blending expects premultiplied alpha, which is what filtering and mips need to get transparent edges right.
 global const char *fragment_shader =
     "#version 330\n"
     "in vec2 texture_pos;\n"
+    "flat in float layer;\n"
     "out vec4 frag_color;\n"
     "uniform sampler2D texture_data;\n"
+    "uniform sampler2DArray layer_data;\n"
+    "uniform bool instanced;\n"
+    "uniform usampler2D index_data;\n"
+    "uniform sampler2D palette_data;\n"
+    "uniform bool paletted;\n"
+    "uniform bool mipless;\n"
+    "uniform bool premultiplied;\n"
+    "uniform vec3 camera;\n"
+    "uniform vec4 quad_rect;\n"
+    "vec4 palette_fetch(ivec2 p, ivec2 size) {\n"
+    "  uint i = texelFetch(index_data, clamp(p, ivec2(0), size - 1), 0).r;\n"
+    "  return texelFetch(palette_data, ivec2(int(i), 0), 0);\n"
+    "}\n"
     "void main() {\n"
-    "  frag_color = texture(texture_data, texture_pos);\n"
+    "  if (instanced) {\n"
+    "    frag_color = texture(layer_data, vec3(texture_pos, layer));\n"
+    "  } else if (paletted) {\n"
+    "    ivec2 size = textureSize(index_data, 0);\n"
+    "    vec2 p = texture_pos * vec2(size) - 0.5;\n"
+    "    ivec2 i = ivec2(floor(p));\n"
+    "    vec2 f = fract(p);\n"
+    "    vec4 top = mix(palette_fetch(i, size), palette_fetch(i + ivec2(1, 0), size), f.x);\n"
+    "    vec4 bottom = mix(palette_fetch(i + ivec2(0, 1), size), palette_fetch(i + ivec2(1, 1), size), f.x);\n"
+    "    frag_color = mix(top, bottom, f.y);\n"
+    "  } else if (mipless) {\n"
+    "    vec2 size = vec2(textureSize(texture_data, 0));\n"
+    "    vec2 footprint = max(size / (quad_rect.zw * camera.z), vec2(1.0));\n"
+    "    ivec2 taps = clamp(ivec2(ceil(footprint * 0.5)), ivec2(1), ivec2(8));\n"
+    "    vec2 spacing = footprint / (vec2(taps) * size);\n"
+    "    vec2 start = texture_pos - 0.5 * footprint / size + 0.5 * spacing;\n"
+    "    vec4 sum = vec4(0.0);\n"
+    "    for (int y = 0; y < taps.y; ++y) {\n"
+    "      for (int x = 0; x < taps.x; ++x) {\n"
+    "        sum += textureLod(texture_data, start + vec2(x, y) * spacing, 0.0);\n"
+    "      }\n"
+    "    }\n"
+    "    frag_color = sum / float(taps.x * taps.y);\n"
+    "  } else {\n"
+    "    frag_color = texture(texture_data, texture_pos);\n"
+    "  }\n"
+    "  if (!premultiplied) {\n"
+    "    frag_color.rgb *= frag_color.a;\n"
+    "  }\n"
     "}";
 
-internal inline void screen_to_world(Camera *camera, float sx, float sy, float *wx, float *wy)
-{
-    *wx = (sx / camera->scale) + camera->offset_x;
-    *wy = (sy / camera->scale) + camera->offset_y;
-}
-
-internal inline void world_to_screen(Camera *camera, float wx, float wy, float *sx, float *sy)
-{
-    *sx = (wx - camera->offset_x) * camera->scale;
-    *sy = (wy - camera->offset_y) * camera->scale;
-}
+#include "tiles.cpp"
+#include "batch.cpp"
+#include "png_write.cpp"
+#include "thumbnailer.cpp"
+#include "thumbnails.cpp"
+#include "frame_stats.cpp"
 
 internal inline void win32_error(const char *msg, const char *title)
 {
+    if (!message_boxes) {
+        fprintf(stderr, "[ERROR]: %s (%s)\n", msg, title);
+        return;
+    }
+
     MessageBox(NULL, msg, title, MB_OK | MB_ICONWARNING | MB_TASKMODAL);
 }
 
@@ -172,8 +428,313 @@ internal inline void fit_image_to_window(Renderer *renderer, float width, float
     renderer->texture_height = height * scale;
 }
 
+internal bool has_file_extension(const char *filename, const char *extension)
+{
+    size_t length = strlen(filename);
+    size_t extension_length = strlen(extension);
+
+    return(length >= extension_length && strcmp(filename + (length - extension_length), extension) == 0);
+}
+
+// Run by decode_pending_load(), false when it's not a paletted PNG and the regular path has to deal with it.
+internal bool decode_pending_paletted_load(Pending_Load *load)
+{
+    int palette_len;
+    memset(load->palette, 0, sizeof(load->palette));
+    {
+        PROFILE_ZONE(PROFILE_DECODE);
+        load->data = stbi_load_png_indexed(load->filename, &load->width, &load->height, load->palette, &palette_len);
+    }
+
+    load->paletted = (load->data != NULL);
+    return(load->paletted);
+}
+
+internal void upload_paletted_texture(Renderer *renderer, const unsigned char *indices, int width, int height,
+                                      const unsigned char *palette)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    
+    PROFILE_ZONE(PROFILE_UPLOAD);
+
+    glGenTextures(1, &renderer->texture);
+    glBindTexture(GL_TEXTURE_2D, renderer->texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, indices);
+
+    glGenTextures(1, &renderer->palette_texture);
+    glBindTexture(GL_TEXTURE_2D, renderer->palette_texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, PALETTE_ENTRIES, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, palette);
+    
+    renderer->paletted = true;
+    renderer->premultiplied = true;
+    fit_image_to_window(renderer, static_cast<float> (width), static_cast<float> (height));
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Free VRAM as reported by the driver, 0 if it doesn't tell.
+internal unsigned long long query_free_vram()
+{
+    int kilobytes[4] = {0};
+
+    if (GLEW_NVX_gpu_memory_info) {
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, kilobytes);
+    } else if (GLEW_ATI_meminfo) {
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, kilobytes);
+    }
+
+    return(static_cast<unsigned long long> (kilobytes[0]) * 1024);
+}
+
+internal bool choose_mipless(unsigned long long chain_size)
+{
+    if (settings.mip_policy != MIP_POLICY_AUTO) {
+        return(settings.mip_policy == MIP_POLICY_MIPLESS);
+    }
+
+    unsigned long long free_vram = query_free_vram();
+    if (free_vram != 0 && chain_size + MIPLESS_VRAM_RESERVE > free_vram) {
+        return(true);
+    }
+
+    return(settings.texture_budget_mb != 0 && chain_size > (static_cast<unsigned long long> (settings.texture_budget_mb) << 20));
+}
+
+internal void upload_compressed_texture(Renderer *renderer, const Compressed_Image *image)
+{
+    PROFILE_ZONE(PROFILE_UPLOAD);
+
+    unsigned int internal_format = block_format_gl(image->format);
+    renderer->mipless = (image->levels > 1 && choose_mipless(image->data_size));
+    int levels = (renderer->mipless ? 1 : image->levels);
+    
+    glGenTextures(1, &renderer->texture);
+    glBindTexture(GL_TEXTURE_2D, renderer->texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    // NOTE(Aiden): glGenerateMipmap doesn't work on compressed formats,
+    // so whatever levels we have must come from the encoder or the file.
+    for (int level = 0, w = image->width, h = image->height; level < levels; ++level) {
+        int size = static_cast<int> (block_level_size(image->format, w, h));
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, w, h, 0, size, image->data + image->level_offsets[level]);
+        
+        w = (w > 1 ? w / 2 : 1);
+        h = (h > 1 ? h / 2 : 1);
+    }
+
+    renderer->paletted = false;
+    renderer->premultiplied = image->premultiplied;
+    fit_image_to_window(renderer, static_cast<float> (image->width), static_cast<float> (image->height));
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Run by decode_pending_load(), reads the BC levels from the cache or encodes (and caches) them. False when
+// that didn't work out and the regular path has to deal with the image.
+internal bool decode_pending_compressed_load(Pending_Load *load)
+{
+    const char *filename = load->filename;
+
+    Compressed_Image image = {};
+    if (!cache_read_compressed(filename, &image)) {
+        int width, height, channels;
+        unsigned char *data = stbi_load(filename, &width, &height, &channels, 4);
+
+        if (data == NULL) {
+            return(false);
+        }
+
+        bool compressed = compress_image(data, width, height, &image);
+        stbi_image_free(data);
+
+        if (!compressed) {
+            return(false);
+        }
+
+        cache_write_compressed(filename, &image);
+    }
+
+    // Encoded from what stb_image decoded, cached ones too (see CACHE_VERSION).
+    image.premultiplied = true;
+
+    load->compressed = image;
+    return(true);
+}
+
+internal bool load_create_container_texture(Renderer *renderer, const char *filename)
+{
+    Mapped_File file;
+    if (!platform_map_file(filename, &file)) {
+        return(false);
+    }
+
+    Compressed_Image image = {};
+    bool ok = (has_file_extension(filename, ".dds") ? parse_dds(file.data, file.size, &image) : parse_ktx2(file.data, file.size, &image));
+    ok = ok && block_format_supported(image.format);
+
+    int max_texture_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    ok = ok && image.width <= max_texture_size && image.height <= max_texture_size;
+    
+    if (ok) {
+        upload_compressed_texture(renderer, &image);
+    }
+
+    platform_unmap_file(&file);
+    return(ok);
+}
+
+// The tiled counterpart of decode_pending_load(), run as a job too: opens the cached pyramid, or decodes the
+// image and builds (and caches) a new one, which for images this large takes seconds.
+internal void decode_pending_tiled_load(Pending_Load *load)
+{
+    PROFILE_IMAGE(load->profile_record);
+    PROFILE_ZONE(PROFILE_LOAD);
+
+    const char *filename = load->filename;
+    bool compressed = settings.compress_textures;
+    Tiled_Image *image = (settings.cache_pyramids ? tiled_image_open_cache(filename, compressed) : NULL);
+
+    if (image == NULL && settings.jpeg_region_decode &&
+        (has_file_extension(filename, ".jpg") || has_file_extension(filename, ".jpeg"))) {
+        image = tiled_image_open_jpeg(filename, &settings.mips);
+    }
+
+    if (image == NULL) {
+        int width, height, channels;
+        unsigned char *data = stbi_load(filename, &width, &height, &channels, 4);
+
+        if (data == NULL) {
+            load->error = "Could not properly load the image.";
+            render_thread_wake(false);
+            return;
+        }
+
+        image = tiled_image_create(data, width, height, &settings.mips);
+        if (image == NULL) {
+            load->error = "Could not allocate the tile table.";
+            stbi_image_free(data);
+            render_thread_wake(false);
+            return;
+        }
+
+        // Serve tiles from the freshly written cache too, that way the decoded pyramid can go right away. With
+        // 'compress_textures' that means the BC tiles from the first open on, just like every later open.
+        if (settings.cache_pyramids && tiled_image_write_cache(image, filename, compressed)) {
+            Tiled_Image *cached = tiled_image_open_cache(filename, compressed);
+            if (cached) {
+                tiled_image_destroy(image);
+                image = cached;
+            }
+        }
+    }
+
+    load->tiled_image = image;
+    render_thread_wake(false);
+}
+
+internal void load_create_tiled_texture(Renderer *renderer, const char *filename)
+{
+    Pending_Load *load = &renderer->load;
+    snprintf(load->filename, sizeof(load->filename), "%s", filename);
+    load->tiled = true;
+    load->profile_record = profile_current_image();
+
+    load->job = job_create([load]() { decode_pending_tiled_load(load); }, JOB_PRIORITY_HIGH, NULL);
+    job_submit(job_system, load->job);
+}
+
+// The part of loading an image that doesn't need GL, run as a job. The mip chain is a job of its own that
+// depends on this one, see generate_pending_mips(). Paletted and compressed images don't need one.
+internal void decode_pending_load(Pending_Load *load)
+{
+    PROFILE_IMAGE(load->profile_record);
+    PROFILE_ZONE(PROFILE_LOAD);
+
+    if (load->try_palette && decode_pending_paletted_load(load)) {
+        return;
+    }
+
+    if (load->try_compress && decode_pending_compressed_load(load)) {
+        return;
+    }
+
+    int channels;
+    load->data = stbi_load(load->filename, &load->width, &load->height, &channels, load->wanted_channels);
+
+    if (load->data == NULL) {
+        load->error = "Could not properly load the image.";
+    }
+}
+
+// Runs once decode_pending_load() is done, whether it worked or not, so this is what finish_pending_load() waits for.
+internal void generate_pending_mips(Pending_Load *load)
+{
+    PROFILE_IMAGE(load->profile_record);
+    PROFILE_ZONE(PROFILE_LOAD);
+
+    if (load->data == NULL || load->paletted) {
+        render_thread_wake(false);
+        return;
+    }
+
+    int width = load->width;
+    int height = load->height;
+    int wanted_channels = load->wanted_channels;
+
+    // A single level 'chain' is just level 0.
+    Mip_Chain chain = {};
+    chain.width = width;
+    chain.height = height;
+    chain.channels = wanted_channels;
+    chain.levels = 1;
+
+    bool cacheable = (settings.cache_mips && static_cast<long long> (width) * height >= MIP_CACHE_MIN_PIXELS);
+
+    if (load->mipless) {
+        // Nothing to generate.
+    } else if (!(cacheable && cache_read_mips(load->filename, width, height, wanted_channels, &settings.mips, &chain))) {
+        if (!mip_generate(load->data, width, height, wanted_channels, &settings.mips, 0, &chain)) {
+            load->error = "Could not allocate the mip chain.";
+            stbi_image_free(load->data);
+            load->data = NULL;
+            render_thread_wake(false);
+            return;
+        }
+
+        if (cacheable) {
+            cache_write_mips(load->filename, &settings.mips, &chain);
+        }
+    }
+
+    load->chain = chain;
+
+    // Wakes the renderer up in case it's waiting for something to draw.
+    render_thread_wake(false);
+}
+
 internal void load_create_texture(Renderer *renderer, const char *filename)
 {
+    PROFILE_IMAGE(filename);
+    PROFILE_ZONE(PROFILE_LOAD);
+
     unsigned long file_attr = GetFileAttributes(filename);
     if ((file_attr == INVALID_FILE_ATTRIBUTES) || (file_attr & FILE_ATTRIBUTE_DIRECTORY)) {
         win32_error("Could not find the requested file.", "Incorrect path");
@@ -184,65 +745,292 @@ internal void load_create_texture(Renderer *renderer, const char *filename)
         win32_error("File format not currently supported.", "Incorrect format");
         return;
     }
-        
-    int width, height, channels;
-    unsigned char *data = stbi_load(filename, &width, &height, &channels, 0);
 
-    if (data == NULL) { 
-        win32_error("Could not properly load the image.", "Memory/File format exception");
+    if (has_file_extension(filename, ".dds") || has_file_extension(filename, ".ktx2")) {
+        if (!load_create_container_texture(renderer, filename)) {
+            win32_error("Could not load the texture, only plain 2D BCn textures are supported.", "Memory/File format exception");
+        }
+        return;
+    }
+
+    // Anything the GPU can't hold in one texture goes through the tile renderer instead.
+    int max_texture_size, info_width, info_height, info_channels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+
+    bool has_info;
+    {
+        PROFILE_ZONE(PROFILE_PROBE);
+        has_info = (stbi_info(filename, &info_width, &info_height, &info_channels) != 0);
+    }
+
+    if (has_info && (info_width > max_texture_size || info_height > max_texture_size)) {
+        load_create_tiled_texture(renderer, filename);
         return;
     }
 
-    int format = (channels == 4 ? (GL_RGBA) : (GL_RGB));
+    // NOTE(Aiden): Grey images are expanded by stb_image, we only ever upload RGB or RGBA.
+    // Decoding and the mip chain happen in jobs so the window keeps responding meanwhile, the mipless
+    // decision and whether the driver takes BC1/BC7 need GL and are made here.
+    Pending_Load *load = &renderer->load;
+    snprintf(load->filename, sizeof(load->filename), "%s", filename);
+    load->try_palette = (settings.keep_png_palette && has_file_extension(filename, ".png"));
+    load->try_compress = (settings.compress_textures &&
+                          GLEW_EXT_texture_compression_s3tc && GLEW_ARB_texture_compression_bptc);
+    load->wanted_channels = ((info_channels == 2 || info_channels == 4) ? 4 : 3);
+    size_t level_size = (has_info ? mip_level_size(info_width, info_height, load->wanted_channels) : 0);
+    load->mipless = (has_info && choose_mipless(level_size + level_size / 3));
+    load->profile_record = profile_current_image();
+
+    Job *decode = job_create([load]() { decode_pending_load(load); }, JOB_PRIORITY_HIGH, NULL);
+    load->job = job_create([load]() { generate_pending_mips(load); }, JOB_PRIORITY_HIGH, NULL);
+    job_depends_on(load->job, decode);
+
+    job_submit(job_system, load->job);
+    job_submit(job_system, decode);
+    job_release(decode);
+}
+
+// Creates the texture for a finished Pending_Load and starts uploading it, called once per frame. True if
+// the load finished (successfully or not) this time.
+internal bool finish_pending_load(Renderer *renderer)
+{
+    Pending_Load *load = &renderer->load;
+    if (load->job == NULL || !job_done(load->job)) {
+        return(false);
+    }
+
+    job_release(load->job);
+    load->job = NULL;
+
+    if (load->tiled) {
+        if (load->tiled_image == NULL) {
+            win32_error(load->error, "Memory/File format exception");
+            return(true);
+        }
+
+        renderer->tiled_image = load->tiled_image;
+        load->tiled_image = NULL;
+        fit_image_to_window(renderer, static_cast<float> (renderer->tiled_image->width), static_cast<float> (renderer->tiled_image->height));
+        return(true);
+    }
+
+    PROFILE_IMAGE(load->profile_record);
+    PROFILE_ZONE(PROFILE_LOAD);
+
+    if (load->compressed.data) {
+        upload_compressed_texture(renderer, &load->compressed);
+        free(load->compressed.data);
+        load->compressed.data = NULL;
+        return(true);
+    }
+
+    if (load->data == NULL) {
+        win32_error(load->error, "Memory/File format exception");
+        return(true);
+    }
+
+    if (load->paletted) {
+        upload_paletted_texture(renderer, load->data, load->width, load->height, load->palette);
+        stbi_image_free(load->data);
+        load->data = NULL;
+        return(true);
+    }
+
+    int width = load->width;
+    int height = load->height;
+    Mip_Chain chain = load->chain;
+
+    int format = (load->wanted_channels == 4 ? (GL_RGBA) : (GL_RGB));
+    renderer->paletted = false;
+    renderer->premultiplied = true;
+    renderer->mipless = load->mipless;
     
     glGenTextures(1, &renderer->texture);
     glBindTexture(GL_TEXTURE_2D, renderer->texture);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (chain.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // Storage for every level up front, the contents arrive through continue_mip_upload().
+    // Until then the texture only samples from the levels that are already there.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, chain.levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, chain.levels - 1);
+
+    {
+        PROFILE_ZONE(PROFILE_UPLOAD);
+
+        for (int level = 0; level < chain.levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, format, mip_level_dimension(width, level), mip_level_dimension(height, level),
+                         0, format, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+
+    renderer->upload.pixels = load->data;
+    renderer->upload.chain = chain;
+    renderer->upload.format = format;
+    renderer->upload.level = chain.levels - 1;
+    renderer->upload.row = 0;
+    renderer->upload.profile_record = load->profile_record;
+
+    load->data = NULL;
+    load->chain.data = NULL;
 
     fit_image_to_window(renderer, static_cast<float> (width), static_cast<float> (height));
 
     glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(data);
+    return(true);
 }
 
-internal void display_image_centered(Renderer *renderer)
-{    
-    float sx, sy;
-    world_to_screen(&renderer->camera, 0.0f, 0.0f, &sx, &sy);
+internal void finish_mip_upload(Mip_Upload *upload)
+{
+    stbi_image_free(upload->pixels);
+    free(upload->chain.data);
 
-    float width = renderer->texture_width * renderer->camera.scale;
-    float height = renderer->texture_height * renderer->camera.scale;
-    
-    renderer->vertices[0] = {{ sx - (width / 2.0f),         sy - (height / 2.0f) },          { 0.0f, 0.0f }};
-    renderer->vertices[1] = {{ sx - (width / 2.0f) + width, sy - (height / 2.0f) },          { 1.0f, 0.0f }};
-    renderer->vertices[2] = {{ sx - (width / 2.0f),         sy - (height / 2.0f) + height }, { 0.0f, 1.0f }};
-    renderer->vertices[3] = {{ sx - (width / 2.0f) + width, sy - (height / 2.0f) + height }, { 1.0f, 1.0f }};
-    
-    renderer->indices[0] = {0, 1, 2};
-    renderer->indices[1] = {1, 2, 3};
+    upload->pixels = NULL;
+    upload->chain.data = NULL;
+}
+
+// Uploads up to MIP_UPLOAD_BYTES_PER_FRAME of the pending levels, coarsest first. Each finished level
+// becomes the texture's base level, so a huge level 0 never holds up the frames showing the smaller ones.
+internal void continue_mip_upload(Renderer *renderer)
+{
+    Mip_Upload *upload = &renderer->upload;
+    if (upload->pixels == NULL) {
+        return;
+    }
+
+    PROFILE_IMAGE(upload->profile_record);
+    PROFILE_ZONE(PROFILE_UPLOAD);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, renderer->texture);
+
+    size_t budget = MIP_UPLOAD_BYTES_PER_FRAME;
+    while (upload->level >= 0 && budget > 0) {
+        int width = mip_level_dimension(upload->chain.width, upload->level);
+        int height = mip_level_dimension(upload->chain.height, upload->level);
+        size_t row_size = static_cast<size_t> (width) * upload->chain.channels;
+
+        size_t budget_rows = budget / row_size;
+        int rows = (budget_rows < 1 ? 1 : static_cast<int> (MIN(budget_rows, static_cast<size_t> (height - upload->row))));
+
+        const unsigned char *pixels = mip_level_pixels(&upload->chain, upload->pixels, upload->level) + upload->row * row_size;
+        glTexSubImage2D(GL_TEXTURE_2D, upload->level, 0, upload->row, width, rows, upload->format, GL_UNSIGNED_BYTE, pixels);
+
+        upload->row += rows;
+        budget -= MIN(budget, rows * row_size);
+
+        if (upload->row == height) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload->level);
+            upload->level -= 1;
+            upload->row = 0;
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (upload->level < 0) {
+        finish_mip_upload(upload);
+    }
+}
+
+// True while the next frame will look different from the last one even if nothing else changes. A load
+// still decoding doesn't count, its job wakes the main loop up when it's done.
+internal bool renderer_pending(Renderer *renderer)
+{
+    return(renderer->upload.pixels || renderer->animating ||
+           (renderer->tiled_image && tiled_image_pending(renderer->tiled_image)) ||
+           (renderer->grid && renderer->grid->busy));
 }
 
 internal void gl_render(Renderer *renderer)
 {    
+    const Shader_Uniforms *uniforms = &renderer->uniforms;
+    Camera *camera = &renderer->camera;
+
+    glUniform3f(uniforms->camera, camera->offset_x, camera->offset_y, camera->scale);
+
+    if (renderer->grid) {
+        thumbnail_grid_update(renderer->grid, camera, get_shader_resolution(renderer->shader_program));
+        glUniform1i(uniforms->instanced, true);
+        glUniform1i(uniforms->premultiplied, true);
+        batch_render(renderer->grid->batch);
+        return;
+    }
+
+    glUniform1i(uniforms->instanced, false);
     glBindVertexArray(renderer->VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->VBO);
-    
-    // NOTE(Aiden): We are never rendering more than one texture really,
-    // if that happens to be the case at some point (multiple images in one window or something)
-    // this alongside immediate_quad_centered(); would need to be modified with something
-    // like an array of textures and their respective IDs.
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, renderer->texture);
-        
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(renderer->vertices), renderer->vertices);
-    glDrawElements(GL_TRIANGLES, QUAD_TRIANGLES * QUAD_ELEMENTS, GL_UNSIGNED_INT, renderer->indices);
+
+    if (renderer->tiled_image) {
+        glUniform1i(uniforms->paletted, false);
+        glUniform1i(uniforms->mipless, false);
+        glUniform1i(uniforms->premultiplied, true);
+        tiled_image_render(renderer->tiled_image,
+                           camera,
+                           renderer->texture_width,
+                           renderer->texture_height,
+                           get_shader_resolution(renderer->shader_program),
+                           uniforms);
+        return;
+    }
+
+    // NOTE(Aiden): From here on it's a single texture, several images at once go through the grid's
+    // texture array above.
+
+    // A mipless texture only has level 0, which continue_mip_upload() fills a band of rows per frame. Until
+    // it's complete there's nothing to draw but undefined rows.
+    if (renderer->mipless && renderer->upload.pixels) {
+        return;
+    }
+
+    if (renderer->paletted) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, renderer->texture);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, renderer->palette_texture);
+    } else {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, renderer->texture);
+    }
+
+    glUniform1i(uniforms->paletted, renderer->paletted);
+    glUniform1i(uniforms->mipless, renderer->mipless);
+    glUniform1i(uniforms->premultiplied, renderer->premultiplied);
+
+    // The image is centered at the world origin.
+    glUniform4f(uniforms->quad_rect,
+                -renderer->texture_width / 2.0f,
+                -renderer->texture_height / 2.0f,
+                renderer->texture_width,
+                renderer->texture_height);
+    glUniform4f(uniforms->uv_rect, 0.0f, 0.0f, 1.0f, 1.0f);
+
+    glDrawElements(GL_TRIANGLES, QUAD_TRIANGLES * QUAD_ELEMENTS, GL_UNSIGNED_INT, NULL);
+}
+
+// Main thread only, makes the changes to 'renderer->view' visible to the renderer.
+internal void publish_view(Renderer *renderer)
+{
+    // NOTE(Aiden): When the renderer didn't get to the state this one replaces, the input in that one still
+    // isn't on screen either, so it keeps counting from there. The renderer may take it right in between,
+    // which only makes this frame's latency look a little longer than it was.
+    if (!view_buffer_unread(&renderer->views)) {
+        renderer->view.input_time = glfwGetTime();
+    }
+
+    view_buffer_publish(&renderer->views, &renderer->view);
+    render_thread_wake(false);
+}
+
+internal inline Vec2 view_resolution(const View_State *view)
+{
+    Vec2 resolution;
+    resolution.x = static_cast<float> (view->width);
+    resolution.y = static_cast<float> (view->height);
+
+    return(resolution);
 }
 
 internal void framebuffer_size_callback(GLFWwindow *window, int width, int height)
@@ -252,19 +1040,47 @@ internal void framebuffer_size_callback(GLFWwindow *window, int width, int heigh
     }
 
     Renderer *renderer = static_cast<Renderer *> (glfwGetWindowUserPointer(window));
-    Camera *camera = &renderer->camera;
+    View_State *view = &renderer->view;
+    Camera *camera = &view->camera;
 
-    Vec2 old_resolution = get_shader_resolution(renderer->shader_program);
-    camera->offset_x = width * (camera->offset_x / static_cast<float> (old_resolution.x));
-    camera->offset_y = height * (camera->offset_y / static_cast<float> (old_resolution.y));
-    
-    glUseProgram(renderer->shader_program);
-    glUniform2f(glGetUniformLocation(renderer->shader_program, "resolution"),
-                static_cast<float> (width),
-                static_cast<float> (height));
-    
-    fit_image_to_window(renderer, renderer->texture_width, renderer->texture_height);
-    glViewport(0, 0, width, height);
+    Vec2 old_resolution = view_resolution(view);
+    view->width = width;
+    view->height = height;
+
+    // The GL side of it happens in apply_view(), the camera doesn't animate to the new layout.
+    view->cuts += 1;
+
+    if (renderer->grid) {
+        thumbnail_grid_layout(renderer->grid, camera, old_resolution, view_resolution(view));
+    } else {
+        camera->offset_x = static_cast<float> (width) * (camera->offset_x / old_resolution.x);
+        camera->offset_y = static_cast<float> (height) * (camera->offset_y / old_resolution.y);
+    }
+
+    publish_view(renderer);
+}
+
+// The window was uncovered or needs repainting for some other reason we don't see.
+internal void window_refresh_callback(GLFWwindow *window)
+{
+    UNUSED(window);
+    render_thread_wake(true);
+}
+
+// Pending uploads slow down while unfocused, see the render loops in main().
+internal void window_focus_callback(GLFWwindow *window, int focused)
+{
+    UNUSED(window);
+    render_thread.focused.store(focused != 0);
+    render_thread_wake(false);
+}
+
+// Nothing is drawn while minimised.
+internal void window_iconify_callback(GLFWwindow *window, int iconified)
+{
+    UNUSED(window);
+    render_thread.iconified.store(iconified != 0);
+    render_thread_wake(iconified == 0);
 }
 
 // NOTE(Aiden): We _could_ update the mouse position everytime we click instead of doing
@@ -276,15 +1092,78 @@ internal void cursor_position_callback(GLFWwindow *window, double xpos, double y
     int state = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
 
     Renderer *renderer = static_cast<Renderer *> (glfwGetWindowUserPointer(window));
-    Camera *camera = &renderer->camera;
+    View_State *view = &renderer->view;
+    Camera *camera = &view->camera;
 
-    if (state == GLFW_PRESS) {
+    if (state == GLFW_PRESS && renderer->grid) {
+        // The grid only moves up and down.
+        thumbnail_grid_scroll(renderer->grid, camera, view_resolution(view), camera->mouse_y - static_cast<float> (ypos));
+    } else if (state == GLFW_PRESS) {
         camera->offset_x -= (static_cast<float> (xpos) - camera->mouse_x) / camera->scale;
         camera->offset_y -= (static_cast<float> (ypos) - camera->mouse_y) / camera->scale;
     }
     
     camera->mouse_x = static_cast<float> (xpos);
     camera->mouse_y = static_cast<float> (ypos);
+
+    if (state == GLFW_PRESS) {
+        fling_tracker_add(&renderer->fling, glfwGetTime(), camera->mouse_x, camera->mouse_y);
+        publish_view(renderer);
+    }
+}
+
+// Dragging follows the cursor exactly, letting go flings the image (or the grid) on with the cursor's speed.
+internal void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
+{
+    UNUSED(mods);
+
+    if (button != GLFW_MOUSE_BUTTON_LEFT) {
+        return;
+    }
+
+    Renderer *renderer = static_cast<Renderer *> (glfwGetWindowUserPointer(window));
+    View_State *view = &renderer->view;
+    Camera *camera = &view->camera;
+    double now = glfwGetTime();
+
+    if (action == GLFW_PRESS) {
+        view_buffer_take(&renderer->drawn_views, &renderer->drawn);
+        camera->offset_x = renderer->drawn.camera.offset_x;
+        camera->offset_y = renderer->drawn.camera.offset_y;
+        camera->scale = renderer->drawn.camera.scale;
+
+        view->dragging = true;
+        renderer->fling.count = 0;
+        fling_tracker_add(&renderer->fling, now, camera->mouse_x, camera->mouse_y);
+    } else if (action == GLFW_RELEASE) {
+        float velocity_x, velocity_y;
+        fling_tracker_velocity(&renderer->fling, now, &velocity_x, &velocity_y);
+        view->dragging = false;
+
+        if (renderer->grid) {
+            thumbnail_grid_scroll(renderer->grid, camera, view_resolution(view), -velocity_y * CAMERA_PAN_SECONDS);
+        } else {
+            camera->offset_x -= velocity_x / camera->scale * CAMERA_PAN_SECONDS;
+            camera->offset_y -= velocity_y / camera->scale * CAMERA_PAN_SECONDS;
+        }
+    } else {
+        return;
+    }
+
+    publish_view(renderer);
+}
+
+internal void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    UNUSED(scancode);
+    UNUSED(mods);
+
+    Renderer *renderer = static_cast<Renderer *> (glfwGetWindowUserPointer(window));
+
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+        renderer->view.overlay = !renderer->view.overlay;
+        publish_view(renderer);
+    }
 }
 
 internal void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
@@ -292,7 +1171,14 @@ internal void scroll_callback(GLFWwindow *window, double xoffset, double yoffset
     UNUSED(xoffset);
 
     Renderer *renderer = static_cast<Renderer *> (glfwGetWindowUserPointer(window));
-    Camera *camera = &renderer->camera;
+    View_State *view = &renderer->view;
+    Camera *camera = &view->camera;
+
+    if (renderer->grid) {
+        thumbnail_grid_scroll(renderer->grid, camera, view_resolution(view), -static_cast<float> (yoffset) * THUMB_SCROLL_STEP);
+        publish_view(renderer);
+        return;
+    }
         
     float before_x, before_y;
     screen_to_world(camera, camera->mouse_x, camera->mouse_y, &before_x, &before_y);
@@ -310,15 +1196,142 @@ internal void scroll_callback(GLFWwindow *window, double xoffset, double yoffset
 
     camera->offset_x += (before_x - after_x);
     camera->offset_y += (before_y - after_y);
+    publish_view(renderer);
+}
+
+// Renderer side of a new view from the input callbacks.
+internal void apply_view(Renderer *renderer, const View_State *view)
+{
+    Vec2 resolution = view_resolution(view);
+    Vec2 old_resolution = get_shader_resolution(renderer->shader_program);
+
+    if (resolution.x != old_resolution.x || resolution.y != old_resolution.y) {
+        glUniform2f(renderer->uniforms.resolution, resolution.x, resolution.y);
+        glViewport(0, 0, view->width, view->height);
+
+        if (!renderer->grid) {
+            fit_image_to_window(renderer, renderer->texture_width, renderer->texture_height);
+        }
+    }
+
+    if (view->cuts != renderer->target.cuts) {
+        renderer->camera = view->camera;
+        renderer->motion.zoom_velocity = 0.0f;
+    }
+
+    renderer->target = *view;
+    renderer->animating = true;
+    renderer->frame_stats->overlay = view->overlay;
+
+    // An older view that didn't make it to the screen is already counting.
+    if (renderer->input_time < 0.0) {
+        renderer->input_time = view->input_time;
+    }
+
+    renderer->dirty = true;
+}
+
+// Moves the drawn camera on towards the target by the time since the last step.
+internal void animate_camera(Renderer *renderer)
+{
+    if (!renderer->animating) {
+        return;
+    }
+
+    // Starting from rest the first step is a refresh period, about when this frame shows up.
+    double now = glfwGetTime();
+    double step = (renderer->last_step_time >= 0.0 ? now - renderer->last_step_time : renderer->frame_stats->refresh_period);
+    float dt = static_cast<float> (step);
+    dt = (dt < CAMERA_MAX_STEP ? dt : CAMERA_MAX_STEP);
+
+    renderer->animating = !camera_motion_step(&renderer->motion, &renderer->camera, &renderer->target.camera,
+                                              renderer->target.dragging, dt);
+    renderer->last_step_time = (renderer->animating ? now : -1.0);
+
+    View_State drawn = renderer->target;
+    drawn.camera = renderer->camera;
+    view_buffer_publish(&renderer->drawn_views, &drawn);
+}
+
+// Picks up finished loads and the newest view, then draws a frame if anything changed. Called over and over
+// by the render thread, or by the main loop itself with --no-render-thread. 'continuous' is whether it came
+// straight from the last frame, see frame_stats.cpp.
+internal void render_update(GLFWwindow *window, Renderer *renderer, bool continuous)
+{
+    if (finish_pending_load(renderer)) {
+        renderer->dirty = true;
+    }
+
+    View_State view;
+    if (view_buffer_take(&renderer->views, &view)) {
+        apply_view(renderer, &view);
+    }
+
+    if (render_thread.redraw.exchange(false)) {
+        renderer->dirty = true;
+    }
+
+    if (!renderer->dirty || render_thread.iconified.load()) {
+        return;
+    }
+
+    Frame_Stats *frame_stats = renderer->frame_stats;
+    renderer->dirty = false;
+    frame_stats_begin(frame_stats, continuous);
+
+    animate_camera(renderer);
+    continue_mip_upload(renderer);
+
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    gl_render(renderer);
+    frame_stats_end_render(frame_stats);
+    frame_stats_draw_overlay(frame_stats, get_shader_resolution(renderer->shader_program));
+
+    glfwSwapBuffers(window);
+    frame_stats_end(frame_stats, renderer->input_time);
+    renderer->input_time = -1.0;
+
+    if (renderer_pending(renderer)) {
+        renderer->dirty = true;
+    }
 }
 
-internal GLFWwindow* create_window(unsigned int width, unsigned int height, const char* title)
+// NOTE(Aiden): Nothing is drawn unless something changed, otherwise the render thread sleeps until
+// render_thread_wake(). Uploads still in flight keep it going, at vsync pace when focused and
+// BACKGROUND_FRAME_SECONDS when not, and they simply pause while the window is minimised.
+internal void render_thread_run(GLFWwindow *window, Renderer *renderer)
+{
+    glfwMakeContextCurrent(window);
+    bool waited = true;
+
+    for (;;) {
+        render_update(window, renderer, !waited);
+
+        bool idle = (!renderer->dirty || render_thread.iconified.load());
+        bool background = !render_thread.focused.load();
+
+        // Frames paced by BACKGROUND_FRAME_SECONDS aren't late, they don't count as frame times either.
+        waited = (idle || background);
+
+        if (!render_thread_wait(idle ? -1.0 : (background ? BACKGROUND_FRAME_SECONDS : 0.0))) {
+            break;
+        }
+    }
+
+    glfwMakeContextCurrent(NULL);
+}
+
+// 'swap_interval' is for glfwSwapInterval(), VSYNC_ADAPTIVE falls back to 1 where tearing late frames isn't supported.
+internal GLFWwindow* create_window(unsigned int width, unsigned int height, const char* title, bool visible, int swap_interval)
 {
     glfwInit();
     
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
     
     GLFWwindow *window = glfwCreateWindow(width, height, title, NULL, NULL);
     
@@ -338,25 +1351,129 @@ internal GLFWwindow* create_window(unsigned int width, unsigned int height, cons
     }
 
     glfwSetCursorPosCallback(window, cursor_position_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    glfwSetWindowFocusCallback(window, window_focus_callback);
+    glfwSetWindowIconifyCallback(window, window_iconify_callback);
+
+    // Motion is timed by camera_motion.cpp, vsync only decides whether frames wait for the display.
+    if (swap_interval == VSYNC_ADAPTIVE &&
+        !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+        swap_interval = 1;
+    }
 
-    // @ToDo: Find a better way to make the motion smooth, maybe something with delta-time?
-    // instead of enabling v-sync.
-    glfwSwapInterval(1);
+    glfwSwapInterval(visible ? swap_interval : 0);
 
+    // Everything drawn has its alpha premultiplied, see the fragment shaders.
     glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     
     return(window);
 }
 
+// Enough slots for every row the largest window on the primary monitor can show, plus the prefetched ones.
+internal int thumbnail_slots_for_monitor()
+{
+    const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    int width = (mode ? mode->width : DEFAULT_WIDTH);
+    int height = (mode ? mode->height : DEFAULT_HEIGHT);
+
+    int columns = static_cast<int> ((static_cast<float> (width) - THUMB_GAP) / THUMB_PITCH);
+    int rows = static_cast<int> (static_cast<float> (height) / THUMB_PITCH) + 2 + THUMB_PREFETCH_ROWS * 2;
+
+    return((columns > 1 ? columns : 1) * rows);
+}
+
+internal void open_thumbnail_grid(Renderer *renderer, const char *directory)
+{
+    renderer->grid = thumbnail_grid_open(directory, thumbnail_slots_for_monitor(), &settings.mips, renderer->VBO, renderer->EBO);
+
+    if (renderer->grid == NULL) {
+        win32_error("Could not find any images in the directory.", "File exception");
+        return;
+    }
+
+    Vec2 none = {};
+    thumbnail_grid_layout(renderer->grid, &renderer->camera, none, get_shader_resolution(renderer->shader_program));
+}
+
+#include "headless.cpp"
+
+// Usage: simpimg [--profile] [--frame-stats] [--headless script] [image or directory], the current directory
+// is browsed when nothing is given. --profile writes PROFILE_CSV_FILE and PROFILE_TRACE_FILE on exit, see profile.cpp.
+// --frame-stats shows the frame time overlay from the start (F3 toggles it) and logs to FRAME_STATS_LOG_FILE.
+// --headless renders the frames the script asks for without showing a window and exits, see headless.cpp.
+// --no-render-thread draws on the main thread in between handling events, like before render_thread.cpp.
+// --vsync on|off|adaptive, on by default. Adaptive waits for vsync unless a frame is late.
+// --thumbnail <source> <output> [--size pixels] [--threads count] thumbnails a whole directory tree without
+// any window and exits, see thumbnailer.cpp.
 int main(int argc, char **argv)
 {
-    UNUSED(argc);
-    UNUSED(argv);
+    const char *path = ".";
+    const char *headless_script = NULL;
+    const char *thumbnail_source = NULL;
+    const char *thumbnail_output = NULL;
+    int thumbnail_size = THUMBNAILER_DEFAULT_SIZE;
+    int thumbnail_threads = 0;
+    bool profiling = false;
+    bool log_frame_stats = false;
+    bool use_render_thread = true;
+    int swap_interval = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--profile") == 0) {
+            profiling = profile_start();
+            if (!profiling) {
+                fprintf(stderr, "[WARNING]: Profiling isn't compiled in, build with /DSIMPIMG_PROFILE=1\n");
+            }
+        } else if (strcmp(argv[i], "--frame-stats") == 0) {
+            log_frame_stats = true;
+        } else if (strcmp(argv[i], "--no-render-thread") == 0) {
+            use_render_thread = false;
+        } else if (strcmp(argv[i], "--vsync") == 0 && i + 1 < argc) {
+            ++i;
+            swap_interval = (strcmp(argv[i], "off") == 0 ? 0 : (strcmp(argv[i], "adaptive") == 0 ? VSYNC_ADAPTIVE : 1));
+        } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            headless_script = argv[++i];
+        } else if (strcmp(argv[i], "--thumbnail") == 0 && i + 2 < argc) {
+            thumbnail_source = argv[++i];
+            thumbnail_output = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            thumbnail_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thumbnail_threads = atoi(argv[++i]);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (thumbnail_source) {
+        Thumbnailer_Stats stats;
+        if (!thumbnailer_run(thumbnail_source, thumbnail_output, (thumbnail_size > 0 ? thumbnail_size : THUMBNAILER_DEFAULT_SIZE), thumbnail_threads, &stats)) {
+            return(1);
+        }
+
+        printf("%d thumbnails (%d failed) from %.1f megapixels in %.2f s, %.1f images/s, %d steals\n",
+               stats.images, stats.failures, stats.megapixels, stats.seconds,
+               (stats.seconds > 0.0 ? stats.images / stats.seconds : 0.0), stats.steals);
+
+        if (profiling && !(profile_write_csv(PROFILE_CSV_FILE) && profile_write_trace(PROFILE_TRACE_FILE))) {
+            fprintf(stderr, "[ERROR]: Could not write the profile\n");
+        }
 
-    GLFWwindow *window = create_window(DEFAULT_WIDTH, DEFAULT_HEIGHT, "Hello, Sailor!");
+        return(stats.failures == 0 ? 0 : 1);
+    }
+
+    message_boxes = (headless_script == NULL);
+
+    // NOTE(Aiden): Only for what's drawn, the thumbnails written above have to stay straight alpha like any PNG
+    // (the thumbnailer premultiplies on its own while it filters).
+    stbi_set_premultiply_on_load(1);
+
+    GLFWwindow *window = create_window(DEFAULT_WIDTH, DEFAULT_HEIGHT, "Hello, Sailor!", headless_script == NULL, swap_interval);
     Renderer renderer = {0};
     
     // Shader setup
@@ -379,19 +1496,38 @@ int main(int argc, char **argv)
         glDeleteShader(vert);
         glDeleteShader(frag);
     
+        renderer.uniforms.resolution = glGetUniformLocation(renderer.shader_program, "resolution");
+        renderer.uniforms.camera = glGetUniformLocation(renderer.shader_program, "camera");
+        renderer.uniforms.quad_rect = glGetUniformLocation(renderer.shader_program, "quad_rect");
+        renderer.uniforms.uv_rect = glGetUniformLocation(renderer.shader_program, "uv_rect");
+        renderer.uniforms.paletted = glGetUniformLocation(renderer.shader_program, "paletted");
+        renderer.uniforms.mipless = glGetUniformLocation(renderer.shader_program, "mipless");
+        renderer.uniforms.instanced = glGetUniformLocation(renderer.shader_program, "instanced");
+        renderer.uniforms.premultiplied = glGetUniformLocation(renderer.shader_program, "premultiplied");
+    
         glUseProgram(renderer.shader_program);
-        glUniform2f(glGetUniformLocation(renderer.shader_program, "resolution"), DEFAULT_WIDTH, DEFAULT_HEIGHT);
+        glUniform2f(renderer.uniforms.resolution, DEFAULT_WIDTH, DEFAULT_HEIGHT);
+
+        // Each sampler type needs its own texture unit.
+        glUniform1i(glGetUniformLocation(renderer.shader_program, "texture_data"), 0);
+        glUniform1i(glGetUniformLocation(renderer.shader_program, "index_data"), 1);
+        glUniform1i(glGetUniformLocation(renderer.shader_program, "palette_data"), 2);
+        glUniform1i(glGetUniformLocation(renderer.shader_program, "layer_data"), 3);
     }
     
     // Render setup
     {
         glGenVertexArrays(1, &renderer.VAO);
         glGenBuffers(1, &renderer.VBO);
+        glGenBuffers(1, &renderer.EBO);
 
         glBindVertexArray(renderer.VAO);
         glBindBuffer(GL_ARRAY_BUFFER, renderer.VBO);
-        
-        glBufferData(GL_ARRAY_BUFFER, sizeof(renderer.vertices), renderer.vertices, GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD), QUAD, GL_STATIC_DRAW);
+
+        // The element buffer binding is part of the VAO's state, so it stays bound with it.
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(QUAD_INDICES), QUAD_INDICES, GL_STATIC_DRAW);
 
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, vertex_pos));
         glEnableVertexAttribArray(0);
@@ -408,28 +1544,130 @@ int main(int argc, char **argv)
     renderer.camera.offset_y = -(DEFAULT_HEIGHT / 2.0f);
     renderer.camera.scale = 1.0f;
 
-    load_create_texture(&renderer, "../example.png");
+    Frame_Stats frame_stats;
+    if (!frame_stats_create(&frame_stats, log_frame_stats)) {
+        fprintf(stderr, "[ERROR]: Could not set up frame statistics\n");
+        glfwTerminate();
+        return(1);
+    }
+
+    renderer.frame_stats = &frame_stats;
+
+    // Everything from here on decodes through it: the image, the thumbnails, the tiles.
+    job_system = job_system_create(-1);
+
+    if (platform_is_directory(path)) {
+        open_thumbnail_grid(&renderer, path);
+    } else {
+        load_create_texture(&renderer, path);
+    }
+
+    // The callbacks only ever see the view from here on.
+    renderer.view.camera = renderer.camera;
+    renderer.view.width = DEFAULT_WIDTH;
+    renderer.view.height = DEFAULT_HEIGHT;
+    renderer.view.overlay = frame_stats.overlay;
+    renderer.view.input_time = -1.0;
+    view_buffer_init(&renderer.views, &renderer.view);
+    view_buffer_init(&renderer.drawn_views, &renderer.view);
+    renderer.drawn = renderer.view;
+    renderer.target = renderer.view;
+
+    renderer.last_step_time = -1.0;
+    renderer.input_time = -1.0;
+    renderer.dirty = true;
+
+    render_thread.focused.store(glfwGetWindowAttrib(window, GLFW_FOCUSED) != 0);
+    render_thread.iconified.store(glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0);
     glfwSetWindowUserPointer(window, &renderer);
-    
-    while (!glfwWindowShouldClose(window)) {
-        display_image_centered(&renderer);
-        
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
 
-        gl_render(&renderer);
-        
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    int result = 0;
+    if (headless_script) {
+        if (renderer.load.job) {
+            job_wait(job_system, renderer.load.job);
+            finish_pending_load(&renderer);
+        }
+
+        bool loaded = (renderer.texture || renderer.tiled_image || renderer.grid);
+        result = ((loaded && headless_run(&renderer, headless_script)) ? 0 : 1);
+    } else if (use_render_thread) {
+        // The context can only be current on one thread at a time, it's the render thread's until it exits.
+        glfwMakeContextCurrent(NULL);
+        render_thread.running.store(true);
+        render_thread.thread = std::thread(render_thread_run, window, &renderer);
+
+        while (!glfwWindowShouldClose(window)) {
+            glfwWaitEvents();
+        }
+
+        render_thread_stop();
+        glfwMakeContextCurrent(window);
+    } else {
+        // Same as the render thread, with glfwWaitEvents() where it would sleep.
+        bool waited = true;
+
+        while (!glfwWindowShouldClose(window)) {
+            render_update(window, &renderer, !waited);
+
+            bool idle = (!renderer.dirty || render_thread.iconified.load());
+            bool background = !render_thread.focused.load();
+            waited = (idle || background);
+
+            if (idle) {
+                glfwWaitEvents();
+            } else if (background) {
+                glfwWaitEventsTimeout(BACKGROUND_FRAME_SECONDS);
+            } else {
+                glfwPollEvents();
+            }
+        }
     }
 
+    frame_stats_destroy(&frame_stats);
+
     glDeleteVertexArrays(1, &renderer.VAO);
     glDeleteBuffers(1, &renderer.VBO);
+    glDeleteBuffers(1, &renderer.EBO);
     glDeleteTextures(1, &renderer.texture);
+    glDeleteTextures(1, &renderer.palette_texture);
+
+    if (renderer.tiled_image) {
+        tiled_image_destroy(renderer.tiled_image);
+    }
+
+    if (renderer.grid) {
+        thumbnail_grid_destroy(renderer.grid);
+    }
+
+    if (renderer.load.job) {
+        job_wait(job_system, renderer.load.job);
+        job_release(renderer.load.job);
+
+        stbi_image_free(renderer.load.data);
+        free(renderer.load.chain.data);
+        free(renderer.load.compressed.data);
+        if (renderer.load.tiled_image) {
+            tiled_image_destroy(renderer.load.tiled_image);
+        }
+    }
+
+    if (renderer.upload.pixels) {
+        finish_mip_upload(&renderer.upload);
+    }
+
+    if (profiling) {
+        job_system_report(job_system, stdout);
+    }
+    job_system_destroy(job_system);
+
     glDeleteProgram(renderer.shader_program);
     
     glfwDestroyWindow(window);
     glfwTerminate();
+
+    if (profiling && !(profile_write_csv(PROFILE_CSV_FILE) && profile_write_trace(PROFILE_TRACE_FILE))) {
+        fprintf(stderr, "[ERROR]: Could not write the profile\n");
+    }
     
-    return 0;
+    return(result);
 }
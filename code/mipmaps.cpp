@@ -0,0 +1,349 @@
+// Mip chain generation on the CPU, used instead of glGenerateMipmap so the result is the same on every driver
+// and can be filtered in linear light (averaging sRGB values directly darkens every level a little).
+//
+// Every level is built from the one before it. The 2x2 box filter is the default: rows are converted to 14-bit
+// working values (linear light or plain, alpha is always plain), averaged with SSE2 and converted back, in
+// bands of output rows handed out to all cores. Premultiplied colour is made straight before it goes into
+// linear light and premultiplied there, so averaging it is weighted by alpha and it never comes out above
+// alpha. Lanczos-3, a Kaiser windowed sinc and Mitchell are sharper (or in Mitchell's case smoother)
+// alternatives that go through resample.cpp and cost several times as much.
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_SSE2
+#endif
+
+#define MIP_WORKING_MAX 16383 // 14 bits, so four samples plus rounding still fit into 16 bits.
+#define MIP_BAND_ROWS 32
+
+// NOTE(Aiden): Values are stored in cache entries, only ever append to this.
+enum Mip_Filter
+{
+    MIP_FILTER_BOX = 0,
+    MIP_FILTER_LANCZOS = 1,
+    MIP_FILTER_KAISER = 2,
+    MIP_FILTER_MITCHELL = 3,
+};
+
+struct Mip_Options
+{
+    Mip_Filter filter;
+    bool linear_light;
+    bool premultiplied; // The images' colour is premultiplied by alpha, which only changes anything in linear light.
+};
+
+struct Mip_Chain
+{
+    int width;
+    int height;
+    int channels;
+    int levels;
+
+    // Levels 1 and up back to back, level 0 is the caller's image and never copied.
+    unsigned char *data;
+    size_t data_size;
+    size_t level_offsets[MAX_TEXTURE_LEVELS];
+};
+
+struct Mip_Tables
+{
+    unsigned short to_working[256];
+    unsigned char from_working[MIP_WORKING_MAX + 1];
+};
+
+// [0] converts plain values, [1] sRGB to and from linear light.
+internal Mip_Tables *mip_build_tables()
+{
+    static Mip_Tables tables[2];
+
+    for (int i = 0; i < 256; ++i) {
+        double value = i / 255.0;
+        tables[0].to_working[i] = static_cast<unsigned short> (value * MIP_WORKING_MAX + 0.5);
+        tables[1].to_working[i] = static_cast<unsigned short> (srgb_to_linear(value) * MIP_WORKING_MAX + 0.5);
+    }
+
+    for (int i = 0; i <= MIP_WORKING_MAX; ++i) {
+        double value = static_cast<double> (i) / MIP_WORKING_MAX;
+        tables[0].from_working[i] = static_cast<unsigned char> (value * 255.0 + 0.5);
+        tables[1].from_working[i] = static_cast<unsigned char> (linear_to_srgb(value) * 255.0 + 0.5);
+    }
+
+    return(tables);
+}
+
+internal const Mip_Tables *mip_tables(bool linear_light)
+{
+    // NOTE(Aiden): Function statics are initialised exactly once even with several threads asking at the same time.
+    static const Mip_Tables *tables = mip_build_tables();
+    return(&tables[linear_light ? 1 : 0]);
+}
+
+internal inline int mip_level_dimension(int size, int level)
+{
+    int result = size >> level;
+    return(result > 0 ? result : 1);
+}
+
+internal inline size_t mip_level_size(int width, int height, int channels)
+{
+    return(static_cast<size_t> (width) * height * channels);
+}
+
+// Expands a row of 1 to 4 channel pixels to RGBA working values.
+internal void mip_load_row(const unsigned char *src, int width, int channels, const Mip_Tables *colour, const Mip_Tables *alpha, unsigned short *dst)
+{
+    for (int x = 0; x < width; ++x, src += channels, dst += 4) {
+        switch (channels) {
+            case 1: {
+                dst[0] = dst[1] = dst[2] = colour->to_working[src[0]];
+                dst[3] = MIP_WORKING_MAX;
+            } break;
+
+            case 2: {
+                dst[0] = dst[1] = dst[2] = colour->to_working[src[0]];
+                dst[3] = alpha->to_working[src[1]];
+            } break;
+
+            case 3: {
+                dst[0] = colour->to_working[src[0]];
+                dst[1] = colour->to_working[src[1]];
+                dst[2] = colour->to_working[src[2]];
+                dst[3] = MIP_WORKING_MAX;
+            } break;
+
+            default: {
+                dst[0] = colour->to_working[src[0]];
+                dst[1] = colour->to_working[src[1]];
+                dst[2] = colour->to_working[src[2]];
+                dst[3] = alpha->to_working[src[3]];
+            } break;
+        }
+    }
+}
+
+internal void mip_store_row(const unsigned short *src, int width, int channels, const Mip_Tables *colour, const Mip_Tables *alpha, unsigned char *dst)
+{
+    for (int x = 0; x < width; ++x, src += 4, dst += channels) {
+        switch (channels) {
+            case 1: {
+                dst[0] = colour->from_working[src[0]];
+            } break;
+
+            case 2: {
+                dst[0] = colour->from_working[src[0]];
+                dst[1] = alpha->from_working[src[3]];
+            } break;
+
+            case 3: {
+                dst[0] = colour->from_working[src[0]];
+                dst[1] = colour->from_working[src[1]];
+                dst[2] = colour->from_working[src[2]];
+            } break;
+
+            default: {
+                dst[0] = colour->from_working[src[0]];
+                dst[1] = colour->from_working[src[1]];
+                dst[2] = colour->from_working[src[2]];
+                dst[3] = alpha->from_working[src[3]];
+            } break;
+        }
+    }
+}
+
+// mip_load_row() and mip_store_row() for premultiplied 2 and 4 channel pixels in linear light.
+internal void mip_load_row_premultiplied(const unsigned char *src, int width, int channels, const Mip_Tables *colour, const Mip_Tables *alpha, unsigned short *dst)
+{
+    for (int x = 0; x < width; ++x, src += channels, dst += 4) {
+        unsigned int a = src[channels - 1];
+        unsigned int coverage = alpha->to_working[a];
+        dst[3] = static_cast<unsigned short> (coverage);
+
+        for (int c = 0; c < 3; ++c) {
+            unsigned int straight = colour->to_working[resample_unpremultiply(src[channels == 2 ? 0 : c], a, 255)];
+            dst[c] = static_cast<unsigned short> ((straight * coverage + MIP_WORKING_MAX / 2) / MIP_WORKING_MAX);
+        }
+    }
+}
+
+internal void mip_store_row_premultiplied(const unsigned short *src, int width, int channels, const Mip_Tables *colour, const Mip_Tables *alpha, unsigned char *dst)
+{
+    for (int x = 0; x < width; ++x, src += 4, dst += channels) {
+        unsigned int a = alpha->from_working[src[3]];
+        dst[channels - 1] = static_cast<unsigned char> (a);
+
+        for (int c = 0; c < channels - 1; ++c) {
+            unsigned int straight = colour->from_working[resample_unpremultiply(src[c], src[3], MIP_WORKING_MAX)];
+            dst[c] = static_cast<unsigned char> (resample_premultiply(straight, a, 255));
+        }
+    }
+}
+
+// Averages 2x2 blocks of two RGBA working rows, an odd last column or row is dropped like glGenerateMipmap does.
+internal void mip_box_row(const unsigned short *row0, const unsigned short *row1, int width, unsigned short *dst)
+{
+    int dst_width = (width > 1 ? width / 2 : 1);
+    int x = 0;
+
+#ifdef MIP_SSE2
+    // NOTE(Aiden): Two output pixels per iteration: add the rows, then add each pixel to its right
+    // neighbour by splitting the sums into even and odd pixels. Working values are at most 14 bits,
+    // so none of this can overflow the 16-bit lanes.
+    if (width > 1) {
+        __m128i rounding = _mm_set1_epi16(2);
+
+        for (; x + 2 <= dst_width; x += 2) {
+            __m128i a = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *> (row0 + x*8)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i *> (row1 + x*8)));
+            __m128i b = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *> (row0 + x*8 + 8)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i *> (row1 + x*8 + 8)));
+
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+            _mm_storeu_si128(reinterpret_cast<__m128i *> (dst + x*4), _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2));
+        }
+    }
+#endif
+
+    for (; x < dst_width; ++x) {
+        int x0 = MIN(x*2, width - 1);
+        int x1 = MIN(x*2 + 1, width - 1);
+
+        for (int c = 0; c < 4; ++c) {
+            int sum = row0[x0*4 + c] + row0[x1*4 + c] + row1[x0*4 + c] + row1[x1*4 + c];
+            dst[x*4 + c] = static_cast<unsigned short> ((sum + 2) >> 2);
+        }
+    }
+}
+
+internal Resample_Filter mip_resample_filter(Mip_Filter filter)
+{
+    switch (filter) {
+        case MIP_FILTER_KAISER:   return(RESAMPLE_KAISER);
+        case MIP_FILTER_MITCHELL: return(RESAMPLE_MITCHELL);
+        default:                  return(RESAMPLE_LANCZOS3);
+    }
+}
+
+// Builds the next level of a 1 to 4 channel image on up to 'thread_count' threads, 0 means every job worker
+// plus the calling thread.
+internal bool mip_downsample(const unsigned char *src, int width, int height, int channels,
+                             const Mip_Options *options, int thread_count, unsigned char *dst)
+{
+    PROFILE_ZONE(PROFILE_MIPS);
+
+    int dst_width = (width > 1 ? width / 2 : 1);
+    int dst_height = (height > 1 ? height / 2 : 1);
+
+    if (options->filter != MIP_FILTER_BOX) {
+        // An odd last column or row is left out, so every level is exactly half the one before it like with
+        // the box filter.
+        Resample_Image source = { const_cast<unsigned char *> (src), MIN(dst_width * 2, width), MIN(dst_height * 2, height),
+                                  static_cast<size_t> (width) * channels };
+        Resample_Image destination = { dst, dst_width, dst_height, 0 };
+        Resample_Options resample_options = { mip_resample_filter(options->filter), options->linear_light, options->premultiplied };
+
+        return(resample(&source, &destination, channels, RESAMPLE_8_BIT, &resample_options, thread_count));
+    }
+
+    int bands = (dst_height + MIP_BAND_ROWS - 1) / MIP_BAND_ROWS;
+
+    const Mip_Tables *colour = mip_tables(options->linear_light);
+    const Mip_Tables *alpha = mip_tables(false);
+    bool premultiplied = (options->premultiplied && options->linear_light && (channels == 2 || channels == 4));
+
+    size_t src_row = static_cast<size_t> (width) * 4;
+    size_t dst_row = static_cast<size_t> (dst_width) * 4;
+
+    std::atomic<int> next_band(0);
+    std::atomic<bool> failed(false);
+
+    auto worker = [&]() {
+        unsigned short *rows = static_cast<unsigned short *> (malloc(sizeof(unsigned short) * (src_row*2 + dst_row)));
+        if (rows == NULL) {
+            failed = true;
+            return;
+        }
+
+        unsigned short *out = rows + src_row*2;
+
+        for (int band = next_band++; band < bands; band = next_band++) {
+            int y0 = band * MIP_BAND_ROWS;
+            int y1 = MIN(y0 + MIP_BAND_ROWS, dst_height);
+
+            for (int y = y0; y < y1; ++y) {
+                int sy0 = MIN(y*2, height - 1);
+                int sy1 = MIN(y*2 + 1, height - 1);
+
+                const unsigned char *row0 = src + static_cast<size_t> (sy0) * width * channels;
+                const unsigned char *row1 = src + static_cast<size_t> (sy1) * width * channels;
+                unsigned char *dst_row_pixels = dst + static_cast<size_t> (y) * dst_width * channels;
+
+                if (premultiplied) {
+                    mip_load_row_premultiplied(row0, width, channels, colour, alpha, rows);
+                    mip_load_row_premultiplied(row1, width, channels, colour, alpha, rows + src_row);
+                    mip_box_row(rows, rows + src_row, width, out);
+                    mip_store_row_premultiplied(out, dst_width, channels, colour, alpha, dst_row_pixels);
+                } else {
+                    mip_load_row(row0, width, channels, colour, alpha, rows);
+                    mip_load_row(row1, width, channels, colour, alpha, rows + src_row);
+                    mip_box_row(rows, rows + src_row, width, out);
+                    mip_store_row(out, dst_width, channels, colour, alpha, dst_row_pixels);
+                }
+            }
+        }
+
+        free(rows);
+    };
+
+    // NOTE(Aiden): Bands go to jobs rather than threads of our own, every level of every image used to
+    // start and join a full set of threads.
+    int lanes = (thread_count > 0 ? thread_count : (job_system ? job_system->worker_count + 1 : 1));
+    job_run_parallel(MIN(lanes, bands), worker);
+
+    return(!failed);
+}
+
+internal const unsigned char *mip_level_pixels(const Mip_Chain *chain, const unsigned char *pixels, int level)
+{
+    return(level == 0 ? pixels : chain->data + chain->level_offsets[level]);
+}
+
+internal size_t mip_compute_level_offsets(Mip_Chain *chain)
+{
+    size_t offset = 0;
+
+    for (int level = 1; level < chain->levels; ++level) {
+        chain->level_offsets[level] = offset;
+        offset += mip_level_size(mip_level_dimension(chain->width, level), mip_level_dimension(chain->height, level), chain->channels);
+    }
+
+    return(offset);
+}
+
+// Builds every level after 0 for a 1 to 4 channel image, 'thread_count' as in mip_downsample().
+internal bool mip_generate(const unsigned char *pixels, int width, int height, int channels, const Mip_Options *options,
+                           int thread_count, Mip_Chain *chain)
+{
+    chain->width = width;
+    chain->height = height;
+    chain->channels = channels;
+    chain->levels = mip_level_count(width, height);
+    chain->data_size = mip_compute_level_offsets(chain);
+    chain->data = static_cast<unsigned char *> (malloc(chain->data_size > 0 ? chain->data_size : 1));
+
+    if (chain->data == NULL) {
+        return(false);
+    }
+
+    for (int level = 1; level < chain->levels; ++level) {
+        const unsigned char *previous = mip_level_pixels(chain, pixels, level - 1);
+        unsigned char *current = chain->data + chain->level_offsets[level];
+
+        if (!mip_downsample(previous, mip_level_dimension(width, level - 1), mip_level_dimension(height, level - 1), channels, options, thread_count, current)) {
+            free(chain->data);
+            chain->data = NULL;
+            return(false);
+        }
+    }
+
+    return(true);
+}
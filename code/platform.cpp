@@ -0,0 +1,325 @@
+// Everything that has to talk to the OS directly (besides GLFW) lives here,
+// so the rest of the code doesn't need to care which API is underneath.
+//
+// The viewer itself is Windows only, the POSIX versions are there for simpimg_bench on headless Linux boxes.
+
+#ifdef _WIN32
+#define PATH_SEPARATOR "\\"
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PATH_SEPARATOR "/"
+#define _stricmp strcasecmp
+#define _strdup strdup
+
+#ifndef MAX_PATH
+#define MAX_PATH 4096
+#endif
+#endif
+
+struct File_Stamp
+{
+    unsigned long long size;
+    unsigned long long modified;
+};
+
+struct Mapped_File
+{
+    unsigned char *data;
+    size_t size;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+struct Directory_Listing
+{
+    char *names;        // Every name back to back, NUL terminated.
+    size_t *offsets;    // Start of each name in 'names', sorted by name.
+    size_t names_size;
+    int count;
+};
+
+#ifdef _WIN32
+
+internal bool platform_get_file_stamp(const char *filename, File_Stamp *stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &data)) {
+        return(false);
+    }
+
+    stamp->size = (static_cast<unsigned long long> (data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    stamp->modified = (static_cast<unsigned long long> (data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+
+    return(true);
+}
+
+internal bool platform_make_directory(const char *path)
+{
+    if (CreateDirectory(path, NULL)) {
+        return(true);
+    }
+
+    return(GetLastError() == ERROR_ALREADY_EXISTS);
+}
+
+// Read-only view of a whole file, pages are only read from disk once they're touched.
+internal bool platform_map_file(const char *filename, Mapped_File *mapped)
+{
+    mapped->file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mapped->file == INVALID_HANDLE_VALUE) {
+        return(false);
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0) {
+        CloseHandle(mapped->file);
+        return(false);
+    }
+
+    mapped->mapping = CreateFileMapping(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped->mapping == NULL) {
+        CloseHandle(mapped->file);
+        return(false);
+    }
+
+    mapped->data = static_cast<unsigned char *> (MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0));
+    if (mapped->data == NULL) {
+        CloseHandle(mapped->mapping);
+        CloseHandle(mapped->file);
+        return(false);
+    }
+
+    mapped->size = static_cast<size_t> (size.QuadPart);
+    return(true);
+}
+
+internal void platform_unmap_file(Mapped_File *mapped)
+{
+    UnmapViewOfFile(mapped->data);
+    CloseHandle(mapped->mapping);
+    CloseHandle(mapped->file);
+
+    mapped->data = NULL;
+    mapped->size = 0;
+}
+
+internal bool platform_is_directory(const char *path)
+{
+    DWORD attributes = GetFileAttributes(path);
+    return(attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY));
+}
+
+#else
+
+internal bool platform_get_file_stamp(const char *filename, File_Stamp *stamp)
+{
+    struct stat info;
+    if (stat(filename, &info) != 0) {
+        return(false);
+    }
+
+    stamp->size = static_cast<unsigned long long> (info.st_size);
+    stamp->modified = static_cast<unsigned long long> (info.st_mtime);
+
+    return(true);
+}
+
+internal bool platform_make_directory(const char *path)
+{
+    return(mkdir(path, 0755) == 0 || errno == EEXIST);
+}
+
+internal bool platform_map_file(const char *filename, Mapped_File *mapped)
+{
+    int file = open(filename, O_RDONLY);
+    if (file < 0) {
+        return(false);
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        close(file);
+        return(false);
+    }
+
+    // The mapping keeps the file alive on its own.
+    void *data = mmap(NULL, static_cast<size_t> (info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+
+    if (data == MAP_FAILED) {
+        return(false);
+    }
+
+    mapped->data = static_cast<unsigned char *> (data);
+    mapped->size = static_cast<size_t> (info.st_size);
+    return(true);
+}
+
+internal void platform_unmap_file(Mapped_File *mapped)
+{
+    munmap(mapped->data, mapped->size);
+
+    mapped->data = NULL;
+    mapped->size = 0;
+}
+
+internal bool platform_is_directory(const char *path)
+{
+    struct stat info;
+    return(stat(path, &info) == 0 && S_ISDIR(info.st_mode));
+}
+
+#endif
+
+internal const char *platform_listing_name(const Directory_Listing *listing, int index)
+{
+    return(listing->names + listing->offsets[index]);
+}
+
+internal bool platform_listing_wanted(const char *name, const char **extensions, int extension_count)
+{
+    const char *extension = strrchr(name, '.');
+    for (int i = 0; extension && i < extension_count; ++i) {
+        if (_stricmp(extension, extensions[i]) == 0) {
+            return(true);
+        }
+    }
+
+    return(false);
+}
+
+internal bool platform_listing_push(Directory_Listing *listing, const char *name, size_t *names_capacity, int *offsets_capacity)
+{
+    size_t length = strlen(name) + 1;
+
+    if (listing->names_size + length > *names_capacity) {
+        size_t capacity = (*names_capacity ? *names_capacity * 2 : 1 << 16) + length;
+        char *names = static_cast<char *> (realloc(listing->names, capacity));
+        if (names == NULL) {
+            return(false);
+        }
+
+        listing->names = names;
+        *names_capacity = capacity;
+    }
+
+    if (listing->count == *offsets_capacity) {
+        int capacity = (*offsets_capacity ? *offsets_capacity * 2 : 1024);
+        size_t *offsets = static_cast<size_t *> (realloc(listing->offsets, sizeof(size_t) * capacity));
+        if (offsets == NULL) {
+            return(false);
+        }
+
+        listing->offsets = offsets;
+        *offsets_capacity = capacity;
+    }
+
+    memcpy(listing->names + listing->names_size, name, length);
+    listing->offsets[listing->count++] = listing->names_size;
+    listing->names_size += length;
+    return(true);
+}
+
+// Lists what's in 'path', sorted by name: the regular files whose extension (".png", case insensitive) is one
+// of 'extensions', or the subdirectories (except "." and "..") when 'directories' is set.
+internal bool platform_list_entries(const char *path, const char **extensions, int extension_count, bool directories, Directory_Listing *listing)
+{
+    size_t names_capacity = 0;
+    int offsets_capacity = 0;
+    *listing = {};
+    bool ok = true;
+
+#ifdef _WIN32
+    char pattern[MAX_PATH];
+    if (snprintf(pattern, sizeof(pattern), "%s" PATH_SEPARATOR "*", path) >= static_cast<int> (sizeof(pattern))) {
+        return(false);
+    }
+
+    WIN32_FIND_DATA data;
+    HANDLE find = FindFirstFile(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return(false);
+    }
+
+    do {
+        bool is_directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        bool wanted = (directories ? is_directory && strcmp(data.cFileName, ".") != 0 && strcmp(data.cFileName, "..") != 0
+                                   : !is_directory && platform_listing_wanted(data.cFileName, extensions, extension_count));
+        if (wanted) {
+            ok = platform_listing_push(listing, data.cFileName, &names_capacity, &offsets_capacity);
+        }
+    } while (ok && FindNextFile(find, &data));
+
+    FindClose(find);
+#else
+    DIR *directory = opendir(path);
+    if (directory == NULL) {
+        return(false);
+    }
+
+    struct dirent *entry;
+    while (ok && (entry = readdir(directory)) != NULL) {
+        if (directories ? strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0
+                        : !platform_listing_wanted(entry->d_name, extensions, extension_count)) {
+            continue;
+        }
+
+        // d_type isn't filled in by every file system, stat() always knows.
+        char full_path[MAX_PATH];
+        struct stat info;
+        if (snprintf(full_path, sizeof(full_path), "%s" PATH_SEPARATOR "%s", path, entry->d_name) < static_cast<int> (sizeof(full_path)) &&
+            stat(full_path, &info) == 0 && (directories ? S_ISDIR(info.st_mode) : S_ISREG(info.st_mode))) {
+            ok = platform_listing_push(listing, entry->d_name, &names_capacity, &offsets_capacity);
+        }
+    }
+
+    closedir(directory);
+#endif
+
+    if (!ok) {
+        free(listing->names);
+        free(listing->offsets);
+        *listing = {};
+        return(false);
+    }
+
+    // NOTE(Aiden): qsort() has no context pointer, so the comparison finds the names through a static. It's
+    // per thread since the batch thumbnailer lists directories on every core at once.
+    static thread_local const char *sort_names;
+    sort_names = listing->names;
+    if (listing->count > 1) {
+        qsort(listing->offsets, listing->count, sizeof(size_t), [](const void *a, const void *b) {
+            return(_stricmp(sort_names + *static_cast<const size_t *> (a), sort_names + *static_cast<const size_t *> (b)));
+        });
+    }
+
+    return(true);
+}
+
+// Lists the regular files in 'path' whose extension (".png", case insensitive) is one of 'extensions', sorted by name.
+internal bool platform_list_directory(const char *path, const char **extensions, int extension_count, Directory_Listing *listing)
+{
+    return(platform_list_entries(path, extensions, extension_count, false, listing));
+}
+
+internal bool platform_list_subdirectories(const char *path, Directory_Listing *listing)
+{
+    return(platform_list_entries(path, NULL, 0, true, listing));
+}
+
+internal void platform_free_listing(Directory_Listing *listing)
+{
+    free(listing->names);
+    free(listing->offsets);
+    *listing = {};
+}
@@ -0,0 +1,345 @@
+// Minimal PNG encoder for the thumbnails we write out: 8-bit RGBA, every row gets whichever filter makes its
+// bytes smallest (the usual heuristic) and the whole image goes into one deflate block with the fixed Huffman
+// codes. Matches come from a single probe hash table, so it's fast and compresses thumbnails reasonably,
+// nowhere near what zlib's higher levels manage, which is fine for files this size.
+
+#define PNG_HASH_BITS 15
+#define PNG_WINDOW 32768
+#define PNG_MIN_MATCH 3
+#define PNG_MAX_MATCH 258
+
+struct Png_Buffer
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+
+    unsigned int bits;
+    int bit_count;
+};
+
+global const unsigned short PNG_LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+global const unsigned char PNG_LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+global const unsigned short PNG_DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577
+};
+global const unsigned char PNG_DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+internal bool png_reserve(Png_Buffer *buffer, size_t extra)
+{
+    if (buffer->failed) {
+        return(false);
+    }
+
+    if (buffer->size + extra > buffer->capacity) {
+        size_t capacity = buffer->capacity * 2 + extra + 4096;
+        unsigned char *data = static_cast<unsigned char *> (realloc(buffer->data, capacity));
+        if (data == NULL) {
+            buffer->failed = true;
+            return(false);
+        }
+
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+
+    return(true);
+}
+
+internal void png_put_byte(Png_Buffer *buffer, unsigned int value)
+{
+    if (png_reserve(buffer, 1)) {
+        buffer->data[buffer->size++] = static_cast<unsigned char> (value);
+    }
+}
+
+internal void png_put_u32(Png_Buffer *buffer, unsigned int value)
+{
+    png_put_byte(buffer, value >> 24);
+    png_put_byte(buffer, value >> 16);
+    png_put_byte(buffer, value >> 8);
+    png_put_byte(buffer, value);
+}
+
+// Deflate packs bits LSB first.
+internal void png_put_bits(Png_Buffer *buffer, unsigned int value, int count)
+{
+    buffer->bits |= value << buffer->bit_count;
+    buffer->bit_count += count;
+
+    while (buffer->bit_count >= 8) {
+        png_put_byte(buffer, buffer->bits & 0xff);
+        buffer->bits >>= 8;
+        buffer->bit_count -= 8;
+    }
+}
+
+// Huffman codes go in MSB first, so they're reversed into the bit stream.
+internal void png_put_code(Png_Buffer *buffer, unsigned int code, int length)
+{
+    unsigned int reversed = 0;
+    for (int i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+
+    png_put_bits(buffer, reversed, length);
+}
+
+// The fixed literal/length code, RFC 1951 3.2.6.
+internal void png_put_symbol(Png_Buffer *buffer, int symbol)
+{
+    if (symbol < 144) {
+        png_put_code(buffer, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        png_put_code(buffer, 0x190 + (symbol - 144), 9);
+    } else if (symbol < 280) {
+        png_put_code(buffer, symbol - 256, 7);
+    } else {
+        png_put_code(buffer, 0xc0 + (symbol - 280), 8);
+    }
+}
+
+internal void png_put_match(Png_Buffer *buffer, int length, int distance)
+{
+    int code = 28;
+    while (PNG_LENGTH_BASE[code] > length) {
+        --code;
+    }
+    png_put_symbol(buffer, 257 + code);
+    png_put_bits(buffer, length - PNG_LENGTH_BASE[code], PNG_LENGTH_EXTRA[code]);
+
+    code = 29;
+    while (PNG_DISTANCE_BASE[code] > distance) {
+        --code;
+    }
+    png_put_code(buffer, code, 5);
+    png_put_bits(buffer, distance - PNG_DISTANCE_BASE[code], PNG_DISTANCE_EXTRA[code]);
+}
+
+internal inline unsigned int png_hash(const unsigned char *p)
+{
+    unsigned int value = p[0] | (p[1] << 8) | (p[2] << 16);
+    return((value * 2654435761u) >> (32 - PNG_HASH_BITS));
+}
+
+// zlib stream (header, one fixed Huffman block, Adler-32) of 'data'.
+internal bool png_deflate(Png_Buffer *buffer, const unsigned char *data, size_t size)
+{
+    int *head = static_cast<int *> (malloc(sizeof(int) << PNG_HASH_BITS));
+    if (head == NULL) {
+        return(false);
+    }
+
+    for (int i = 0; i < (1 << PNG_HASH_BITS); ++i) {
+        head[i] = -1;
+    }
+
+    png_put_byte(buffer, 0x78); // 32K window, deflate.
+    png_put_byte(buffer, 0x01);
+    png_put_bits(buffer, 1, 1); // Last block.
+    png_put_bits(buffer, 1, 2); // Fixed codes.
+
+    int count = static_cast<int> (size);
+    for (int i = 0; i < count;) {
+        int length = 0, distance = 0;
+
+        if (i + PNG_MIN_MATCH <= count) {
+            unsigned int hash = png_hash(data + i);
+            int candidate = head[hash];
+            head[hash] = i;
+
+            if (candidate >= 0 && i - candidate <= PNG_WINDOW) {
+                int limit = MIN(PNG_MAX_MATCH, count - i);
+                while (length < limit && data[candidate + length] == data[i + length]) {
+                    ++length;
+                }
+                distance = i - candidate;
+            }
+        }
+
+        if (length < PNG_MIN_MATCH) {
+            png_put_symbol(buffer, data[i++]);
+            continue;
+        }
+
+        png_put_match(buffer, length, distance);
+
+        // Everything the match covered can be matched against later too.
+        for (int j = i + 1; j < i + length && j + PNG_MIN_MATCH <= count; ++j) {
+            head[png_hash(data + j)] = j;
+        }
+        i += length;
+    }
+
+    png_put_symbol(buffer, 256);
+    png_put_bits(buffer, 0, 7); // Flush the last byte.
+    free(head);
+
+    unsigned int a = 1, b = 0;
+    for (size_t i = 0; i < size; ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    png_put_u32(buffer, (b << 16) | a);
+
+    return(!buffer->failed);
+}
+
+internal unsigned int png_crc(const unsigned char *data, size_t size, unsigned int crc)
+{
+    static unsigned int table[256];
+    static std::once_flag table_once;
+
+    std::call_once(table_once, [] {
+        for (unsigned int n = 0; n < 256; ++n) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+    });
+
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return(crc);
+}
+
+internal size_t png_start_chunk(Png_Buffer *buffer, const char *type)
+{
+    png_put_u32(buffer, 0); // Length, filled in by png_finish_chunk().
+    size_t start = buffer->size;
+    for (int i = 0; i < 4; ++i) {
+        png_put_byte(buffer, static_cast<unsigned char> (type[i]));
+    }
+
+    return(start);
+}
+
+// The chunk's data has to be in 'buffer' already, starting at 'start' (right after where the length goes).
+internal void png_finish_chunk(Png_Buffer *buffer, size_t start)
+{
+    if (buffer->failed) {
+        return;
+    }
+
+    unsigned int length = static_cast<unsigned int> (buffer->size - start - 4);
+    for (int i = 0; i < 4; ++i) {
+        buffer->data[start - 4 + i] = static_cast<unsigned char> (length >> (24 - i * 8));
+    }
+
+    png_put_u32(buffer, png_crc(buffer->data + start, buffer->size - start, 0xffffffffu) ^ 0xffffffffu);
+}
+
+internal inline int png_predict(int filter, int a, int b, int c)
+{
+    switch (filter) {
+        case 1: return(a);
+        case 2: return(b);
+        case 3: return((a + b) / 2);
+        case 4: {
+            int p = a + b - c;
+            int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+            return((pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c));
+        }
+    }
+
+    return(0);
+}
+
+// Filters every row with whichever of the five filters gives the smallest sum of (signed) bytes.
+internal void png_filter_rows(const unsigned char *pixels, int width, int height, unsigned char *out)
+{
+    size_t stride = static_cast<size_t> (width) * 4;
+
+    for (int y = 0; y < height; ++y) {
+        const unsigned char *row = pixels + y * stride;
+        const unsigned char *above = (y ? row - stride : NULL);
+        unsigned char *filtered = out + y * (stride + 1);
+
+        long long best_cost = -1;
+        int best_filter = 0;
+
+        for (int filter = 0; filter < 5; ++filter) {
+            long long cost = 0;
+            for (size_t i = 0; i < stride; ++i) {
+                int a = (i >= 4 ? row[i - 4] : 0);
+                int b = (above ? above[i] : 0);
+                int c = (above && i >= 4 ? above[i - 4] : 0);
+                int value = static_cast<signed char> (static_cast<unsigned char> (row[i] - png_predict(filter, a, b, c)));
+                cost += (value < 0 ? -value : value);
+            }
+
+            if (best_cost < 0 || cost < best_cost) {
+                best_cost = cost;
+                best_filter = filter;
+            }
+        }
+
+        filtered[0] = static_cast<unsigned char> (best_filter);
+        for (size_t i = 0; i < stride; ++i) {
+            int a = (i >= 4 ? row[i - 4] : 0);
+            int b = (above ? above[i] : 0);
+            int c = (above && i >= 4 ? above[i - 4] : 0);
+            filtered[1 + i] = static_cast<unsigned char> (row[i] - png_predict(best_filter, a, b, c));
+        }
+    }
+}
+
+// Encodes RGBA pixels into a PNG file in memory, the caller frees '*data'.
+internal bool png_encode_rgba(const unsigned char *pixels, int width, int height, unsigned char **data, size_t *size)
+{
+    size_t filtered_size = (static_cast<size_t> (width) * 4 + 1) * height;
+    unsigned char *filtered = static_cast<unsigned char *> (malloc(filtered_size));
+    if (filtered == NULL) {
+        return(false);
+    }
+
+    png_filter_rows(pixels, width, height, filtered);
+
+    Png_Buffer buffer = {};
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    for (int i = 0; i < 8; ++i) {
+        png_put_byte(&buffer, signature[i]);
+    }
+
+    size_t chunk = png_start_chunk(&buffer, "IHDR");
+    png_put_u32(&buffer, static_cast<unsigned int> (width));
+    png_put_u32(&buffer, static_cast<unsigned int> (height));
+    png_put_byte(&buffer, 8); // Bit depth.
+    png_put_byte(&buffer, 6); // RGBA.
+    png_put_byte(&buffer, 0); // Deflate.
+    png_put_byte(&buffer, 0); // Adaptive filtering.
+    png_put_byte(&buffer, 0); // Not interlaced.
+    png_finish_chunk(&buffer, chunk);
+
+    chunk = png_start_chunk(&buffer, "IDAT");
+    if (!png_deflate(&buffer, filtered, filtered_size)) {
+        buffer.failed = true;
+    }
+    png_finish_chunk(&buffer, chunk);
+
+    chunk = png_start_chunk(&buffer, "IEND");
+    png_finish_chunk(&buffer, chunk);
+
+    free(filtered);
+
+    if (buffer.failed) {
+        free(buffer.data);
+        return(false);
+    }
+
+    *data = buffer.data;
+    *size = buffer.size;
+    return(true);
+}
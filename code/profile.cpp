@@ -0,0 +1,321 @@
+// Timing zones for the loading pipeline: where does the time go between a filename and a texture?
+//
+// PROFILE_ZONE(zone) times the rest of its scope, PROFILE_IMAGE(name) groups every zone in its scope (on
+// the same thread) into one record per image. stb_image gets the same treatment through its STBI_ZONE_*
+// hooks. Records come out as CSV (one row per image, inclusive seconds per zone, so nested zones count
+// in both columns) and every zone instance as Chrome trace events (chrome://tracing, Perfetto).
+//
+// Compiled in when SIMPIMG_PROFILE is non-zero, which is the default for debug builds, release builds
+// need "build_release.bat /DSIMPIMG_PROFILE=1". Even then nothing is recorded until profile_start().
+
+#ifndef SIMPIMG_PROFILE
+#ifdef NDEBUG
+#define SIMPIMG_PROFILE 0
+#else
+#define SIMPIMG_PROFILE 1
+#endif
+#endif
+
+#define PROFILE_MAX_RECORDS (1 << 14)
+#define PROFILE_MAX_EVENTS (1 << 19)
+
+enum Profile_Zone_Id
+{
+    PROFILE_LOAD,          // Everything from the filename to the texture (or thumbnail).
+    PROFILE_PROBE,         // stbi_info() and stb_image guessing the format.
+    PROFILE_DECODE,        // The whole stb_image call, the zones below split it up where they can.
+    PROFILE_FILE_READ,     // Cache files. stb_image reads in small buffered pieces as it decodes, so for
+                           // JPEGs the reading is part of JPEG_SCAN.
+    PROFILE_JPEG_SCAN,     // Entropy decoding, for baseline JPEGs stb_image also does the IDCT right away.
+    PROFILE_JPEG_IDCT,     // Progressive JPEGs only.
+    PROFILE_JPEG_RESAMPLE, // Chroma upsampling and YCbCr to RGB.
+    PROFILE_JPEG_INDEX,    // jpeg_index.cpp's checkpoint and DC preview pass.
+    PROFILE_JPEG_REGION,
+    PROFILE_PNG_READ,      // Reading the chunks, mostly IDAT.
+    PROFILE_PNG_INFLATE,
+    PROFILE_PNG_UNFILTER,
+    PROFILE_CONVERT,       // Channel count and bit depth conversion, premultiplying what the decoder itself didn't.
+    PROFILE_MIPS,
+    PROFILE_RESAMPLE,      // Thumbnails and filtered (not box) mip levels, see resample.cpp.
+    PROFILE_COMPRESS,
+    PROFILE_UPLOAD,
+
+    PROFILE_ZONE_COUNT
+};
+
+#if SIMPIMG_PROFILE
+
+// JSON strings can't hold raw backslashes (Windows paths) or quotes.
+internal void profile_write_json_string(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if (static_cast<unsigned char> (*c) >= 0x20) {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+global const char *PROFILE_ZONE_NAMES[PROFILE_ZONE_COUNT] = {
+    "load",
+    "probe",
+    "decode",
+    "file_read",
+    "jpeg_scan",
+    "jpeg_idct",
+    "jpeg_resample",
+    "jpeg_index",
+    "jpeg_region",
+    "png_read",
+    "png_inflate",
+    "png_unfilter",
+    "convert",
+    "mips",
+    "resample",
+    "compress",
+    "upload",
+};
+
+struct Profile_Record
+{
+    char *name;
+    int thread;
+    double start;
+    double end;
+    double seconds[PROFILE_ZONE_COUNT];
+    int calls[PROFILE_ZONE_COUNT];
+};
+
+struct Profile_Event
+{
+    double start;
+    double duration;
+    int record;
+    unsigned short zone;
+    unsigned short thread;
+};
+
+// NOTE(Aiden): Records and events are handed out with an atomic counter and never move, so zones on
+// any thread can write without a lock. A record is only ever written by the thread that has it open.
+global std::atomic<bool> profile_recording;
+global Profile_Record *profile_records;
+global std::atomic<int> profile_record_count;
+global Profile_Event *profile_events;
+global std::atomic<int> profile_event_count;
+global std::atomic<int> profile_thread_count;
+global double profile_epoch;
+
+global thread_local int profile_thread = -1;
+global thread_local int profile_image = -1;
+
+internal double profile_seconds()
+{
+    return(std::chrono::duration<double> (std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+internal int profile_thread_id()
+{
+    if (profile_thread < 0) {
+        profile_thread = profile_thread_count++;
+    }
+
+    return(profile_thread);
+}
+
+internal bool profile_start()
+{
+    profile_records = static_cast<Profile_Record *> (calloc(PROFILE_MAX_RECORDS, sizeof(Profile_Record)));
+    profile_events = static_cast<Profile_Event *> (malloc(sizeof(Profile_Event) * PROFILE_MAX_EVENTS));
+
+    if (profile_records == NULL || profile_events == NULL) {
+        free(profile_records);
+        free(profile_events);
+        profile_records = NULL;
+        profile_events = NULL;
+        return(false);
+    }
+
+    profile_epoch = profile_seconds();
+    profile_recording = true;
+    return(true);
+}
+
+// Returns 0.0 when nothing is being recorded, profile_end() then ignores the zone.
+internal inline double profile_begin()
+{
+    return(profile_recording ? profile_seconds() : 0.0);
+}
+
+internal void profile_end(int zone, double start)
+{
+    if (start == 0.0) {
+        return;
+    }
+
+    double end = profile_seconds();
+
+    if (profile_image >= 0) {
+        Profile_Record *record = &profile_records[profile_image];
+        record->seconds[zone] += end - start;
+        record->calls[zone] += 1;
+    }
+
+    int index = profile_event_count++;
+    if (index < PROFILE_MAX_EVENTS) {
+        Profile_Event *event = &profile_events[index];
+        event->start = start - profile_epoch;
+        event->duration = end - start;
+        event->record = profile_image;
+        event->zone = static_cast<unsigned short> (zone);
+        event->thread = static_cast<unsigned short> (profile_thread_id());
+    }
+}
+
+struct Profile_Scope
+{
+    int zone;
+    double start;
+
+    Profile_Scope(int id) : zone(id), start(profile_begin()) {}
+    ~Profile_Scope() { profile_end(zone, start); }
+};
+
+// Opens a new record, or reopens 'record' for work that continues later (staged uploads).
+struct Profile_Image_Scope
+{
+    int previous;
+
+    Profile_Image_Scope(const char *name) : previous(profile_image)
+    {
+        int index = (profile_recording ? profile_record_count++ : PROFILE_MAX_RECORDS);
+        profile_image = (index < PROFILE_MAX_RECORDS ? index : -1);
+
+        if (profile_image >= 0) {
+            Profile_Record *record = &profile_records[profile_image];
+            record->name = strdup(name);
+            record->thread = profile_thread_id();
+            record->start = profile_seconds() - profile_epoch;
+            record->end = record->start;
+        }
+    }
+
+    Profile_Image_Scope(int record) : previous(profile_image)
+    {
+        profile_image = record;
+    }
+
+    ~Profile_Image_Scope()
+    {
+        if (profile_image >= 0) {
+            profile_records[profile_image].end = profile_seconds() - profile_epoch;
+        }
+
+        profile_image = previous;
+    }
+};
+
+internal int profile_current_image()
+{
+    return(profile_image);
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(zone) Profile_Scope PROFILE_CONCAT(profile_zone_, __LINE__)(zone)
+#define PROFILE_IMAGE(name_or_record) Profile_Image_Scope PROFILE_CONCAT(profile_image_, __LINE__)(name_or_record)
+
+#define STBI_ZONE_BEGIN(zone) double stbi__zone_##zone = profile_begin()
+#define STBI_ZONE_END(zone) profile_end(PROFILE_##zone, stbi__zone_##zone)
+
+// Only call these once every thread that could still record is done.
+internal bool profile_write_csv(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return(false);
+    }
+
+    fprintf(file, "image,thread,start_ms,wall_ms");
+    for (int zone = 0; zone < PROFILE_ZONE_COUNT; ++zone) {
+        fprintf(file, ",%s_ms,%s_calls", PROFILE_ZONE_NAMES[zone], PROFILE_ZONE_NAMES[zone]);
+    }
+    fprintf(file, "\n");
+
+    int count = profile_record_count.load();
+    count = (count < PROFILE_MAX_RECORDS ? count : PROFILE_MAX_RECORDS);
+    for (int i = 0; i < count; ++i) {
+        const Profile_Record *record = &profile_records[i];
+
+        // Quoted the CSV way, quotes inside the name are doubled.
+        fputc('"', file);
+        for (const char *c = (record->name ? record->name : ""); *c; ++c) {
+            if (*c == '"') {
+                fputc('"', file);
+            }
+            fputc(*c, file);
+        }
+        fputc('"', file);
+
+        fprintf(file, ",%d,%.3f,%.3f", record->thread, record->start * 1000.0, (record->end - record->start) * 1000.0);
+        for (int zone = 0; zone < PROFILE_ZONE_COUNT; ++zone) {
+            fprintf(file, ",%.3f,%d", record->seconds[zone] * 1000.0, record->calls[zone]);
+        }
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return(true);
+}
+
+// Complete ("X") events in microseconds, one track per thread.
+internal bool profile_write_trace(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return(false);
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    int count = profile_event_count.load();
+    count = (count < PROFILE_MAX_EVENTS ? count : PROFILE_MAX_EVENTS);
+    for (int i = 0; i < count; ++i) {
+        const Profile_Event *event = &profile_events[i];
+
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"load\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                PROFILE_ZONE_NAMES[event->zone], event->thread, event->start * 1e6, event->duration * 1e6);
+
+        if (event->record >= 0 && profile_records[event->record].name) {
+            fprintf(file, ",\"args\":{\"image\":");
+            profile_write_json_string(file, profile_records[event->record].name);
+            fprintf(file, "}");
+        }
+
+        fprintf(file, "}%s\n", (i + 1 < count ? "," : ""));
+    }
+
+    fprintf(file, "]}\n");
+    fclose(file);
+
+    if (profile_event_count > PROFILE_MAX_EVENTS) {
+        fprintf(stderr, "[WARNING]: %d profile events didn't fit and were dropped\n", profile_event_count.load() - PROFILE_MAX_EVENTS);
+    }
+
+    return(true);
+}
+
+#else
+
+#define PROFILE_ZONE(zone)
+#define PROFILE_IMAGE(name_or_record)
+
+internal bool profile_start() { return(false); }
+internal int profile_current_image() { return(-1); }
+internal bool profile_write_csv(const char *) { return(false); }
+internal bool profile_write_trace(const char *) { return(false); }
+
+#endif
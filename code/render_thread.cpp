@@ -0,0 +1,149 @@
+// Rendering on its own thread, so a slow frame or a big upload never holds up input.
+//
+// The render thread owns the GL context from startup to shutdown: it picks up finished loads, uploads,
+// draws and presents. The main thread only pumps GLFW's events, its callbacks change a View_State of their
+// own and publish a copy of it through a View_Buffer, a lock-free triple buffer the render thread takes
+// the newest copy out of before every frame. Neither thread ever waits for the other there, the only lock
+// is the one the render thread sleeps on while there's nothing to draw.
+//
+// NOTE(Aiden): Anything the callbacks need besides the view has to stay fixed while the render thread
+// runs (like 'Renderer::grid' itself), or be recomputed from the view on both sides (like the number of
+// thumbnail columns, which only depends on the window's width).
+
+#define VIEW_BUFFER_FRESH 4 // Set in 'middle' while it holds a state the reader hasn't taken yet.
+
+// Everything input decides about the next frame.
+struct View_State
+{
+    Camera camera; // Where the drawn camera is headed, see camera_motion.cpp.
+    bool dragging;
+    unsigned int cuts; // Bumped by changes the camera should jump to instead of animating, like resizes.
+
+    int width; // Framebuffer size.
+    int height;
+    bool overlay; // F3.
+
+    // glfwGetTime() of the oldest input in this state that isn't on screen yet, for the input-to-present
+    // latency in frame_stats.cpp.
+    double input_time;
+};
+
+// NOTE(Aiden): The writer always has a slot of its own to fill and the reader one to read from, the third
+// one changes hands through 'middle' with a single atomic exchange each way. A writer publishing faster than
+// the reader reads just keeps replacing the middle slot, the reader only ever sees the newest state.
+struct View_Buffer
+{
+    View_State slots[3];
+    std::atomic<unsigned int> middle;
+    unsigned int back;  // Only touched by the writer.
+    unsigned int front; // Only touched by the reader.
+};
+
+struct Render_Thread
+{
+    std::thread thread;
+    std::atomic<bool> running;
+
+    // What the render thread sleeps on when there's nothing to draw.
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool woken;
+    bool quit;
+
+    // Kept up to date by the main thread's window callbacks, GLFW only answers these on the main thread.
+    std::atomic<bool> redraw;
+    std::atomic<bool> focused;
+    std::atomic<bool> iconified;
+};
+
+global Render_Thread render_thread;
+
+internal void view_buffer_init(View_Buffer *buffer, const View_State *state)
+{
+    for (int i = 0; i < 3; ++i) {
+        buffer->slots[i] = *state;
+    }
+
+    buffer->back = 0;
+    buffer->middle.store(1);
+    buffer->front = 2;
+}
+
+// Writer only.
+internal void view_buffer_publish(View_Buffer *buffer, const View_State *state)
+{
+    buffer->slots[buffer->back] = *state;
+
+    unsigned int previous = buffer->middle.exchange(buffer->back | VIEW_BUFFER_FRESH, std::memory_order_acq_rel);
+    buffer->back = (previous & ~VIEW_BUFFER_FRESH);
+}
+
+// Writer only, whether the last state published is still waiting for the reader.
+internal bool view_buffer_unread(View_Buffer *buffer)
+{
+    return((buffer->middle.load(std::memory_order_acquire) & VIEW_BUFFER_FRESH) != 0);
+}
+
+// Reader only. Copies the newest state into 'state', false (leaving it alone) when nothing was published
+// since the last time.
+internal bool view_buffer_take(View_Buffer *buffer, View_State *state)
+{
+    if (!(buffer->middle.load(std::memory_order_relaxed) & VIEW_BUFFER_FRESH)) {
+        return(false);
+    }
+
+    unsigned int previous = buffer->middle.exchange(buffer->front, std::memory_order_acq_rel);
+    buffer->front = (previous & ~VIEW_BUFFER_FRESH);
+
+    *state = buffer->slots[buffer->front];
+    return(true);
+}
+
+// Safe from any thread. 'redraw' is for when the window needs painting even though nothing else changed.
+// Without a render thread (--no-render-thread) the main loop draws, which sleeps in glfwWaitEvents() instead.
+internal void render_thread_wake(bool redraw)
+{
+    if (redraw) {
+        render_thread.redraw.store(true);
+    }
+
+    if (!render_thread.running.load()) {
+        glfwPostEmptyEvent();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(render_thread.mutex);
+        render_thread.woken = true;
+    }
+
+    render_thread.wake.notify_one();
+}
+
+// Sleeps until render_thread_wake() or 'seconds' (negative is no limit), false once the thread should exit.
+internal bool render_thread_wait(double seconds)
+{
+    std::unique_lock<std::mutex> lock(render_thread.mutex);
+    auto woken = []() { return(render_thread.woken || render_thread.quit); };
+
+    if (seconds < 0.0) {
+        render_thread.wake.wait(lock, woken);
+    } else {
+        render_thread.wake.wait_for(lock, std::chrono::duration<double> (seconds), woken);
+    }
+
+    render_thread.woken = false;
+    return(!render_thread.quit);
+}
+
+internal void render_thread_stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(render_thread.mutex);
+        render_thread.quit = true;
+    }
+
+    render_thread.wake.notify_one();
+    render_thread.thread.join();
+    render_thread.running.store(false);
+}
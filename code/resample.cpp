@@ -0,0 +1,699 @@
+// Separable resampler for any scale factor: thumbnails, the previews in the thumbnail grid and the filtered
+// (not box) mip levels all go through it.
+//
+// For each axis a table of weights is built once per call, per output pixel the first source pixel and a
+// fixed number of taps (zero padded, edges already clamped into the window, so the inner loops never check
+// anything). Source rows are converted to float RGBA (linear light or plain, alpha is always plain, premultiplied
+// colour is linearised straight and premultiplied again), filtered horizontally, then every output row is the
+// weighted sum of the filtered rows under it. A pixel is one SSE2 register in both passes. Bands of output rows
+// are spread over the job system, each band filters the source rows it needs itself, which repeats the few rows
+// where bands overlap but needs no synchronisation.
+//
+// NOTE(Aiden): 1 to 3 channel images are filtered as RGBA as well, same as mipmaps.cpp, one code path beats
+// the three quarters of the arithmetic wasted on grey images.
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RESAMPLE_SSE2
+#endif
+
+#define RESAMPLE_BAND_ROWS 32
+#define RESAMPLE_KAISER_ALPHA 4.0
+#define RESAMPLE_TABLE_SIZE 65536 // Linear light values are looked up at 16 bits.
+
+enum Resample_Filter
+{
+    RESAMPLE_BOX,      // Area average.
+    RESAMPLE_MITCHELL, // Mitchell-Netravali, B = C = 1/3. Soft, hardly rings.
+    RESAMPLE_LANCZOS3,
+    RESAMPLE_KAISER,   // Sinc with a Kaiser window, 3 lobes like Lanczos-3.
+};
+
+enum Resample_Depth
+{
+    RESAMPLE_8_BIT,
+    RESAMPLE_16_BIT,
+};
+
+struct Resample_Options
+{
+    Resample_Filter filter;
+    bool linear_light;
+    bool premultiplied; // Colour (in and out) is premultiplied by alpha, see resample_load_row().
+};
+
+// 'stride' is in bytes, 0 means rows are packed.
+struct Resample_Image
+{
+    void *pixels;
+    int width;
+    int height;
+    size_t stride;
+};
+
+struct Resample_Axis
+{
+    int taps;
+    int *first;
+    float *weights; // 'taps' per output pixel.
+};
+
+// [0] converts plain values, [1] sRGB to linear light.
+struct Resample_Tables
+{
+    float from_8_bit[2][256];
+    float from_16_bit[2][RESAMPLE_TABLE_SIZE];
+    unsigned char linear_to_srgb8[RESAMPLE_TABLE_SIZE];
+    float linear_to_srgb16[RESAMPLE_TABLE_SIZE]; // Not rounded, it's interpolated.
+};
+
+internal double srgb_to_linear(double value)
+{
+    return(value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4));
+}
+
+internal double linear_to_srgb(double value)
+{
+    return(value <= 0.0031308 ? value * 12.92 : 1.055 * pow(value, 1.0 / 2.4) - 0.055);
+}
+
+internal double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+
+    return(sum);
+}
+
+internal double sinc(double x)
+{
+    const double pi = 3.14159265358979323846;
+    return(x == 0.0 ? 1.0 : sin(pi * x) / (pi * x));
+}
+
+// Premultiplied colour back to straight (rounded, 0 where alpha is) and the other way around, 'max' is the
+// largest value of the depth. Straight colour times alpha can't come out above alpha.
+internal inline unsigned int resample_unpremultiply(unsigned int value, unsigned int alpha, unsigned int max)
+{
+    if (alpha == 0) {
+        return(0);
+    }
+
+    unsigned int straight = (value * max + alpha / 2) / alpha;
+    return(straight < max ? straight : max);
+}
+
+internal inline unsigned int resample_premultiply(unsigned int value, unsigned int alpha, unsigned int max)
+{
+    return((value * alpha + max / 2) / max);
+}
+
+internal Resample_Tables *resample_build_tables()
+{
+    Resample_Tables *tables = static_cast<Resample_Tables *> (malloc(sizeof(Resample_Tables)));
+    if (tables == NULL) {
+        return(NULL);
+    }
+
+    for (int i = 0; i < 256; ++i) {
+        tables->from_8_bit[0][i] = static_cast<float> (i / 255.0);
+        tables->from_8_bit[1][i] = static_cast<float> (srgb_to_linear(i / 255.0));
+    }
+
+    for (int i = 0; i < RESAMPLE_TABLE_SIZE; ++i) {
+        double value = i / 65535.0;
+        double srgb = linear_to_srgb(value);
+
+        tables->from_16_bit[0][i] = static_cast<float> (value);
+        tables->from_16_bit[1][i] = static_cast<float> (srgb_to_linear(value));
+        tables->linear_to_srgb8[i] = static_cast<unsigned char> (srgb * 255.0 + 0.5);
+        tables->linear_to_srgb16[i] = static_cast<float> (srgb * 65535.0);
+    }
+
+    return(tables);
+}
+
+internal const Resample_Tables *resample_tables()
+{
+    // NOTE(Aiden): Function statics are initialised exactly once even with several threads asking at the same time.
+    static const Resample_Tables *tables = resample_build_tables();
+    return(tables);
+}
+
+// How far from the centre the filter reaches, in output pixels.
+internal double resample_support(Resample_Filter filter)
+{
+    switch (filter) {
+        case RESAMPLE_BOX:      return(0.5);
+        case RESAMPLE_MITCHELL: return(2.0);
+        default:                return(3.0);
+    }
+}
+
+internal double resample_kernel(Resample_Filter filter, double x)
+{
+    x = fabs(x);
+
+    switch (filter) {
+        case RESAMPLE_BOX: {
+            return(x <= 0.5 ? 1.0 : 0.0);
+        }
+
+        case RESAMPLE_MITCHELL: {
+            const double b = 1.0 / 3.0, c = 1.0 / 3.0;
+            if (x < 1.0) {
+                return(((12.0 - 9.0*b - 6.0*c) * x*x*x + (-18.0 + 12.0*b + 6.0*c) * x*x + (6.0 - 2.0*b)) / 6.0);
+            }
+            if (x < 2.0) {
+                return(((-b - 6.0*c) * x*x*x + (6.0*b + 30.0*c) * x*x + (-12.0*b - 48.0*c) * x + (8.0*b + 24.0*c)) / 6.0);
+            }
+            return(0.0);
+        }
+
+        case RESAMPLE_LANCZOS3: {
+            return(x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0);
+        }
+
+        case RESAMPLE_KAISER: {
+            double r = x / 3.0;
+            return(r < 1.0 ? sinc(x) * bessel_i0(RESAMPLE_KAISER_ALPHA * sqrt(1.0 - r*r)) / bessel_i0(RESAMPLE_KAISER_ALPHA) : 0.0);
+        }
+    }
+
+    return(0.0);
+}
+
+// Safe to call again on an axis that's already been freed.
+internal void resample_free_axis(Resample_Axis *axis)
+{
+    free(axis->first);
+    free(axis->weights);
+    axis->first = NULL;
+    axis->weights = NULL;
+}
+
+// The windows are sized for the filter's whole support, which leaves zeros at either end (half the taps of a
+// box filter halving the size). Cuts them down to the widest run of weights anybody really uses.
+internal bool resample_trim_axis(Resample_Axis *axis, int src_size, int dst_size)
+{
+    int taps = 1;
+    for (int i = 0; i < dst_size; ++i) {
+        const float *weights = axis->weights + static_cast<size_t> (i) * axis->taps;
+        int first = 0, last = axis->taps - 1;
+
+        while (first < last && weights[first] == 0.0f) {
+            ++first;
+        }
+        while (last > first && weights[last] == 0.0f) {
+            --last;
+        }
+
+        taps = (last - first + 1 > taps ? last - first + 1 : taps);
+    }
+
+    if (taps == axis->taps) {
+        return(true);
+    }
+
+    float *trimmed = static_cast<float *> (calloc(static_cast<size_t> (dst_size) * taps, sizeof(float)));
+    if (trimmed == NULL) {
+        resample_free_axis(axis);
+        return(false);
+    }
+
+    for (int i = 0; i < dst_size; ++i) {
+        const float *weights = axis->weights + static_cast<size_t> (i) * axis->taps;
+        int skip = 0;
+        while (skip < axis->taps - 1 && weights[skip] == 0.0f) {
+            ++skip;
+        }
+
+        // Still has to stay inside the row.
+        int first = MIN(axis->first[i] + skip, src_size - taps);
+        for (int k = 0; k < axis->taps; ++k) {
+            if (weights[k] != 0.0f) {
+                trimmed[static_cast<size_t> (i) * taps + (axis->first[i] + k - first)] = weights[k];
+            }
+        }
+
+        axis->first[i] = first;
+    }
+
+    free(axis->weights);
+    axis->weights = trimmed;
+    axis->taps = taps;
+
+    return(true);
+}
+
+// Weights for mapping 'src_size' pixels onto 'dst_size'. When shrinking the filter is stretched by the scale
+// factor so it covers every source pixel that ends up in the output pixel.
+internal bool resample_build_axis(Resample_Filter filter, int src_size, int dst_size, Resample_Axis *axis)
+{
+    double scale = static_cast<double> (src_size) / dst_size;
+    double filter_scale = (scale > 1.0 ? scale : 1.0);
+    double support = resample_support(filter) * filter_scale;
+
+    int taps = static_cast<int> (ceil(support)) * 2 + 2;
+    axis->taps = MIN(taps, src_size);
+    axis->first = static_cast<int *> (malloc(sizeof(int) * dst_size));
+    axis->weights = static_cast<float *> (calloc(static_cast<size_t> (dst_size) * axis->taps, sizeof(float)));
+
+    if (axis->first == NULL || axis->weights == NULL) {
+        resample_free_axis(axis);
+        return(false);
+    }
+
+    for (int i = 0; i < dst_size; ++i) {
+        double center = (i + 0.5) * scale;
+        int lo = static_cast<int> (floor(center - support - 0.5));
+        int hi = static_cast<int> (ceil(center + support + 0.5));
+
+        // The window starts at the first pixel the filter touches but has to stay inside the row.
+        int first = (lo < 0 ? 0 : lo);
+        first = MIN(first, src_size - axis->taps);
+        axis->first[i] = first;
+
+        float *weights = axis->weights + static_cast<size_t> (i) * axis->taps;
+        double total = 0.0;
+
+        for (int j = lo; j <= hi; ++j) {
+            double weight;
+            if (filter == RESAMPLE_BOX) {
+                // How much of the pixel the stretched box covers.
+                double left = center - 0.5 * filter_scale;
+                double right = center + 0.5 * filter_scale;
+                left = (left > j ? left : j);
+                right = (right < j + 1 ? right : j + 1);
+                weight = (right > left ? right - left : 0.0);
+            } else {
+                weight = resample_kernel(filter, (j + 0.5 - center) / filter_scale);
+            }
+
+            if (weight == 0.0) {
+                continue;
+            }
+
+            // Pixels past the edges repeat the edge pixel.
+            int clamped = (j < 0 ? 0 : (j >= src_size ? src_size - 1 : j));
+            weights[clamped - first] += static_cast<float> (weight);
+            total += weight;
+        }
+
+        for (int k = 0; k < axis->taps && total != 0.0; ++k) {
+            weights[k] = static_cast<float> (weights[k] / total);
+        }
+    }
+
+    return(resample_trim_axis(axis, src_size, dst_size));
+}
+
+// Expands a row of 1 to 4 channel pixels to float RGBA through the tables for 'colour' and 'alpha'.
+internal void resample_load_row_8(const unsigned char *src, int width, int channels, const float *colour, const float *alpha, float *dst)
+{
+    for (int x = 0; x < width; ++x, src += channels, dst += 4) {
+        switch (channels) {
+            case 1: {
+                dst[0] = dst[1] = dst[2] = colour[src[0]];
+                dst[3] = 1.0f;
+            } break;
+
+            case 2: {
+                dst[0] = dst[1] = dst[2] = colour[src[0]];
+                dst[3] = alpha[src[1]];
+            } break;
+
+            case 3: {
+                dst[0] = colour[src[0]];
+                dst[1] = colour[src[1]];
+                dst[2] = colour[src[2]];
+                dst[3] = 1.0f;
+            } break;
+
+            default: {
+                dst[0] = colour[src[0]];
+                dst[1] = colour[src[1]];
+                dst[2] = colour[src[2]];
+                dst[3] = alpha[src[3]];
+            } break;
+        }
+    }
+}
+
+// Premultiplied 2 or 4 channel pixels into linear light: the colour is made straight before it goes through
+// the sRGB table and multiplied by alpha again after, in linear light.
+internal void resample_load_row_8_premultiplied(const unsigned char *src, int width, int channels, const float *colour, const float *alpha, float *dst)
+{
+    for (int x = 0; x < width; ++x, src += channels, dst += 4) {
+        unsigned int a = src[channels - 1];
+        dst[3] = alpha[a];
+
+        if (channels == 2) {
+            dst[0] = dst[1] = dst[2] = colour[resample_unpremultiply(src[0], a, 255)] * dst[3];
+        } else {
+            dst[0] = colour[resample_unpremultiply(src[0], a, 255)] * dst[3];
+            dst[1] = colour[resample_unpremultiply(src[1], a, 255)] * dst[3];
+            dst[2] = colour[resample_unpremultiply(src[2], a, 255)] * dst[3];
+        }
+    }
+}
+
+internal void resample_load_row_16(const unsigned short *src, int width, int channels, const float *colour, const float *alpha, float *dst)
+{
+    for (int x = 0; x < width; ++x, src += channels, dst += 4) {
+        switch (channels) {
+            case 1: {
+                dst[0] = dst[1] = dst[2] = colour[src[0]];
+                dst[3] = 1.0f;
+            } break;
+
+            case 2: {
+                dst[0] = dst[1] = dst[2] = colour[src[0]];
+                dst[3] = alpha[src[1]];
+            } break;
+
+            case 3: {
+                dst[0] = colour[src[0]];
+                dst[1] = colour[src[1]];
+                dst[2] = colour[src[2]];
+                dst[3] = 1.0f;
+            } break;
+
+            default: {
+                dst[0] = colour[src[0]];
+                dst[1] = colour[src[1]];
+                dst[2] = colour[src[2]];
+                dst[3] = alpha[src[3]];
+            } break;
+        }
+    }
+}
+
+internal void resample_load_row_16_premultiplied(const unsigned short *src, int width, int channels, const float *colour, const float *alpha, float *dst)
+{
+    for (int x = 0; x < width; ++x, src += channels, dst += 4) {
+        unsigned int a = src[channels - 1];
+        dst[3] = alpha[a];
+
+        if (channels == 2) {
+            dst[0] = dst[1] = dst[2] = colour[resample_unpremultiply(src[0], a, 65535)] * dst[3];
+        } else {
+            dst[0] = colour[resample_unpremultiply(src[0], a, 65535)] * dst[3];
+            dst[1] = colour[resample_unpremultiply(src[1], a, 65535)] * dst[3];
+            dst[2] = colour[resample_unpremultiply(src[2], a, 65535)] * dst[3];
+        }
+    }
+}
+
+// NOTE(Aiden): Premultiplied colour only needs its own path in linear light. Plain premultiplied values are
+// filtered like any others, but the sRGB curve of a premultiplied value isn't the premultiplied linear value,
+// converted directly the colour of a translucent pixel could come out above its alpha. 'premultiplied' is
+// only set for 2 and 4 channels.
+internal void resample_load_row(const void *row, int width, int channels, Resample_Depth depth, bool linear_light,
+                                bool premultiplied, const Resample_Tables *tables, float *dst)
+{
+    int mode = (linear_light ? 1 : 0);
+
+    if (depth == RESAMPLE_8_BIT) {
+        const unsigned char *src = static_cast<const unsigned char *> (row);
+        if (premultiplied) {
+            resample_load_row_8_premultiplied(src, width, channels, tables->from_8_bit[1], tables->from_8_bit[0], dst);
+        } else {
+            resample_load_row_8(src, width, channels, tables->from_8_bit[mode], tables->from_8_bit[0], dst);
+        }
+    } else {
+        const unsigned short *src = static_cast<const unsigned short *> (row);
+        if (premultiplied) {
+            resample_load_row_16_premultiplied(src, width, channels, tables->from_16_bit[1], tables->from_16_bit[0], dst);
+        } else {
+            resample_load_row_16(src, width, channels, tables->from_16_bit[mode], tables->from_16_bit[0], dst);
+        }
+    }
+}
+
+// 'scaled' is already clamped to [0, 1] and multiplied by 65535 for linear light colour, by the output's
+// maximum for anything else.
+internal inline unsigned int resample_encode(float scaled, Resample_Depth depth, bool linear, const Resample_Tables *tables)
+{
+    if (!linear) {
+        return(static_cast<unsigned int> (scaled + 0.5f));
+    }
+
+    if (depth == RESAMPLE_8_BIT) {
+        return(tables->linear_to_srgb8[static_cast<int> (scaled + 0.5f)]);
+    }
+
+    // NOTE(Aiden): sRGB is so steep near black that 16 bits of linear light would be off by several steps of
+    // 16-bit sRGB there, so it's interpolated between the table's entries.
+    int index = static_cast<int> (scaled);
+    if (index >= RESAMPLE_TABLE_SIZE - 1) {
+        return(65535);
+    }
+
+    const float *table = tables->linear_to_srgb16;
+    float value = table[index] + (table[index + 1] - table[index]) * (scaled - static_cast<float> (index));
+    return(static_cast<unsigned int> (value + 0.5f));
+}
+
+// 'premultiplied' as in resample_load_row(): the colour is divided by alpha before it's encoded and the
+// encoded colour multiplied by the encoded alpha.
+internal void resample_store_row(const float *src, int width, int channels, Resample_Depth depth, bool linear_light,
+                                 bool premultiplied, const Resample_Tables *tables, void *row)
+{
+    // Which of the RGBA values each channel comes from.
+    int layout[4] = { 0, 1, 2, 3 };
+    layout[1] = (channels == 2 ? 3 : 1);
+    bool has_alpha = (channels == 2 || channels == 4);
+
+    float range = (depth == RESAMPLE_8_BIT ? 255.0f : 65535.0f);
+    float colour_range = (linear_light ? 65535.0f : range);
+    float alpha_range = (has_alpha ? range : colour_range);
+
+    unsigned char *bytes = static_cast<unsigned char *> (row);
+    unsigned short *shorts = static_cast<unsigned short *> (row);
+
+    for (int x = 0; x < width; ++x, src += 4) {
+        // The negative lobes can over and undershoot.
+        float scaled[4];
+#ifdef RESAMPLE_SSE2
+        __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        _mm_storeu_ps(scaled, _mm_mul_ps(value, _mm_setr_ps(colour_range, colour_range, colour_range, alpha_range)));
+#else
+        for (int c = 0; c < 4; ++c) {
+            float value = (src[c] < 0.0f ? 0.0f : (src[c] > 1.0f ? 1.0f : src[c]));
+            scaled[c] = value * (c == 3 ? alpha_range : colour_range);
+        }
+#endif
+
+        unsigned int encoded_alpha = 0;
+        if (premultiplied) {
+            // Filtered colour can end up above alpha (or alpha at 0 with colour left) where lobes overshoot.
+            float coverage = scaled[3] / alpha_range;
+            for (int c = 0; c < 3; ++c) {
+                float colour = scaled[c] / colour_range;
+                scaled[c] = (coverage > 0.0f ? MIN(colour, coverage) / coverage * colour_range : 0.0f);
+            }
+
+            encoded_alpha = resample_encode(scaled[3], depth, false, tables);
+        }
+
+        for (int c = 0; c < channels; ++c) {
+            bool linear = (linear_light && !(has_alpha && c == channels - 1));
+            unsigned int encoded = resample_encode(scaled[layout[c]], depth, linear, tables);
+
+            if (premultiplied && c < channels - 1) {
+                encoded = resample_premultiply(encoded, encoded_alpha, static_cast<unsigned int> (range));
+            }
+
+            if (depth == RESAMPLE_8_BIT) {
+                bytes[x * channels + c] = static_cast<unsigned char> (encoded);
+            } else {
+                shorts[x * channels + c] = static_cast<unsigned short> (encoded);
+            }
+        }
+    }
+}
+
+internal void resample_horizontal(const float *src, const Resample_Axis *axis, int dst_width, float *dst)
+{
+    int taps = axis->taps;
+
+    for (int x = 0; x < dst_width; ++x, dst += 4) {
+        const float *pixels = src + axis->first[x] * 4;
+        const float *weights = axis->weights + static_cast<size_t> (x) * taps;
+
+#ifdef RESAMPLE_SSE2
+        // NOTE(Aiden): Two sums so every add doesn't have to wait for the one before it.
+        __m128 even = _mm_setzero_ps();
+        __m128 odd = _mm_setzero_ps();
+        int k = 0;
+
+        for (; k + 2 <= taps; k += 2) {
+            even = _mm_add_ps(even, _mm_mul_ps(_mm_loadu_ps(pixels + k*4), _mm_set1_ps(weights[k])));
+            odd = _mm_add_ps(odd, _mm_mul_ps(_mm_loadu_ps(pixels + k*4 + 4), _mm_set1_ps(weights[k + 1])));
+        }
+
+        if (k < taps) {
+            even = _mm_add_ps(even, _mm_mul_ps(_mm_loadu_ps(pixels + k*4), _mm_set1_ps(weights[k])));
+        }
+
+        _mm_storeu_ps(dst, _mm_add_ps(even, odd));
+#else
+        float sum[4] = {0};
+        for (int k = 0; k < taps; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                sum[c] += weights[k] * pixels[k*4 + c];
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            dst[c] = sum[c];
+        }
+#endif
+    }
+}
+
+// 'rows' are the horizontally filtered rows from the output row's first tap on.
+internal void resample_vertical(const float *rows, size_t row_floats, const float *weights, int taps, float *dst)
+{
+#ifdef RESAMPLE_SSE2
+    size_t i = 0;
+
+    // Four pixels at a time, each one a sum of its own.
+    for (; i + 16 <= row_floats; i += 16) {
+        const float *pixel = rows + i;
+        __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps(), sum2 = _mm_setzero_ps(), sum3 = _mm_setzero_ps();
+
+        for (int k = 0; k < taps; ++k, pixel += row_floats) {
+            __m128 weight = _mm_set1_ps(weights[k]);
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(pixel), weight));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(pixel + 4), weight));
+            sum2 = _mm_add_ps(sum2, _mm_mul_ps(_mm_loadu_ps(pixel + 8), weight));
+            sum3 = _mm_add_ps(sum3, _mm_mul_ps(_mm_loadu_ps(pixel + 12), weight));
+        }
+
+        _mm_storeu_ps(dst + i, sum0);
+        _mm_storeu_ps(dst + i + 4, sum1);
+        _mm_storeu_ps(dst + i + 8, sum2);
+        _mm_storeu_ps(dst + i + 12, sum3);
+    }
+
+    for (; i < row_floats; i += 4) {
+        const float *pixel = rows + i;
+        __m128 sum = _mm_setzero_ps();
+
+        for (int k = 0; k < taps; ++k, pixel += row_floats) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pixel), _mm_set1_ps(weights[k])));
+        }
+
+        _mm_storeu_ps(dst + i, sum);
+    }
+#else
+    for (size_t i = 0; i < row_floats; ++i) {
+        dst[i] = 0.0f;
+    }
+
+    for (int k = 0; k < taps; ++k, rows += row_floats) {
+        for (size_t i = 0; i < row_floats; ++i) {
+            dst[i] += weights[k] * rows[i];
+        }
+    }
+#endif
+}
+
+// Resamples a 1 to 4 channel image to 'dst's size (which can be anything, bigger too) on up to 'thread_count'
+// threads, 0 means every job worker plus the calling thread.
+internal bool resample(const Resample_Image *src, Resample_Image *dst, int channels, Resample_Depth depth,
+                       const Resample_Options *options, int thread_count)
+{
+    PROFILE_ZONE(PROFILE_RESAMPLE);
+
+    const Resample_Tables *tables = resample_tables();
+    if (tables == NULL) {
+        return(false);
+    }
+
+    int bytes = channels * (depth == RESAMPLE_8_BIT ? 1 : 2);
+    size_t src_stride = (src->stride ? src->stride : static_cast<size_t> (src->width) * bytes);
+    size_t dst_stride = (dst->stride ? dst->stride : static_cast<size_t> (dst->width) * bytes);
+
+    Resample_Axis horizontal = {}, vertical = {};
+    if (!resample_build_axis(options->filter, src->width, dst->width, &horizontal) ||
+        !resample_build_axis(options->filter, src->height, dst->height, &vertical)) {
+        resample_free_axis(&horizontal);
+        return(false);
+    }
+
+    // Every band keeps the horizontally filtered source rows it touches ('first' only ever grows from one
+    // output pixel to the next), room for as many as the biggest band needs.
+    int bands = (dst->height + RESAMPLE_BAND_ROWS - 1) / RESAMPLE_BAND_ROWS;
+    int band_span = 0;
+    for (int band = 0; band < bands; ++band) {
+        int y0 = band * RESAMPLE_BAND_ROWS;
+        int y1 = MIN(y0 + RESAMPLE_BAND_ROWS, dst->height);
+        int span = vertical.first[y1 - 1] + vertical.taps - vertical.first[y0];
+        band_span = (span > band_span ? span : band_span);
+    }
+
+    size_t src_row = static_cast<size_t> (src->width) * 4;
+    size_t dst_row = static_cast<size_t> (dst->width) * 4;
+    bool premultiplied = (options->premultiplied && options->linear_light && (channels == 2 || channels == 4));
+
+    std::atomic<int> next_band(0);
+    std::atomic<bool> failed(false);
+
+    auto worker = [&]() {
+        float *loaded = static_cast<float *> (malloc(sizeof(float) * (src_row + dst_row * (band_span + 1))));
+        if (loaded == NULL) {
+            failed = true;
+            return;
+        }
+
+        float *filtered = loaded + src_row;
+        float *out = filtered + dst_row * band_span;
+
+        for (int band = next_band++; band < bands; band = next_band++) {
+            int y0 = band * RESAMPLE_BAND_ROWS;
+            int y1 = MIN(y0 + RESAMPLE_BAND_ROWS, dst->height);
+            int first = vertical.first[y0];
+            int last = vertical.first[y1 - 1] + vertical.taps;
+
+            for (int sy = first; sy < last; ++sy) {
+                const unsigned char *row = static_cast<const unsigned char *> (src->pixels) + sy * src_stride;
+                resample_load_row(row, src->width, channels, depth, options->linear_light, premultiplied, tables, loaded);
+                resample_horizontal(loaded, &horizontal, dst->width, filtered + (sy - first) * dst_row);
+            }
+
+            for (int y = y0; y < y1; ++y) {
+                const float *rows = filtered + (vertical.first[y] - first) * dst_row;
+                resample_vertical(rows, dst_row, vertical.weights + static_cast<size_t> (y) * vertical.taps, vertical.taps, out);
+
+                unsigned char *row = static_cast<unsigned char *> (dst->pixels) + y * dst_stride;
+                resample_store_row(out, dst->width, channels, depth, options->linear_light, premultiplied, tables, row);
+            }
+        }
+
+        free(loaded);
+    };
+
+    int lanes = (thread_count > 0 ? thread_count : (job_system ? job_system->worker_count + 1 : 1));
+    job_run_parallel(MIN(lanes, bands), worker);
+
+    resample_free_axis(&horizontal);
+    resample_free_axis(&vertical);
+
+    return(!failed);
+}
+
+// Shorthand for packed 8-bit images.
+internal bool resample_8(const unsigned char *src, int width, int height, unsigned char *dst, int dst_width, int dst_height,
+                         int channels, const Resample_Options *options, int thread_count)
+{
+    Resample_Image source = { const_cast<unsigned char *> (src), width, height, 0 };
+    Resample_Image destination = { dst, dst_width, dst_height, 0 };
+    return(resample(&source, &destination, channels, RESAMPLE_8_BIT, options, thread_count));
+}
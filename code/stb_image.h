@@ -430,6 +430,16 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
 #endif
 
+#ifndef STBI_NO_PNG
+// paletted (color type 3) PNGs only: returns the raw 8-bit index plane,
+// one byte per pixel, and writes the palette as RGBA into 'palette',
+// which must have room for 256*4 bytes. Any other PNG fails with NULL.
+STBIDEF stbi_uc *stbi_load_png_indexed_from_memory(stbi_uc const *buffer, int len, int *x, int *y, stbi_uc *palette, int *palette_len);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_png_indexed(char const *filename, int *x, int *y, stbi_uc *palette, int *palette_len);
+#endif
+#endif
+
 #ifdef STBI_WINDOWS_UTF8
 STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -514,12 +524,20 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// multiply the color channels by alpha while decoding (8-bit loads only), for
+// images that are going to be filtered or blended. the PNG unfilter and the
+// format conversion do it as they go, other formats get one pass at the end.
+// images without alpha, or loaded without it (req_comp 1 or 3), are left alone;
+// iPhone PNGs are already premultiplied and then never get unpremultiplied.
+STBIDEF void stbi_set_premultiply_on_load(int flag_true_if_should_premultiply);
+
 // as above, but only applies to images loaded on the thread that calls the function
 // this function is only available if your compiler supports thread-local variables;
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply);
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
+STBIDEF void stbi_set_premultiply_on_load_thread(int flag_true_if_should_premultiply);
 
 // ZLIB client - used by PNG, available for other purposes
 
@@ -600,6 +618,15 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #define STBI_ASSERT(x) assert(x)
 #endif
 
+// timing hooks around the decoder's stages (DECODE, PROBE, JPEG_SCAN, JPEG_IDCT, JPEG_RESAMPLE, PNG_READ,
+// PNG_INFLATE, PNG_UNFILTER, CONVERT); define both before the #include to use them. STBI_ZONE_BEGIN
+// may declare a variable, STBI_ZONE_END follows it in the same scope; an error return between the two
+// simply never ends the zone.
+#ifndef STBI_ZONE_BEGIN
+#define STBI_ZONE_BEGIN(name)
+#define STBI_ZONE_END(name)
+#endif
+
 #ifdef __cplusplus
 #define STBI_EXTERN extern "C"
 #else
@@ -900,6 +927,7 @@ typedef struct
    int bits_per_channel;
    int num_channels;
    int channel_order;
+   int premultiplied; // colors already multiplied by alpha, set by loaders that do it themselves
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -1114,45 +1142,120 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__premultiply_on_load_global = 0;
+
+STBIDEF void stbi_set_premultiply_on_load(int flag_true_if_should_premultiply)
+{
+   stbi__premultiply_on_load_global = flag_true_if_should_premultiply;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__premultiply_on_load  stbi__premultiply_on_load_global
+#else
+static STBI_THREAD_LOCAL int stbi__premultiply_on_load_local, stbi__premultiply_on_load_set;
+
+STBIDEF void stbi_set_premultiply_on_load_thread(int flag_true_if_should_premultiply)
+{
+   stbi__premultiply_on_load_local = flag_true_if_should_premultiply;
+   stbi__premultiply_on_load_set = 1;
+}
+
+#define stbi__premultiply_on_load  (stbi__premultiply_on_load_set           \
+                                     ? stbi__premultiply_on_load_local      \
+                                     : stbi__premultiply_on_load_global)
+#endif // STBI_THREAD_LOCAL
+
+// v * a / 255, rounded to nearest; exact for every 8-bit v and a
+static stbi_uc stbi__mul8(int v, int a)
+{
+   int t = v * a + 128;
+   return (stbi_uc) ((t + (t >> 8)) >> 8);
+}
+
+// multiplies the colors of 'n' pixels with 'comp' (2 or 4) channels by their
+// alpha, which is the last channel and stays as it is
+static void stbi__premultiply(stbi_uc *p, stbi__uint32 n, int comp)
+{
+   stbi__uint32 i = 0;
+
+   if (comp == 2) {
+      for (; i < n; ++i, p += 2)
+         p[0] = stbi__mul8(p[0], p[1]);
+      return;
+   }
+
+#ifdef STBI_SSE2
+   {
+      // four pixels at a time: widen to 16 bits, broadcast each pixel's alpha
+      // across its lanes, multiply and divide by 255 the same way stbi__mul8
+      // does, then put the original alpha back
+      __m128i zero  = _mm_setzero_si128();
+      __m128i bias  = _mm_set1_epi16(128);
+      __m128i amask = _mm_set1_epi32((int) 0xff000000u);
+      for (; i + 4 <= n; i += 4, p += 16) {
+         __m128i px = _mm_loadu_si128((__m128i *) p);
+         __m128i lo = _mm_unpacklo_epi8(px, zero);
+         __m128i hi = _mm_unpackhi_epi8(px, zero);
+         __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+         __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+         lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), bias);
+         hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), bias);
+         lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+         hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+         px = _mm_or_si128(_mm_andnot_si128(amask, _mm_packus_epi16(lo, hi)), _mm_and_si128(amask, px));
+         _mm_storeu_si128((__m128i *) p, px);
+      }
+   }
+#endif
+
+   for (; i < n; ++i, p += 4) {
+      p[0] = stbi__mul8(p[0], p[3]);
+      p[1] = stbi__mul8(p[1], p[3]);
+      p[2] = stbi__mul8(p[2], p[3]);
+   }
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
    ri->bits_per_channel = 8; // default is 8 so most paths don't have to be changed
    ri->channel_order = STBI_ORDER_RGB; // all current input & output are this, but this is here so we can add BGR order
    ri->num_channels = 0;
+   STBI_ZONE_BEGIN(PROBE);
 
    // test the formats with a very explicit header first (at least a FOURCC
    // or distinctive magic number first)
    #ifndef STBI_NO_PNG
-   if (stbi__png_test(s))  return stbi__png_load(s,x,y,comp,req_comp, ri);
+   if (stbi__png_test(s)) { STBI_ZONE_END(PROBE); return stbi__png_load(s,x,y,comp,req_comp, ri); }
    #endif
    #ifndef STBI_NO_BMP
-   if (stbi__bmp_test(s))  return stbi__bmp_load(s,x,y,comp,req_comp, ri);
+   if (stbi__bmp_test(s)) { STBI_ZONE_END(PROBE); return stbi__bmp_load(s,x,y,comp,req_comp, ri); }
    #endif
    #ifndef STBI_NO_GIF
-   if (stbi__gif_test(s))  return stbi__gif_load(s,x,y,comp,req_comp, ri);
+   if (stbi__gif_test(s)) { STBI_ZONE_END(PROBE); return stbi__gif_load(s,x,y,comp,req_comp, ri); }
    #endif
    #ifndef STBI_NO_PSD
-   if (stbi__psd_test(s))  return stbi__psd_load(s,x,y,comp,req_comp, ri, bpc);
+   if (stbi__psd_test(s)) { STBI_ZONE_END(PROBE); return stbi__psd_load(s,x,y,comp,req_comp, ri, bpc); }
    #else
    STBI_NOTUSED(bpc);
    #endif
    #ifndef STBI_NO_PIC
-   if (stbi__pic_test(s))  return stbi__pic_load(s,x,y,comp,req_comp, ri);
+   if (stbi__pic_test(s)) { STBI_ZONE_END(PROBE); return stbi__pic_load(s,x,y,comp,req_comp, ri); }
    #endif
 
    // then the formats that can end up attempting to load with just 1 or 2
    // bytes matching expectations; these are prone to false positives, so
    // try them later
    #ifndef STBI_NO_JPEG
-   if (stbi__jpeg_test(s)) return stbi__jpeg_load(s,x,y,comp,req_comp, ri);
+   if (stbi__jpeg_test(s)) { STBI_ZONE_END(PROBE); return stbi__jpeg_load(s,x,y,comp,req_comp, ri); }
    #endif
    #ifndef STBI_NO_PNM
-   if (stbi__pnm_test(s))  return stbi__pnm_load(s,x,y,comp,req_comp, ri);
+   if (stbi__pnm_test(s)) { STBI_ZONE_END(PROBE); return stbi__pnm_load(s,x,y,comp,req_comp, ri); }
    #endif
 
    #ifndef STBI_NO_HDR
    if (stbi__hdr_test(s)) {
+      STBI_ZONE_END(PROBE);
       float *hdr = stbi__hdr_load(s, x,y,comp,req_comp, ri);
       return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
    }
@@ -1160,10 +1263,13 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
 
    #ifndef STBI_NO_TGA
    // test tga last because it's a crappy test!
-   if (stbi__tga_test(s))
+   if (stbi__tga_test(s)) {
+      STBI_ZONE_END(PROBE);
       return stbi__tga_load(s,x,y,comp,req_comp, ri);
+   }
    #endif
 
+   STBI_ZONE_END(PROBE);
    return stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
@@ -1240,7 +1346,9 @@ static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int byt
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
-   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   void *result;
+   STBI_ZONE_BEGIN(DECODE);
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
 
    if (result == NULL)
       return NULL;
@@ -1249,17 +1357,31 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
    STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
 
    if (ri.bits_per_channel != 8) {
+      STBI_ZONE_BEGIN(CONVERT);
       result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp == 0 ? *comp : req_comp);
       ri.bits_per_channel = 8;
+      STBI_ZONE_END(CONVERT);
    }
 
    // @TODO: move stbi__convert_format to here
 
+   // whatever the loader didn't premultiply itself, as long as there's alpha
+   // both in the file and in the result
+   if (stbi__premultiply_on_load && !ri.premultiplied) {
+      int channels = req_comp ? req_comp : *comp;
+      if ((channels == 2 || channels == 4) && (*comp == 2 || *comp == 4)) {
+         STBI_ZONE_BEGIN(CONVERT);
+         stbi__premultiply((stbi_uc *) result, (stbi__uint32) *x * (stbi__uint32) *y, channels);
+         STBI_ZONE_END(CONVERT);
+      }
+   }
+
    if (stbi__vertically_flip_on_load) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
    }
 
+   STBI_ZONE_END(DECODE);
    return (unsigned char *) result;
 }
 
@@ -1732,7 +1854,9 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
-static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+// 'premultiply' also multiplies the colors by alpha, each row right after
+// converting it, when both formats have alpha
+static unsigned char *stbi__convert_format_premultiply(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y, int premultiply)
 {
    int i,j;
    unsigned char *good;
@@ -1770,11 +1894,18 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
          default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
       }
       #undef STBI__CASE
+      if (premultiply && (img_n == 2 || img_n == 4) && (req_comp == 2 || req_comp == 4))
+         stbi__premultiply(good + j * x * req_comp, x, req_comp);
    }
 
    STBI_FREE(data);
    return good;
 }
+
+static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+   return stbi__convert_format_premultiply(data, img_n, req_comp, x, y, 0);
+}
 #endif
 
 #if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
@@ -3365,7 +3496,9 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
+         STBI_ZONE_BEGIN(JPEG_SCAN);
          if (!stbi__parse_entropy_coded_data(j)) return 0;
+         STBI_ZONE_END(JPEG_SCAN);
          if (j->marker == STBI__MARKER_none ) {
             // handle 0s at the end of image data from IP Kamera 9060
             while (!stbi__at_eof(j->s)) {
@@ -3387,8 +3520,11 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
       }
       m = stbi__get_marker(j);
    }
-   if (j->progressive)
+   if (j->progressive) {
+      STBI_ZONE_BEGIN(JPEG_IDCT);
       stbi__jpeg_finish(j);
+      STBI_ZONE_END(JPEG_IDCT);
+   }
    return 1;
 }
 
@@ -3869,6 +4005,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
       // now go ahead and resample
+      STBI_ZONE_BEGIN(JPEG_RESAMPLE);
       for (j=0; j < z->s->img_y; ++j) {
          stbi_uc *out = output + n * z->s->img_x * j;
          for (k=0; k < decode_n; ++k) {
@@ -3963,6 +4100,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
             }
          }
       }
+      STBI_ZONE_END(JPEG_RESAMPLE);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -4554,6 +4692,10 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi_uc *indexed_palette; // if set, keep palette indices and copy the palette here
+   int indexed_palette_len;
+   int premultiply;   // have stbi__create_png_image_raw premultiply the rows it unfilters
+   int premultiplied; // the decoded image already is
 } stbi__png;
 
 
@@ -4713,8 +4855,16 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
             }
          }
       }
+
+      // the filters only ever look one row back, so the previous row can be
+      // premultiplied now, while it's still in the cache
+      if (a->premultiply && j > 0)
+         stbi__premultiply(a->out + stride*(j-1), x, out_n);
    }
 
+   if (a->premultiply && y > 0)
+      stbi__premultiply(a->out + stride*(y-1), x, out_n);
+
    // we make a separate pass to expand bits to pixels; for performance,
    // this could run two scanlines behind the above code, so it won't
    // intefere with filtering but will still be in the cache.
@@ -4848,25 +4998,33 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
-static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n, int premultiply)
 {
    stbi__context *s = z->s;
    stbi__uint32 i, pixel_count = s->img_x * s->img_y;
    stbi_uc *p = z->out;
 
    // compute color-based transparency, assuming we've
-   // already got 255 as the alpha value in the output
+   // already got 255 as the alpha value in the output;
+   // premultiplied, the transparent pixels also go black
    STBI_ASSERT(out_n == 2 || out_n == 4);
 
    if (out_n == 2) {
       for (i=0; i < pixel_count; ++i) {
-         p[1] = (p[0] == tc[0] ? 0 : 255);
+         if (p[0] == tc[0]) {
+            p[1] = 0;
+            if (premultiply) p[0] = 0;
+         } else {
+            p[1] = 255;
+         }
          p += 2;
       }
    } else {
       for (i=0; i < pixel_count; ++i) {
-         if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
+         if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2]) {
             p[3] = 0;
+            if (premultiply) p[0] = p[1] = p[2] = 0;
+         }
          p += 4;
       }
    }
@@ -4990,7 +5148,8 @@ static void stbi__de_iphone(stbi__png *z)
       }
    } else {
       STBI_ASSERT(s->img_out_n == 4);
-      if (stbi__unpremultiply_on_load) {
+      if (stbi__unpremultiply_on_load && !stbi__premultiply_on_load) {
+         z->premultiplied = 0;
          // convert bgr to rgb and unpremultiply
          for (i=0; i < pixel_count; ++i) {
             stbi_uc a = p[3];
@@ -5032,11 +5191,14 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    z->expanded = NULL;
    z->idata = NULL;
    z->out = NULL;
+   z->premultiply = 0;
+   z->premultiplied = 0;
 
    if (!stbi__check_png_header(s)) return 0;
 
    if (scan == STBI__SCAN_type) return 1;
 
+   STBI_ZONE_BEGIN(PNG_READ);
    for (;;) {
       stbi__pngchunk c = stbi__get_chunk_header(s);
       switch (c.type) {
@@ -5057,6 +5219,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             color = stbi__get8(s);  if (color > 6)         return stbi__err("bad ctype","Corrupt PNG");
             if (color == 3 && z->depth == 16)                  return stbi__err("bad ctype","Corrupt PNG");
             if (color == 3) pal_img_n = 3; else if (color & 1) return stbi__err("bad ctype","Corrupt PNG");
+            if (z->indexed_palette && color != 3) return stbi__err("not paletted","PNG is not paletted");
             comp  = stbi__get8(s);  if (comp) return stbi__err("bad comp method","Corrupt PNG");
             filter= stbi__get8(s);  if (filter) return stbi__err("bad filter method","Corrupt PNG");
             interlace = stbi__get8(s); if (interlace>1) return stbi__err("bad interlace method","Corrupt PNG");
@@ -5134,30 +5297,53 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 
          case STBI__PNG_TYPE('I','E','N','D'): {
             stbi__uint32 raw_len, bpl;
+            int premultiply = (stbi__premultiply_on_load && !is_iphone && (req_comp == 0 || req_comp == 2 || req_comp == 4));
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
+            STBI_ZONE_END(PNG_READ);
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
             raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+            STBI_ZONE_BEGIN(PNG_INFLATE);
             z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
+            STBI_ZONE_END(PNG_INFLATE);
             if (z->expanded == NULL) return 0; // zlib should set error
             STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            // 8-bit gray+alpha and RGBA get premultiplied right in the unfilter pass
+            z->premultiply = (premultiply && z->depth == 8 && s->img_out_n == s->img_n && (s->img_n == 2 || s->img_n == 4));
+            STBI_ZONE_BEGIN(PNG_UNFILTER);
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            STBI_ZONE_END(PNG_UNFILTER);
+            z->premultiplied = z->premultiply;
             if (has_trans) {
                if (z->depth == 16) {
                   if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
                } else {
-                  if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
+                  if (!stbi__compute_transparency(z, tc, s->img_out_n, premultiply)) return 0;
+                  z->premultiplied = premultiply;
                }
             }
+            if (is_iphone)
+               z->premultiplied = 1; // stored that way, unless de-iphoning undoes it
             if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
                stbi__de_iphone(z);
-            if (pal_img_n) {
+            if (pal_img_n == 4 && premultiply) {
+               // premultiplying the palette premultiplies every pixel of the expansion
+               stbi__premultiply(palette, pal_len, 4);
+               z->premultiplied = 1;
+            }
+            if (pal_img_n && z->indexed_palette) {
+               // caller resolves colors itself, hand back indices + palette untouched
+               s->img_n = pal_img_n;
+               s->img_out_n = 1;
+               memcpy(z->indexed_palette, palette, pal_len * 4);
+               z->indexed_palette_len = pal_len;
+            } else if (pal_img_n) {
                // pal_img_n == 3 or 4
                s->img_n = pal_img_n; // record the actual colors we had
                s->img_out_n = pal_img_n;
@@ -5210,16 +5396,21 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
       result = p->out;
       p->out = NULL;
       if (req_comp && req_comp != p->s->img_out_n) {
-         if (ri->bits_per_channel == 8)
-            result = stbi__convert_format((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
-         else
+         STBI_ZONE_BEGIN(CONVERT);
+         if (ri->bits_per_channel == 8) {
+            int premultiply = (stbi__premultiply_on_load && !p->premultiplied);
+            result = stbi__convert_format_premultiply((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y, premultiply);
+            p->premultiplied |= premultiply;
+         } else
             result = stbi__convert_format16((stbi__uint16 *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
+         STBI_ZONE_END(CONVERT);
          p->s->img_out_n = req_comp;
          if (result == NULL) return result;
       }
       *x = p->s->img_x;
       *y = p->s->img_y;
       if (n) *n = p->s->img_n;
+      ri->premultiplied = p->premultiplied;
    }
    STBI_FREE(p->out);      p->out      = NULL;
    STBI_FREE(p->expanded); p->expanded = NULL;
@@ -5232,6 +5423,7 @@ static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req
 {
    stbi__png p;
    p.s = s;
+   p.indexed_palette = NULL;
    return stbi__do_png(&p, x,y,comp,req_comp, ri);
 }
 
@@ -5259,6 +5451,7 @@ static int stbi__png_info(stbi__context *s, int *x, int *y, int *comp)
 {
    stbi__png p;
    p.s = s;
+   p.indexed_palette = NULL;
    return stbi__png_info_raw(&p, x, y, comp);
 }
 
@@ -5266,6 +5459,7 @@ static int stbi__png_is16(stbi__context *s)
 {
    stbi__png p;
    p.s = s;
+   p.indexed_palette = NULL;
    if (!stbi__png_info_raw(&p, NULL, NULL, NULL))
 	   return 0;
    if (p.depth != 16) {
@@ -5274,6 +5468,51 @@ static int stbi__png_is16(stbi__context *s)
    }
    return 1;
 }
+
+static stbi_uc *stbi__png_load_indexed(stbi__context *s, int *x, int *y, stbi_uc *palette, int *palette_len)
+{
+   stbi_uc *result = NULL;
+   stbi__png p;
+   p.s = s;
+   p.indexed_palette = palette;
+   p.indexed_palette_len = 0;
+   if (!stbi__png_test(s)) return stbi__errpuc("not PNG", "Image not of any known type, or corrupt");
+   if (stbi__parse_png_file(&p, STBI__SCAN_load, 0)) {
+      if (stbi__vertically_flip_on_load)
+         stbi__vertical_flip(p.out, p.s->img_x, p.s->img_y, 1);
+      result = p.out;
+      p.out = NULL;
+      *x = p.s->img_x;
+      *y = p.s->img_y;
+      *palette_len = p.indexed_palette_len;
+   }
+   STBI_FREE(p.out);      p.out      = NULL;
+   STBI_FREE(p.expanded); p.expanded = NULL;
+   STBI_FREE(p.idata);    p.idata    = NULL;
+
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_png_indexed_from_memory(stbi_uc const *buffer, int len, int *x, int *y, stbi_uc *palette, int *palette_len)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__png_load_indexed(&s,x,y,palette,palette_len);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_png_indexed(char const *filename, int *x, int *y, stbi_uc *palette, int *palette_len)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi_uc *result;
+   stbi__context s;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__png_load_indexed(&s,x,y,palette,palette_len);
+   fclose(f);
+   return result;
+}
+#endif
 #endif
 
 // Microsoft/Windows BMP image
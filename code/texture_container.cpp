@@ -0,0 +1,210 @@
+// DDS and KTX2 containers holding BCn data, the blocks are handed to GL exactly as they are stored.
+// Both parsers only fill in a Compressed_Image pointing into the (mapped) file, nothing is copied.
+// NOTE(Aiden): sRGB variants are treated as their UNORM counterparts, same as every other image we display.
+// Alpha is straight unless the file says it's premultiplied (DXT2/DXT4, the DX10 alpha mode, the KTX2 DFD flag).
+
+#define DDS_HEADER_SIZE 124
+#define DDS_DX10_HEADER_SIZE 20
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_SIZE 24
+
+// Bigger than any GL implementation's GL_MAX_TEXTURE_SIZE, and small enough that nothing derived from it overflows an int.
+#define CONTAINER_MAX_DIMENSION 65536
+#define DDS_MISC_TEXTURECUBE 0x4
+
+#define DDS_ALPHA_PREMULTIPLIED 0x8000 // Legacy pixel format flag.
+#define DDS_ALPHA_MODE_PREMULTIPLIED 2
+#define KTX2_DFD_FLAG_ALPHA_PREMULTIPLIED 1
+
+#define FOURCC(a, b, c, d) ((unsigned int) (a) | ((unsigned int) (b) << 8) | ((unsigned int) (c) << 16) | ((unsigned int) (d) << 24))
+
+global const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+internal inline unsigned int read_u32(const unsigned char *p)
+{
+    return(p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<unsigned int> (p[3]) << 24));
+}
+
+internal inline unsigned long long read_u64(const unsigned char *p)
+{
+    return(read_u32(p) | (static_cast<unsigned long long> (read_u32(p + 4)) << 32));
+}
+
+internal bool dxgi_to_block_format(unsigned int dxgi_format, Block_Format *format)
+{
+    switch (dxgi_format) {
+        case 71: case 72: *format = BLOCK_FORMAT_BC1_ALPHA;     return(true);
+        case 74: case 75: *format = BLOCK_FORMAT_BC2;           return(true);
+        case 77: case 78: *format = BLOCK_FORMAT_BC3;           return(true);
+        case 80:          *format = BLOCK_FORMAT_BC4;           return(true);
+        case 83:          *format = BLOCK_FORMAT_BC5;           return(true);
+        case 95:          *format = BLOCK_FORMAT_BC6H_UNSIGNED; return(true);
+        case 96:          *format = BLOCK_FORMAT_BC6H_SIGNED;   return(true);
+        case 98: case 99: *format = BLOCK_FORMAT_BC7;           return(true);
+    }
+
+    return(false);
+}
+
+internal bool vk_to_block_format(unsigned int vk_format, Block_Format *format)
+{
+    switch (vk_format) {
+        case 131: case 132: *format = BLOCK_FORMAT_BC1;           return(true);
+        case 133: case 134: *format = BLOCK_FORMAT_BC1_ALPHA;     return(true);
+        case 135: case 136: *format = BLOCK_FORMAT_BC2;           return(true);
+        case 137: case 138: *format = BLOCK_FORMAT_BC3;           return(true);
+        case 139:           *format = BLOCK_FORMAT_BC4;           return(true);
+        case 141:           *format = BLOCK_FORMAT_BC5;           return(true);
+        case 143:           *format = BLOCK_FORMAT_BC6H_UNSIGNED; return(true);
+        case 144:           *format = BLOCK_FORMAT_BC6H_SIGNED;   return(true);
+        case 145: case 146: *format = BLOCK_FORMAT_BC7;           return(true);
+    }
+
+    return(false);
+}
+
+internal bool parse_dds(unsigned char *data, size_t size, Compressed_Image *image)
+{
+    if (size < 4 + DDS_HEADER_SIZE || read_u32(data) != FOURCC('D', 'D', 'S', ' ')) {
+        return(false);
+    }
+
+    const unsigned char *header = data + 4;
+    size_t offset = 4 + DDS_HEADER_SIZE;
+
+    if (read_u32(header) != DDS_HEADER_SIZE) {
+        return(false);
+    }
+
+    unsigned int height = read_u32(header + 8);
+    unsigned int width = read_u32(header + 12);
+    unsigned int depth = read_u32(header + 20);
+    unsigned int mip_count = read_u32(header + 24);
+    unsigned int pixel_flags = read_u32(header + 76);
+    unsigned int fourcc = read_u32(header + 80);
+    unsigned int caps2 = read_u32(header + 108);
+
+    // Only compressed 2D textures, no volumes or cube maps.
+    if (!(pixel_flags & 0x4) || (caps2 & 0x200) || (caps2 & 0x200000) || depth > 1) {
+        return(false);
+    }
+
+    // DXT2 and DXT4 are DXT3 and DXT5 with premultiplied alpha.
+    image->premultiplied = ((pixel_flags & DDS_ALPHA_PREMULTIPLIED) != 0 ||
+                            fourcc == FOURCC('D', 'X', 'T', '2') || fourcc == FOURCC('D', 'X', 'T', '4'));
+
+    switch (fourcc) {
+        case FOURCC('D', 'X', 'T', '1'): image->format = BLOCK_FORMAT_BC1_ALPHA; break;
+        case FOURCC('D', 'X', 'T', '2'):
+        case FOURCC('D', 'X', 'T', '3'): image->format = BLOCK_FORMAT_BC2;       break;
+        case FOURCC('D', 'X', 'T', '4'):
+        case FOURCC('D', 'X', 'T', '5'): image->format = BLOCK_FORMAT_BC3;       break;
+        case FOURCC('A', 'T', 'I', '1'):
+        case FOURCC('B', 'C', '4', 'U'): image->format = BLOCK_FORMAT_BC4;       break;
+        case FOURCC('A', 'T', 'I', '2'):
+        case FOURCC('B', 'C', '5', 'U'): image->format = BLOCK_FORMAT_BC5;       break;
+        case FOURCC('D', 'X', '1', '0'): {
+            if (size < offset + DDS_DX10_HEADER_SIZE) {
+                return(false);
+            }
+
+            const unsigned char *dx10 = data + offset;
+            unsigned int resource_dimension = read_u32(dx10 + 4);
+            unsigned int misc_flags = read_u32(dx10 + 8);
+            unsigned int array_size = read_u32(dx10 + 12);
+            unsigned int alpha_mode = read_u32(dx10 + 16) & 0x7;
+            
+            if (!dxgi_to_block_format(read_u32(dx10), &image->format) || resource_dimension != 3 || array_size > 1 ||
+                (misc_flags & DDS_MISC_TEXTURECUBE)) {
+                return(false);
+            }
+
+            image->premultiplied = (alpha_mode == DDS_ALPHA_MODE_PREMULTIPLIED);
+            offset += DDS_DX10_HEADER_SIZE;
+        } break;
+        default:
+            return(false);
+    }
+
+    if (width == 0 || height == 0 || width > CONTAINER_MAX_DIMENSION || height > CONTAINER_MAX_DIMENSION ||
+        mip_count > MAX_TEXTURE_LEVELS) {
+        return(false);
+    }
+
+    image->width = static_cast<int> (width);
+    image->height = static_cast<int> (height);
+    image->levels = (mip_count > 0 ? static_cast<int> (mip_count) : 1);
+
+    if (image->levels > mip_level_count(image->width, image->height)) {
+        return(false);
+    }
+
+    // DDS levels are stored back to back, largest first.
+    image->data = data + offset;
+    image->data_size = compute_level_offsets(image);
+
+    return(offset + image->data_size <= size);
+}
+
+internal bool parse_ktx2(unsigned char *data, size_t size, Compressed_Image *image)
+{
+    if (size < KTX2_HEADER_SIZE || memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+        return(false);
+    }
+
+    unsigned int vk_format = read_u32(data + 12);
+    unsigned int width = read_u32(data + 20);
+    unsigned int height = read_u32(data + 24);
+    unsigned int depth = read_u32(data + 28);
+    unsigned int layers = read_u32(data + 32);
+    unsigned int faces = read_u32(data + 36);
+    unsigned int level_count = read_u32(data + 40);
+    unsigned int supercompression = read_u32(data + 44);
+    unsigned int dfd_offset = read_u32(data + 48);
+    unsigned int dfd_size = read_u32(data + 52);
+
+    // Supercompressed (Basis, zstd) data would need decoding first, which is exactly what we're avoiding here.
+    if (!vk_to_block_format(vk_format, &image->format) || depth > 0 || layers > 1 || faces != 1 || supercompression != 0) {
+        return(false);
+    }
+
+    if (width == 0 || height == 0 || width > CONTAINER_MAX_DIMENSION || height > CONTAINER_MAX_DIMENSION ||
+        level_count > MAX_TEXTURE_LEVELS) {
+        return(false);
+    }
+
+    image->width = static_cast<int> (width);
+    image->height = static_cast<int> (height);
+    image->levels = (level_count > 0 ? static_cast<int> (level_count) : 1);
+
+    // The flags byte of the basic descriptor block, after the DFD's total size and the block's two header words
+    // and its colour model, primaries and transfer function.
+    image->premultiplied = (dfd_size >= 16 && static_cast<size_t> (dfd_offset) + 16 <= size &&
+                            (data[dfd_offset + 15] & KTX2_DFD_FLAG_ALPHA_PREMULTIPLIED) != 0);
+
+    if (image->levels > mip_level_count(image->width, image->height) ||
+        size < KTX2_HEADER_SIZE + static_cast<size_t> (image->levels) * KTX2_LEVEL_SIZE) {
+        return(false);
+    }
+
+    // NOTE(Aiden): The level index is always largest level first, even though
+    // the levels themselves are stored smallest first in the file.
+    image->data = data;
+    image->data_size = size;
+
+    for (int level = 0, w = image->width, h = image->height; level < image->levels; ++level) {
+        const unsigned char *entry = data + KTX2_HEADER_SIZE + level * KTX2_LEVEL_SIZE;
+        unsigned long long level_offset = read_u64(entry);
+        unsigned long long level_size = read_u64(entry + 8);
+
+        if (level_size != block_level_size(image->format, w, h) || level_offset > size || level_size > size - level_offset) {
+            return(false);
+        }
+
+        image->level_offsets[level] = static_cast<size_t> (level_offset);
+        w = (w > 1 ? w / 2 : 1);
+        h = (h > 1 ? h / 2 : 1);
+    }
+
+    return(true);
+}
@@ -0,0 +1,409 @@
+// Batch thumbnailer (--thumbnail): walks a directory tree and writes a PNG thumbnail that fits a square box
+// for every PNG/JPEG in it, into the same tree under another directory ("a/b.jpg" becomes "a/b.jpg.png").
+//
+// Directories and files are both jobs (see jobs.cpp), listing a directory submits a job for each of its
+// subdirectories and files. Directories go first so there's always plenty of work for idle workers to steal,
+// the run is over once no job of the run's token is left.
+//
+// Big JPEGs only go through the 1/8 DC-only pass of jpeg_index.cpp. Whatever gets decoded is halved (in linear
+// light, through mipmaps.cpp) while that still leaves it at least as big as the result, Lanczos-3 (resample.cpp)
+// does the last step. Before decoding, a worker reserves what the decode is going to take from an in-flight budget and
+// waits while that's used up, so a tree full of huge PNGs can't take all the memory.
+//
+// NOTE(Aiden): GL free, so the benchmark builds it too.
+
+#define THUMBNAILER_DEFAULT_SIZE 256
+#define THUMBNAILER_DEFAULT_BUDGET (512ull << 20)
+
+global const char *THUMBNAIL_EXTENSIONS[] = {
+    ".png",
+    ".jpg",
+    ".jpeg",
+};
+
+struct Thumbnailer_Stats
+{
+    int images;
+    int failures;
+    int steals;
+    double megapixels; // Of the sources.
+    double seconds;
+};
+
+struct Thumbnailer
+{
+    const char *source;
+    const char *output; // NULL encodes everything but writes nothing (for the benchmark).
+    int size;
+    Mip_Options mip_options;
+
+    Job_System *system;
+    Job_Token token;
+
+    std::mutex budget_mutex;
+    std::condition_variable budget_freed;
+    unsigned long long budget;
+    unsigned long long in_flight;
+
+    std::atomic<int> images;
+    std::atomic<int> failures;
+    std::atomic<unsigned long long> pixels;
+};
+
+internal bool thumbnail_is_jpeg(const char *filename)
+{
+    const char *extension = strrchr(filename, '.');
+    return(extension && (_stricmp(extension, ".jpg") == 0 || _stricmp(extension, ".jpeg") == 0));
+}
+
+// Opens 'filename' for the 1/8 DC-only pass when it's a JPEG of at least 'dc_min_size' pixels on its longer
+// side that jpeg_index.cpp can take (baseline, single scan), NULL when it has to be decoded fully.
+internal Jpeg_Source *thumbnail_open_reduced(const char *filename, int dc_min_size)
+{
+    if (!thumbnail_is_jpeg(filename)) {
+        return(NULL);
+    }
+
+    Jpeg_Source *source = jpeg_source_open(filename);
+    if (source && source->width < dc_min_size && source->height < dc_min_size) {
+        jpeg_source_destroy(source);
+        source = NULL;
+    }
+
+    return(source);
+}
+
+// Decodes the DC-only preview of a source from thumbnail_open_reduced() and destroys the source. NULL if that
+// fails, the file still has to be decoded fully then.
+internal unsigned char *thumbnail_decode_reduced(Jpeg_Source *source, int *width, int *height)
+{
+    unsigned char *pixels = NULL;
+
+    source->preview_width = (source->width > 8 ? source->width / 8 : 1);
+    source->preview_height = (source->height > 8 ? source->height / 8 : 1);
+
+    if (jpeg_build_index(source, 1)) {
+        pixels = source->preview;
+        *width = source->preview_width;
+        *height = source->preview_height;
+        source->preview = NULL;
+    }
+
+    jpeg_source_destroy(source);
+    return(pixels);
+}
+
+// NOTE(Aiden): stb_image allocates with plain malloc(), so whatever comes out of here is free()'d alike.
+internal unsigned char *thumbnail_load_full(const char *filename, int *width, int *height)
+{
+    int channels;
+    return(stbi_load(filename, width, height, &channels, 4));
+}
+
+// Decodes 'filename' into RGBA, through the DC-only preview where thumbnail_open_reduced() allows it and fully
+// otherwise. The caller free()s the pixels.
+internal unsigned char *thumbnail_load_reduced(const char *filename, int dc_min_size, int *width, int *height)
+{
+    unsigned char *pixels = NULL;
+
+    Jpeg_Source *source = thumbnail_open_reduced(filename, dc_min_size);
+    if (source) {
+        pixels = thumbnail_decode_reduced(source, width, height);
+    }
+
+    return(pixels ? pixels : thumbnail_load_full(filename, width, height));
+}
+
+// NOTE(Aiden): stb_image decodes straight alpha here (the viewer only premultiplies after --thumbnail is done)
+// and the PNGs written have to be straight too, but halving and Lanczos-3 have to see premultiplied colour, or
+// the colour of transparent pixels bleeds into their neighbours as fringes.
+internal void thumbnail_premultiply(unsigned char *pixels, int width, int height)
+{
+    size_t count = static_cast<size_t> (width) * height;
+    for (size_t i = 0; i < count; ++i, pixels += 4) {
+        for (int c = 0; c < 3; ++c) {
+            pixels[c] = static_cast<unsigned char> (resample_premultiply(pixels[c], pixels[3], 255));
+        }
+    }
+}
+
+internal void thumbnail_unpremultiply(unsigned char *pixels, int width, int height)
+{
+    size_t count = static_cast<size_t> (width) * height;
+    for (size_t i = 0; i < count; ++i, pixels += 4) {
+        for (int c = 0; c < 3; ++c) {
+            pixels[c] = static_cast<unsigned char> (resample_unpremultiply(pixels[c], pixels[3], 255));
+        }
+    }
+}
+
+// Shrinks RGBA 'pixels' (which it takes over) to fit a 'size' x 'size' box keeping the aspect ratio, never
+// enlarging. Halving is cheap and stops at less than twice the size, Lanczos-3 does the rest. Returns NULL if
+// it runs out of memory.
+internal unsigned char *thumbnail_fit(unsigned char *pixels, int *width, int *height, int size, const Mip_Options *mip_options)
+{
+    float scale = MIN(static_cast<float> (size) / static_cast<float> (*width), static_cast<float> (size) / static_cast<float> (*height));
+    if (scale >= 1.0f) {
+        return(pixels);
+    }
+
+    int fit_width = static_cast<int> (static_cast<float> (*width) * scale + 0.5f);
+    int fit_height = static_cast<int> (static_cast<float> (*height) * scale + 0.5f);
+    fit_width = (fit_width > 0 ? fit_width : 1);
+    fit_height = (fit_height > 0 ? fit_height : 1);
+
+    while (pixels && *width / 2 >= fit_width && *height / 2 >= fit_height) {
+        int half_width = *width / 2;
+        int half_height = *height / 2;
+        unsigned char *half = static_cast<unsigned char *> (malloc(static_cast<size_t> (half_width) * half_height * 4));
+
+        if (half && !mip_downsample(pixels, *width, *height, 4, mip_options, 1, half)) {
+            free(half);
+            half = NULL;
+        }
+
+        free(pixels);
+        pixels = half;
+        *width = half_width;
+        *height = half_height;
+    }
+
+    if (pixels && (*width != fit_width || *height != fit_height)) {
+        unsigned char *fitted = static_cast<unsigned char *> (malloc(static_cast<size_t> (fit_width) * fit_height * 4));
+
+        Resample_Options options = { RESAMPLE_LANCZOS3, mip_options->linear_light, mip_options->premultiplied };
+        if (fitted && !resample_8(pixels, *width, *height, fitted, fit_width, fit_height, 4, &options, 1)) {
+            free(fitted);
+            fitted = NULL;
+        }
+
+        free(pixels);
+        pixels = fitted;
+        *width = fit_width;
+        *height = fit_height;
+    }
+
+    return(pixels);
+}
+
+// NOTE(Aiden): Always lets one decode through when nothing is in flight, or an image bigger than the whole
+// budget would wait forever.
+internal void thumbnailer_reserve(Thumbnailer *thumbnailer, unsigned long long bytes)
+{
+    std::unique_lock<std::mutex> lock(thumbnailer->budget_mutex);
+    thumbnailer->budget_freed.wait(lock, [thumbnailer, bytes] {
+        return(thumbnailer->in_flight == 0 || thumbnailer->in_flight + bytes <= thumbnailer->budget);
+    });
+    thumbnailer->in_flight += bytes;
+}
+
+internal void thumbnailer_release(Thumbnailer *thumbnailer, unsigned long long bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(thumbnailer->budget_mutex);
+        thumbnailer->in_flight -= bytes;
+    }
+
+    thumbnailer->budget_freed.notify_all();
+}
+
+internal void thumbnailer_submit(Thumbnailer *thumbnailer, const char *path, bool directory);
+
+internal void thumbnailer_directory(Thumbnailer *thumbnailer, const char *path)
+{
+    char directory[MAX_PATH];
+    char child[MAX_PATH];
+    snprintf(directory, sizeof(directory), "%s%s%s", thumbnailer->source, (path[0] ? PATH_SEPARATOR : ""), path);
+
+    if (thumbnailer->output && path[0]) {
+        snprintf(child, sizeof(child), "%s" PATH_SEPARATOR "%s", thumbnailer->output, path);
+        if (!platform_make_directory(child)) {
+            fprintf(stderr, "[ERROR]: Could not create %s\n", child);
+            return;
+        }
+    }
+
+    Directory_Listing listing;
+    if (platform_list_directory(directory, THUMBNAIL_EXTENSIONS, static_cast<int> (ARR_LEN(THUMBNAIL_EXTENSIONS)), &listing)) {
+        for (int i = 0; i < listing.count; ++i) {
+            snprintf(child, sizeof(child), "%s%s%s", path, (path[0] ? PATH_SEPARATOR : ""), platform_listing_name(&listing, i));
+            thumbnailer_submit(thumbnailer, child, false);
+        }
+
+        platform_free_listing(&listing);
+    }
+
+    if (platform_list_subdirectories(directory, &listing)) {
+        for (int i = 0; i < listing.count; ++i) {
+            snprintf(child, sizeof(child), "%s%s%s", path, (path[0] ? PATH_SEPARATOR : ""), platform_listing_name(&listing, i));
+            thumbnailer_submit(thumbnailer, child, true);
+        }
+
+        platform_free_listing(&listing);
+    }
+}
+
+internal bool thumbnailer_write(const char *filename, const unsigned char *data, size_t size)
+{
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        return(false);
+    }
+
+    bool ok = (fwrite(data, 1, size, file) == size);
+    return((fclose(file) == 0) && ok);
+}
+
+internal bool thumbnailer_file(Thumbnailer *thumbnailer, const char *path)
+{
+    char filename[MAX_PATH];
+    snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "%s", thumbnailer->source, path);
+
+    PROFILE_IMAGE(filename);
+    PROFILE_ZONE(PROFILE_LOAD);
+
+    // The DC-only preview has to cover the box by itself.
+    int dc_min_size = thumbnailer->size * 8;
+
+    int width, height, channels;
+    if (!stbi_info(filename, &width, &height, &channels)) {
+        return(false);
+    }
+
+    unsigned long long source_pixels = static_cast<unsigned long long> (width) * height;
+
+    // Only what jpeg_index.cpp really takes gets the small reservation, progressive JPEGs and the like are
+    // decoded fully.
+    Jpeg_Source *reduced = thumbnail_open_reduced(filename, dc_min_size);
+
+    // The decoded image and its first half, stb_image's own buffers are about as big again.
+    unsigned long long full_bytes = source_pixels * 4 * 2;
+    unsigned long long bytes = (reduced ? full_bytes / 64 : full_bytes);
+    thumbnailer_reserve(thumbnailer, bytes);
+
+    unsigned char *pixels = NULL;
+    if (reduced) {
+        pixels = thumbnail_decode_reduced(reduced, &width, &height);
+
+        if (pixels == NULL) {
+            thumbnailer_release(thumbnailer, bytes);
+            bytes = full_bytes;
+            thumbnailer_reserve(thumbnailer, bytes);
+        }
+    }
+
+    if (pixels == NULL) {
+        pixels = thumbnail_load_full(filename, &width, &height);
+    }
+
+    // JPEGs (and anything else without alpha) come out opaque, nothing to premultiply.
+    bool has_alpha = (channels == 2 || channels == 4);
+
+    if (pixels) {
+        if (has_alpha) {
+            thumbnail_premultiply(pixels, width, height);
+        }
+
+        pixels = thumbnail_fit(pixels, &width, &height, thumbnailer->size, &thumbnailer->mip_options);
+    }
+
+    thumbnailer_release(thumbnailer, bytes);
+
+    if (pixels == NULL) {
+        return(false);
+    }
+
+    if (has_alpha) {
+        thumbnail_unpremultiply(pixels, width, height);
+    }
+
+    unsigned char *png;
+    size_t png_size;
+    bool ok = png_encode_rgba(pixels, width, height, &png, &png_size);
+    free(pixels);
+
+    if (!ok) {
+        return(false);
+    }
+
+    if (thumbnailer->output) {
+        snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "%s.png", thumbnailer->output, path);
+        ok = thumbnailer_write(filename, png, png_size);
+    }
+
+    free(png);
+    thumbnailer->pixels += source_pixels;
+
+    return(ok);
+}
+
+// Directories are more urgent than files, every one of them is more work for the workers to spread out.
+internal void thumbnailer_submit(Thumbnailer *thumbnailer, const char *path, bool directory)
+{
+    char *copy = _strdup(path);
+    if (copy == NULL) {
+        thumbnailer->failures += 1;
+        return;
+    }
+
+    job_run(thumbnailer->system, [thumbnailer, copy, directory]() {
+        if (directory) {
+            thumbnailer_directory(thumbnailer, copy);
+        } else if (thumbnailer_file(thumbnailer, copy)) {
+            thumbnailer->images += 1;
+        } else {
+            fprintf(stderr, "[ERROR]: Could not make a thumbnail of %s\n", copy);
+            thumbnailer->failures += 1;
+        }
+
+        free(copy);
+    }, (directory ? JOB_PRIORITY_NORMAL : JOB_PRIORITY_LOW), &thumbnailer->token);
+}
+
+// Thumbnails everything under 'source' into 'output' (nothing is written when it's NULL) with 'thread_count'
+// workers, 0 means one per core.
+internal bool thumbnailer_run(const char *source, const char *output, int size, int thread_count, Thumbnailer_Stats *stats)
+{
+    *stats = {};
+
+    if (!platform_is_directory(source)) {
+        fprintf(stderr, "[ERROR]: %s isn't a directory\n", source);
+        return(false);
+    }
+
+    if (output && !platform_make_directory(output)) {
+        fprintf(stderr, "[ERROR]: Could not create %s\n", output);
+        return(false);
+    }
+
+    if (thread_count <= 0) {
+        thread_count = static_cast<int> (std::thread::hardware_concurrency());
+    }
+
+    // NOTE(Aiden): A system of its own, sized to 'thread_count' with the calling thread as one of them, so the
+    // benchmark can measure how it scales.
+    Thumbnailer *thumbnailer = new Thumbnailer();
+    thumbnailer->system = job_system_create(thread_count > 1 ? thread_count - 1 : 0);
+    thumbnailer->source = source;
+    thumbnailer->output = output;
+    thumbnailer->size = size;
+    thumbnailer->mip_options.filter = MIP_FILTER_BOX;
+    thumbnailer->mip_options.linear_light = true;
+    thumbnailer->mip_options.premultiplied = true;
+    thumbnailer->budget = THUMBNAILER_DEFAULT_BUDGET;
+
+    auto start = std::chrono::steady_clock::now();
+
+    thumbnailer_submit(thumbnailer, "", true);
+    job_token_wait(thumbnailer->system, &thumbnailer->token);
+
+    stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats->images = thumbnailer->images;
+    stats->failures = thumbnailer->failures;
+    stats->steals = static_cast<int> (job_system_steals(thumbnailer->system));
+    stats->megapixels = static_cast<double> (thumbnailer->pixels) / 1e6;
+
+    job_system_destroy(thumbnailer->system);
+    delete thumbnailer;
+    return(true);
+}
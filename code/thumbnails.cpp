@@ -0,0 +1,422 @@
+// Contact sheet for a whole directory, meant to stay smooth with 100k+ images in it.
+//
+// Only the rows on screen plus THUMB_PREFETCH_ROWS above and below are ever decoded. Jobs decode and
+// shrink them off the main thread (JPEGs through the 1/8 DC-only pass of jpeg_index.cpp, so most of the
+// IDCT and upsampling work never happens), the main thread uploads a few finished ones per frame into
+// the layers of an Image_Batch and draws everything on screen in one instanced call. There are only as
+// many layers (slots) as the largest window could show at once, they're recycled least recently drawn
+// first as the user scrolls, so neither memory nor VRAM grow with the size of the directory.
+
+#define THUMB_CELL 200.0f // World units, which are screen pixels since the grid is always drawn at scale 1.
+#define THUMB_GAP 8.0f
+#define THUMB_PITCH (THUMB_CELL + THUMB_GAP)
+#define THUMB_PREFETCH_ROWS 2
+#define THUMB_UPLOADS_PER_FRAME 8
+#define THUMB_MAX_SLOTS 1024
+#define THUMB_SCROLL_STEP (THUMB_PITCH / 2.0f)
+
+// Below this the 1/8 preview would come out smaller than half a layer, those get a full decode instead.
+#define THUMB_DC_MIN_SIZE (BATCH_LAYER_SIZE * 4)
+
+#define THUMB_NOT_RESIDENT -1
+
+enum Thumb_State : unsigned char
+{
+    THUMB_IDLE,     // Not resident, or resident (see 'entry_slots').
+    THUMB_QUEUED,
+    THUMB_DECODING,
+    THUMB_DECODED,  // Waiting in the done list for the main thread.
+    THUMB_FAILED,   // Never tried again.
+};
+
+struct Thumbnail
+{
+    int entry;
+    unsigned char *pixels; // RGBA, fits a layer. NULL when the file couldn't be decoded.
+    Mip_Chain chain;
+    Thumbnail *next;
+};
+
+struct Thumbnail_Slot
+{
+    int entry; // THUMB_NOT_RESIDENT when free.
+    unsigned long long last_drawn;
+};
+
+struct Thumbnail_Grid
+{
+    char *directory;
+    Directory_Listing listing;
+    int *entry_slots;
+    Thumb_State *entry_states; // Shared with the jobs, only touched with 'mutex' held.
+
+    int columns; // Of the last update, see thumbnail_grid_columns().
+    int first_wanted, last_wanted; // Rows that should be resident, -1 before the first update.
+
+    Image_Batch *batch;
+    Thumbnail_Slot slots[THUMB_MAX_SLOTS];
+    int slot_count;
+    unsigned long long frame;
+    bool busy;
+
+    Mip_Options mip_options;
+
+    // NOTE(Aiden): Every queued entry has a job (visible rows at normal priority, prefetched ones at low).
+    // When the wanted rows change the queue starts over with a new generation, the jobs of the old one
+    // find out when they start and return right away.
+    std::mutex mutex;
+    int *queue;
+    int queue_count;
+    int queued;
+    int generation;
+    int decoding;
+    Thumbnail *done_first;
+    Thumbnail *done_last;
+
+    Job_Token token; // Cancelled when the grid goes away.
+};
+
+// Returns RGBA pixels that fill a layer (on their longer side, unless the image is smaller) with their mip
+// chain, pixels are NULL if the file can't be decoded.
+internal Thumbnail *thumbnail_decode(const char *filename, int entry, int layer_size, const Mip_Options *mip_options)
+{
+    PROFILE_IMAGE(filename);
+    PROFILE_ZONE(PROFILE_LOAD);
+
+    Thumbnail *thumb = static_cast<Thumbnail *> (calloc(1, sizeof(Thumbnail)));
+    if (thumb == NULL) {
+        return(NULL);
+    }
+
+    thumb->entry = entry;
+
+    int width = 0, height = 0;
+    unsigned char *pixels = thumbnail_load_reduced(filename, THUMB_DC_MIN_SIZE, &width, &height);
+
+    if (pixels) {
+        pixels = thumbnail_fit(pixels, &width, &height, layer_size, mip_options);
+    }
+
+    if (pixels && !mip_generate(pixels, width, height, 4, mip_options, 1, &thumb->chain)) {
+        free(pixels);
+        pixels = NULL;
+    }
+
+    thumb->pixels = pixels;
+    return(thumb);
+}
+
+internal void thumbnail_free(Thumbnail *thumb)
+{
+    free(thumb->pixels);
+    free(thumb->chain.data);
+    free(thumb);
+}
+
+internal void thumbnail_job(Thumbnail_Grid *grid, int entry, int generation)
+{
+    {
+        std::lock_guard<std::mutex> lock(grid->mutex);
+        if (generation != grid->generation || grid->entry_states[entry] != THUMB_QUEUED) {
+            return;
+        }
+
+        grid->entry_states[entry] = THUMB_DECODING;
+        grid->queued -= 1;
+        grid->decoding += 1;
+    }
+
+    char filename[MAX_PATH];
+    snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "%s", grid->directory, platform_listing_name(&grid->listing, entry));
+
+    Thumbnail *thumb = thumbnail_decode(filename, entry, grid->batch->layer_size, &grid->mip_options);
+
+    {
+        std::lock_guard<std::mutex> lock(grid->mutex);
+        grid->decoding -= 1;
+
+        if (thumb) {
+            grid->entry_states[entry] = THUMB_DECODED;
+
+            if (grid->done_last) {
+                grid->done_last->next = thumb;
+            } else {
+                grid->done_first = thumb;
+            }
+
+            grid->done_last = thumb;
+        } else {
+            grid->entry_states[entry] = THUMB_IDLE;
+        }
+    }
+
+    // Wakes the renderer up in case it's waiting for something to draw.
+    render_thread_wake(false);
+}
+
+internal void thumbnail_grid_destroy(Thumbnail_Grid *grid)
+{
+    job_token_cancel(&grid->token);
+    job_token_wait(job_system, &grid->token);
+
+    while (grid->done_first) {
+        Thumbnail *next = grid->done_first->next;
+        thumbnail_free(grid->done_first);
+        grid->done_first = next;
+    }
+
+    if (grid->batch) {
+        batch_destroy(grid->batch);
+    }
+
+    platform_free_listing(&grid->listing);
+    free(grid->directory);
+    free(grid->entry_slots);
+    free(grid->entry_states);
+    free(grid->queue);
+    delete grid;
+}
+
+// 'slot_count' is how many thumbnails can be resident at once, it should cover the wanted rows of the
+// largest window. Returns NULL when the directory can't be listed or has no images in it.
+internal Thumbnail_Grid *thumbnail_grid_open(const char *directory, int slot_count, const Mip_Options *mip_options,
+                                             unsigned int quad_vbo, unsigned int quad_ebo)
+{
+    Thumbnail_Grid *grid = new Thumbnail_Grid();
+
+    grid->directory = _strdup(directory);
+    grid->mip_options = *mip_options;
+    grid->first_wanted = -1;
+    grid->last_wanted = -1;
+
+    bool ok = (grid->directory != NULL &&
+               platform_list_directory(directory, THUMBNAIL_EXTENSIONS, static_cast<int> (ARR_LEN(THUMBNAIL_EXTENSIONS)), &grid->listing) &&
+               grid->listing.count > 0);
+
+    if (ok) {
+        int count = grid->listing.count;
+        grid->entry_slots = static_cast<int *> (malloc(sizeof(int) * count));
+        grid->entry_states = static_cast<Thumb_State *> (calloc(count, sizeof(Thumb_State)));
+        grid->queue = static_cast<int *> (malloc(sizeof(int) * count));
+        grid->batch = batch_create(MIN(MIN(slot_count, THUMB_MAX_SLOTS), count), quad_vbo, quad_ebo);
+
+        ok = (grid->entry_slots && grid->entry_states && grid->queue && grid->batch);
+    }
+
+    if (!ok) {
+        thumbnail_grid_destroy(grid);
+        return(NULL);
+    }
+
+    for (int i = 0; i < grid->listing.count; ++i) {
+        grid->entry_slots[i] = THUMB_NOT_RESIDENT;
+    }
+
+    grid->slot_count = grid->batch->capacity;
+    for (int i = 0; i < grid->slot_count; ++i) {
+        grid->slots[i].entry = THUMB_NOT_RESIDENT;
+    }
+
+    return(grid);
+}
+
+// NOTE(Aiden): Only depends on the window's width, so the input callbacks scrolling the grid on the main
+// thread and the render thread drawing it agree on it without sharing anything, see render_thread.cpp.
+internal int thumbnail_grid_columns(Vec2 resolution)
+{
+    int columns = static_cast<int> ((resolution.x - THUMB_GAP) / THUMB_PITCH);
+    return(columns > 1 ? columns : 1);
+}
+
+internal int thumbnail_grid_rows(const Thumbnail_Grid *grid, int columns)
+{
+    return((grid->listing.count + columns - 1) / columns);
+}
+
+internal void thumbnail_grid_scroll(const Thumbnail_Grid *grid, Camera *camera, Vec2 resolution, float amount)
+{
+    float height = static_cast<float> (thumbnail_grid_rows(grid, thumbnail_grid_columns(resolution))) * THUMB_PITCH + THUMB_GAP;
+    float max_offset = (height > resolution.y ? height - resolution.y : 0.0f);
+
+    camera->offset_y += amount;
+    camera->offset_y = (camera->offset_y < 0.0f ? 0.0f : (camera->offset_y > max_offset ? max_offset : camera->offset_y));
+}
+
+// Fits as many columns as the window is wide and centers them, keeping the top row's first image on screen.
+// 'old_resolution' is what the camera was laid out for before, zero the first time.
+internal void thumbnail_grid_layout(const Thumbnail_Grid *grid, Camera *camera, Vec2 old_resolution, Vec2 resolution)
+{
+    int columns = thumbnail_grid_columns(resolution);
+
+    if (old_resolution.x > 0.0f) {
+        int first_entry = static_cast<int> (camera->offset_y / THUMB_PITCH) * thumbnail_grid_columns(old_resolution);
+        camera->offset_y = static_cast<float> (first_entry / columns) * THUMB_PITCH;
+    }
+
+    float width = static_cast<float> (columns) * THUMB_PITCH + THUMB_GAP;
+    camera->scale = 1.0f;
+    camera->offset_x = -(resolution.x - width) / 2.0f;
+    thumbnail_grid_scroll(grid, camera, resolution, 0.0f);
+}
+
+// Called with 'mutex' held.
+internal void thumbnail_grid_request(Thumbnail_Grid *grid, int first_row, int last_row, Job_Priority priority)
+{
+    int count = grid->listing.count;
+    int first = MIN(first_row * grid->columns, count);
+    int last = MIN((last_row + 1) * grid->columns, count);
+
+    for (int entry = first; entry < last; ++entry) {
+        if (grid->entry_slots[entry] == THUMB_NOT_RESIDENT && grid->entry_states[entry] == THUMB_IDLE) {
+            grid->entry_states[entry] = THUMB_QUEUED;
+            grid->queue[grid->queue_count++] = entry;
+            grid->queued += 1;
+
+            int generation = grid->generation;
+            job_run(job_system, [grid, entry, generation]() { thumbnail_job(grid, entry, generation); }, priority, &grid->token);
+        }
+    }
+}
+
+// Everything that's neither drawn this frame nor wanted soon can be replaced, least recently drawn first.
+internal int thumbnail_grid_find_slot(Thumbnail_Grid *grid)
+{
+    int best = -1;
+
+    for (int i = 0; i < grid->slot_count; ++i) {
+        Thumbnail_Slot *slot = &grid->slots[i];
+        if (slot->entry == THUMB_NOT_RESIDENT) {
+            return(i);
+        }
+
+        int row = slot->entry / grid->columns;
+        bool wanted = (row >= grid->first_wanted && row <= grid->last_wanted);
+
+        if (!wanted && (best < 0 || slot->last_drawn < grid->slots[best].last_drawn)) {
+            best = i;
+        }
+    }
+
+    return(best);
+}
+
+internal void thumbnail_grid_upload(Thumbnail_Grid *grid, Thumbnail *thumb)
+{
+    int row = thumb->entry / grid->columns;
+    if (row < grid->first_wanted || row > grid->last_wanted) {
+        return; // Scrolled away while it was decoding.
+    }
+
+    int index = thumbnail_grid_find_slot(grid);
+    if (index < 0) {
+        return;
+    }
+
+    Thumbnail_Slot *slot = &grid->slots[index];
+    if (slot->entry != THUMB_NOT_RESIDENT) {
+        grid->entry_slots[slot->entry] = THUMB_NOT_RESIDENT;
+        slot->entry = THUMB_NOT_RESIDENT;
+    }
+
+    if (batch_upload_layer(grid->batch, index, thumb->pixels, &thumb->chain, 0)) {
+        slot->entry = thumb->entry;
+        slot->last_drawn = grid->frame;
+        grid->entry_slots[thumb->entry] = index;
+    }
+}
+
+// Requests and uploads whatever the current view needs and rebuilds the instances for the visible cells.
+internal void thumbnail_grid_update(Thumbnail_Grid *grid, Camera *camera, Vec2 resolution)
+{
+    grid->frame += 1;
+    grid->columns = thumbnail_grid_columns(resolution);
+
+    int rows = thumbnail_grid_rows(grid, grid->columns);
+    int first_visible = static_cast<int> (camera->offset_y / THUMB_PITCH);
+    int last_visible = MIN(static_cast<int> ((camera->offset_y + resolution.y) / THUMB_PITCH), rows - 1);
+    int first_wanted = (first_visible > THUMB_PREFETCH_ROWS ? first_visible - THUMB_PREFETCH_ROWS : 0);
+    int last_wanted = MIN(last_visible + THUMB_PREFETCH_ROWS, rows - 1);
+
+    Thumbnail *done = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(grid->mutex);
+
+        if (first_wanted != grid->first_wanted || last_wanted != grid->last_wanted) {
+            grid->first_wanted = first_wanted;
+            grid->last_wanted = last_wanted;
+
+            for (int i = 0; i < grid->queue_count; ++i) {
+                if (grid->entry_states[grid->queue[i]] == THUMB_QUEUED) {
+                    grid->entry_states[grid->queue[i]] = THUMB_IDLE;
+                }
+            }
+
+            grid->queue_count = 0;
+            grid->queued = 0;
+            grid->generation += 1;
+
+            thumbnail_grid_request(grid, first_visible, last_visible, JOB_PRIORITY_NORMAL);
+            thumbnail_grid_request(grid, last_visible + 1, last_wanted, JOB_PRIORITY_LOW);
+            thumbnail_grid_request(grid, first_wanted, first_visible - 1, JOB_PRIORITY_LOW);
+        }
+
+        // NOTE(Aiden): Uploads are capped per frame so a burst of finished thumbnails doesn't stall
+        // a frame, the rest stay in the done list for the next ones.
+        Thumbnail **last = &done;
+        for (int i = 0; i < THUMB_UPLOADS_PER_FRAME && grid->done_first; ++i) {
+            Thumbnail *thumb = grid->done_first;
+            grid->done_first = thumb->next;
+            grid->entry_states[thumb->entry] = (thumb->pixels ? THUMB_IDLE : THUMB_FAILED);
+
+            thumb->next = NULL;
+            *last = thumb;
+            last = &thumb->next;
+        }
+
+        if (grid->done_first == NULL) {
+            grid->done_last = NULL;
+        }
+
+        grid->busy = (grid->queued > 0 || grid->decoding > 0 || grid->done_first);
+    }
+
+    while (done) {
+        Thumbnail *next = done->next;
+        if (done->pixels) {
+            thumbnail_grid_upload(grid, done);
+        }
+
+        thumbnail_free(done);
+        done = next;
+    }
+
+    Image_Batch *batch = grid->batch;
+    float layer_size = static_cast<float> (batch->layer_size);
+    batch_clear_instances(batch);
+
+    int first = first_visible * grid->columns;
+    int last = MIN((last_visible + 1) * grid->columns, grid->listing.count);
+
+    for (int entry = first; entry < last; ++entry) {
+        int index = grid->entry_slots[entry];
+        if (index == THUMB_NOT_RESIDENT) {
+            continue;
+        }
+
+        grid->slots[index].last_drawn = grid->frame;
+
+        // Fitted into the cell, but never blown up past the size it was decoded at.
+        const float *extent = batch->layer_extents[index];
+        float width = extent[0] * layer_size;
+        float height = extent[1] * layer_size;
+        float scale = THUMB_CELL / (width > height ? width : height);
+        scale = (scale < 1.0f ? scale : 1.0f);
+        width *= scale;
+        height *= scale;
+
+        float x = THUMB_GAP + static_cast<float> (entry % grid->columns) * THUMB_PITCH + (THUMB_CELL - width) / 2.0f;
+        float y = THUMB_GAP + static_cast<float> (entry / grid->columns) * THUMB_PITCH + (THUMB_CELL - height) / 2.0f;
+        batch_push_instance(batch, index, x, y, width, height);
+    }
+}
@@ -0,0 +1,798 @@
+// Tiled rendering for images that don't fit into a single texture (wider or taller than GL_MAX_TEXTURE_SIZE).
+//
+// The decoded image is turned into a resolution pyramid once (every level half the size of the previous one)
+// and every level is cut into TILE_SIZE^2 tiles. A page table maps every tile to one of a limited number of
+// texture slots. Each frame we pick the level that matches the on-screen resolution, upload its visible tiles
+// on demand (coarse to fine, within a per-frame budget) and draw coarser resident tiles in place of the ones
+// that haven't arrived yet. The least recently drawn tiles are evicted when we run out of slots, so VRAM use
+// follows the window size rather than the image size.
+//
+// The pyramid is also persisted in the cache (see 'Pyramid cache' below), later opens map that file and upload
+// tiles straight from it without decoding the image at all.
+//
+// Huge baseline JPEGs skip the full decode entirely (see jpeg_index.cpp): only the coarse levels are kept in
+// memory and the tiles of the finer ones are decoded from just the part of the file they cover, by a job,
+// while the coarser tiles stand in for them.
+
+#define TILE_SIZE 512
+#define TILE_BORDER 2
+#define TILE_TEXTURE_SIZE (TILE_SIZE + 2*TILE_BORDER) // Multiple of 4, so cached tiles are whole BC blocks.
+#define TILE_SLOTS 256
+#define TILE_UPLOADS_PER_FRAME 8
+#define TILE_MAX_LEVELS 32
+#define TILE_NOT_RESIDENT -1
+#define TILE_FAILED -2 // In the page table, for tiles that couldn't be decoded or uploaded and aren't tried again.
+
+#define PYRAMID_INDEX_OFFSET 4096
+#define PYRAMID_TILE_ALIGNMENT 4096
+#define PYRAMID_TILE_LEVELS 2 // We never minify a tile by more than 2x, so level 1 is all the mips it needs.
+#define PYRAMID_FORMAT_RGBA 0 // Pyramid_Header::format of raw tiles, BC-encoded ones have their Block_Format.
+#define TILE_HALF_SIZE (TILE_TEXTURE_SIZE / 2)
+
+struct Pyramid_Header
+{
+    unsigned int format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int tile_count;
+    unsigned int tile_size;
+    unsigned int tile_border;
+};
+
+struct Pyramid_Tile
+{
+    unsigned long long offset;
+    unsigned long long size;
+};
+
+struct Tile_Slot
+{
+    unsigned int texture;
+    int tile; // Index into the page table, TILE_NOT_RESIDENT when free.
+    unsigned long long last_used;
+};
+
+struct Tile_Level
+{
+    unsigned char *pixels; // RGBA
+    int width;
+    int height;
+
+    int tiles_x;
+    int tiles_y;
+    int first_tile; // Where this level starts in the page table.
+};
+
+struct Tiled_Image
+{
+    int width;
+    int height;
+
+    Tile_Level levels[TILE_MAX_LEVELS];
+    int level_count;
+
+    int *page_table; // Slot index per tile, TILE_NOT_RESIDENT or TILE_FAILED.
+    int tile_count;
+
+    Tile_Slot slots[TILE_SLOTS];
+    int slot_count;
+    int slot_limit;
+
+    unsigned long long frame;
+    int uploads;
+    int missing; // Visible tiles drawn from a coarser level (or not at all) last frame.
+    unsigned char *scratch; // One tile followed by its level 1.
+    Mip_Options mip_options;
+
+    // Set when the tiles come from a mapped pyramid cache entry instead of 'pixels'.
+    Mapped_File cache;
+    unsigned int format; // Pyramid_Header::format
+    const Pyramid_Tile *index;
+
+    // Set when the levels finer than JPEG_PREVIEW_LEVEL are decoded by region, 'region' holds the decoded pixels.
+    Jpeg_Source *jpeg;
+    unsigned char *region;
+
+    // NOTE(Aiden): All region decodes go through the one decoder in 'jpeg', so there's only ever one tile
+    // being decoded. Its job leaves the tile and its level 1 in 'decoded'.
+    Job *decode_job;
+    Job_Token decode_token;
+    int decode_level;
+    int decode_tx;
+    int decode_ty;
+    bool decode_ok;
+    unsigned char *decoded;
+};
+
+internal void tiled_image_layout(Tiled_Image *image, int width, int height)
+{
+    image->width = width;
+    image->height = height;
+    image->slot_limit = TILE_SLOTS;
+
+    // Keep halving until the whole level fits into a single tile.
+    for (int w = width, h = height; image->level_count < TILE_MAX_LEVELS; ) {
+        Tile_Level *level = &image->levels[image->level_count++];
+
+        level->width = w;
+        level->height = h;
+        level->tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+        level->tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
+        level->first_tile = image->tile_count;
+        image->tile_count += level->tiles_x * level->tiles_y;
+
+        if (level->tiles_x == 1 && level->tiles_y == 1) {
+            break;
+        }
+
+        w = (w > 1 ? w / 2 : 1);
+        h = (h > 1 ? h / 2 : 1);
+    }
+}
+
+// Fills in every level after 'first' by downsampling, then allocates the page table.
+internal bool tiled_image_build_levels(Tiled_Image *image, int first)
+{
+    for (int i = first + 1; i < image->level_count; ++i) {
+        Tile_Level *previous = &image->levels[i - 1];
+        Tile_Level *level = &image->levels[i];
+
+        level->pixels = static_cast<unsigned char *> (malloc(static_cast<size_t> (level->width) * level->height * 4));
+        if (level->pixels == NULL) {
+            image->level_count = i;
+            break;
+        }
+
+        downsample_rgba_half(previous->pixels, previous->width, previous->height, level->pixels);
+    }
+
+    image->page_table = static_cast<int *> (malloc(sizeof(int) * image->tile_count));
+    image->scratch = static_cast<unsigned char *> (malloc((TILE_TEXTURE_SIZE * TILE_TEXTURE_SIZE + TILE_HALF_SIZE * TILE_HALF_SIZE) * 4));
+
+    if (image->page_table == NULL || image->scratch == NULL) {
+        return(false);
+    }
+
+    for (int i = 0; i < image->tile_count; ++i) {
+        image->page_table[i] = TILE_NOT_RESIDENT;
+    }
+
+    return(true);
+}
+
+internal Tiled_Image *tiled_image_create(unsigned char *pixels, int width, int height, const Mip_Options *mip_options)
+{
+    Tiled_Image *image = static_cast<Tiled_Image *> (calloc(1, sizeof(Tiled_Image)));
+    if (image == NULL) {
+        return(NULL);
+    }
+
+    tiled_image_layout(image, width, height);
+    image->mip_options = *mip_options;
+
+    image->levels[0].pixels = pixels;
+    if (!tiled_image_build_levels(image, 0)) {
+        for (int i = 1; i < image->level_count; ++i) {
+            free(image->levels[i].pixels);
+        }
+        free(image->page_table);
+        free(image->scratch);
+        free(image);
+        return(NULL);
+    }
+
+    return(image);
+}
+
+internal void tiled_image_destroy(Tiled_Image *image)
+{
+    if (image->decode_job) {
+        job_token_cancel(&image->decode_token);
+        job_wait(job_system, image->decode_job);
+        job_release(image->decode_job);
+    }
+
+    for (int i = 0; i < image->slot_count; ++i) {
+        glDeleteTextures(1, &image->slots[i].texture);
+    }
+
+    if (image->cache.data) {
+        platform_unmap_file(&image->cache);
+    }
+
+    if (image->jpeg) {
+        jpeg_source_destroy(image->jpeg);
+    }
+
+    stbi_image_free(image->levels[0].pixels);
+    for (int i = 1; i < image->level_count; ++i) {
+        free(image->levels[i].pixels);
+    }
+
+    free(image->page_table);
+    free(image->scratch);
+    free(image->region);
+    free(image->decoded);
+    free(image);
+}
+
+// Returns a slot to upload into: a fresh one while we're under the limit, the least recently used one after that.
+internal int tiled_image_acquire_slot(Tiled_Image *image)
+{
+    if (image->slot_count < image->slot_limit) {
+        Tile_Slot *slot = &image->slots[image->slot_count];
+
+        glGenTextures(1, &slot->texture);
+        glBindTexture(GL_TEXTURE_2D, slot->texture);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, PYRAMID_TILE_LEVELS - 1);
+
+        // Compressed tiles are (re)specified on every upload, straight from the mapped cache, the rest go into
+        // storage allocated here.
+        if (image->cache.data == NULL || image->format == PYRAMID_FORMAT_RGBA) {
+            for (int i = 0, size = TILE_TEXTURE_SIZE; i < PYRAMID_TILE_LEVELS; ++i, size /= 2) {
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            }
+        }
+
+        slot->tile = TILE_NOT_RESIDENT;
+        return(image->slot_count++);
+    }
+
+    int oldest = -1;
+    for (int i = 0; i < image->slot_count; ++i) {
+        // Never steal a slot that's already in use this frame.
+        if (image->slots[i].last_used == image->frame) {
+            continue;
+        }
+
+        if (oldest == -1 || image->slots[i].last_used < image->slots[oldest].last_used) {
+            oldest = i;
+        }
+    }
+
+    if (oldest != -1 && image->slots[oldest].tile != TILE_NOT_RESIDENT) {
+        image->page_table[image->slots[oldest].tile] = TILE_NOT_RESIDENT;
+        image->slots[oldest].tile = TILE_NOT_RESIDENT;
+    }
+
+    return(oldest);
+}
+
+// Copies the tile plus a border taken from its neighbours, so bilinear filtering
+// across tile edges matches what a single big texture would give us.
+// 'pixels' only has to cover the part of the level the tile touches, starting at 'origin_x'/'origin_y'.
+internal void tiled_image_copy_region(Tile_Level *level, const unsigned char *pixels, int origin_x, int origin_y, int stride,
+                                      int tx, int ty, unsigned char *out)
+{
+    int x0 = tx * TILE_SIZE - TILE_BORDER;
+    int y0 = ty * TILE_SIZE - TILE_BORDER;
+
+    for (int y = 0; y < TILE_TEXTURE_SIZE; ++y) {
+        int sy = y0 + y;
+        sy = (sy < 0 ? 0 : MIN(sy, level->height - 1));
+
+        for (int x = 0; x < TILE_TEXTURE_SIZE; ++x) {
+            int sx = x0 + x;
+            sx = (sx < 0 ? 0 : MIN(sx, level->width - 1));
+
+            memcpy(out + (y * TILE_TEXTURE_SIZE + x) * 4,
+                   pixels + (static_cast<size_t> (sy - origin_y) * stride + (sx - origin_x)) * 4, 4);
+        }
+    }
+}
+
+// Builds level 1 of the tile in 'scratch' right behind it.
+internal inline unsigned char *tiled_image_scratch_half(Tiled_Image *image)
+{
+    unsigned char *half = image->scratch + TILE_TEXTURE_SIZE * TILE_TEXTURE_SIZE * 4;
+
+    // NOTE(Aiden): A single tile is too little work to be worth waking up other threads for.
+    mip_downsample(image->scratch, TILE_TEXTURE_SIZE, TILE_TEXTURE_SIZE, 4, &image->mip_options, 1, half);
+    return(half);
+}
+
+internal inline void tiled_image_copy_tile(Tile_Level *level, int tx, int ty, unsigned char *out)
+{
+    tiled_image_copy_region(level, level->pixels, 0, 0, level->width, tx, ty, out);
+}
+
+// Decodes the part of the JPEG under a tile (border included) and shrinks it down to the tile's level,
+// which gives exactly the pixels tiled_image_create would have computed for it.
+internal bool tiled_image_decode_tile(Tiled_Image *image, int level_index, int tx, int ty, unsigned char *out)
+{
+    Tile_Level *level = &image->levels[level_index];
+
+    int x0 = tx * TILE_SIZE - TILE_BORDER;
+    int y0 = ty * TILE_SIZE - TILE_BORDER;
+    x0 = (x0 < 0 ? 0 : x0);
+    y0 = (y0 < 0 ? 0 : y0);
+
+    int x1 = MIN(tx * TILE_SIZE - TILE_BORDER + TILE_TEXTURE_SIZE, level->width);
+    int y1 = MIN(ty * TILE_SIZE - TILE_BORDER + TILE_TEXTURE_SIZE, level->height);
+
+    int w = (x1 - x0) << level_index;
+    int h = (y1 - y0) << level_index;
+
+    if (!jpeg_decode_region(image->jpeg, x0 << level_index, y0 << level_index, w, h, image->region)) {
+        return(false);
+    }
+
+    for (int i = 0; i < level_index; ++i, w /= 2, h /= 2) {
+        downsample_rgba_half(image->region, w, h, image->region);
+    }
+
+    tiled_image_copy_region(level, image->region, x0, y0, x1 - x0, tx, ty, out);
+    return(true);
+}
+
+internal inline size_t pyramid_level_size(unsigned int format, int size)
+{
+    if (format == PYRAMID_FORMAT_RGBA) {
+        return(static_cast<size_t> (size) * size * 4);
+    }
+
+    return(block_level_size(static_cast<Block_Format> (format), size, size));
+}
+
+internal inline size_t pyramid_tile_size(unsigned int format)
+{
+    return(pyramid_level_size(format, TILE_TEXTURE_SIZE) + pyramid_level_size(format, TILE_HALF_SIZE));
+}
+
+internal bool tiled_image_upload(Tiled_Image *image, int level_index, int tx, int ty, int slot_index)
+{
+    PROFILE_ZONE(PROFILE_UPLOAD);
+
+    Tile_Level *level = &image->levels[level_index];
+    int tile = level->first_tile + ty * level->tiles_x + tx;
+    Tile_Slot *slot = &image->slots[slot_index];
+
+    glBindTexture(GL_TEXTURE_2D, slot->texture);
+
+    if (image->cache.data) {
+        const Pyramid_Tile *entry = &image->index[tile];
+        if (entry->size != pyramid_tile_size(image->format) || entry->offset > image->cache.size || entry->size > image->cache.size - entry->offset) {
+            return(false);
+        }
+
+        // NOTE(Aiden): These are the only bytes of the cache entry we ever touch for this tile.
+        const unsigned char *data = image->cache.data + entry->offset;
+        
+        for (int i = 0, size = TILE_TEXTURE_SIZE; i < PYRAMID_TILE_LEVELS; ++i, size /= 2) {
+            int level_size = static_cast<int> (pyramid_level_size(image->format, size));
+
+            if (image->format == PYRAMID_FORMAT_RGBA) {
+                glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            } else {
+                unsigned int internal_format = block_format_gl(static_cast<Block_Format> (image->format));
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format, size, size, 0, level_size, data);
+            }
+            data += level_size;
+        }
+    } else {
+        // Tiles without pixels of their own were decoded by tiled_image_decoded()'s job.
+        unsigned char *pixels = image->decoded;
+        unsigned char *half = image->decoded + TILE_TEXTURE_SIZE * TILE_TEXTURE_SIZE * 4;
+
+        if (level->pixels) {
+            tiled_image_copy_tile(level, tx, ty, image->scratch);
+            pixels = image->scratch;
+            half = tiled_image_scratch_half(image);
+        }
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TILE_TEXTURE_SIZE, TILE_TEXTURE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glTexSubImage2D(GL_TEXTURE_2D, 1, 0, 0, TILE_HALF_SIZE, TILE_HALF_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, half);
+    }
+
+    slot->tile = tile;
+    image->page_table[tile] = slot_index;
+    
+    return(true);
+}
+
+internal void tiled_image_decode_job(Tiled_Image *image)
+{
+    image->decode_ok = tiled_image_decode_tile(image, image->decode_level, image->decode_tx, image->decode_ty, image->decoded);
+
+    if (image->decode_ok) {
+        unsigned char *half = image->decoded + TILE_TEXTURE_SIZE * TILE_TEXTURE_SIZE * 4;
+        mip_downsample(image->decoded, TILE_TEXTURE_SIZE, TILE_TEXTURE_SIZE, 4, &image->mip_options, 1, half);
+    }
+
+    // Wakes the renderer up in case it's waiting for something to draw.
+    render_thread_wake(false);
+}
+
+// True once the region decoded tile is in 'decoded', otherwise starts decoding it unless another tile is
+// being decoded still. A finished tile nobody asks for any more (scrolled or zoomed away) is dropped.
+// A tile that fails to decode is marked TILE_FAILED, so a corrupt part of the file is only decoded once.
+internal bool tiled_image_decoded(Tiled_Image *image, int level_index, int tx, int ty)
+{
+    if (image->decode_job) {
+        if (!job_done(image->decode_job)) {
+            return(false);
+        }
+
+        job_release(image->decode_job);
+        image->decode_job = NULL;
+
+        if (image->decode_level == level_index && image->decode_tx == tx && image->decode_ty == ty) {
+            if (!image->decode_ok) {
+                Tile_Level *level = &image->levels[level_index];
+                image->page_table[level->first_tile + ty * level->tiles_x + tx] = TILE_FAILED;
+            }
+
+            return(image->decode_ok);
+        }
+    }
+
+    image->decode_level = level_index;
+    image->decode_tx = tx;
+    image->decode_ty = ty;
+    image->decode_job = job_create([image]() { tiled_image_decode_job(image); }, JOB_PRIORITY_NORMAL, &image->decode_token);
+    job_submit(job_system, image->decode_job);
+
+    return(false);
+}
+
+// Makes sure the tile is resident, uploading it if the frame's budget allows.
+// Returns the slot (marked as used this frame) or TILE_NOT_RESIDENT.
+internal int tiled_image_request(Tiled_Image *image, int level_index, int tx, int ty)
+{
+    Tile_Level *level = &image->levels[level_index];
+    int tile = level->first_tile + ty * level->tiles_x + tx;
+    int slot = image->page_table[tile];
+
+    // Drawn from a coarser level for good.
+    if (slot == TILE_FAILED) {
+        return(TILE_NOT_RESIDENT);
+    }
+
+    if (slot == TILE_NOT_RESIDENT) {
+        if (image->uploads >= TILE_UPLOADS_PER_FRAME) {
+            return(TILE_NOT_RESIDENT);
+        }
+
+        bool region_decoded = (image->cache.data == NULL && level->pixels == NULL);
+        if (region_decoded && !tiled_image_decoded(image, level_index, tx, ty)) {
+            return(TILE_NOT_RESIDENT);
+        }
+
+        slot = tiled_image_acquire_slot(image);
+        if (slot == -1) {
+            return(TILE_NOT_RESIDENT);
+        }
+
+        image->uploads += 1;
+        if (!tiled_image_upload(image, level_index, tx, ty, slot)) {
+            image->page_table[tile] = TILE_FAILED;
+            return(TILE_NOT_RESIDENT);
+        }
+    }
+
+    image->slots[slot].last_used = image->frame;
+    return(slot);
+}
+
+// Picks the finest level that's still at least half a screen pixel per level pixel.
+internal int tiled_image_select_level(Tiled_Image *image, float screen_pixels_per_image_pixel)
+{
+    int level = 0;
+    float scale = screen_pixels_per_image_pixel;
+
+    while (level + 1 < image->level_count && scale < 0.5f) {
+        scale *= 2.0f;
+        level += 1;
+    }
+
+    return(level);
+}
+
+// True while the last frame still had tiles to stream in and made progress on them (or has one being decoded),
+// i.e. the next one will look different.
+internal inline bool tiled_image_pending(const Tiled_Image *image)
+{
+    return(image->missing > 0 && (image->uploads > 0 || image->decode_job));
+}
+
+// Draws every visible tile of the level matching the current zoom, expects the VAO and shader (camera uniform included)
+// to be set up already. 'width'/'height' is the size the whole image is displayed at (before camera scale), centered at the origin.
+internal void tiled_image_render(Tiled_Image *image, Camera *camera, float width, float height, Vec2 resolution, const Shader_Uniforms *uniforms)
+{
+    image->frame += 1;
+    image->uploads = 0;
+    image->missing = 0;
+
+    // Enough slots for the visible tiles of the current level and a fallback level, plus a ring of neighbours.
+    int window_tiles = (static_cast<int> (resolution.x) / TILE_SIZE + 2) * (static_cast<int> (resolution.y) / TILE_SIZE + 2);
+    image->slot_limit = MIN(window_tiles * 3, TILE_SLOTS);
+
+    // The part of the world that's on screen, tiles outside of it are skipped.
+    float view_left, view_top, view_right, view_bottom;
+    screen_to_world(camera, 0.0f, 0.0f, &view_left, &view_top);
+    screen_to_world(camera, resolution.x, resolution.y, &view_right, &view_bottom);
+
+    int level_index = tiled_image_select_level(image, width * camera->scale / static_cast<float> (image->width));
+    Tile_Level *level = &image->levels[level_index];
+
+    // World size of one pixel of the selected level.
+    float pixel_w = width / static_cast<float> (level->width);
+    float pixel_h = height / static_cast<float> (level->height);
+
+    for (int ty = 0; ty < level->tiles_y; ++ty) {
+        int tile_y = ty * TILE_SIZE;
+        int tile_h = MIN(TILE_SIZE, level->height - tile_y);
+
+        float top = -height / 2.0f + static_cast<float> (tile_y) * pixel_h;
+        float bottom = top + static_cast<float> (tile_h) * pixel_h;
+        if (bottom < view_top || top > view_bottom) {
+            continue;
+        }
+
+        for (int tx = 0; tx < level->tiles_x; ++tx) {
+            int tile_x = tx * TILE_SIZE;
+            int tile_w = MIN(TILE_SIZE, level->width - tile_x);
+
+            float left = -width / 2.0f + static_cast<float> (tile_x) * pixel_w;
+            float right = left + static_cast<float> (tile_w) * pixel_w;
+            if (right < view_left || left > view_right) {
+                continue;
+            }
+
+            // NOTE(Aiden): Stream coarse to fine, the first missing level on the way down gets the upload,
+            // so a whole region shows up (blurry) quickly instead of one sharp tile at a time.
+            int slot = TILE_NOT_RESIDENT;
+            int source = level_index;
+
+            for (int i = image->level_count - 1; i >= level_index; --i) {
+                int resident = tiled_image_request(image, i, tx >> (i - level_index), ty >> (i - level_index));
+                if (resident == TILE_NOT_RESIDENT) {
+                    break;
+                }
+
+                slot = resident;
+                source = i;
+            }
+
+            if (slot == TILE_NOT_RESIDENT) {
+                image->missing += 1;
+                continue;
+            }
+
+            if (source != level_index) {
+                image->missing += 1;
+            }
+
+            // Where this tile sits inside the (possibly coarser) tile we're drawing it from, in source pixels.
+            int shift = source - level_index;
+            float region_x = static_cast<float> ((tile_x >> shift) - (tx >> shift) * TILE_SIZE);
+            float region_y = static_cast<float> ((tile_y >> shift) - (ty >> shift) * TILE_SIZE);
+            float region_w = static_cast<float> (tile_w) / static_cast<float> (1 << shift);
+            float region_h = static_cast<float> (tile_h) / static_cast<float> (1 << shift);
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, image->slots[slot].texture);
+
+            glUniform4f(uniforms->quad_rect, left, top, right - left, bottom - top);
+            glUniform4f(uniforms->uv_rect,
+                        (TILE_BORDER + region_x) / TILE_TEXTURE_SIZE,
+                        (TILE_BORDER + region_y) / TILE_TEXTURE_SIZE,
+                        region_w / TILE_TEXTURE_SIZE,
+                        region_h / TILE_TEXTURE_SIZE);
+
+            glDrawElements(GL_TRIANGLES, QUAD_TRIANGLES * QUAD_ELEMENTS, GL_UNSIGNED_INT, NULL);
+        }
+    }
+}
+
+// Only the levels from JPEG_PREVIEW_LEVEL down are kept in memory, the finer tiles are decoded when first requested.
+internal Tiled_Image *tiled_image_open_jpeg(const char *filename, const Mip_Options *mip_options)
+{
+    Jpeg_Source *jpeg = jpeg_source_open(filename);
+    if (jpeg == NULL) {
+        return(NULL);
+    }
+
+    Tiled_Image *image = static_cast<Tiled_Image *> (calloc(1, sizeof(Tiled_Image)));
+    if (image == NULL) {
+        jpeg_source_destroy(jpeg);
+        return(NULL);
+    }
+
+    tiled_image_layout(image, jpeg->width, jpeg->height);
+    image->jpeg = jpeg;
+    image->mip_options = *mip_options;
+
+    if (image->level_count <= JPEG_PREVIEW_LEVEL) {
+        tiled_image_destroy(image);
+        return(NULL);
+    }
+
+    Tile_Level *preview = &image->levels[JPEG_PREVIEW_LEVEL];
+    size_t region_size = static_cast<size_t> (TILE_TEXTURE_SIZE << (JPEG_PREVIEW_LEVEL - 1));
+    image->region = static_cast<unsigned char *> (malloc(region_size * region_size * 4));
+    image->decoded = static_cast<unsigned char *> (malloc((TILE_TEXTURE_SIZE * TILE_TEXTURE_SIZE + TILE_HALF_SIZE * TILE_HALF_SIZE) * 4));
+
+    if (image->region == NULL || image->decoded == NULL || !jpeg_source_load_index(jpeg, filename, preview->width, preview->height)) {
+        tiled_image_destroy(image);
+        return(NULL);
+    }
+
+    // The preview is the first level we keep, the image owns it from here on.
+    preview->pixels = jpeg->preview;
+    jpeg->preview = NULL;
+
+    if (!tiled_image_build_levels(image, JPEG_PREVIEW_LEVEL)) {
+        tiled_image_destroy(image);
+        return(NULL);
+    }
+
+    return(image);
+}
+
+// Pyramid cache
+//
+// Layout of a cache entry:
+//   Cache_Header + Pyramid_Header
+//   Pyramid_Tile index[tile_count], always at PYRAMID_INDEX_OFFSET, in page table order
+//   tile payloads, each on a PYRAMID_TILE_ALIGNMENT boundary
+//
+// Every payload is one tile (border included) on its own, level 0 followed by level 1, so serving a tile only
+// touches the index entry and the pages of that one payload. Tiles are BC-encoded when 'compressed' is set
+// (lossy, a quarter to an eighth of the size), raw RGBA otherwise, which keeps the pixels exact but makes the
+// entry about as large as the pyramid is in memory. An entry in the other format doesn't count as a hit.
+
+internal Tiled_Image *tiled_image_open_cache(const char *filename, bool compressed)
+{
+    if (compressed && (!block_format_supported(BLOCK_FORMAT_BC1) || !block_format_supported(BLOCK_FORMAT_BC7))) {
+        return(NULL);
+    }
+
+    Mapped_File cache;
+    if (!cache_map_entry(filename, ".pyr", CACHE_MAGIC_PYRAMID, &cache)) {
+        return(NULL);
+    }
+
+    Pyramid_Header header;
+    Tiled_Image *image = NULL;
+
+    if (cache.size >= sizeof(Cache_Header) + sizeof(header)) {
+        memcpy(&header, cache.data + sizeof(Cache_Header), sizeof(header));
+        image = static_cast<Tiled_Image *> (calloc(1, sizeof(Tiled_Image)));
+    }
+
+    if (image) {
+        tiled_image_layout(image, static_cast<int> (header.width), static_cast<int> (header.height));
+
+        image->cache = cache;
+        image->format = header.format;
+        image->index = reinterpret_cast<const Pyramid_Tile *> (cache.data + PYRAMID_INDEX_OFFSET);
+        image->page_table = static_cast<int *> (malloc(sizeof(int) * image->tile_count));
+
+        bool format_valid = (compressed ? (image->format == BLOCK_FORMAT_BC1 || image->format == BLOCK_FORMAT_BC7) :
+                                          image->format == PYRAMID_FORMAT_RGBA);
+
+        bool valid = (format_valid &&
+                      header.tile_count == static_cast<unsigned int> (image->tile_count) &&
+                      header.tile_size == TILE_SIZE &&
+                      header.tile_border == TILE_BORDER &&
+                      PYRAMID_INDEX_OFFSET + sizeof(Pyramid_Tile) * image->tile_count <= cache.size);
+
+        if (!valid || image->page_table == NULL) {
+            free(image->page_table);
+            free(image);
+            image = NULL;
+        }
+    }
+
+    if (image == NULL) {
+        platform_unmap_file(&cache);
+        return(NULL);
+    }
+
+    for (int i = 0; i < image->tile_count; ++i) {
+        image->page_table[i] = TILE_NOT_RESIDENT;
+    }
+
+    return(image);
+}
+
+internal bool write_padding(FILE *file, unsigned long long *offset, unsigned long long alignment)
+{
+    static const unsigned char zeros[PYRAMID_TILE_ALIGNMENT] = {0};
+    size_t padding = static_cast<size_t> ((alignment - (*offset % alignment)) % alignment);
+
+    *offset += padding;
+    return(fwrite(zeros, 1, padding, file) == padding);
+}
+
+// Writes every tile of an in-memory pyramid into a cache entry, which can be huge, so this takes a while.
+internal bool tiled_image_write_cache(Tiled_Image *image, const char *filename, bool compressed)
+{
+    if (compressed && (!block_format_supported(BLOCK_FORMAT_BC1) || !block_format_supported(BLOCK_FORMAT_BC7))) {
+        return(false);
+    }
+
+    FILE *file = cache_create_entry(filename, ".pyr", CACHE_MAGIC_PYRAMID);
+    if (file == NULL) {
+        return(false);
+    }
+
+    Tile_Level *base = &image->levels[0];
+    unsigned int format = PYRAMID_FORMAT_RGBA;
+
+    if (compressed) {
+        format = (has_transparency(base->pixels, base->width, base->height) ? BLOCK_FORMAT_BC7 : BLOCK_FORMAT_BC1);
+    }
+
+    Pyramid_Header header = {0};
+    header.format = format;
+    header.width = static_cast<unsigned int> (image->width);
+    header.height = static_cast<unsigned int> (image->height);
+    header.tile_count = static_cast<unsigned int> (image->tile_count);
+    header.tile_size = TILE_SIZE;
+    header.tile_border = TILE_BORDER;
+
+    size_t index_size = sizeof(Pyramid_Tile) * image->tile_count;
+    size_t payload_size = pyramid_tile_size(format);
+
+    Pyramid_Tile *index = static_cast<Pyramid_Tile *> (calloc(1, index_size));
+
+    // Uncompressed tiles are written straight from 'scratch', which holds the tile followed by its level 1.
+    unsigned char *payload = (compressed ? static_cast<unsigned char *> (malloc(payload_size)) : image->scratch);
+
+    unsigned long long offset = sizeof(Cache_Header) + sizeof(header);
+    bool ok = (index && payload && fwrite(&header, sizeof(header), 1, file) == 1);
+
+    // Reserve the header area and the index, the index is rewritten once we know where every tile went.
+    ok = ok && write_padding(file, &offset, PYRAMID_INDEX_OFFSET);
+    ok = ok && (fwrite(index, 1, index_size, file) == index_size);
+    offset += index_size;
+
+    for (int l = 0; ok && l < image->level_count; ++l) {
+        Tile_Level *level = &image->levels[l];
+
+        for (int ty = 0; ok && ty < level->tiles_y; ++ty) {
+            for (int tx = 0; ok && tx < level->tiles_x; ++tx) {
+                tiled_image_copy_tile(level, tx, ty, image->scratch);
+                unsigned char *half = tiled_image_scratch_half(image);
+
+                if (compressed) {
+                    Block_Format block_format = static_cast<Block_Format> (format);
+                    encode_blocks(image->scratch, TILE_TEXTURE_SIZE, TILE_TEXTURE_SIZE, block_format, payload);
+                    encode_blocks(half, TILE_HALF_SIZE, TILE_HALF_SIZE, block_format,
+                                  payload + pyramid_level_size(format, TILE_TEXTURE_SIZE));
+                }
+
+                ok = write_padding(file, &offset, PYRAMID_TILE_ALIGNMENT);
+
+                Pyramid_Tile *entry = &index[level->first_tile + ty * level->tiles_x + tx];
+                entry->offset = offset;
+                entry->size = payload_size;
+
+                ok = ok && (fwrite(payload, 1, payload_size, file) == payload_size);
+                offset += payload_size;
+            }
+        }
+    }
+
+    ok = ok && (fseek(file, PYRAMID_INDEX_OFFSET, SEEK_SET) == 0) && (fwrite(index, 1, index_size, file) == index_size);
+    ok = (fclose(file) == 0) && ok;
+
+    free(index);
+    if (compressed) {
+        free(payload);
+    }
+
+    if (!ok) {
+        cache_remove_entry(filename, ".pyr");
+    }
+
+    return(ok);
+}